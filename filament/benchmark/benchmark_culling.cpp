@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "details/BoundingVolumeHierarchy.h"
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/JobSystem.h>
+
+#include <math/mat4.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::details;
+using namespace filament::math;
+using namespace utils;
+
+class CullingFixture : public benchmark::Fixture {
+protected:
+    JobSystem js;
+    Frustum frustum;
+    std::vector<uint32_t> ids;
+    std::vector<float3> centers;
+    std::vector<float3> extents;
+    std::vector<Culler::result_type> visible;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        js.adopt();
+
+        // small boxes scattered around a camera at the origin, looking down -z
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> size(0.5f, 5.0f);
+        const size_t count = size_t(state.range(0));
+        ids.resize(count);
+        centers.resize(count);
+        extents.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            ids[i] = uint32_t(i);
+            centers[i] = { position(gen), position(gen), position(gen) };
+            extents[i] = size(gen);
+        }
+        // as in the scene, the rows are padded to a multiple of Culler::MODULO
+        visible.resize(Culler::round(count));
+        frustum = Frustum(mat4f::perspective(60.0f, 16.0f / 9.0f, 0.1f, 500.0f));
+    }
+
+    void TearDown(benchmark::State& state) override {
+        js.emancipate();
+    }
+};
+
+// what FView::cullRenderables() does without a hierarchy
+BENCHMARK_DEFINE_F(CullingFixture, flat)(benchmark::State& state) {
+    for (auto _ : state) {
+        std::fill(visible.begin(), visible.end(), 0);
+        auto functor = [this](uint32_t index, uint32_t c) {
+            Culler::intersects(visible.data() + index, frustum,
+                    centers.data() + index, extents.data() + index, c, 0);
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(centers.size()),
+                std::ref(functor),
+                jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+        js.runAndWait(job);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// the hierarchy culls into per-instance masks, which are then gathered into the rows, here
+// the rows are in instance order
+BENCHMARK_DEFINE_F(CullingFixture, hierarchy)(benchmark::State& state) {
+    BoundingVolumeHierarchy bvh;
+    bvh.build(ids.data(), centers.data(), extents.data(), ids.size(), ids.size());
+    std::vector<Culler::result_type> instanceVisibility(ids.size());
+
+    for (auto _ : state) {
+        std::fill(visible.begin(), visible.end(), 0);
+        bvh.cull(js, instanceVisibility.data(), frustum, 0);
+        auto functor = [this, &instanceVisibility](uint32_t index, uint32_t c) {
+            for (uint32_t i = index, e = index + c; i < e; i++) {
+                visible[i] |= instanceVisibility[ids[i]];
+                instanceVisibility[ids[i]] = 0;
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(ids.size()),
+                std::ref(functor),
+                jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+        js.runAndWait(job);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// building the hierarchy, which happens after each structural change of the scene
+BENCHMARK_DEFINE_F(CullingFixture, build)(benchmark::State& state) {
+    BoundingVolumeHierarchy bvh;
+    for (auto _ : state) {
+        bvh.build(ids.data(), centers.data(), extents.data(), ids.size(), ids.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_REGISTER_F(CullingFixture, flat)
+        ->Arg(10000)->Arg(100000)->Arg(1000000)
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_REGISTER_F(CullingFixture, hierarchy)
+        ->Arg(10000)->Arg(100000)->Arg(1000000)
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_REGISTER_F(CullingFixture, build)
+        ->Arg(10000)->Arg(100000)->Arg(1000000)
+        ->Unit(benchmark::kMicrosecond);
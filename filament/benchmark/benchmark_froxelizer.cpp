@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+#include <filament/LightManager.h>
+#include <filament/Viewport.h>
+
+#include "details/Camera.h"
+#include "details/Engine.h"
+#include "details/Froxelizer.h"
+#include "details/Scene.h"
+
+#include "Intersections.h"
+
+#include <utils/EntityManager.h>
+
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::details;
+using namespace filament::math;
+using namespace utils;
+
+class FroxelizerFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t LIGHT_COUNT = CONFIG_MAX_LIGHT_COUNT;
+
+    Engine* engine = nullptr;
+    std::vector<Entity> lights;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+        lights.resize(LIGHT_COUNT);
+        EntityManager::get().create(lights.size(), lights.data());
+
+        // lights are scattered in front of the camera, every other light is a spot light
+        std::default_random_engine generator(82828);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        for (size_t i = 0; i < LIGHT_COUNT; i++) {
+            const float3 position = {
+                    distribution(generator) * 20.0f,
+                    distribution(generator) * 10.0f,
+                    distribution(generator) * 45.0f - 50.0f };
+            const bool isSpot = (i & 1) != 0;
+            LightManager::Builder(isSpot ? LightManager::Type::SPOT : LightManager::Type::POINT)
+                    .position(position)
+                    .direction({ distribution(generator), distribution(generator), -1.0f })
+                    .falloff(4.0f)
+                    .spotLightCone(0.2f, 0.6f)
+                    .build(*engine, lights[i]);
+        }
+    }
+
+    void TearDown(benchmark::State& state) override {
+        for (Entity e : lights) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(lights.size(), lights.data());
+        Engine::destroy(&engine);
+    }
+};
+
+// Froxelizer::froxelizeLights() with a varying number of point and spot lights
+BENCHMARK_DEFINE_F(FroxelizerFixture, froxelizeLights)(benchmark::State& state) {
+    FEngine& fengine = upcast(*engine);
+    FLightManager& lcm = fengine.getLightManager();
+    FEngine::DriverApi& driver = fengine.getDriverApi();
+    const size_t lightCount = size_t(state.range(0));
+
+    // the directional light is always first
+    FScene::LightSoa lightData;
+    lightData.resize(lightCount + FScene::DIRECTIONAL_LIGHTS_COUNT);
+    for (size_t i = 0; i < lightCount; i++) {
+        const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+        FLightManager::Instance li = lcm.getInstance(lights[i]);
+        lightData.elementAt<FScene::POSITION_RADIUS>(j) =
+                float4{ lcm.getLocalPosition(li), lcm.getRadius(li) };
+        lightData.elementAt<FScene::DIRECTION>(j) = lcm.getLocalDirection(li);
+        lightData.elementAt<FScene::LIGHT_INSTANCE>(j) = li;
+    }
+
+    CameraInfo camera;
+    camera.zn = 0.1f;
+    camera.zf = 100.0f;
+    camera.projection = mat4f::perspective(60, 16.0f / 9.0f, camera.zn, camera.zf);
+    camera.cullingProjection = camera.projection;
+
+    const Viewport viewport(0, 0, 1920, 1080);
+    LinearAllocatorArena arena("benchmark: froxelizer", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    Froxelizer froxelizer(fengine);
+
+    for (auto _ : state) {
+        utils::ArenaScope<LinearAllocatorArena> scope(arena);
+        froxelizer.prepare(driver, scope, viewport, camera.projection, camera.zn, camera.zf);
+        froxelizer.froxelizeLights(fengine, camera, lightData);
+        froxelizer.commit(driver);
+
+        // this is normally done by the engine at the end of each frame
+        state.PauseTiming();
+        Fence::waitAndDestroy(engine->createFence());
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * lightCount);
+
+    froxelizer.terminate(driver);
+}
+
+// above 128 lights, the froxelizer switches to the light tree
+BENCHMARK_REGISTER_F(FroxelizerFixture, froxelizeLights)
+        ->RangeMultiplier(2)->Range(16, CONFIG_MAX_LIGHT_COUNT)->Arg(192)
+        ->Unit(benchmark::kMicrosecond);
+
+// The spot light test of a row of froxels, one froxel at a time and batched (SIMD)
+template<bool BATCHED>
+static void sphereConeIntersection(benchmark::State& state) {
+    const size_t count = size_t(state.range(0));
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float4> spheres(count);
+    for (float4& sphere : spheres) {
+        sphere = { distribution(generator) * 4.0f, distribution(generator) * 4.0f,
+                   distribution(generator) * 4.0f, std::abs(distribution(generator)) };
+    }
+    std::vector<uint32_t> results(count);
+    const float3 position = { 0, 0, 0 };
+    const float3 axis = normalize(float3{ 0.2f, 0.1f, -1.0f });
+    const float invSin = 1.0f / std::sin(0.6f);
+    const float cosSqr = std::cos(0.6f) * std::cos(0.6f);
+
+    for (auto _ : state) {
+        if (BATCHED) {
+            sphereConeIntersectionFast(spheres.data(), count, position, axis, invSin, cosSqr,
+                    results.data(), 1u);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                results[i] |= uint32_t(sphereConeIntersectionFast(spheres[i],
+                        position, axis, invSin, cosSqr));
+            }
+        }
+        benchmark::DoNotOptimize(results.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+BENCHMARK_TEMPLATE(sphereConeIntersection, false)->Arg(8)->Arg(32)->Arg(128);
+BENCHMARK_TEMPLATE(sphereConeIntersection, true)->Arg(8)->Arg(32)->Arg(128);
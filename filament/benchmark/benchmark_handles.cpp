@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "driver/Handle.h"
+
+#include <utils/Allocator.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace filament;
+using namespace utils;
+
+/*
+ * These compare the two handle allocation schemes used by the drivers. They are
+ * reimplemented here so they can be measured without a Vulkan device:
+ *  - MapHandles: handles are keys of a mutex-guarded hash map (VulkanDriver, formerly)
+ *  - ArenaHandles: handles are offsets into a pool arena with lock-free free lists (VulkanDriver)
+ */
+
+namespace {
+
+struct HwObject {
+    uint8_t data[96];
+};
+
+class MapHandles {
+    using Blob = std::vector<uint8_t>;
+    std::unordered_map<HandleBase::HandleId, Blob> mHandleMap;
+    std::mutex mHandleMapMutex;
+    HandleBase::HandleId mNextId = 1;
+
+public:
+    HandleBase::HandleId alloc() {
+        std::lock_guard<std::mutex> lock(mHandleMapMutex);
+        mHandleMap[mNextId] = Blob(sizeof(HwObject));
+        return mNextId++;
+    }
+
+    HwObject* handle_cast(HandleBase::HandleId id) noexcept {
+        std::lock_guard<std::mutex> lock(mHandleMapMutex);
+        return reinterpret_cast<HwObject*>(mHandleMap.find(id)->second.data());
+    }
+
+    void free(HandleBase::HandleId id) noexcept {
+        std::lock_guard<std::mutex> lock(mHandleMapMutex);
+        mHandleMap.erase(id);
+    }
+};
+
+class ArenaHandles {
+    using HandleArena = Arena<PoolAllocator<128, 16, 0, AtomicFreeList>, LockingPolicy::NoLock>;
+    static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
+    HandleArena mHandleArena{ "Handles", 4U * 1024U * 1024U };
+
+public:
+    HandleBase::HandleId alloc() noexcept {
+        void* addr = mHandleArena.alloc(sizeof(HwObject), 16);
+        size_t offset = (char*)addr - (char*)mHandleArena.getArea().begin();
+        return HandleBase::HandleId(offset >> MIN_ALIGNMENT_SHIFT);
+    }
+
+    HwObject* handle_cast(HandleBase::HandleId id) noexcept {
+        char* const base = (char*)mHandleArena.getArea().begin();
+        return reinterpret_cast<HwObject*>(base + (size_t(id) << MIN_ALIGNMENT_SHIFT));
+    }
+
+    void free(HandleBase::HandleId id) noexcept {
+        mHandleArena.free(handle_cast(id), sizeof(HwObject));
+    }
+};
+
+static constexpr size_t HANDLE_COUNT = 4096;
+
+} // anonymous namespace
+
+template <typename HANDLES>
+static void handleCast(benchmark::State& state) {
+    static HANDLES* handles = nullptr;
+    static std::vector<HandleBase::HandleId> ids;
+
+    if (state.thread_index == 0) {
+        handles = new HANDLES;
+        ids.resize(HANDLE_COUNT);
+        for (auto& id : ids) {
+            id = handles->alloc();
+        }
+    }
+
+    // thread 0 (the "driver thread") casts handles while the other threads (the "main thread")
+    // allocate and free handles concurrently.
+    size_t i = 0;
+    for (auto _ : state) {
+        if (state.thread_index == 0) {
+            for (size_t j = 0; j < 64; j++) {
+                benchmark::DoNotOptimize(handles->handle_cast(ids[(i + j) % HANDLE_COUNT]));
+            }
+            i += 64;
+        } else {
+            handles->free(handles->alloc());
+        }
+    }
+    if (state.thread_index == 0) {
+        state.SetItemsProcessed(state.iterations() * 64);
+        for (auto id : ids) {
+            handles->free(id);
+        }
+        delete handles;
+        handles = nullptr;
+    }
+}
+
+BENCHMARK_TEMPLATE(handleCast, MapHandles)->ThreadRange(1, 2);
+BENCHMARK_TEMPLATE(handleCast, ArenaHandles)->ThreadRange(1, 2);
+
+template <typename HANDLES>
+static void allocFree(benchmark::State& state) {
+    HANDLES handles;
+    for (auto _ : state) {
+        handles.free(handles.alloc());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(allocFree, MapHandles);
+BENCHMARK_TEMPLATE(allocFree, ArenaHandles);
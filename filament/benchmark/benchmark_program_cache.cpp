@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+#include <filament/Material.h>
+
+#include "details/Engine.h"
+#include "details/Material.h"
+
+#include "generated/resources/materials.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+using namespace filament;
+using namespace filament::details;
+
+/*
+ * Measures the time it takes to create a material and compile all its variants, which is what
+ * happens when an application starts, with and without a program binary cache.
+ * This needs an OpenGL context (e.g. a software implementation such as Mesa's llvmpipe).
+ */
+
+namespace {
+
+// an in-memory stand-in for the application's storage (e.g. files on disk)
+class BlobCache {
+    std::map<std::string, std::vector<uint8_t>> mBlobs;
+
+public:
+    static void insert(void* user,
+            void const* key, size_t keySize, void const* value, size_t valueSize) {
+        BlobCache* const cache = static_cast<BlobCache*>(user);
+        uint8_t const* const data = static_cast<uint8_t const*>(value);
+        cache->mBlobs[std::string(static_cast<char const*>(key), keySize)].assign(
+                data, data + valueSize);
+    }
+
+    static size_t retrieve(void* user,
+            void const* key, size_t keySize, void* value, size_t valueSize) {
+        BlobCache* const cache = static_cast<BlobCache*>(user);
+        auto const pos = cache->mBlobs.find(std::string(static_cast<char const*>(key), keySize));
+        if (pos == cache->mBlobs.end()) {
+            return 0;
+        }
+        std::vector<uint8_t> const& blob = pos->second;
+        if (blob.size() <= valueSize) {
+            memcpy(value, blob.data(), blob.size());
+        }
+        return blob.size();
+    }
+};
+
+void compileMaterial(Engine* engine) {
+    Material* material = Material::Builder()
+            .package(MATERIALS_DEFAULTMATERIAL_DATA, MATERIALS_DEFAULTMATERIAL_SIZE)
+            .build(*engine);
+    material->compile();
+
+    // the GL driver checks the programs being compiled at the beginning of each frame
+    FEngine::DriverApi& driver = upcast(engine)->getDriverApi();
+    while (upcast(material)->updatePendingPrograms()) {
+        driver.beginFrame(0, 0);
+        driver.endFrame(0);
+        Fence::waitAndDestroy(engine->createFence());
+    }
+
+    engine->destroy(material);
+    Fence::waitAndDestroy(engine->createFence());
+}
+
+} // anonymous namespace
+
+static void startup(benchmark::State& state) {
+    const bool useCache = state.range(0) != 0;
+
+    // the cache must be given at creation, the engine's own materials are compiled right away
+    BlobCache cache;
+    Engine::Platform::BlobFunc blobFunc;
+    if (useCache) {
+        blobFunc = { &BlobCache::insert, &BlobCache::retrieve, &cache };
+    }
+
+    Engine* engine = Engine::create(Engine::Backend::OPENGL, nullptr, nullptr, blobFunc);
+    if (!engine) {
+        state.SkipWithError("couldn't create an OpenGL context");
+        return;
+    }
+
+    // this populates the cache, as the first launch of the application would
+    compileMaterial(engine);
+
+    for (auto _ : state) {
+        compileMaterial(engine);
+    }
+
+    Engine::destroy(&engine);
+}
+
+BENCHMARK(startup)->ArgName("cache")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
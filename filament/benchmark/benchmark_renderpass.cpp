@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "RenderPass.h"
+
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::details;
+using namespace utils;
+
+class RenderPassFixture : public benchmark::Fixture {
+protected:
+    using Command = RenderPass::Command;
+
+    JobSystem js;
+    std::vector<Command> unsorted;
+    std::vector<Command> commands;
+    std::vector<Command> scratch;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        js.adopt();
+
+        // keys laid out like a depth + color pass with blended objects
+        std::default_random_engine gen; // NOLINT
+        std::uniform_int_distribution<uint32_t> rand;
+        const size_t count = size_t(state.range(0));
+        unsorted.resize(count);
+        for (Command& command : unsorted) {
+            const uint32_t type = rand(gen) % 8;
+            if (type == 0) {
+                // cancelled command
+                command.key = uint64_t(RenderPass::Pass::SENTINEL);
+                continue;
+            }
+            if (type < 4) {
+                command.key = uint64_t(RenderPass::Pass::DEPTH);
+                command.key |= RenderPass::makeField(rand(gen),
+                        RenderPass::DISTANCE_BITS_MASK, RenderPass::DISTANCE_BITS_SHIFT);
+            } else if (type < 7) {
+                command.key = uint64_t(RenderPass::Pass::COLOR);
+                command.key |= RenderPass::makeMaterialSortingKey(rand(gen) % 64, rand(gen) % 1024);
+            } else {
+                command.key = uint64_t(RenderPass::Pass::BLENDED);
+                command.key |= RenderPass::makeFieldTruncate(rand(gen),
+                        RenderPass::BLEND_DISTANCE_MASK, RenderPass::BLEND_DISTANCE_SHIFT);
+            }
+            command.key |= RenderPass::makeField(rand(gen) % 8,
+                    RenderPass::PRIORITY_MASK, RenderPass::PRIORITY_SHIFT);
+        }
+        commands.resize(count);
+        scratch.resize(count);
+    }
+
+    void TearDown(benchmark::State& state) override {
+        js.emancipate();
+    }
+};
+
+BENCHMARK_DEFINE_F(RenderPassFixture, stdSort)(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        commands = unsorted;
+        state.ResumeTiming();
+        std::sort(commands.begin(), commands.end());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_DEFINE_F(RenderPassFixture, sortCommands)(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        commands = unsorted;
+        state.ResumeTiming();
+        RenderPass::sortCommands(js,
+                commands.data(), commands.data() + commands.size(), scratch.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_REGISTER_F(RenderPassFixture, stdSort)
+        ->Arg(1000)->Arg(10000)->Arg(100000)->Arg(250000)
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_REGISTER_F(RenderPassFixture, sortCommands)
+        ->Arg(1000)->Arg(10000)->Arg(100000)->Arg(250000)
+        ->Unit(benchmark::kMicrosecond);
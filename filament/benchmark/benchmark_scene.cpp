@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <filament/Box.h>
+#include <filament/Engine.h>
+#include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+
+#include "details/Engine.h"
+#include "details/Scene.h"
+
+#include <utils/EntityManager.h>
+
+#include <vector>
+
+using namespace filament;
+using namespace filament::details;
+using namespace filament::math;
+using namespace utils;
+
+class SceneFixture : public benchmark::Fixture {
+protected:
+    static constexpr size_t ENTITY_COUNT = 50000;
+
+    Engine* engine = nullptr;
+    Scene* scene = nullptr;
+    std::vector<Entity> entities;
+
+public:
+    void SetUp(benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+        scene = engine->createScene();
+        entities.resize(ENTITY_COUNT);
+        EntityManager::get().create(entities.size(), entities.data());
+        for (Entity e : entities) {
+            RenderableManager::Builder(1)
+                    .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                    .build(*engine, e);
+        }
+        scene->addEntities(entities.data(), entities.size());
+    }
+
+    void TearDown(benchmark::State& state) override {
+        for (Entity e : entities) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        engine->destroy(scene);
+        Engine::destroy(&engine);
+    }
+};
+
+// FScene::prepare() with a varying number of entities moving every frame
+BENCHMARK_DEFINE_F(SceneFixture, prepare)(benchmark::State& state) {
+    FEngine& fengine = upcast(*engine);
+    FScene& fscene = upcast(*scene);
+    FRenderableManager& rcm = fengine.getRenderableManager();
+    FLightManager& lcm = fengine.getLightManager();
+    FTransformManager& tcm = fengine.getTransformManager();
+    const size_t changeCount = size_t(state.range(0));
+    const mat4f worldOrigin;
+
+    fscene.prepare(worldOrigin);
+
+    size_t first = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < changeCount; i++) {
+            Entity e = entities[(first + i) % ENTITY_COUNT];
+            tcm.setTransform(tcm.getInstance(e), mat4f::translate(float3{ float(i), 0, 0 }));
+        }
+        first += changeCount;
+
+        fscene.prepare(worldOrigin);
+
+        // this is normally done by the engine at the end of each frame
+        rcm.trimChangeLog();
+        lcm.trimChangeLog();
+        tcm.trimChangeLog();
+    }
+    state.SetItemsProcessed(state.iterations() * changeCount);
+}
+
+BENCHMARK_REGISTER_F(SceneFixture, prepare)
+        ->Arg(0)->Arg(100)->Arg(1000)->Arg(10000)->Arg(50000)
+        ->Unit(benchmark::kMicrosecond);
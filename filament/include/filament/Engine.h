@@ -168,6 +168,11 @@ public:
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkan for instance).
      *
+     *  @param blobFunc         Functions used to cache compiled programs, see
+     *                          Platform::setBlobFunc(). They're given to the Platform before
+     *                          the render thread uses it, including a Platform created
+     *                          automatically. If they're null, the Platform's are left alone.
+     *
      *
      * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
      *
@@ -182,7 +187,8 @@ public:
      * This method is thread-safe.
      */
     static Engine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            Platform::BlobFunc const& blobFunc = {});
 
     /**
      * Destroy the Engine instance and all associated resources.
@@ -218,6 +224,12 @@ public:
 
     TransformManager& getTransformManager() noexcept;
 
+    /**
+     * Returns the Platform used by this Engine, either the one given to create() or the one
+     * created automatically.
+     */
+    Platform* getPlatform() const noexcept;
+
     /**
      * Creates a SwapChain from the given Operating System's native window handle.
      *
@@ -231,6 +243,25 @@ public:
      */
     SwapChain* createSwapChain(void* nativeWindow, uint64_t flags = 0) noexcept;
 
+    /**
+     * Creates a headless SwapChain, which isn't associated with a native window. Rendering
+     * happens into an offscreen surface (e.g. an EGL or GLX pbuffer) whose content can only be
+     * retrieved with Renderer::readPixels().
+     *
+     * Headless rendering is only supported by the OpenGL backend, on platforms providing
+     * pbuffer surfaces (EGL and GLX).
+     *
+     * @param width  Width of the offscreen surface in pixels.
+     * @param height Height of the offscreen surface in pixels.
+     * @param flags One or more configuration flags as defined in `SwapChain`.
+     *
+     * @return A pointer to the newly created SwapChain or nullptr if it couldn't be created.
+     *
+     * @see Renderer.beginFrame()
+     * @see Renderer.readPixels()
+     */
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags = 0) noexcept;
+
     /**
      * Creates a renderer associated to this engine.
      *
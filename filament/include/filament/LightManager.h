@@ -210,6 +210,27 @@ public:
          * use the camera far distance.
          */
         float shadowFarHint = 100.0f;
+
+        /** Number of shadow cascades used by a directional light, between 1 and 4 (inclusive).
+         * Each cascade covers a range of distances from the camera and uses its own shadow map
+         * of mapSize texels, so distant shadows don't steal resolution from the near ones.
+         * This value is ignored by other types of lights.
+         */
+        uint8_t shadowCascades = 1;
+
+        /** Selects how the depth range between the camera near plane and shadowFar is split
+         * between the cascades: 0.0f splits it uniformly, 1.0f splits it logarithmically.
+         * Values in between blend the two schemes. Must be between 0 and 1.
+         */
+        float shadowCascadeSplitLambda = 0.5f;
+
+        /** Keep the shadow map across frames and only render it again when the light, the
+         * camera (directional lights only) or the shadow casters change. Changes to the
+         * casters' transform, bounds, visibility, layers, geometry, material instance and bones
+         * are tracked, but not changes to the content of their buffers or material parameters.
+         * Cached shadow maps are best suited to static lights and casters.
+         */
+        bool cacheShadowMap = false;
     };
 
     //! Use Builder to construct a Light object instance
@@ -236,7 +257,10 @@ public:
          * @return This Builder, for chaining calls.
          *
          * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * - Type.SPOT and Type.POINT lights share a shadow atlas of 16 tiles, a spot light
+         *   uses one tile and a point light uses six. When more lights cast shadows, only the
+         *   ones that appear the largest on screen do. Of ShadowOptions, only constantBias and
+         *   normalBias apply to them.
          */
         Builder& castShadows(bool enable) noexcept;
 
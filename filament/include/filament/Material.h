@@ -124,6 +124,20 @@ public:
      */
     MaterialInstance* createInstance() const noexcept;
 
+    /**
+     * Starts compiling the variants of this material selected by \p variants, so that
+     * they're ready by the time they're first needed. Variants that don't apply to this material
+     * (e.g. lighting variants of an unlit material) are ignored.
+     *
+     * Compilation happens in the background when the backend supports it. Until it completes,
+     * draws use a compatible variant that is already compiled (e.g. without shadows), if there
+     * is one.
+     *
+     * @param variants A mask of UserVariantFilterBit, all variants by default.
+     */
+    void compile(UserVariantFilterMask variants =
+            UserVariantFilterMask(UserVariantFilterBit::ALL)) noexcept;
+
     //! Returns the name of this material as a null-terminated string.
     const char* getName() const noexcept;
 
@@ -59,6 +59,16 @@ public:
         float reserved = 0;
     };
 
+    // Encoding of the bones on the GPU
+    enum class BoneFormat : uint8_t {
+        // Quaternion, translation and non-uniform scale in floats, 64 bytes per bone
+        FULL,
+        // Unit quaternion, translation and uniform scale in half floats, 16 bytes per bone.
+        // Translations must fit the range and precision of half floats, e.g. be expressed
+        // relative to the renderable's transform.
+        COMPACT
+    };
+
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
     public:
@@ -82,10 +92,29 @@ public:
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
-        Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
+        // The bones of all the skinned renderables are stored in a single buffer shared by the
+        // engine. A primitive can address at most 256 bones, or 1024 compact bones, see
+        // boneOffset().
+        Builder& skinning(size_t boneCount) noexcept; // 0 by default
         Builder& skinning(size_t boneCount, Bone const* bones) noexcept;
         Builder& skinning(size_t boneCount, filament::math::mat4f const* transforms) noexcept;
 
+        // COMPACT bones take a quarter of the memory and upload bandwidth of FULL bones, but
+        // are less precise and only support uniform scales.
+        Builder& boneFormat(BoneFormat format) noexcept; // FULL by default
+
+        // The bone indices of the primitive are relative to the given bone, so a renderable
+        // can have more than 256 bones as long as each of its primitives uses at most 256
+        // consecutive bones (1024 compact bones). The offset must be a multiple of 4
+        // (16 for compact bones).
+        Builder& boneOffset(size_t index, size_t offset) noexcept; // 0 by default
+
+        // Draws instanceCount copies of the renderable with a single draw call per primitive,
+        // each one with its own transform relative to the renderable's. The bounding box applies
+        // to each instance, instances are culled individually. Transforms default to identity.
+        Builder& instances(size_t instanceCount) noexcept; // 0 by default, 128 max
+        Builder& instances(size_t instanceCount, filament::math::mat4f const* transforms) noexcept;
+
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
@@ -123,6 +152,7 @@ public:
             MaterialInstance const* materialInstance = nullptr;
             PrimitiveType type = PrimitiveType::TRIANGLES;
             uint16_t blendOrder = 0;
+            uint32_t boneOffset = 0;
         };
     };
 
@@ -138,10 +168,19 @@ public:
     bool isShadowReceiver(Instance instance) const noexcept;
 
     // Updates the bone transforms in the range [offset, offset + boneCount).
-    // The bones must be pre-allocated using Builder::skinning().
+    // The bones must be pre-allocated using Builder::skinning(). Compact bones keep the
+    // average of the scales of the transforms.
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, filament::math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
+    // Updates the instance transforms in the range [offset, offset + instanceCount).
+    // The instances must be pre-allocated using Builder::instances().
+    void setInstanceTransforms(Instance instance, filament::math::mat4f const* transforms,
+            size_t instanceCount = 1, size_t offset = 0) noexcept;
+
+    // number of instances of this renderable, 0 if it isn't instanced
+    size_t getInstanceCount(Instance instance) const noexcept;
+
 
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
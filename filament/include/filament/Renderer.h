@@ -236,10 +236,18 @@ public:
      * main thread, indicating that the read-back has completed. Typically, this will happen
      * after multiple calls to beginFrame(), render(), endFrame().
      *
-     * It is also possible to use a Fence to wait for the read-back.
+     * The read-back doesn't stall: the pixels are copied into `buffer` once the GPU is done
+     * with the frame, and several read-backs can be in flight.
+     *
+     * It is also possible to use a Fence to wait for the read-back, the callbacks of the
+     * read-backs issued before the Fence was created are then scheduled.
+     *
+     * If the read-back fails (e.g. the render target can't be read from), an error is logged,
+     * the callback is still invoked and the content of `buffer` is undefined.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * readPixels() is intended for debugging, testing and offline rendering. It uses additional
+     * bandwidth and memory.
      *
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -129,6 +129,28 @@ public:
      * @return Whether the given entity is in the Scene.
      */
     bool hasEntity(utils::Entity entity) const noexcept;
+
+    /**
+     * Enables or disables hierarchical culling.
+     *
+     * When enabled, the renderables of the Scene are kept in a bounding volume hierarchy, which
+     * lets the Views skip whole groups of renderables outside of the camera and shadow frustums,
+     * instead of testing each one of them. This is beneficial for scenes with many thousands
+     * of renderables, but the hierarchy is rebuilt each time entities are added or removed, or
+     * components are created or destroyed.
+     *
+     * Hierarchical culling is disabled by default.
+     *
+     * @param enabled true to enable hierarchical culling, false to disable it.
+     */
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether hierarchical culling is enabled.
+     *
+     * @return true if hierarchical culling is enabled, false otherwise.
+     */
+    bool isHierarchicalCullingEnabled() const noexcept;
 };
 
 } // namespace filament
@@ -365,6 +365,42 @@ public:
      * @attention This Texture instance must NOT use driver::SamplerType::SAMPLER_CUBEMAP or it has no effect
      */
     void generateMipmaps(Engine& engine) const noexcept;
+
+    /**
+     * Specifies the base level of a 2D texture and generates all the other mipmap levels on
+     * the CPU, using the engine's job system. Use this when generateMipmaps() is not
+     * available, e.g. when the texture's format isn't color-renderable.
+     *
+     * Filtering is done in linear space: sRGB textures (SRGB8, SRGB8_A8) are linearized and
+     * RGBM textures (see Builder::rgbm()) are decoded before filtering and re-encoded after.
+     * All the levels are uploaded at once when this method returns.
+     *
+     * @param engine    Engine this texture is associated to.
+     * @param buffer    Client-side buffer containing the image of the base level.
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention \p buffer's driver::PixelDataType must be UBYTE, HALF or FLOAT and its
+     *            driver::PixelDataFormat must be R, RG, RGB, RGBA or RGBM.
+     * @attention This Texture instance must use driver::SamplerType::SAMPLER_2D or it has no effect
+     */
+    void generateMipmaps(Engine& engine, PixelBufferDescriptor&& buffer) const noexcept;
+
+    /**
+     * Specifies the six images of the base level of a cube map and generates all the other
+     * mipmap levels on the CPU, using the engine's job system.
+     *
+     * @param engine        Engine this texture is associated to.
+     * @param buffer        Client-side buffer containing the images of the base level.
+     * @param faceOffsets   Offsets in bytes into \p buffer for all six images. The offsets
+     *                      are specified in the following order: +x, -x, +y, -y, +z, -z
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention This Texture instance must use driver::SamplerType::SAMPLER_CUBEMAP or it has no effect
+     *
+     * @see generateMipmaps(Engine&, PixelBufferDescriptor&&)
+     */
+    void generateMipmaps(Engine& engine,
+            PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept;
 };
 
 } // namespace filament
@@ -21,6 +21,8 @@
 
 #include <utils/compiler.h>
 
+#include <stddef.h>
+
 namespace filament {
 namespace details {
 class FEngine;
@@ -43,6 +45,61 @@ public:
 
     virtual ~Platform() noexcept;
 
+    /**
+     * Functions used to store compiled programs (e.g. on disk), so that they don't need to be
+     * compiled again the next time the application runs. Keys and values are opaque blobs.
+     *
+     * InsertBlobFunc stores \p value under \p key, replacing any previous value.
+     *
+     * RetrieveBlobFunc returns the size of the value stored under \p key, or 0 if there is none.
+     * The value is copied into \p value only if it fits in \p valueSize bytes.
+     *
+     * Both are called from filament's render thread.
+     */
+    using InsertBlobFunc = void (*)(void* user,
+            void const* key, size_t keySize, void const* value, size_t valueSize);
+    using RetrieveBlobFunc = size_t (*)(void* user,
+            void const* key, size_t keySize, void* value, size_t valueSize);
+
+    struct BlobFunc {
+        InsertBlobFunc insert = nullptr;
+        RetrieveBlobFunc retrieve = nullptr;
+        void* user = nullptr;
+    };
+
+    /**
+     * Sets the functions used to cache compiled programs. Passing null functions disables
+     * the cache.
+     *
+     * They're used from the render thread without synchronization, so this must be called
+     * before the Platform is given to Engine::create(). The functions of a Platform created by
+     * the Engine are given to Engine::create() instead.
+     *
+     * Only the OpenGL backend uses this cache currently.
+     */
+    void setBlobFunc(BlobFunc const& blobFunc) noexcept {
+        mBlobFunc = blobFunc;
+    }
+
+    void setBlobFunc(InsertBlobFunc insert, RetrieveBlobFunc retrieve, void* user) noexcept {
+        setBlobFunc({ insert, retrieve, user });
+    }
+
+    bool hasBlobFunc() const noexcept {
+        return mBlobFunc.insert && mBlobFunc.retrieve;
+    }
+
+    void insertBlob(void const* key, size_t keySize, void const* value, size_t valueSize) {
+        if (mBlobFunc.insert) {
+            mBlobFunc.insert(mBlobFunc.user, key, keySize, value, valueSize);
+        }
+    }
+
+    size_t retrieveBlob(void const* key, size_t keySize, void* value, size_t valueSize) {
+        return mBlobFunc.retrieve ?
+                mBlobFunc.retrieve(mBlobFunc.user, key, keySize, value, valueSize) : 0;
+    }
+
 protected:
     // Creates and initializes the low-level API (e.g. an OpenGL context or Vulkan instance),
     // then creates the concrete Driver. Returns null on failure.
@@ -53,6 +110,8 @@ private:
     friend class details::FEngine;
     static Platform* create(driver::Backend* backendHint) noexcept;
     static void destroy(Platform** context) noexcept;
+
+    BlobFunc mBlobFunc;
 };
 
 class UTILS_PUBLIC OpenGLPlatform : public Platform {
@@ -64,6 +123,13 @@ public:
     virtual void terminate() noexcept = 0;
 
     virtual SwapChain* createSwapChain(void* nativeWindow, uint64_t& flags) noexcept = 0;
+
+    // Creates a swap chain that isn't associated with a native window, typically a pbuffer
+    // surface. Returns nullptr if the platform doesn't support headless rendering.
+    virtual SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+        return nullptr;
+    }
+
     virtual void destroySwapChain(SwapChain* swapChain) noexcept = 0;
 
     virtual void createDefaultRenderTarget(uint32_t& framebuffer, uint32_t& colorbuffer,
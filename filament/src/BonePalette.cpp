@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BonePalette.h"
+
+#include "driver/DriverApi.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace filament {
+namespace details {
+
+static_assert(BonePalette::BONE_ALIGNMENT * sizeof(PerRenderableUibBone) == 256,
+        "bones ranges must be aligned to 256 bytes");
+
+static_assert(CONFIG_MAX_BONE_COUNT % BonePalette::BONE_ALIGNMENT == 0,
+        "CONFIG_MAX_BONE_COUNT must be a multiple of BonePalette::BONE_ALIGNMENT");
+
+BonePalette::BonePalette() noexcept
+        // the last range is always backed by a whole BonesUniforms block
+        : mBones(BLOCK_SIZE) {
+}
+
+void BonePalette::terminate(driver::DriverApi& driver) noexcept {
+    if (mHandle) {
+        driver.destroyUniformBuffer(mHandle);
+        mHandle = {};
+        mHandleSize = 0;
+    }
+}
+
+uint32_t BonePalette::allocate(size_t count) noexcept {
+    const size_t size = align(count);
+
+    // first fit in the ranges freed
+    auto pos = std::find_if(mFreeRanges.begin(), mFreeRanges.end(),
+            [size](Range const& r) { return r.count >= size; });
+
+    uint32_t index;
+    if (pos != mFreeRanges.end()) {
+        index = pos->index;
+        pos->index += size;
+        pos->count -= size;
+        if (!pos->count) {
+            mFreeRanges.erase(pos);
+        }
+    } else {
+        index = uint32_t(mUsedCount);
+        mUsedCount += size;
+
+        const size_t needed = (mUsedCount + CONFIG_MAX_BONE_COUNT) * sizeof(PerRenderableUibBone);
+        if (needed > mBones.getSize()) {
+            UniformBuffer bones(std::max(needed, mBones.getSize() * 2));
+            memcpy(bones.invalidate(), mBones.getBuffer(), index * sizeof(PerRenderableUibBone));
+            mBones = std::move(bones);
+        }
+    }
+
+    std::uninitialized_fill_n(edit(index, size), size, PerRenderableUibBone{});
+    return index;
+}
+
+void BonePalette::free(uint32_t index, size_t count) noexcept {
+    Range range = { index, uint32_t(align(count)) };
+
+    auto pos = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), range,
+            [](Range const& lhs, Range const& rhs) { return lhs.index < rhs.index; });
+
+    // merge with the neighbors
+    if (pos != mFreeRanges.end() && range.index + range.count == pos->index) {
+        range.count += pos->count;
+        pos = mFreeRanges.erase(pos);
+    }
+    if (pos != mFreeRanges.begin() && (pos - 1)->index + (pos - 1)->count == range.index) {
+        --pos;
+        range.index = pos->index;
+        range.count += pos->count;
+        pos = mFreeRanges.erase(pos);
+    }
+
+    if (range.index + range.count == mUsedCount) {
+        // this was the last range, the free ranges are all below it
+        mUsedCount = range.index;
+    } else {
+        mFreeRanges.insert(pos, range);
+    }
+}
+
+void BonePalette::commit(driver::DriverApi& driver) noexcept {
+    SYSTRACE_CALL();
+
+    const size_t size = (mUsedCount + CONFIG_MAX_BONE_COUNT) * sizeof(PerRenderableUibBone);
+    bool upload = mBones.isDirty();
+    if (UTILS_UNLIKELY(size > mHandleSize)) {
+        // grow to the capacity of the CPU copy, so we don't reallocate each time we grow
+        if (mHandle) {
+            driver.destroyUniformBuffer(mHandle);
+        }
+        mHandleSize = mBones.getSize();
+        mHandle = driver.createUniformBuffer(mHandleSize, driver::BufferUsage::DYNAMIC);
+        upload = true;
+    }
+
+    if (upload) {
+        // The palette can be larger than what the command stream can hold, so it's copied
+        // out-of-line. The whole palette is uploaded, which is a single copy on the driver side.
+        void* buffer = malloc(size);
+        memcpy(buffer, mBones.getBuffer(), size);
+        driver.updateUniformBuffer(mHandle, { buffer, size,
+                [](void* buffer, size_t, void*) { ::free(buffer); } });
+        mBones.clean();
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BoundingVolumeHierarchy.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+#include <assert.h>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+static_assert(BoundingVolumeHierarchy::LEAF_SIZE % Culler::MODULO == 0,
+        "LEAF_SIZE must be a multiple of Culler::MODULO");
+
+// trees with fewer entries are culled on the calling thread
+static constexpr size_t PARALLEL_CULL_MIN_COUNT = 8192;
+
+// number of subtrees culled in parallel
+static constexpr size_t PARALLEL_CULL_ROOT_COUNT = 32;
+
+// the tree is balanced and leaves are at least half full, which bounds its depth
+static constexpr size_t MAX_DEPTH = 64;
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() noexcept = default;
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy() noexcept = default;
+
+void BoundingVolumeHierarchy::clear() noexcept {
+    mNodes.clear();
+    mCenters.clear();
+    mExtents.clear();
+    mIds.clear();
+    mEntries.clear();
+    mLeaves.clear();
+    mDirtyLeaves.clear();
+    mCount = 0;
+    mUpdateCount = 0;
+}
+
+void BoundingVolumeHierarchy::build(uint32_t const* ids,
+        float3 const* centers, float3 const* extents, size_t count, size_t idCount) {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!count) {
+        return;
+    }
+
+    // each leaf is padded to a multiple of Culler::MODULO entries
+    const size_t leafCount = (count + LEAF_SIZE / 2 - 1) / (LEAF_SIZE / 2);
+    mNodes.reserve(2 * leafCount);
+    mCenters.reserve(count + leafCount * Culler::MODULO);
+    mExtents.reserve(count + leafCount * Culler::MODULO);
+    mIds.reserve(count + leafCount * Culler::MODULO);
+    mLeaves.reserve(count + leafCount * Culler::MODULO);
+
+    std::vector<uint32_t> indices(count);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    mNodes.push_back({});
+    buildNode(0, indices.data(), count, NONE, ids, centers, extents);
+
+    // padding entries are never looked up
+    mEntries.assign(idCount, NONE);
+    for (Node const& node : mNodes) {
+        for (uint32_t i = node.first, c = node.first + node.count; node.count && i < c; i++) {
+            mEntries[mIds[i]] = i;
+        }
+    }
+    mCount = count;
+}
+
+void BoundingVolumeHierarchy::buildNode(uint32_t index, uint32_t* indices, size_t count,
+        uint32_t parent, uint32_t const* ids, float3 const* centers, float3 const* extents) {
+    // bounds of the entries and of their centers
+    float3 lo{ std::numeric_limits<float>::max() };
+    float3 hi{ std::numeric_limits<float>::lowest() };
+    float3 centerLo = lo;
+    float3 centerHi = hi;
+    for (size_t i = 0; i < count; i++) {
+        float3 const& c = centers[indices[i]];
+        float3 const& e = extents[indices[i]];
+        lo = min(lo, c - e);
+        hi = max(hi, c + e);
+        centerLo = min(centerLo, c);
+        centerHi = max(centerHi, c);
+    }
+
+    Node node = {};
+    node.min = lo;
+    node.max = hi;
+    node.parent = parent;
+
+    if (count <= LEAF_SIZE) {
+        node.first = uint32_t(mIds.size());
+        node.count = uint32_t(count);
+        for (size_t i = 0; i < count; i++) {
+            mCenters.push_back(centers[indices[i]]);
+            mExtents.push_back(extents[indices[i]]);
+            mIds.push_back(ids[indices[i]]);
+            mLeaves.push_back(index);
+        }
+        for (size_t i = count, c = Culler::round(count); i < c; i++) {
+            mCenters.push_back({});
+            mExtents.push_back({});
+            mIds.push_back(0);
+            mLeaves.push_back(index);
+        }
+        mNodes[index] = node;
+        return;
+    }
+
+    // median split along the largest axis of the centers
+    const float3 size = centerHi - centerLo;
+    const size_t axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+    const size_t half = count / 2;
+    std::nth_element(indices, indices + half, indices + count,
+            [centers, axis](uint32_t lhs, uint32_t rhs) {
+                return centers[lhs][axis] < centers[rhs][axis];
+            });
+
+    // children are allocated next to each other, mNodes can be reallocated below
+    const uint32_t child = uint32_t(mNodes.size());
+    mNodes.resize(mNodes.size() + 2);
+
+    node.child = child;
+    buildNode(child,     indices,        half,         index, ids, centers, extents);
+    buildNode(child + 1, indices + half, count - half, index, ids, centers, extents);
+    mNodes[index] = node;
+}
+
+void BoundingVolumeHierarchy::update(uint32_t id,
+        float3 const& center, float3 const& extent) noexcept {
+    if (id >= mEntries.size() || mEntries[id] == NONE) {
+        return;
+    }
+    const uint32_t entry = mEntries[id];
+    mCenters[entry] = center;
+    mExtents[entry] = extent;
+    Node& leaf = mNodes[mLeaves[entry]];
+    if (!leaf.dirty) {
+        leaf.dirty = true;
+        mDirtyLeaves.push_back(mLeaves[entry]);
+    }
+    mUpdateCount++;
+}
+
+void BoundingVolumeHierarchy::refitLeaf(Node& node) noexcept {
+    float3 lo{ std::numeric_limits<float>::max() };
+    float3 hi{ std::numeric_limits<float>::lowest() };
+    for (uint32_t i = node.first, c = node.first + node.count; i < c; i++) {
+        lo = min(lo, mCenters[i] - mExtents[i]);
+        hi = max(hi, mCenters[i] + mExtents[i]);
+    }
+    node.min = lo;
+    node.max = hi;
+    node.dirty = false;
+}
+
+void BoundingVolumeHierarchy::refit() noexcept {
+    SYSTRACE_CALL();
+
+    for (uint32_t index : mDirtyLeaves) {
+        refitLeaf(mNodes[index]);
+
+        // the ancestors shared by several dirty leaves are recomputed each time, which is
+        // still cheap since there are only a few levels
+        for (uint32_t p = mNodes[index].parent; p != NONE; p = mNodes[p].parent) {
+            Node& node = mNodes[p];
+            Node const& lhs = mNodes[node.child];
+            Node const& rhs = mNodes[node.child + 1];
+            node.min = min(lhs.min, rhs.min);
+            node.max = max(lhs.max, rhs.max);
+        }
+    }
+    mDirtyLeaves.clear();
+}
+
+void BoundingVolumeHierarchy::cull(JobSystem& js, Culler::result_type* results,
+        Frustum const& frustum, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (mNodes.empty()) {
+        return;
+    }
+
+    if (mCount < PARALLEL_CULL_MIN_COUNT) {
+        cullNode(0, results, frustum, bit);
+        return;
+    }
+
+    // split the top of the tree breadth-first in subtrees, which don't share any entries
+    uint32_t roots[2 * PARALLEL_CULL_ROOT_COUNT];
+    size_t first = 0;
+    size_t last = 0;
+    roots[last++] = 0;
+    while (last - first < PARALLEL_CULL_ROOT_COUNT) {
+        // the tree is balanced, so when the shallowest node is a leaf, we're done
+        const uint32_t child = mNodes[roots[first]].child;
+        if (!child) {
+            break;
+        }
+        first++;
+        roots[last++] = child;
+        roots[last++] = child + 1;
+    }
+
+    auto work = [this, &roots, results, &frustum, bit](uint32_t start, uint32_t count) {
+        for (uint32_t i = start, c = start + count; i < c; i++) {
+            cullNode(roots[i], results, frustum, bit);
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, uint32_t(first), uint32_t(last - first),
+            std::ref(work), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+}
+
+void BoundingVolumeHierarchy::cullNode(uint32_t root, Culler::result_type* results,
+        Frustum const& frustum, size_t bit) const noexcept {
+    float4 const* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
+    const Culler::result_type visible = Culler::result_type(1u << bit);
+
+    struct Item {
+        uint32_t index;
+        bool inside;    // the node is entirely inside the frustum
+    };
+    Item stack[MAX_DEPTH];
+    size_t top = 0;
+    stack[top++] = { root, false };
+
+    while (top) {
+        const Item item = stack[--top];
+        Node const& node = mNodes[item.index];
+        bool inside = item.inside;
+
+        if (!inside) {
+            // same test as the Culler, and the farthest corner to find whether the node
+            // is entirely inside
+            const float3 center = (node.max + node.min) * 0.5f;
+            const float3 extent = (node.max - node.min) * 0.5f;
+            bool outside = false;
+            inside = true;
+            for (size_t j = 0; j < 6; j++) {
+                const float d = dot(planes[j].xyz, center) + planes[j].w;
+                const float r = dot(abs(planes[j].xyz), extent);
+                outside |= d - r > 0;
+                inside &= d + r < 0;
+            }
+            if (outside) {
+                continue;
+            }
+        }
+
+        if (node.child) {
+            assert(top + 2 <= MAX_DEPTH);
+            stack[top++] = { node.child + 1, inside };
+            stack[top++] = { node.child, inside };
+        } else if (inside) {
+            for (uint32_t i = node.first, c = node.first + node.count; i < c; i++) {
+                results[mIds[i]] |= visible;
+            }
+        } else {
+            Culler::result_type leaf[LEAF_SIZE] = {};
+            Culler::intersects(leaf, frustum,
+                    mCenters.data() + node.first, mExtents.data() + node.first,
+                    node.count, bit);
+            for (uint32_t i = 0; i < node.count; i++) {
+                results[mIds[node.first + i]] |= leaf[i];
+            }
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
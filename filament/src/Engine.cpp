@@ -34,6 +34,7 @@
 #include "driver/Program.h"
 
 #include <private/filament/SibGenerator.h>
+#include <private/filament/UibGenerator.h>
 
 #include <filament/Exposure.h>
 #include <filament/MaterialEnums.h>
@@ -53,6 +54,7 @@
 #include <functional>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "generated/resources/materials.h"
 
@@ -70,8 +72,9 @@ namespace details {
 static std::unordered_map<Engine const*, std::unique_ptr<FEngine>> sEngines;
 static std::mutex sEnginesLock;
 
-FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext) {
-    FEngine* instance = new FEngine(backend, platform, sharedGLContext);
+FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        Platform::BlobFunc const& blobFunc) {
+    FEngine* instance = new FEngine(backend, platform, sharedGLContext, blobFunc);
 
     slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << instance << " "
             << "(threading is " << (UTILS_HAS_THREADING ? "enabled)" : "disabled)") << io::endl;
@@ -82,11 +85,13 @@ FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLCont
     // Normally we launch a thread and create the context and Driver from there (see FEngine::loop).
     // In the single-threaded case, we do so in the here and now.
     if (!UTILS_HAS_THREADING) {
-        // we don't own the external context at that point, set it to null
-        instance->mPlatform = nullptr;
         if (platform == nullptr) {
             platform = Platform::create(&instance->mBackend);
             instance->mPlatform = platform;
+            instance->mOwnPlatform = true;
+        }
+        if (blobFunc.insert || blobFunc.retrieve) {
+            platform->setBlobFunc(blobFunc);
         }
         instance->mDriver = platform->createDriver(sharedGLContext);
         instance->init();
@@ -123,10 +128,12 @@ static const half4 sFullScreenTriangleVertices[3] = {
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
-FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
+FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext,
+        Platform::BlobFunc const& blobFunc) :
         mBackend(backend),
         mPlatform(platform),
         mSharedGLContext(sharedGLContext),
+        mBlobFunc(blobFunc),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
         mTransformManager(),
@@ -137,6 +144,7 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
         mPostProcessUib(PostProcessingUib::getUib()),
         mPostProcessSib(PostProcessSib::getSib()),
         mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
+        mCommandBufferPool(CONFIG_MIN_COMMAND_BUFFERS_SIZE),
         mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
         mEngineEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1)
@@ -146,6 +154,8 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
     // we're assuming we're on the main thread here.
     // (it may not be the case)
     mJobSystem.adopt();
+
+    mEntityManager.registerListener(&mEntityListener);
 }
 
 /*
@@ -195,6 +205,15 @@ void FEngine::init() {
     driverApi.setRenderPrimitiveRange(mFullScreenTriangleRph, Driver::PrimitiveType::TRIANGLES,
             0, 0, 2, (uint32_t)mFullScreenTriangleIb->getIndexCount());
 
+    // every vertex shader declares the InstancesUniforms block, which must be bound even
+    // when nothing is instanced
+    const size_t instancesBlockSize = CONFIG_MAX_INSTANCE_COUNT * sizeof(PerRenderableUibInstance);
+    mDummyInstancesUbh = driverApi.createUniformBuffer(instancesBlockSize,
+            driver::BufferUsage::STATIC);
+    void* const instances = driverApi.allocate(instancesBlockSize);
+    memset(instances, 0, instancesBlockSize);
+    driverApi.updateUniformBuffer(mDummyInstancesUbh, { instances, instancesBlockSize });
+
     mDefaultIblTexture = upcast(Texture::Builder()
             .width(1).height(1).levels(1)
             .format(Texture::InternalFormat::RGBA8)
@@ -231,7 +250,9 @@ void FEngine::init() {
 FEngine::~FEngine() noexcept {
     ASSERT_DESTRUCTOR(mTerminated, "Engine destroyed but not terminated!");
     delete mDriver;
-    Platform::destroy(&mPlatform);
+    if (mOwnPlatform) {
+        Platform::destroy(&mPlatform);
+    }
 }
 
 void FEngine::shutdown() {
@@ -255,8 +276,10 @@ void FEngine::shutdown() {
     mRenderableManager.terminate();         // free-up all renderables
     mLightManager.terminate();              // free-up all lights
     mCameraManager.terminate();             // free-up all cameras
+    mEntityManager.unregisterListener(&mEntityListener);
 
     driver.destroyRenderPrimitive(mFullScreenTriangleRph);
+    driver.destroyUniformBuffer(mDummyInstancesUbh);
     destroy(mFullScreenTriangleIb);
     destroy(mFullScreenTriangleVb);
 
@@ -327,10 +350,13 @@ void FEngine::prepare() {
         }
     }
 
-    // Commit default material instances.
+    // Commit default material instances, and promote the programs that finished compiling.
+    uint32_t pendingProgramCount = 0;
     for (auto& material : mMaterials) {
         material->getDefaultInstance()->commit(*this);
+        pendingProgramCount += material->updatePendingPrograms();
     }
+    mPendingProgramCount = pendingProgramCount;
 }
 
 void FEngine::gc() {
@@ -348,6 +374,23 @@ void FEngine::gc() {
             JobSystem::DONT_SIGNAL);
 
     js.runAndWait(parent);
+
+    // gc() is called once per frame after all views are rendered, at this point all
+    // scenes have consumed the changes they're interested in.
+    mRenderableManager.trimChangeLog();
+    mLightManager.trimChangeLog();
+    mTransformManager.trimChangeLog();
+    for (FScene* scene : mScenes) {
+        scene->trimShadowCasterChangeLog();
+    }
+}
+
+void FEngine::EntityListener::onEntitiesDestroyed(size_t n, Entity const* entities) noexcept {
+    destructionCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FEngine::EntityListener::onAllEntitiesDestroyed() noexcept {
+    destructionCount.fetch_add(1, std::memory_order_relaxed);
 }
 
 void FEngine::flush() {
@@ -360,13 +403,11 @@ void FEngine::flush() {
 // -----------------------------------------------------------------------------------------------
 
 int FEngine::loop() {
-    // we don't own the external context at that point, set it to null
     Platform* platform = mPlatform;
-    mPlatform = nullptr;
-
     if (platform == nullptr) {
         platform = Platform::create(&mBackend);
         mPlatform = platform;
+        mOwnPlatform = true;
         slog.d << "FEngine resolved backend: ";
         switch (mBackend) {
             case driver::Backend::OPENGL:
@@ -387,6 +428,10 @@ int FEngine::loop() {
         }
         slog.d << io::endl;
     }
+    // this happens before the driver uses the platform, on its own thread
+    if (mBlobFunc.insert || mBlobFunc.retrieve) {
+        platform->setBlobFunc(mBlobFunc);
+    }
     mDriver = platform->createDriver(mSharedGLContext);
     mDriverBarrier.latch();
     if (UTILS_UNLIKELY(!mDriver)) {
@@ -575,6 +620,18 @@ FSwapChain* FEngine::createSwapChain(void* nativeWindow, uint64_t flags) noexcep
     return p;
 }
 
+FSwapChain* FEngine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    if (!ASSERT_POSTCONDITION_NON_FATAL(mBackend == Backend::OPENGL,
+            "Headless SwapChain is only supported by the OpenGL backend")) {
+        return nullptr;
+    }
+    FSwapChain* p = mHeapAllocator.make<FSwapChain>(*this, width, height, flags);
+    if (p) {
+        mSwapChains.insert(p);
+    }
+    return p;
+}
+
 /*
  * Objects created with a component manager
  */
@@ -752,8 +809,10 @@ bool FEngine::execute() {
 
 using namespace details;
 
-Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext) {
-    std::unique_ptr<FEngine> engine(FEngine::create(backend, platform, sharedGLContext));
+Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        Platform::BlobFunc const& blobFunc) {
+    std::unique_ptr<FEngine> engine(FEngine::create(backend, platform, sharedGLContext,
+            blobFunc));
     if (UTILS_UNLIKELY(!engine)) {
         // something went wrong during the driver or engine initialization
         return nullptr;
@@ -811,13 +870,20 @@ Camera* Engine::createCamera(Entity entity) noexcept {
 }
 
 Fence* Engine::createFence(Fence::Type type) noexcept {
-    return upcast(this)->createFence(type);
+    FEngine* engine = upcast(this);
+    // the client can wait on its fences for the read-backs, see Renderer::readPixels()
+    engine->getDriverApi().finish();
+    return engine->createFence(type);
 }
 
 SwapChain* Engine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept {
     return upcast(this)->createSwapChain(nativeWindow, flags);
 }
 
+SwapChain* Engine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    return upcast(this)->createSwapChain(width, height, flags);
+}
+
 void Engine::destroy(const VertexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -886,6 +952,10 @@ TransformManager& Engine::getTransformManager() noexcept {
     return upcast(this)->getTransformManager();
 }
 
+Platform* Engine::getPlatform() const noexcept {
+    return upcast(this)->getPlatform();
+}
+
 void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
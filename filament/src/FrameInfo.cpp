@@ -39,6 +39,26 @@ FrameInfoManager::FrameInfoManager(FEngine& engine)
 
 FrameInfoManager::~FrameInfoManager() noexcept = default;
 
+void FrameInfoManager::run() {
+    mTimerQuerySupported = mEngine.getDriverApi().isTimerQuerySupported();
+    mSyncThread.run();
+}
+
+void FrameInfoManager::terminate() {
+    mSyncThread.requestExitAndWait();
+
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    for (TimedFrame const& timedFrame : mTimedFrames) {
+        releaseTimedFrame(driver, timedFrame, false);
+    }
+    mTimedFrames.clear();
+    mCurrentTimedFrame = nullptr;
+    for (Handle<HwTimerQuery> query : mFreeTimerQueries) {
+        driver.destroyTimerQuery(query);
+    }
+    mFreeTimerQueries.clear();
+}
+
 void FrameInfo::beginFrame(FrameInfoManager* mgr) {
     Fence* fence = mgr->getEngine().createFence(Fence::Type::HARD);
     mgr->push([this, fence]() {
@@ -80,14 +100,30 @@ void FrameInfoManager::beginFrame(uint32_t frameId) {
         info->frame = frameId;
         info->beginFrame(this);
     }
+
+    if (mTimerQuerySupported) {
+        resolveTimedFrames(mEngine.getDriverApi(), frameId);
+        mTimedFrames.emplace_back();
+        mCurrentTimedFrame = &mTimedFrames.back();
+        mCurrentTimedFrame->frame = frameId;
+    }
 }
 
 void FrameInfoManager::endFrame() {
     FrameInfo* const info = mCurrentFrameInfo;
     if (info) {
         mCurrentFrameInfo = nullptr;
+        info->pendingProgramCount = mEngine.getPendingProgramCount();
         info->endFrame(this);
     }
+
+    if (mCurrentTimedFrame) {
+        assert(!mPassStarted);
+        if (!mCurrentTimedFrame->passCount) {
+            mTimedFrames.pop_back();
+        }
+        mCurrentTimedFrame = nullptr;
+    }
 }
 
 void FrameInfoManager::cancelFrame() {
@@ -98,6 +134,92 @@ void FrameInfoManager::cancelFrame() {
             mPoolArena.free(info);
         });
     }
+
+    if (mCurrentTimedFrame) {
+        // no passes were issued
+        mTimedFrames.pop_back();
+        mCurrentTimedFrame = nullptr;
+    }
+}
+
+void FrameInfoManager::beginPass(driver::DriverApi& driver, const char* name) noexcept {
+    TimedFrame* const timedFrame = mCurrentTimedFrame;
+    if (!timedFrame || timedFrame->passCount == FrameInfo::MAX_PASS_COUNT) {
+        return;
+    }
+    assert(!mPassStarted);
+
+    Handle<HwTimerQuery> query;
+    if (!mFreeTimerQueries.empty()) {
+        query = mFreeTimerQueries.back();
+        mFreeTimerQueries.pop_back();
+    } else {
+        query = driver.createTimerQuery();
+    }
+
+    const size_t i = timedFrame->passCount;
+    timedFrame->passes[i] = { name, {} };
+    timedFrame->queries[i] = query;
+    driver.beginTimerQuery(query);
+    mPassStarted = true;
+}
+
+void FrameInfoManager::endPass(driver::DriverApi& driver) noexcept {
+    if (mPassStarted) {
+        TimedFrame* const timedFrame = mCurrentTimedFrame;
+        driver.endTimerQuery(timedFrame->queries[timedFrame->passCount++]);
+        mPassStarted = false;
+    }
+}
+
+void FrameInfoManager::resolveTimedFrames(driver::DriverApi& driver, uint32_t frameId) noexcept {
+    // The queries complete in order, so do the frames. A frame is done when the GPU time of
+    // all its passes is known and its FrameInfo is in the history, or when it's too old.
+    auto& timedFrames = mTimedFrames;
+    while (!timedFrames.empty()) {
+        TimedFrame& timedFrame = timedFrames.front();
+        const uint32_t allResolved = (1u << timedFrame.passCount) - 1u;
+        for (size_t i = 0; i < timedFrame.passCount; i++) {
+            uint64_t elapsedTime = 0;
+            if (!(timedFrame.resolved & (1u << i)) &&
+                    driver.getTimerQueryValue(timedFrame.queries[i], &elapsedTime)) {
+                timedFrame.passes[i].gpuTime = std::chrono::nanoseconds(elapsedTime);
+                timedFrame.resolved |= 1u << i;
+            }
+        }
+
+        bool done = false;
+        if (timedFrame.resolved == allResolved) {
+            std::unique_lock<std::mutex> lock(mLock);
+            auto& history = mFrameInfoHistory;
+            auto pos = std::find_if(history.begin(), history.end(),
+                    [&timedFrame](FrameInfo const& info) { return info.frame == timedFrame.frame; });
+            if (pos != history.end()) {
+                pos->passCount = timedFrame.passCount;
+                std::copy_n(timedFrame.passes, timedFrame.passCount, pos->passes);
+                done = true;
+            }
+        }
+
+        if (!done && frameId - timedFrame.frame <= MAX_TIMER_LATENCY) {
+            break;
+        }
+
+        // a query whose result never came is destroyed, so it can't be mistaken for a new one
+        releaseTimedFrame(driver, timedFrame, timedFrame.resolved == allResolved);
+        timedFrames.pop_front();
+    }
+}
+
+void FrameInfoManager::releaseTimedFrame(driver::DriverApi& driver,
+        TimedFrame const& timedFrame, bool recycle) noexcept {
+    for (size_t i = 0; i < timedFrame.passCount; i++) {
+        if (recycle) {
+            mFreeTimerQueries.push_back(timedFrame.queries[i]);
+        } else {
+            driver.destroyTimerQuery(timedFrame.queries[i]);
+        }
+    }
 }
 
 UTILS_ALWAYS_INLINE
@@ -19,10 +19,13 @@
 
 #include "details/Engine.h"
 
+#include "fg/FrameGraph.h"
+
 #include <filament/Fence.h>
 
 #include <utils/Allocator.h>
 
+#include <algorithm>
 #include <deque>
 #include <chrono>
 #include <condition_variable>
@@ -65,15 +68,37 @@ public:
     void endFrame(FrameInfoManager* mgr);
 
     static constexpr size_t MAX_LAPS_IDS = 8;
+    static constexpr size_t MAX_PASS_COUNT = 16;
+
+    struct Pass {
+        const char* name = nullptr;     // must outlive the history, e.g. a string literal
+        duration gpuTime = {};
+    };
 
     uint32_t frame = 0;
+    uint32_t pendingProgramCount = 0;   // programs still compiling at the end of the frame
     time_point laps[MAX_LAPS_IDS] = { time_point::max() };
+
+    // GPU time of the passes, in the order they were issued. These are known a few frames
+    // later than the rest, passCount is zero until then or if timer queries aren't supported.
+    uint32_t passCount = 0;
+    Pass passes[MAX_PASS_COUNT];
+
+    duration getGpuTime() const noexcept {
+        duration sum = {};
+        for (size_t i = 0; i < passCount; i++) {
+            sum += passes[i].gpuTime;
+        }
+        return sum;
+    }
 };
 
-class FrameInfoManager {
+class FrameInfoManager : public FrameGraph::PassTimer {
     friend class FrameInfo;
     static constexpr size_t HISTORY_COUNT = 5;
     static constexpr size_t POOL_COUNT = 8;
+    // frames whose passes' GPU time isn't known after this many frames are dropped
+    static constexpr size_t MAX_TIMER_LATENCY = 8;
 
     // set this to true to enable extra timing info
     static constexpr bool mLapRecordsEnabled = EXTRA_TIMING_INFO;
@@ -85,16 +110,14 @@ public:
 
     explicit FrameInfoManager(FEngine& engine);
     ~FrameInfoManager() noexcept;
+    FrameInfoManager(FrameInfoManager const&) = delete;
+    FrameInfoManager& operator=(FrameInfoManager const&) = delete;
 
     Engine& getEngine() { return mEngine; }
 
-    void run() {
-        mSyncThread.run();
-    }
+    void run();
 
-    void terminate() {
-        mSyncThread.requestExitAndWait();
-    }
+    void terminate();
 
     // call this immediately after "make current"
     void beginFrame(uint32_t frameId);
@@ -113,6 +136,12 @@ public:
 
     void cancelFrame();
 
+    // Call between beginFrame and endFrame to measure the GPU time of the commands issued
+    // between beginPass() and endPass(), which can't be nested. The results are added to the
+    // frame's FrameInfo when they're known.
+    void beginPass(driver::DriverApi& driver, const char* name) noexcept override;
+    void endPass(driver::DriverApi& driver) noexcept override;
+
     constexpr bool isLapRecordsEnabled() const noexcept {
         return mLapRecordsEnabled;
     }
@@ -123,6 +152,15 @@ public:
         return info.laps[FrameInfo::FINISH] - info.laps[FrameInfo::START];
     }
 
+    // GPU time of the passes of the most recent frame for which it's known, zero if unknown
+    duration getLastGpuTime() const noexcept {
+        std::unique_lock<std::mutex> lock(mLock);
+        auto const& history = mFrameInfoHistory;
+        auto pos = std::find_if(history.rbegin(), history.rend(),
+                [](FrameInfo const& info) { return info.passCount > 0; });
+        return pos != history.rend() ? pos->getGpuTime() : duration{};
+    }
+
     std::vector<FrameInfo> getHistory() const noexcept {
         std::unique_lock<std::mutex> lock(mLock);
         return mFrameInfoHistory;
@@ -169,6 +207,20 @@ private:
     FrameInfo* obtain() noexcept;
     void finish(FrameInfo* info) noexcept;
 
+    // the passes of a frame, whose GPU time is being measured
+    struct TimedFrame {
+        uint32_t frame = 0;
+        uint32_t passCount = 0;
+        FrameInfo::Pass passes[FrameInfo::MAX_PASS_COUNT];
+        Handle<HwTimerQuery> queries[FrameInfo::MAX_PASS_COUNT];
+        uint32_t resolved = 0;      // bitmask of the passes whose GPU time is known
+    };
+
+    // reads the results of the timer queries and copies the completed frames to the history
+    void resolveTimedFrames(driver::DriverApi& driver, uint32_t frameId) noexcept;
+    void releaseTimedFrame(driver::DriverApi& driver, TimedFrame const& timedFrame,
+            bool recycle) noexcept;
+
     using PoolArena = utils::Arena<utils::ObjectPoolAllocator<FrameInfo>, utils::LockingPolicy::SpinLock>;
     FEngine& mEngine;
     PoolArena mPoolArena;
@@ -177,6 +229,13 @@ private:
 
     mutable std::mutex mLock;
     std::vector<FrameInfo> mFrameInfoHistory;
+
+    // these are only used on the main thread
+    bool mTimerQuerySupported = false;
+    TimedFrame* mCurrentTimedFrame = nullptr;   // frame being recorded, null if not timed
+    bool mPassStarted = false;
+    std::deque<TimedFrame> mTimedFrames;        // frames being recorded or measured
+    std::vector<Handle<HwTimerQuery>> mFreeTimerQueries;
 };
 
 
@@ -69,11 +69,11 @@ constexpr size_t FROXEL_BUFFER_WIDTH        = 1u << FROXEL_BUFFER_WIDTH_SHIFT;
 constexpr size_t FROXEL_BUFFER_WIDTH_MASK   = FROXEL_BUFFER_WIDTH - 1u;
 constexpr size_t FROXEL_BUFFER_HEIGHT       = (FROXEL_BUFFER_ENTRY_COUNT_MAX + FROXEL_BUFFER_WIDTH_MASK) / FROXEL_BUFFER_WIDTH;
 
-constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 5u;
+constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 6u;
 constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
 
 constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
-constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
+constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 128K
 
 // Buffer needed for Froxelizer internal data structures (~256 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
@@ -89,22 +89,33 @@ static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8
 static constexpr size_t GROUP_COUNT =
         (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
 
+// maximum number of jobs each group is split into, by ranges of Z slices (e.g. 4)
+static constexpr size_t SLICE_GROUP_COUNT = 4;
 
-// record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
-// so its maximum size is 128 KiB
-static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
-        "RecordBuffer cannot be larger than 65536 entries");
+// number of lights per group needed to add a range of Z slices (i.e. a job) to a group
+static constexpr size_t LIGHT_PER_SLICE_GROUP = 8;
+
+// above this number of lights, lights are assigned to froxels using a light tree, i.e. one
+// job per Z slice only processes the lights overlapping that slice.
+static constexpr size_t LIGHT_TREE_THRESHOLD = CONFIG_MAX_LIGHT_COUNT / 2;
+
+// maximum number of nodes of a light tree, a complete binary tree with one leaf per light
+static constexpr size_t LIGHT_TREE_NODE_COUNT_MAX = 2 * CONFIG_MAX_LIGHT_COUNT - 1;
+
+// record buffer offsets are stored as uint32_t in the froxel buffer, the record buffer itself
+// is limited by the maximum texture height (2048 on ES3.0)
+static_assert(RECORD_BUFFER_HEIGHT <= 2048,
+        "RecordBuffer cannot be taller than 2048 texels");
 
 Froxelizer::Froxelizer(FEngine& engine)
         : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
-    // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
-    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
+    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT32, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
 }
 
@@ -165,12 +176,12 @@ bool Froxelizer::prepare(
      * the command stream.
      */
 
-    // froxel buffer (~32 KiB)
+    // froxel buffer (~64 KiB)
     mFroxelBufferUser = {
             driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // record buffer (~64 KiB)
+    // record buffer (~256 KiB)
     mRecordBufferUser = {
             driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
             RECORD_BUFFER_ENTRY_COUNT };
@@ -179,21 +190,39 @@ bool Froxelizer::prepare(
      * Temporary allocations for processing all froxel data
      */
 
-    // light records per froxel (~256 KiB)
+    // light records per froxel (~1 MiB)
     mLightRecords = {
             arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
+    // froxel thread data (~1 MiB)
     mFroxelShardedData = {
             arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
             uint32_t(GROUP_COUNT)
     };
 
+    // light tree (~80 KiB)
+    mLightParams = {
+            arena.allocate<LightParams>(CONFIG_MAX_LIGHT_COUNT, CACHELINE_SIZE),
+            CONFIG_MAX_LIGHT_COUNT };
+    mLightRanges = {
+            arena.allocate<float2>(CONFIG_MAX_LIGHT_COUNT, CACHELINE_SIZE),
+            CONFIG_MAX_LIGHT_COUNT };
+    mLightList = {
+            arena.allocate<RecordBufferType>(CONFIG_MAX_LIGHT_COUNT, CACHELINE_SIZE),
+            CONFIG_MAX_LIGHT_COUNT };
+    mLightTree = {
+            arena.allocate<LightTreeNode>(LIGHT_TREE_NODE_COUNT_MAX, CACHELINE_SIZE),
+            LIGHT_TREE_NODE_COUNT_MAX };
+
     assert(mFroxelBufferUser.begin());
     assert(mRecordBufferUser.begin());
     assert(mLightRecords.begin());
     assert(mFroxelShardedData.begin());
+    assert(mLightParams.begin());
+    assert(mLightRanges.begin());
+    assert(mLightList.begin());
+    assert(mLightTree.begin());
 
 #ifndef NDEBUG
     memset(mFroxelBufferUser.data(),    0x55, mFroxelBufferUser.sizeInBytes());
@@ -537,7 +566,12 @@ void Froxelizer::froxelizeLights(FEngine& engine,
         CameraInfo const& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
-    froxelizeLoop(engine, camera, lightData);
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    if (lightCount > LIGHT_TREE_THRESHOLD) {
+        froxelizeLightTree(engine, camera, lightData);
+    } else {
+        froxelizeLoop(engine, camera, lightData);
+    }
     froxelizeAssignRecordsCompress();
 
 #ifndef NDEBUG
@@ -569,17 +603,30 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     SYSTRACE_CALL();
 
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+
+    // only the froxels in use need to be cleared, the remaining entries are never read
     Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    for (FroxelThreadData& threadData : froxelThreadData) {
+        memset(threadData.data(), 0, (getFroxelCount() + 1) * sizeof(LightGroupType));
+    }
 
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
 
+    // The type of each light is recorded upfront, because several jobs can work on the
+    // same group of lights (see below).
+    for (size_t i = 0; i < lightCount; i++) {
+        const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+        const bool isSpot = lcm.getSinInverse(instances[j]) != std::numeric_limits<float>::infinity();
+        froxelThreadData[i % GROUP_COUNT][0] |= LightGroupType(isSpot) << (i / GROUP_COUNT);
+    }
+
     auto process = [ this, &froxelThreadData,
                      spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
+            (size_t count, size_t offset, size_t stride, size_t zbegin, size_t zend) {
 
         const mat4f& projection = mProjection;
         const mat3f& vn = camera.view.upperLeft();
@@ -599,31 +646,129 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
             const size_t bit   = i / GROUP_COUNT;
             assert(bit < LIGHT_PER_GROUP);
 
-            FroxelThreadData& threadData = froxelThreadData[group];
-            const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
-            threadData[0] |= isSpot << bit;
-            froxelizePointAndSpotLight(threadData, bit, projection, light);
+            froxelizePointAndSpotLight(froxelThreadData[group], bit, zbegin, zend,
+                    projection, light);
         }
     };
 
-    // we do 64 lights per job
+    // With many lights, one job per group doesn't keep all the cores busy, so each group is
+    // further split in ranges of Z slices. Jobs working on the same group write to disjoint
+    // froxels, because each froxel belongs to a single slice.
+    const size_t sliceGroupCount = std::max(size_t(1),
+            std::min(SLICE_GROUP_COUNT, lightCount / (GROUP_COUNT * LIGHT_PER_SLICE_GROUP)));
+    const size_t sliceCount = mFroxelCountZ;
+
     JobSystem& js = engine.getJobSystem();
 
     constexpr bool SINGLE_THREADED = false;
     if (!SINGLE_THREADED) {
         auto parent = js.createJob();
-        for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+        // groups past the light count are empty
+        for (size_t i = 0, c = std::min(lightCount, GROUP_COUNT); i < c; i++) {
+            for (size_t k = 0; k < sliceGroupCount; k++) {
+                js.run(jobs::createJob(js, parent, std::cref(process), lightCount, i, GROUP_COUNT,
+                        (k * sliceCount) / sliceGroupCount, ((k + 1) * sliceCount) / sliceGroupCount));
+            }
         }
         js.runAndWait(parent);
     } else {
         js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
+                lightCount, 0, 1, 0, sliceCount)
         );
     }
 }
 
+void Froxelizer::froxelizeLightTree(FEngine& engine,
+        const CameraInfo& UTILS_RESTRICT camera,
+        const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+    SYSTRACE_CALL();
+
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    assert(lightCount <= CONFIG_MAX_LIGHT_COUNT);
+
+    // only the froxels in use need to be cleared, the remaining entries are never read
+    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
+    for (FroxelThreadData& threadData : froxelThreadData) {
+        memset(threadData.data(), 0, (getFroxelCount() + 1) * sizeof(LightGroupType));
+    }
+
+    auto& lcm = engine.getLightManager();
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+
+    LightParams* const UTILS_RESTRICT params = mLightParams.data();
+    float2* const UTILS_RESTRICT zrange = mLightRanges.data();
+    RecordBufferType* const UTILS_RESTRICT lightList = mLightList.data();
+
+    // Lights are transformed to view-space once, and the range of Z slices they cover is
+    // computed the same way froxelizePointAndSpotLight() does.
+    const mat3f& vn = camera.view.upperLeft();
+    for (size_t i = 0; i < lightCount; i++) {
+        const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+        FLightManager::Instance li = instances[j];
+        LightParams const light = {
+                .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
+                .cosSqr = lcm.getCosOuterSquared(li),   // spot only
+                .axis = vn * directions[j],             // spot only
+                .invSin = lcm.getSinInverse(li),        // spot only
+                .radius = spheres[j].w,
+        };
+        params[i] = light;
+
+        const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
+        froxelThreadData[i % GROUP_COUNT][0] |= LightGroupType(isSpot) << (i / GROUP_COUNT);
+
+        if (UTILS_UNLIKELY(light.position.z + light.radius < -mZLightFar)) {
+            // this light doesn't light anything, give it an empty range
+            zrange[i] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        } else {
+            const float znear = std::min(-mNear, light.position.z + light.radius);
+            const float zfar  = light.position.z - light.radius;
+            zrange[i] = { float(findSliceZ(znear)), float(findSliceZ(zfar)) };
+        }
+        lightList[i] = RecordBufferType(i);
+    }
+
+    // sorting the lights by their first slice keeps the ranges of the tree nodes tight
+    std::sort(lightList, lightList + lightCount,
+            [zrange](RecordBufferType lhs, RecordBufferType rhs) {
+                return zrange[lhs].x < zrange[rhs].x;
+            });
+
+    LightTreeNode* const UTILS_RESTRICT lightTree = mLightTree.data();
+    const size_t nodeCount = computeLightTree(lightTree,
+            { lightList, lightCount }, zrange, 0);
+    assert(nodeCount <= mLightTree.size());
+
+    // Each job processes a single Z slice and walks the tree to only visit the lights
+    // overlapping it. Jobs write to disjoint froxels, because each froxel belongs to a
+    // single slice.
+    auto process = [ this, &froxelThreadData, lightTree, nodeCount, lightList, params ]
+            (size_t iz) {
+        const mat4f& projection = mProjection;
+        const float z = float(iz);
+        for (size_t n = 0; n < nodeCount;) {
+            LightTreeNode const& node = lightTree[n];
+            const bool overlaps = node.min <= z && z <= node.max;
+            if (overlaps && node.isLeaf) {
+                const size_t i = lightList[node.offset];
+                froxelizePointAndSpotLight(froxelThreadData[i % GROUP_COUNT], i / GROUP_COUNT,
+                        iz, iz + 1, projection, params[i]);
+            }
+            // skip the whole subtree when it doesn't overlap this slice
+            n = (overlaps && !node.isLeaf) ? n + 1 : node.next;
+        }
+    };
+
+    JobSystem& js = engine.getJobSystem();
+    auto parent = js.createJob();
+    for (size_t iz = 0, c = mFroxelCountZ; iz < c; iz++) {
+        js.run(jobs::createJob(js, parent, std::cref(process), iz));
+    }
+    js.runAndWait(parent);
+}
+
 void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 
     SYSTRACE_CALL();
@@ -648,7 +793,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 
     // this gets very well vectorized...
     utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 1, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
+    for (size_t j = 1, jc = getFroxelCount() + 1; j < jc; j++) {
         for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
             using container_type = LightRecord::bitset::container_type;
             constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
@@ -660,10 +805,11 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         }
     }
 
-    uint16_t offset = 0;
+    uint32_t offset = 0;
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
     const size_t froxelCountX = mFroxelCountX;
+    const size_t froxelSliceStride = froxelCountX * mFroxelCountY;
     auto remap = [stride = size_t(froxelCountX * mFroxelCountY)](size_t i) -> size_t {
         if (SUPPORTS_REMAPPED_FROXELS) {
             // TODO: with the non-square froxel change these would be mask ops instead of divide.
@@ -680,15 +826,15 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
     for (size_t i = 0, c = getFroxelCount(); i < c;) {
         LightRecord b = records[i];
         if (b.lights.none()) {
-            froxels[remap(i++)].u32 = 0;
+            froxels[remap(i++)].u64 = 0;
             continue;
         }
 
-        // We have a limitation of 255 spot + 255 point lights per froxel.
+        // the counts are 16 bits, which holds all CONFIG_MAX_LIGHT_COUNT lights
         FroxelEntry entry = {
                 .offset = offset,
-                .pointLightCount = (uint8_t)std::min(size_t(255), (b.lights & ~spotLights).count()),
-                .spotLightCount  = (uint8_t)std::min(size_t(255), (b.lights &  spotLights).count())
+                .pointLightCount = (uint16_t)(b.lights & ~spotLights).count(),
+                .spotLightCount  = (uint16_t)(b.lights &  spotLights).count()
         };
         const size_t lightCount = entry.count[0] + entry.count[1];
 
@@ -699,7 +845,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
             // note: instead of dropping froxels we could look for similar records we've already
             // filed up.
             do { // this compiles to memset() when remap() is identity
-                froxels[remap(i++)].u32 = 0;
+                froxels[remap(i++)].u64 = 0;
             } while(i < c);
             goto out_of_memory;
         }
@@ -707,23 +853,18 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         // iterate the bitfield
         auto beginPoint = froxelRecords + offset;
         auto beginSpot  = froxelRecords + offset + entry.count[0];
-        b.lights.forEachSetBit([&spotLights,
-                point = beginPoint, spot = beginSpot, beginPoint, beginSpot]
+        b.lights.forEachSetBit([&spotLights, point = beginPoint, spot = beginSpot]
                 (size_t l) mutable {
 
             // make sure to keep this code branch-less
             const bool isSpot = spotLights[l];
-            auto& p = isSpot ? spot      : point;
-            auto  s = isSpot ? beginSpot : beginPoint;
+            auto& p = isSpot ? spot : point;
 
             const size_t word = l / LIGHT_PER_GROUP;
             const size_t bit  = l % LIGHT_PER_GROUP;
             l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
 
-            *p = (RecordBufferType)l;
-            // we need to "cancel" the write if we have more than 255 spot or point lights
-            // (this is a limitation of the data type used to store the light counts per froxel)
-            p += (p - s < 255) ? 1 : 0;
+            *p++ = (RecordBufferType)l;
         });
 
         offset += lightCount;
@@ -735,7 +876,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 #ifndef NDEBUG
             if (lightCount) { reused++; }
 #endif
-            froxels[remap(i++)].u32 = entry.u32;
+            froxels[remap(i++)].u64 = entry.u64;
             if (i >= c) break;
 
             if (records[i].lights != b.lights && i >= froxelCountX) {
@@ -743,7 +884,13 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
                 // we re-try with the record above it, which saves many froxel records
                 // (north of 10% in practice).
                 b = records[i - froxelCountX];
-                entry.u32 = froxels[remap(i - froxelCountX)].u32;
+                entry.u64 = froxels[remap(i - froxelCountX)].u64;
+            }
+            if (records[i].lights != b.lights && i >= froxelSliceStride) {
+                // and then with the record in the previous slice, lights that span several
+                // slices often cover the same froxels in each of them.
+                b = records[i - froxelSliceStride];
+                entry.u64 = froxels[remap(i - froxelSliceStride)].u64;
             }
         } while(records[i].lights == b.lights);
     }
@@ -774,7 +921,7 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
 }
 
 void Froxelizer::froxelizePointAndSpotLight(
-        FroxelThreadData& froxelThread, size_t bit,
+        FroxelThreadData& froxelThread, size_t bit, size_t zbegin, size_t zend,
         mat4f const& UTILS_RESTRICT p,
         const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
 
@@ -793,8 +940,8 @@ void Froxelizer::froxelizePointAndSpotLight(
     const size_t x1 = mFroxelCountX;
     const size_t y0 = 0;
     const size_t y1 = mFroxelCountY - 1;
-    const size_t z0 = 0;
-    const size_t z1 = mFroxelCountZ - 1;
+    const size_t z0 = zbegin;
+    const size_t z1 = zend - 1;
 #else
     // find a reasonable bounding-box in froxel space for the sphere by projecting
     // it's (clipped) bounding-box to clip-space and converting to froxel indices.
@@ -802,6 +949,13 @@ void Froxelizer::froxelizePointAndSpotLight(
     const float znear = std::min(-mNear, aabb.center.z + aabb.halfExtent.z); // z values are negative
     const float zfar  =                  aabb.center.z - aabb.halfExtent.z;
 
+    // only the slices in [zbegin, zend) are processed by this call
+    const size_t z0 = std::max(findSliceZ(znear), zbegin);
+    const size_t z1 = std::min(findSliceZ(zfar), zend - 1); // z1 points to the last value
+    if (z0 > z1) {
+        return;
+    }
+
     float2 xyLeftNear  = project(p, { aabb.center.xy - aabb.halfExtent.xy, znear });
     float2 xyLeftFar   = project(p, { aabb.center.xy - aabb.halfExtent.xy, zfar  });
     float2 xyRightNear = project(p, { aabb.center.xy + aabb.halfExtent.xy, znear });
@@ -816,12 +970,10 @@ void Froxelizer::froxelizePointAndSpotLight(
     const auto imin = clipToIndices(min(xyLeftNear, xyLeftFar));
     const size_t x0 = imin.first;
     const size_t y0 = imin.second;
-    const size_t z0 = findSliceZ(znear);
 
     const auto imax = clipToIndices(max(xyRightNear, xyRightFar));
     const size_t x1 = imax.first  + 1;  // x1 points to 1 past the last value (like end() does
     const size_t y1 = imax.second;      // y1 points to the last value
-    const size_t z1 = findSliceZ(zfar); // z1 points to the last value
 
     assert(x0 < x1);
     assert(y0 <= y1);
@@ -854,23 +1006,11 @@ void Froxelizer::froxelizePointAndSpotLight(
                     cy = spherePlaneIntersection(cz, plane.y, plane.z);
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
-                    size_t bx, ex; // horizontal begin/end indices
                     // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
+                    size_t bx = findFirstSpherePlaneIntersection(cy, planesX, x0, xcenter + 1);
 
                     // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
-                    ++ex;
+                    size_t ex = findLastSpherePlaneIntersection(cy, planesX, xcenter + 1, x1);
 
                     if (UTILS_UNLIKELY(bx >= ex)) {
                         continue;
@@ -882,13 +1022,10 @@ void Froxelizer::froxelizePointAndSpotLight(
                     size_t fi = getFroxelIndex(bx, iy, iz) + 1;
                     if (light.invSin != std::numeric_limits<float>::infinity()) {
                         // This is a spotlight (common case)
-                        // this loops gets vectorized (on arm64) w/ clang
-                        while (bx++ != ex) {
-                            // see if this froxel intersects the cone
-                            bool intersect = sphereConeIntersectionFast(boundingSpheres[fi - 1],
-                                    light.position, light.axis, light.invSin, light.cosSqr);
-                            froxelThread[fi++] |= LightGroupType(intersect) << bit;
-                        }
+                        // see which froxels intersect the cone, 4 or 8 at a time
+                        sphereConeIntersectionFast(boundingSpheres + fi - 1, ex - bx,
+                                light.position, light.axis, light.invSin, light.cosSqr,
+                                froxelThread.data() + fi, LightGroupType(1) << bit);
                     } else {
                         // this loops gets vectorized (on arm64) w/ clang
                         while (bx++ != ex) {
@@ -905,13 +1042,15 @@ void Froxelizer::froxelizePointAndSpotLight(
  *
  * lightTree            output the light tree structure there (must be large enough to hold a complete tree)
  * lightList            list if lights
- * lightData            scene's light data SoA
+ * zrange               z-range of each light, indexed by the entries of lightList
  * lightRecordsOffset   offset in the record buffer where to find the light list
+ *
+ * returns the number of nodes in the tree
  */
-void Froxelizer::computeLightTree(
+size_t Froxelizer::computeLightTree(
         LightTreeNode* lightTree,
         utils::Slice<RecordBufferType> const& lightList,
-        const FScene::LightSoa& lightData,
+        float2 const* UTILS_RESTRICT zrange,
         size_t lightRecordsOffset) noexcept {
 
     // number of lights in this record
@@ -923,13 +1062,12 @@ void Froxelizer::computeLightTree(
     // height of the tree
     const size_t h = log2i(w) + 1u;
 
-    auto const* UTILS_RESTRICT zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>() + 1;
     BinaryTreeArray::traverse(h,
             [lightTree, lightRecordsOffset, zrange, indices = lightList.data(), count]
             (size_t index, size_t col, size_t next) {
-                // indices[] cannot be accessed past 'col'
-                const float min = (col < count) ? zrange[indices[col]].x : 1.0f;
-                const float max = (col < count) ? zrange[indices[col]].y : 0.0f;
+                // indices[] cannot be accessed past 'col', the padding leaves have an empty range
+                const float min = (col < count) ? zrange[indices[col]].x : std::numeric_limits<float>::max();
+                const float max = (col < count) ? zrange[indices[col]].y : std::numeric_limits<float>::lowest();
                 lightTree[index] = {
                         .min = min,
                         .max = max,
@@ -951,6 +1089,8 @@ void Froxelizer::computeLightTree(
                         .reserved = 0,
                 };
             });
+
+    return BinaryTreeArray::count(h);
 }
 
 } // namespace details
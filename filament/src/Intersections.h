@@ -17,11 +17,27 @@
 #ifndef TNT_FILAMENT_INTERSECTIONS_H
 #define TNT_FILAMENT_INTERSECTIONS_H
 
+#include <utils/algorithm.h>
 #include <utils/compiler.h>
 
 #include <math/mat4.h>
 #include <math/vec4.h>
 
+#include <stddef.h>
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#   define FILAMENT_INTERSECTIONS_USE_AVX 1
+#endif
+
+#if defined(__SSE2__)
+#   include <xmmintrin.h>
+#   define FILAMENT_INTERSECTIONS_USE_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#   define FILAMENT_INTERSECTIONS_USE_NEON 1
+#endif
+
 namespace filament {
 
 // sphere radius must be squared
@@ -94,6 +110,208 @@ inline bool sphereConeIntersection(
     return false;
 }
 
+/*
+ * Batched versions of the tests above, used by the Froxelizer. They process 4 (SSE, NEON) or
+ * 8 (AVX) planes or spheres at a time, and fall back to the scalar tests for the remainder
+ * (or entirely, on other architectures). The results are bit-exact with the scalar tests,
+ * which is why the arithmetic below is done in the same order and never uses FMAs.
+ */
+
+namespace simd {
+
+#if defined(FILAMENT_INTERSECTIONS_USE_SSE)
+
+// loads 4 float4 and returns their x, y, z and w components
+inline void load4(filament::math::float4 const* UTILS_RESTRICT v,
+        __m128& x, __m128& y, __m128& z, __m128& w) noexcept {
+    x = _mm_loadu_ps(&v[0].x);
+    y = _mm_loadu_ps(&v[1].x);
+    z = _mm_loadu_ps(&v[2].x);
+    w = _mm_loadu_ps(&v[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+}
+
+// returns bit i set if spherePlaneDistanceSquared(s, planes[i].x, planes[i].z) > 0
+inline unsigned int spherePlaneIntersectionMask4(filament::math::float4 const& s,
+        filament::math::float4 const* UTILS_RESTRICT planes) noexcept {
+    __m128 px, py, pz, pw;
+    load4(planes, px, py, pz, pw);
+    const __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.x), px), _mm_mul_ps(_mm_set1_ps(s.z), pz));
+    const __m128 rr = _mm_sub_ps(_mm_set1_ps(s.w), _mm_mul_ps(d, d));
+    return unsigned(_mm_movemask_ps(_mm_cmpgt_ps(rr, _mm_setzero_ps())));
+}
+
+// returns bit i set if sphereConeIntersectionFast(spheres[i], ...) is true
+inline unsigned int sphereConeIntersectionMask4(filament::math::float4 const* UTILS_RESTRICT spheres,
+        filament::math::float3 const& conePosition, filament::math::float3 const& coneAxis,
+        float coneSinInverse, float coneCosSquared) noexcept {
+    __m128 sx, sy, sz, sw;
+    load4(spheres, sx, sy, sz, sw);
+    const __m128 ax = _mm_set1_ps(coneAxis.x);
+    const __m128 ay = _mm_set1_ps(coneAxis.y);
+    const __m128 az = _mm_set1_ps(coneAxis.z);
+    const __m128 k = _mm_mul_ps(sw, _mm_set1_ps(coneSinInverse));
+    const __m128 dx = _mm_sub_ps(sx, _mm_sub_ps(_mm_set1_ps(conePosition.x), _mm_mul_ps(k, ax)));
+    const __m128 dy = _mm_sub_ps(sy, _mm_sub_ps(_mm_set1_ps(conePosition.y), _mm_mul_ps(k, ay)));
+    const __m128 dz = _mm_sub_ps(sz, _mm_sub_ps(_mm_set1_ps(conePosition.z), _mm_mul_ps(k, az)));
+    const __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, dx), _mm_mul_ps(ay, dy)), _mm_mul_ps(az, dz));
+    const __m128 dd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    const __m128 r = _mm_and_ps(
+            _mm_cmpge_ps(_mm_mul_ps(e, e), _mm_mul_ps(dd, _mm_set1_ps(coneCosSquared))),
+            _mm_cmpgt_ps(e, _mm_setzero_ps()));
+    return unsigned(_mm_movemask_ps(r));
+}
+
+#elif defined(FILAMENT_INTERSECTIONS_USE_NEON)
+
+// returns the 4 lanes of a comparison result as 4 bits
+inline unsigned int movemask(uint32x4_t m) noexcept {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(m, bits));
+}
+
+// returns bit i set if spherePlaneDistanceSquared(s, planes[i].x, planes[i].z) > 0
+inline unsigned int spherePlaneIntersectionMask4(filament::math::float4 const& s,
+        filament::math::float4 const* UTILS_RESTRICT planes) noexcept {
+    const float32x4x4_t p = vld4q_f32(&planes[0].x);
+    const float32x4_t d = vaddq_f32(vmulq_n_f32(p.val[0], s.x), vmulq_n_f32(p.val[2], s.z));
+    const float32x4_t rr = vsubq_f32(vdupq_n_f32(s.w), vmulq_f32(d, d));
+    return movemask(vcgtq_f32(rr, vdupq_n_f32(0.0f)));
+}
+
+// returns bit i set if sphereConeIntersectionFast(spheres[i], ...) is true
+inline unsigned int sphereConeIntersectionMask4(filament::math::float4 const* UTILS_RESTRICT spheres,
+        filament::math::float3 const& conePosition, filament::math::float3 const& coneAxis,
+        float coneSinInverse, float coneCosSquared) noexcept {
+    const float32x4x4_t s = vld4q_f32(&spheres[0].x);
+    const float32x4_t k = vmulq_n_f32(s.val[3], coneSinInverse);
+    const float32x4_t dx = vsubq_f32(s.val[0], vsubq_f32(vdupq_n_f32(conePosition.x), vmulq_n_f32(k, coneAxis.x)));
+    const float32x4_t dy = vsubq_f32(s.val[1], vsubq_f32(vdupq_n_f32(conePosition.y), vmulq_n_f32(k, coneAxis.y)));
+    const float32x4_t dz = vsubq_f32(s.val[2], vsubq_f32(vdupq_n_f32(conePosition.z), vmulq_n_f32(k, coneAxis.z)));
+    const float32x4_t e = vaddq_f32(vaddq_f32(vmulq_n_f32(dx, coneAxis.x), vmulq_n_f32(dy, coneAxis.y)),
+            vmulq_n_f32(dz, coneAxis.z));
+    const float32x4_t dd = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+    const uint32x4_t r = vandq_u32(
+            vcgeq_f32(vmulq_f32(e, e), vmulq_n_f32(dd, coneCosSquared)),
+            vcgtq_f32(e, vdupq_n_f32(0.0f)));
+    return movemask(r);
+}
+
+#endif
+
+#if defined(FILAMENT_INTERSECTIONS_USE_AVX)
+
+// returns bit i set if sphereConeIntersectionFast(spheres[i], ...) is true
+inline unsigned int sphereConeIntersectionMask8(filament::math::float4 const* UTILS_RESTRICT spheres,
+        filament::math::float3 const& conePosition, filament::math::float3 const& coneAxis,
+        float coneSinInverse, float coneCosSquared) noexcept {
+    __m128 x0, y0, z0, w0, x1, y1, z1, w1;
+    load4(spheres + 0, x0, y0, z0, w0);
+    load4(spheres + 4, x1, y1, z1, w1);
+    const __m256 sx = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+    const __m256 sy = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+    const __m256 sz = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+    const __m256 sw = _mm256_insertf128_ps(_mm256_castps128_ps256(w0), w1, 1);
+    const __m256 ax = _mm256_set1_ps(coneAxis.x);
+    const __m256 ay = _mm256_set1_ps(coneAxis.y);
+    const __m256 az = _mm256_set1_ps(coneAxis.z);
+    const __m256 k = _mm256_mul_ps(sw, _mm256_set1_ps(coneSinInverse));
+    const __m256 dx = _mm256_sub_ps(sx, _mm256_sub_ps(_mm256_set1_ps(conePosition.x), _mm256_mul_ps(k, ax)));
+    const __m256 dy = _mm256_sub_ps(sy, _mm256_sub_ps(_mm256_set1_ps(conePosition.y), _mm256_mul_ps(k, ay)));
+    const __m256 dz = _mm256_sub_ps(sz, _mm256_sub_ps(_mm256_set1_ps(conePosition.z), _mm256_mul_ps(k, az)));
+    const __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, dx), _mm256_mul_ps(ay, dy)),
+            _mm256_mul_ps(az, dz));
+    const __m256 dd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+            _mm256_mul_ps(dz, dz));
+    const __m256 r = _mm256_and_ps(
+            _mm256_cmp_ps(_mm256_mul_ps(e, e),
+                    _mm256_mul_ps(dd, _mm256_set1_ps(coneCosSquared)), _CMP_GE_OQ),
+            _mm256_cmp_ps(e, _mm256_setzero_ps(), _CMP_GT_OQ));
+    return unsigned(_mm256_movemask_ps(r));
+}
+
+#endif
+
+} // namespace simd
+
+// Returns the index of the first plane in [begin, end) intersecting the sphere, or end.
+// Same requirements as spherePlaneDistanceSquared().
+inline size_t findFirstSpherePlaneIntersection(filament::math::float4 const& s,
+        filament::math::float4 const* UTILS_RESTRICT planes, size_t begin, size_t end) noexcept {
+    size_t i = begin;
+#if defined(FILAMENT_INTERSECTIONS_USE_SSE) || defined(FILAMENT_INTERSECTIONS_USE_NEON)
+    for (; i + 4 <= end; i += 4) {
+        const unsigned int m = simd::spherePlaneIntersectionMask4(s, planes + i);
+        if (m) {
+            return i + utils::ctz(m);
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (spherePlaneDistanceSquared(s, planes[i].x, planes[i].z) > 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Returns one past the index of the last plane in [begin, end) intersecting the sphere,
+// or begin. Same requirements as spherePlaneDistanceSquared().
+inline size_t findLastSpherePlaneIntersection(filament::math::float4 const& s,
+        filament::math::float4 const* UTILS_RESTRICT planes, size_t begin, size_t end) noexcept {
+    size_t i = end;
+#if defined(FILAMENT_INTERSECTIONS_USE_SSE) || defined(FILAMENT_INTERSECTIONS_USE_NEON)
+    for (; i >= begin + 4; i -= 4) {
+        const unsigned int m = simd::spherePlaneIntersectionMask4(s, planes + i - 4);
+        if (m) {
+            return i - 4 + (32 - utils::clz(m));
+        }
+    }
+#endif
+    for (; i > begin; --i) {
+        if (spherePlaneDistanceSquared(s, planes[i - 1].x, planes[i - 1].z) > 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+// Sets the bits of mask in results[i] for each of the count spheres intersecting the cone.
+// Same requirements as sphereConeIntersectionFast().
+template<typename T>
+inline void sphereConeIntersectionFast(
+        filament::math::float4 const* UTILS_RESTRICT spheres, size_t count,
+        filament::math::float3 const& conePosition,
+        filament::math::float3 const& coneAxis,
+        float coneSinInverse,
+        float coneCosSquared,
+        T* UTILS_RESTRICT results, T mask) noexcept {
+    size_t i = 0;
+#if defined(FILAMENT_INTERSECTIONS_USE_AVX)
+    for (; i + 8 <= count; i += 8) {
+        const unsigned int m = simd::sphereConeIntersectionMask8(spheres + i,
+                conePosition, coneAxis, coneSinInverse, coneCosSquared);
+        for (size_t k = 0; k < 8; k++) {
+            results[i + k] |= mask & -T((m >> k) & 1u);
+        }
+    }
+#endif
+#if defined(FILAMENT_INTERSECTIONS_USE_SSE) || defined(FILAMENT_INTERSECTIONS_USE_NEON)
+    for (; i + 4 <= count; i += 4) {
+        const unsigned int m = simd::sphereConeIntersectionMask4(spheres + i,
+                conePosition, coneAxis, coneSinInverse, coneCosSquared);
+        for (size_t k = 0; k < 4; k++) {
+            results[i + k] |= mask & -T((m >> k) & 1u);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        const bool intersect = sphereConeIntersectionFast(spheres[i],
+                conePosition, coneAxis, coneSinInverse, coneCosSquared);
+        results[i] |= mask & -T(intersect);
+    }
+}
+
 } // namespace filament
 
 #endif //TNT_FILAMENT_INTERSECTIONS_H
@@ -118,6 +118,10 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
         : mEngine(engine),
           mMaterialId(engine.getMaterialId())
 {
+    for (auto& program : mCachedPrograms) {
+        program.store(HandleBase::nullid, std::memory_order_relaxed);
+    }
+
     MaterialParser* parser = builder->mMaterialParser;
     mMaterialParser = parser;
 
@@ -227,10 +231,10 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
 
     // pre-cache the shared variants -- these variants are shared with the default material.
     if (UTILS_UNLIKELY(!mIsDefaultMaterial && !mHasCustomDepthShader)) {
-        auto& cachedPrograms = mCachedPrograms;
-        for (uint8_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
-            if (Variant(i).isDepthPass()) {
-                cachedPrograms[i] = engine.getDefaultMaterial()->getProgram(i);
+        for (uint8_t i = 0, n = uint8_t(mCachedPrograms.size()); i < n; ++i) {
+            if (isSharedVariant(i)) {
+                setCachedProgram(i,
+                        engine.getDefaultMaterial()->getProgram(engine.getDriverApi(), i));
             }
         }
     }
@@ -251,18 +255,15 @@ FMaterial::~FMaterial() noexcept {
 
 void FMaterial::terminate(FEngine& engine) {
     DriverApi& driverApi = engine.getDriverApi();
-    auto& cachedPrograms = mCachedPrograms;
-    for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
-        if (!mIsDefaultMaterial) {
-            // The depth variants may be shared with the default material, in which case
-            // we should not free it now.
-            bool isSharedVariant = Variant(i).isDepthPass() && !mHasCustomDepthShader;
-            if (isSharedVariant) {
-                // we don't own this variant, skip.
-                continue;
-            }
+    for (size_t i = 0, n = mCachedPrograms.size(); i < n; ++i) {
+        if (isSharedVariant(uint8_t(i))) {
+            // we don't own this variant, skip.
+            continue;
         }
-        driverApi.destroyProgram(cachedPrograms[i]);
+        driverApi.destroyProgram(getCachedProgram(uint8_t(i)));
+    }
+    for (Handle<HwProgram> program : mPendingPrograms) {
+        driverApi.destroyProgram(program);
     }
     mDefaultInstance.terminate(engine);
 }
@@ -278,10 +279,110 @@ bool FMaterial::hasParameter(const char* name) const noexcept {
     return true;
 }
 
-Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
+Handle<HwProgram> FMaterial::getProgramSlow(DriverApi& driver,
+        uint8_t variantKey) const noexcept {
+    assert(!Variant::isReserved(variantKey));
+
+    std::lock_guard<utils::Mutex> lock(mProgramLock);
+
+    // another thread may have cached this program while we were waiting for the lock
+    Handle<HwProgram> const cached = getCachedProgram(variantKey);
+    if (cached) {
+        return cached;
+    }
+
+    Handle<HwProgram>& pending = mPendingPrograms[variantKey];
+    if (!pending) {
+        pending = createProgram(driver, variantKey, true);
+        mPendingProgramCount++;
+    }
+
+    if (!driver.isProgramReady(pending)) {
+        // while this variant compiles, use one that's ready if we can (e.g. without shadows)
+        Handle<HwProgram> fallback = getFallbackProgram(variantKey);
+        if (fallback) {
+            return fallback;
+        }
+        // otherwise the driver will wait for this program to be ready
+    }
+
+    Handle<HwProgram> program = pending;
+    pending.clear();
+    mPendingProgramCount--;
+    setCachedProgram(variantKey, program);
+    return program;
+}
+
+Handle<HwProgram> FMaterial::getFallbackProgram(uint8_t variantKey) const noexcept {
+    if (Variant(variantKey).isDepthPass()) {
+        return {};
+    }
+    // try the variants with fewer lighting features, but never drop skinning
+    const uint8_t lighting = variantKey & Variant::FRAGMENT_MASK;
+    const uint8_t others = variantKey & ~Variant::FRAGMENT_MASK;
+    for (uint8_t sub = uint8_t((lighting - 1) & lighting); ; sub = uint8_t((sub - 1) & lighting)) {
+        const uint8_t key = others | sub;
+        if (key != variantKey && !Variant::isReserved(key) && !Variant(key).isDepthPass()) {
+            Handle<HwProgram> const cached = getCachedProgram(key);
+            if (cached) {
+                return cached;
+            }
+        }
+        if (!sub) {
+            break;
+        }
+    }
+    return {};
+}
+
+void FMaterial::compile(UserVariantFilterMask variants) noexcept {
+    DriverApi& driver = mEngine.getDriverApi();
+    std::lock_guard<utils::Mutex> lock(mProgramLock);
+    for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+        if (Variant::isReserved(k) || Variant::filterVariant(k, mIsVariantLit) != k) {
+            // this variant is never used by this material
+            continue;
+        }
+        // the depth variants are selected by their non-depth bits (i.e. skinning)
+        const uint8_t userKey = Variant(k).isDepthPass() ? uint8_t(k & ~Variant::DEPTH_VARIANT) : k;
+        if (userKey & ~variants) {
+            continue;
+        }
+        if (getCachedProgram(k) || mPendingPrograms[k]) {
+            continue;
+        }
+        // the material may not include all variants, in which case it's not an error here
+        Handle<HwProgram> program = createProgram(driver, k, false);
+        if (program) {
+            mPendingPrograms[k] = program;
+            mPendingProgramCount++;
+        }
+    }
+}
+
+uint32_t FMaterial::updatePendingPrograms() const noexcept {
+    std::lock_guard<utils::Mutex> lock(mProgramLock);
+    if (UTILS_LIKELY(!mPendingProgramCount)) {
+        return 0;
+    }
+    DriverApi& driverApi = mEngine.getDriverApi();
+    auto& pendingPrograms = mPendingPrograms;
+    for (size_t i = 0, n = pendingPrograms.size(); i < n; ++i) {
+        if (pendingPrograms[i] && driverApi.isProgramReady(pendingPrograms[i])) {
+            setCachedProgram(uint8_t(i), pendingPrograms[i]);
+            pendingPrograms[i].clear();
+            mPendingProgramCount--;
+        }
+    }
+    return mPendingProgramCount;
+}
+
+Handle<HwProgram> FMaterial::createProgram(DriverApi& driver,
+        uint8_t variantKey, bool required) const noexcept {
     const ShaderModel sm = mEngine.getDriver().getShaderModel();
 
-    assert(!Variant::isReserved(variantKey));
+    // the shader builders are shared by all materials
+    std::lock_guard<utils::Mutex> lock(mEngine.getShaderBuilderLock());
 
     uint8_t vertexVariantKey = Variant::filterVariantVertex(variantKey);
     uint8_t fragmentVariantKey = Variant::filterVariantFragment(variantKey);
@@ -292,9 +393,13 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
 
     filaflat::ShaderBuilder& vsBuilder = mEngine.getVertexShaderBuilder();
 
-    UTILS_UNUSED_IN_RELEASE bool vsOK = mMaterialParser->getShader(sm,
+    bool vsOK = mMaterialParser->getShader(sm,
             vertexVariantKey, ShaderType::VERTEX, vsBuilder);
 
+    if (!required && !(vsOK && vsBuilder.size() > 0)) {
+        return {};
+    }
+
     ASSERT_POSTCONDITION(vsOK && vsBuilder.size() > 0,
             "The material '%s' has not been compiled to include the required "
             "GLSL or SPIR-V chunks for the vertex shader (variant=0x%x, filtered=0x%x).",
@@ -306,9 +411,13 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
 
     filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
 
-    UTILS_UNUSED_IN_RELEASE bool fsOK = mMaterialParser->getShader(sm,
+    bool fsOK = mMaterialParser->getShader(sm,
             fragmentVariantKey, ShaderType::FRAGMENT, fsBuilder);
 
+    if (!required && !(fsOK && fsBuilder.size() > 0)) {
+        return {};
+    }
+
     ASSERT_POSTCONDITION(fsOK && fsBuilder.size() > 0,
             "The material '%s' has not been compiled to include the required "
             "GLSL or SPIR-V chunks for the fragment shader (variant=0x%x, filterer=0x%x).",
@@ -322,6 +431,7 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
             .addUniformBlock(BindingPoints::PER_VIEW, &UibGenerator::getPerViewUib())
             .addUniformBlock(BindingPoints::LIGHTS, &UibGenerator::getLightsUib())
             .addUniformBlock(BindingPoints::PER_RENDERABLE, &UibGenerator::getPerRenderableUib())
+            .addUniformBlock(BindingPoints::PER_RENDERABLE_INSTANCES, &UibGenerator::getPerRenderableInstancesUib())
             .addUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mUniformInterfaceBlock)
             .addSamplerBlock(BindingPoints::PER_VIEW, &SibGenerator::getPerViewSib())
             .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock);
@@ -330,10 +440,8 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
         pb.addUniformBlock(BindingPoints::PER_RENDERABLE_BONES, &UibGenerator::getPerRenderableBonesUib());
     }
 
-    auto program = mEngine.getDriverApi().createProgram(std::move(pb));
+    auto program = driver.createProgram(std::move(pb));
     assert(program);
-
-    mCachedPrograms[variantKey] = program;
     return program;
 }
 
@@ -379,6 +487,10 @@ MaterialInstance* Material::createInstance() const noexcept {
     return upcast(this)->createInstance();
 }
 
+void Material::compile(UserVariantFilterMask variants) noexcept {
+    upcast(this)->compile(variants);
+}
+
 const char* Material::getName() const noexcept {
     return upcast(this)->getName().c_str();
 }
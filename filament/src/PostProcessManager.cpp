@@ -38,8 +38,6 @@ void PostProcessManager::init(FEngine& engine) noexcept {
 
     mCommands.reserve(8);
 
-    mPostProcessUb = UniformBuffer(engine.getPerPostProcessUib());
-
     // create sampler for post-process FBO
     DriverApi& driver = engine.getDriverApi();
     mPostProcessSbh = driver.createSamplerBuffer(engine.getPostProcessSib().getSize());
@@ -54,10 +52,10 @@ void PostProcessManager::terminate(driver::DriverApi& driver) noexcept {
     driver.destroyUniformBuffer(mPostProcessUbh);
 }
 
-void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeight,
+void PostProcessManager::setSource(DriverApi& driver,
+        uint32_t viewportWidth, uint32_t viewportHeight,
         Handle<HwTexture> texture, uint32_t textureWidth, uint32_t textureHeight) const noexcept {
     FEngine& engine = *mEngine;
-    DriverApi& driver = engine.getDriverApi();
 
     // FXAA requires linear filtering. The post-processing stage however, doesn't
     // use samplers.
@@ -70,7 +68,8 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     auto duration = engine.getEngineTime();
     float fraction = (duration.count() % 1000000000) / 1000000000.0f;
 
-    UniformBuffer& ub = mPostProcessUb;
+    // the passes can be recorded concurrently, so each has its own copy of the uniforms
+    UniformBuffer ub(engine.getPerPostProcessUib());
     ub.setUniform(offsetof(PostProcessingUib, time), fraction);
     ub.setUniform(offsetof(PostProcessingUib, uvScale),
             filament::math::float2{ viewportWidth, viewportHeight } / filament::math::float2{ textureWidth, textureHeight });
@@ -139,7 +138,7 @@ void PostProcessManager::finish(driver::TargetBufferFlags discarded,
 
         if (commands[i].program) {
             // set the source for this pass (i.e. previous target)
-            setSource(params.viewport.width, params.viewport.height, previous->texture, previous->w, previous->h);
+            setSource(driver, params.viewport.width, params.viewport.height, previous->texture, previous->w, previous->h);
 
             // draw a full screen triangle
             pipeline.program = commands[i].program;
@@ -169,7 +168,7 @@ void PostProcessManager::finish(driver::TargetBufferFlags discarded,
         params.viewport.width = vp.width;
         params.viewport.height = vp.height;
 
-        setSource(params.viewport.width, params.viewport.height, previous->texture, previous->w, previous->h);
+        setSource(driver, params.viewport.width, params.viewport.height, previous->texture, previous->w, previous->h);
         pipeline.program = commands.back().program;
         driver.beginRenderPass(viewRenderTarget, params);
         driver.draw(pipeline, fullScreenRenderPrimitive);
@@ -260,7 +259,7 @@ FrameGraphResource PostProcessManager::toneMapping(FrameGraph& fg,
                 auto const& targetDesc = resources.getDescriptor(data.output);
                 auto const& textureDesc = resources.getDescriptor(data.input);
                 auto const& texture = resources.getTexture(data.input);
-                setSource(targetDesc.width, targetDesc.height, texture, textureDesc.width, textureDesc.height);
+                setSource(driver, targetDesc.width, targetDesc.height, texture, textureDesc.width, textureDesc.height);
 
                 auto const& target = resources.getRenderTarget(data.output);
                 driver.beginRenderPass(target.target, target.params);
@@ -311,7 +310,7 @@ FrameGraphResource PostProcessManager::fxaa(FrameGraph& fg,
                 auto const& targetDesc = resources.getDescriptor(data.output);
                 auto const& textureDesc = resources.getDescriptor(data.input);
                 auto const& texture = resources.getTexture(data.input);
-                setSource(targetDesc.width, targetDesc.height, texture, textureDesc.width, textureDesc.height);
+                setSource(driver, targetDesc.width, targetDesc.height, texture, textureDesc.width, textureDesc.height);
 
                 auto const& target = resources.getRenderTarget(data.output);
                 driver.beginRenderPass(target.target, target.params);
@@ -43,7 +43,10 @@ class PostProcessManager {
 public:
     void init(details::FEngine& engine) noexcept;
     void terminate(driver::DriverApi& driver) noexcept;
-    void setSource(uint32_t viewportWidth, uint32_t viewportHeight, Handle <HwTexture> texture,
+    // This can be called from the FrameGraph passes, which record concurrently, so it only uses
+    // the given DriverApi.
+    void setSource(driver::DriverApi& driver,
+            uint32_t viewportWidth, uint32_t viewportHeight, Handle <HwTexture> texture,
             uint32_t textureWidth, uint32_t textureHeight) const noexcept;
 
     // start() is a scam, it does nothing
@@ -89,8 +92,7 @@ private:
 
     std::vector<Command> mCommands;
 
-    // we need only one of these
-    mutable UniformBuffer mPostProcessUb;
+    // we need only one of these, each pass updates them in its own commands
     Handle<HwSamplerBuffer> mPostProcessSbh;
     Handle<HwUniformBuffer> mPostProcessUbh;
 };
@@ -16,10 +16,13 @@
 
 #include "RenderPass.h"
 
+#include "details/BonePalette.h"
 #include "details/Culler.h"
 #include "details/Material.h"
 #include "details/MaterialInstance.h"
 #include "details/RenderPrimitive.h"
+#include "details/ShadowAtlas.h"
+#include "details/ShadowCasterMasks.h"
 #include "details/ShadowMap.h"
 #include "details/View.h"
 
@@ -28,9 +31,14 @@
 
 #include <private/filament/UibGenerator.h>
 
+#include <utils/Hash.h>
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <limits>
+
+#include <string.h>
+
 using namespace utils;
 using namespace filament::math;
 
@@ -49,7 +57,7 @@ void RenderPass::render(
         FScene& scene, Range<uint32_t> vr,
         uint32_t commandTypeFlags, RenderFlags renderFlags,
         const CameraInfo& camera, filament::Viewport const& viewport,
-        GrowingSlice<Command>& commands) noexcept {
+        GrowingSlice<Command>& commands, CommandCache* cache) noexcept {
 
     SYSTRACE_CONTEXT();
 
@@ -61,6 +69,37 @@ void RenderPass::render(
     // up-to-date summed primitive counts needed for generateCommands()
     updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
 
+    // we extract camera position/forward outside of the loop, because these are not cheap.
+    const float3 cameraPosition(camera.getPosition());
+    const float3 cameraForwardVector(camera.getForwardVector());
+
+    Slice<Command> const sortedCommands = cache ?
+            generateCachedCommands(*cache, js, commandTypeFlags, soa, vr, renderFlags,
+                    cameraPosition, cameraForwardVector, commands) :
+            generateSortedCommands(js, commandTypeFlags, soa, vr, renderFlags,
+                    cameraPosition, cameraForwardVector, commands);
+
+    // Take care not to upload data within the render pass (synchronize can commit froxel data)
+    driver::DriverApi& driver = engine.getDriverApi();
+    beginRenderPass(driver, viewport, camera);
+
+    // Now, execute all commands
+    RenderPass::recordDriverCommands(driver, scene, sortedCommands);
+
+    endRenderPass(driver, viewport);
+
+    // Kick the GPU since we're done with this render target
+    driver.flush();
+    // Wake-up the driver thread
+    engine.flush();
+}
+
+/* static */
+Slice<RenderPass::Command> RenderPass::generateSortedCommands(JobSystem& js,
+        uint32_t commandTypeFlags, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        RenderFlags renderFlags, float3 cameraPosition, float3 cameraForwardVector,
+        GrowingSlice<Command>& commands) noexcept {
+
     // compute how much maximum storage we need for this pass
     uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
     // double the color pass for transparent objects that need to render twice
@@ -69,9 +108,6 @@ void RenderPass::render(
     growBy *= uint32_t(colorPass * 2 + depthPass);
     Command* const curr = commands.grow(growBy);
 
-    // we extract camera position/forward outside of the loop, because these are not cheap.
-    const float3 cameraPosition(camera.getPosition());
-    const float3 cameraForwardVector(camera.getForwardVector());
     auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
             (uint32_t startIndex, uint32_t indexCount) {
         RenderPass::generateCommands(commandTypeFlags, curr,
@@ -94,22 +130,285 @@ void RenderPass::render(
 
     { // sort all commands
         SYSTRACE_NAME("sort commands");
-        std::sort(commands.begin(), commands.end());
+        // the unused part of the command buffer is used as scratch space by the radix sort
+        Command* const scratch = commands.remain() >= commands.size() ? commands.end() : nullptr;
+        RenderPass::sortCommands(js, commands.begin(), commands.end(), scratch);
     }
 
-    // Take care not to upload data within the render pass (synchronize can commit froxel data)
-    driver::DriverApi& driver = engine.getDriverApi();
-    beginRenderPass(driver, viewport, camera);
+    return { commands.begin(), commands.end() };
+}
 
-    // Now, execute all commands
-    RenderPass::recordDriverCommands(driver, scene, commands);
+/* static */
+Slice<RenderPass::Command> RenderPass::generateCachedCommands(CommandCache& cache, JobSystem& js,
+        uint32_t commandTypeFlags, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        RenderFlags renderFlags, float3 cameraPosition, float3 cameraForwardVector,
+        GrowingSlice<Command>& commands) noexcept {
+    SYSTRACE_CALL();
 
-    endRenderPass(driver, viewport);
+    // all commands depend on the pass and the camera
+    const struct {
+        uint32_t commandTypeFlags;
+        uint32_t renderFlags;
+        float3 cameraPosition;
+        float3 cameraForwardVector;
+        uint32_t first;
+        uint32_t last;
+    } signatureData = { commandTypeFlags, renderFlags, cameraPosition, cameraForwardVector,
+            vr.first, vr.last };
+    static_assert(sizeof(signatureData) % 4 == 0, "signature must be a multiple of 4 bytes");
+    const uint32_t* const words = reinterpret_cast<const uint32_t*>(&signatureData);
+    const uint64_t signature =
+            (uint64_t(hash::murmur3(words, sizeof(signatureData) / 4, 0)) << 32) |
+            hash::murmur3(words, sizeof(signatureData) / 4, 0x9e3779b9);
+    const bool sameSignature = cache.mSignature == signature;
+    cache.mSignature = signature;
+
+    // commands identify their renderable by its row, which is stored on 16 bits
+    if (!sameSignature || vr.last > std::numeric_limits<uint16_t>::max() + 1u) {
+        // this is not a static view, don't spend any time maintaining the cache
+        cache.mRowHashes.clear();
+        cache.mCommands.clear();
+        return generateSortedCommands(js, commandTypeFlags, soa, vr, renderFlags,
+                cameraPosition, cameraForwardVector, commands);
+    }
 
-    // Kick the GPU since we're done with this render target
-    driver.flush();
-    // Wake-up the driver thread
-    engine.flush();
+    // find which renderables have changed since the last frame
+    std::vector<uint64_t>& rowHashes = cache.mNewRowHashes;
+    rowHashes.resize(vr.last);
+    auto hashWork = [&soa, &rowHashes](uint32_t startIndex, uint32_t indexCount) {
+        for (uint32_t i = startIndex, e = startIndex + indexCount; i < e; i++) {
+            rowHashes[i] = hashRenderable(soa, i);
+        }
+    };
+    auto jobHashParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
+            std::cref(hashWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT * 4, 8>());
+    js.runAndWait(jobHashParallel);
+
+    std::vector<uint8_t>& changedRows = cache.mChangedRows;
+    changedRows.assign(vr.last, 0);
+    std::vector<uint64_t> const& previousRowHashes = cache.mRowHashes;
+    size_t changedCount = 0;
+    size_t changedPrimitiveCount = 0;
+    auto const* const UTILS_RESTRICT primitives = soa.data<FScene::PRIMITIVES>();
+    for (uint32_t i : vr) {
+        const bool changed = i >= previousRowHashes.size() || previousRowHashes[i] != rowHashes[i];
+        changedRows[i] = uint8_t(changed);
+        changedCount += changed;
+        changedPrimitiveCount += changed ? primitives[i].size() : 0;
+    }
+    std::swap(cache.mRowHashes, cache.mNewRowHashes);
+
+    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
+    const size_t changedCommandCount = changedPrimitiveCount * (colorPass * 2 + depthPass);
+
+    if (cache.mCommands.empty() || changedCount > vr.size() / 4 ||
+            commands.remain() < changedCommandCount + 1) {
+        // regenerate everything and keep the result for the next frames
+        Slice<Command> sorted = generateSortedCommands(js, commandTypeFlags, soa, vr,
+                renderFlags, cameraPosition, cameraForwardVector, commands);
+        // cancelled commands are sentinels, and are sorted last
+        Command const* const last = std::partition_point(sorted.cbegin(), sorted.cend(),
+                [](Command const& c) { return c.key != uint64_t(Pass::SENTINEL); });
+        cache.mCommands.assign(sorted.cbegin(), last + 1);
+        return sorted;
+    }
+
+    if (!changedCount) {
+        // nothing to do, replay the last frame's commands
+        return { cache.mCommands.data(), cache.mCommands.size() };
+    }
+
+    // generate and sort the commands of the renderables that changed only...
+    Command* const curr = commands.grow(uint32_t(changedCommandCount + 1));
+    Command* p = curr;
+    for (uint32_t i : vr) {
+        if (changedRows[i]) {
+            generateCommandsAt(commandTypeFlags, p, soa, { i, i + 1 }, renderFlags,
+                    cameraPosition, cameraForwardVector);
+            p += primitives[i].size() * (colorPass * 2 + depthPass);
+        }
+    }
+    p->key = uint64_t(Pass::SENTINEL);
+    std::sort(curr, p + 1);
+
+    // ...and merge them with the commands of the last frame which are still valid
+    std::vector<Command>& merged = cache.mScratch;
+    merged.resize(cache.mCommands.size() + changedCommandCount + 1);
+    Command const* UTILS_RESTRICT a = cache.mCommands.data();
+    Command const* UTILS_RESTRICT b = curr;
+    Command* UTILS_RESTRICT out = merged.data();
+    while (true) {
+        while (a->key != uint64_t(Pass::SENTINEL) && changedRows[a->primitive.index]) {
+            ++a;
+        }
+        if (a->key == uint64_t(Pass::SENTINEL) && b->key == uint64_t(Pass::SENTINEL)) {
+            break;
+        }
+        *out++ = (b->key < a->key) ? *b++ : *a++;
+    }
+    *out++ = *a; // the sentinel
+    merged.resize(size_t(out - merged.data()));
+    std::swap(cache.mCommands, merged);
+
+    return { cache.mCommands.data(), cache.mCommands.size() };
+}
+
+/* static */
+uint64_t RenderPass::hashRenderable(FScene::RenderableSoa const& soa, uint32_t i) noexcept {
+    // everything generateCommands() reads for this renderable
+    struct {
+        uint32_t instance;
+        float3 worldAABBCenter;
+        uint32_t bones;
+        uint32_t instances;
+        uint32_t visibility;
+        uint32_t visibleMask;
+    } renderable = {
+            soa.elementAt<FScene::RENDERABLE_INSTANCE>(i).asValue(),
+            soa.elementAt<FScene::WORLD_AABB_CENTER>(i),
+            soa.elementAt<FScene::BONES_OFFSET>(i),
+            uint32_t(soa.elementAt<FScene::INSTANCES>(i).count) |
+                    (uint32_t(soa.elementAt<FScene::INSTANCES>(i).visibleCount) << 16),
+            0,
+            soa.elementAt<FScene::VISIBLE_MASK>(i) };
+    memcpy(&renderable.visibility, &soa.elementAt<FScene::VISIBILITY_STATE>(i),
+            sizeof(FRenderableManager::Visibility));
+
+    uint32_t h0 = hash::murmur3(reinterpret_cast<const uint32_t*>(&renderable),
+            sizeof(renderable) / 4, 0);
+    uint32_t h1 = hash::murmur3(reinterpret_cast<const uint32_t*>(&renderable),
+            sizeof(renderable) / 4, 0x9e3779b9);
+
+    // a material instance only affects the commands through its material and sorting key,
+    // the rest of its state is read when recording the driver commands
+    for (FRenderPrimitive const& primitive : soa.elementAt<FScene::PRIMITIVES>(i)) {
+        FMaterialInstance const* const mi = primitive.getMaterialInstance();
+        struct {
+            uint64_t mi;
+            uint64_t sortingKey;
+            uint32_t handle;
+            uint32_t typeAndBlendOrder;
+        } data = {
+                uint64_t(uintptr_t(mi)),
+                mi ? mi->getSortingKey() : 0,
+                primitive.getHwHandle().getId(),
+                uint32_t(primitive.getPrimitiveType()) | (uint32_t(primitive.getBlendOrder()) << 16) };
+        h0 = hash::murmur3(reinterpret_cast<const uint32_t*>(&data), sizeof(data) / 4, h0);
+        h1 = hash::murmur3(reinterpret_cast<const uint32_t*>(&data), sizeof(data) / 4, h1);
+    }
+    return (uint64_t(h0) << 32) | h1;
+}
+
+/* static */
+void RenderPass::sortCommands(JobSystem& js,
+        Command* const begin, Command* const end, Command* const scratch) noexcept {
+    const size_t count = size_t(end - begin);
+    if (!scratch || count < RADIX_SORT_MIN_COMMAND_COUNT) {
+        std::sort(begin, end);
+        return;
+    }
+
+    /*
+     * LSD radix sort with 8-bits digits. Each job processes a contiguous block of commands and
+     * scatters it in order, which keeps each pass stable.
+     *
+     * Most of the bits of the key are either reserved or constant within a pass (see the
+     * command key encoding in RenderPass.h), the digits that are the same in all keys are
+     * skipped. Sentinel keys (cancelled commands) would defeat this, so they're not accounted
+     * for and instead always placed in an extra bucket after all the others.
+     */
+
+    constexpr size_t RADIX = 256;
+    constexpr size_t SENTINEL_BUCKET = RADIX;
+    const uint32_t blockCount = uint32_t(std::min(RADIX_SORT_MAX_BLOCK_COUNT,
+            count / RADIX_SORT_BLOCK_MIN_COMMAND_COUNT));
+    const size_t blockSize = (count + blockCount - 1) / blockCount;
+
+    auto parallel = [&js, blockCount](auto const& work) {
+        auto job = jobs::parallel_for(js, nullptr, 0, blockCount,
+                std::cref(work), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+    };
+
+    // find which bits are not the same in all keys
+    const CommandKey firstKey = begin->key;
+    CommandKey varyingBits[RADIX_SORT_MAX_BLOCK_COUNT];
+    auto findVaryingBits = [=, &varyingBits](uint32_t start, uint32_t c) {
+        for (uint32_t b = start; b < start + c; b++) {
+            CommandKey bits = 0;
+            for (size_t i = b * blockSize, e = std::min(i + blockSize, count); i < e; i++) {
+                const CommandKey key = begin[i].key;
+                bits |= (key != uint64_t(Pass::SENTINEL)) ? (key ^ firstKey) : 0;
+            }
+            varyingBits[b] = bits;
+        }
+    };
+    parallel(findVaryingBits);
+
+    CommandKey varying = 0;
+    for (uint32_t b = 0; b < blockCount; b++) {
+        varying |= varyingBits[b];
+    }
+    if (!varying) {
+        // we still need one pass to move the sentinels at the end
+        varying = PASS_MASK;
+    }
+
+    uint32_t histograms[RADIX_SORT_MAX_BLOCK_COUNT][RADIX + 1];
+    Command* UTILS_RESTRICT src = begin;
+    Command* UTILS_RESTRICT dst = scratch;
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (!((varying >> shift) & (RADIX - 1))) {
+            continue;
+        }
+
+        auto digit = [shift](CommandKey key) -> size_t {
+            return key == uint64_t(Pass::SENTINEL) ? SENTINEL_BUCKET : (key >> shift) & (RADIX - 1);
+        };
+
+        auto countDigits = [=, &histograms](uint32_t start, uint32_t c) {
+            for (uint32_t b = start; b < start + c; b++) {
+                uint32_t* const UTILS_RESTRICT histogram = histograms[b];
+                std::fill_n(histogram, RADIX + 1, 0);
+                for (size_t i = b * blockSize, e = std::min(i + blockSize, count); i < e; i++) {
+                    histogram[digit(src[i].key)]++;
+                }
+            }
+        };
+        parallel(countDigits);
+
+        // turn the counts into the destination offset of each bucket for each block
+        uint32_t offset = 0;
+        for (size_t d = 0; d < RADIX + 1; d++) {
+            for (uint32_t b = 0; b < blockCount; b++) {
+                const uint32_t c = histograms[b][d];
+                histograms[b][d] = offset;
+                offset += c;
+            }
+        }
+
+        auto scatter = [=, &histograms](uint32_t start, uint32_t c) {
+            for (uint32_t b = start; b < start + c; b++) {
+                uint32_t* const UTILS_RESTRICT offsets = histograms[b];
+                for (size_t i = b * blockSize, e = std::min(i + blockSize, count); i < e; i++) {
+                    dst[offsets[digit(src[i].key)]++] = src[i];
+                }
+            }
+        };
+        parallel(scatter);
+
+        std::swap(src, dst);
+    }
+
+    if (src != begin) {
+        auto copyBack = [=](uint32_t start, uint32_t c) {
+            const size_t first = start * blockSize;
+            const size_t last = std::min((start + c) * blockSize, count);
+            std::copy(src + first, src + last, begin + first);
+        };
+        parallel(copyBack);
+    }
 }
 
 UTILS_NOINLINE // no need to be inlined
@@ -122,10 +421,21 @@ void RenderPass::recordDriverCommands(
     if (!commands.empty()) {
         Driver::PipelineState pipeline;
         Handle<HwUniformBuffer> uboHandle = scene.getRenderableUBO();
+        Handle<HwUniformBuffer> instancesUboHandle = scene.getInstancesUBO();
+        Handle<HwUniformBuffer> bonesUboHandle = scene.getBonesUBO();
+        uint32_t bonesOffset = ~0u;
+        FScene::InstancesInfo const* const UTILS_RESTRICT instances =
+                scene.getRenderableData().data<FScene::INSTANCES>();
+        constexpr size_t instancesBlockSize =
+                CONFIG_MAX_INSTANCE_COUNT * sizeof(PerRenderableUibInstance);
+
+        // all vertex shaders declare the instances block, so it must always be bound
+        driver.bindUniformBuffer(BindingPoints::PER_RENDERABLE_INSTANCES, instancesUboHandle);
+
         FMaterialInstance const* UTILS_RESTRICT mi = nullptr;
         FMaterial const* UTILS_RESTRICT ma = nullptr;
         Command const* UTILS_RESTRICT c;
-        for (c = commands.cbegin(); c->key != -1LLU; ++c) {
+        for (c = commands.cbegin(); c->key != -1LLU;) {
             /*
              * Be careful when changing code below, this is the hot inner-loop
              */
@@ -141,13 +451,51 @@ void RenderPass::recordDriverCommands(
                 mi->use(driver);
             }
 
-            pipeline.program = ma->getProgram(info.materialVariant.key);
-            size_t offset = info.index * sizeof(PerRenderableUib);
-            if (info.perRenderableBones) {
-                driver.bindUniformBuffer(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
+            pipeline.program = ma->getProgram(driver, info.materialVariant.key);
+
+            // find the run of commands that can be drawn with the same pipeline state, these
+            // only differ by their primitive and per-renderable uniforms
+            Command const* UTILS_RESTRICT last = c + 1;
+            const bool skinning = info.materialVariant.hasSkinning();
+            if (!skinning && !info.instanceCount) {
+                while (last->key != -1LLU &&
+                        last->primitive.mi == info.mi &&
+                        last->primitive.materialVariant.key == info.materialVariant.key &&
+                        last->primitive.rasterState.u == info.rasterState.u &&
+                        !last->primitive.instanceCount) {
+                    ++last;
+                }
+            }
+
+            // all the skinned renderables share the bone palette, only the range changes
+            if (UTILS_UNLIKELY(skinning && bonesOffset != info.bonesOffset)) {
+                bonesOffset = info.bonesOffset;
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE_BONES, bonesUboHandle,
+                        bonesOffset, BonePalette::BLOCK_SIZE);
             }
-            driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, sizeof(PerRenderableUib));
-            driver.draw(pipeline, info.primitiveHandle);
+
+            const size_t count = size_t(last - c);
+            if (UTILS_UNLIKELY(info.instanceCount)) {
+                size_t offset = info.index * sizeof(PerRenderableUib);
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, sizeof(PerRenderableUib));
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE_INSTANCES, instancesUboHandle,
+                        instances[info.index].offset, instancesBlockSize);
+                driver.drawInstanced(pipeline, info.primitiveHandle, info.instanceCount);
+            } else if (count == 1) {
+                size_t offset = info.index * sizeof(PerRenderableUib);
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE, uboHandle, offset, sizeof(PerRenderableUib));
+                driver.draw(pipeline, info.primitiveHandle);
+            } else {
+                Driver::BatchedDraw* const UTILS_RESTRICT draws =
+                        driver.allocatePod<Driver::BatchedDraw>(count);
+                for (size_t i = 0; i < count; i++) {
+                    draws[i].primitive = c[i].primitive.primitiveHandle;
+                    draws[i].offset = uint32_t(c[i].primitive.index * sizeof(PerRenderableUib));
+                }
+                driver.drawBatch(pipeline, BindingPoints::PER_RENDERABLE, uboHandle,
+                        sizeof(PerRenderableUib), draws, count);
+            }
+            c = last;
         }
 
         SYSTRACE_VALUE32("commandCount", c - commands.cbegin());
@@ -219,7 +567,15 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
     offset *= uint32_t(colorPass * 2 + depthPass);
-    Command* const curr = commands + offset;
+    generateCommandsAt(commandTypeFlags, commands + offset,
+            soa, range, renderFlags, cameraPosition, cameraForward);
+}
+
+/* static */
+inline
+void RenderPass::generateCommandsAt(uint32_t commandTypeFlags, Command* const curr,
+        FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+        filament::math::float3 cameraPosition, filament::math::float3 cameraForward) noexcept {
 
     /*
      *
@@ -275,7 +631,9 @@ void RenderPass::generateCommandsImpl(uint32_t,
     auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaBonesOffset     = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaInstances       = soa.data<FScene::INSTANCES>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
     const bool inverseFrontFaces = renderFlags & HAS_INVERSE_FRONT_FACES;
@@ -329,7 +687,6 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdColor.primitive.index = (uint16_t)i;
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
@@ -339,13 +696,26 @@ void RenderPass::generateCommandsImpl(uint32_t,
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
         cmdDepth.primitive.index = (uint16_t)i;
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
 
+        // the shadow pass draws all the instances, the other passes only the ones visible
+        // from the camera, which can be none of them.
+        const FScene::InstancesInfo instances = soaInstances[i];
+        const uint8_t instanceCount = uint8_t(shadowPass ? instances.count : instances.visibleCount);
+        const bool noVisibleInstance = instances.count && !instanceCount;
+        cmdColor.primitive.instanceCount = instanceCount;
+        cmdDepth.primitive.instanceCount = instanceCount;
+
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
 
+        // a shadow pass only draws the casters visible from its light, e.g. the casters of
+        // a shadow atlas tile are a subset of the view's casters.
+        const bool culledFromLight = shadowPass & !(soaVisibleMask[i] & VISIBLE_SHADOW_CASTER);
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
+        const size_t boneSize = soaVisibility[i].compactBones ?
+                sizeof(PerRenderableUibCompactBone) : sizeof(PerRenderableUibBone);
 
         /*
          * This is our hot loop. It's written to avoid branches.
@@ -353,6 +723,10 @@ void RenderPass::generateCommandsImpl(uint32_t,
          */
         for (auto const& primitive : primitives) {
             FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            const uint32_t bonesOffset = uint32_t(soaBonesOffset[i] +
+                    primitive.getBoneOffset() * boneSize);
+            cmdColor.primitive.bonesOffset = bonesOffset;
+            cmdDepth.primitive.bonesOffset = bonesOffset;
             if (colorPass) {
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
                 cmdColor.primitive.materialVariant = materialVariant;
@@ -397,6 +771,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                     // handle the case where this primitive is empty / no-op
                     key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                    key |= select(noVisibleInstance);
 
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
@@ -435,6 +810,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 *curr = cmdColor;
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(noVisibleInstance);
                 ++curr;
             }
 
@@ -456,10 +832,11 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 bool issueDepth =
                         (rs.depthWrite & !(colorPass & (rs.alphaToCoverage | rs.hasBlending())))
                         | writeDepthForShadows;
-                curr->key |= select(!issueDepth);
+                curr->key |= select(!issueDepth | culledFromLight);
 
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(noVisibleInstance);
                 ++curr;
             }
         }
@@ -588,20 +965,20 @@ void FRenderer::ColorPass::renderColorPass(FEngine& engine,
     ColorPass colorPass("ColorPass", js, sync, view, rth);
     driver.pushGroupMarker("Color Pass");
     colorPass.render(engine, js, *view.getScene(), vr, commandType, flags,
-            cameraInfo, scaledViewport, commands);
+            cameraInfo, scaledViewport, commands, &view.getColorPassCommandCache());
     driver.popGroupMarker();
 }
 
 // ------------------------------------------------------------------------------------------------
 
 FRenderer::ShadowPass::ShadowPass(const char* name,
-        ShadowMap const& shadowMap) noexcept
-        : RenderPass(name), shadowMap(shadowMap) {
+        ShadowMap const& shadowMap, size_t cascade) noexcept
+        : RenderPass(name), shadowMap(shadowMap), cascade(cascade) {
 }
 
 void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver,
         filament::Viewport const&, const CameraInfo&) noexcept {
-    shadowMap.beginRenderPass(driver);
+    shadowMap.beginRenderPass(driver, cascade);
 }
 
 void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
@@ -610,24 +987,7 @@ void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
     auto& soa = view.getScene()->getRenderableData();
     auto vr = view.getVisibleShadowCasters();
     ShadowMap const& shadowMap = view.getShadowMap();
-    filament::Viewport const& viewport = shadowMap.getViewport();
-    FCamera const& camera = shadowMap.getCamera();
-
-    CameraInfo cameraInfo = {
-            .projection         = mat4f{ camera.getProjectionMatrix() },
-            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
-            .model              = camera.getModelMatrix(),
-            .view               = camera.getViewMatrix(),
-            .zn                 = camera.getNear(),
-            .zf                 = camera.getCullingFar(),
-    };
-
-    // populate the RenderPrimitive array with the proper LOD
-    view.updatePrimitivesLod(engine, cameraInfo, soa, vr);
-
     driver::DriverApi& driver = engine.getDriverApi();
-    view.prepareCamera(cameraInfo, viewport);
-    view.commitUniforms(driver);
 
     RenderPass::RenderFlags flags = 0;
     if (view.hasShadowing())               flags |= RenderPass::HAS_SHADOWING;
@@ -635,11 +995,74 @@ void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
     if (view.hasDynamicLighting())         flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
     if (view.isFrontFaceWindingInverted()) flags |= RenderPass::HAS_INVERSE_FRONT_FACES;
 
-    ShadowPass shadowPass("ShadowPass", shadowMap);
-    driver.pushGroupMarker("Shadow map Pass");
-    shadowPass.render(engine, js, *view.getScene(), vr,
-            CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
-    driver.popGroupMarker();
+    // Each cascade is rendered in its own pass, because the camera uniforms must be updated
+    // outside of a render pass. Each cascade only draws its own casters. Cached shadow maps
+    // skip the cascades that didn't change.
+    bool restoreShadowCasters = false;
+    const size_t cascadeCount = view.hasDirectionalShadowing() ? shadowMap.getCascadeCount() : 0;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        if (!shadowMap.isCascadeDirty(i)) {
+            continue;
+        }
+
+        // the commands of the previous cascade have been recorded already
+        commands.clear();
+
+        restoreShadowCasters |= shadowMap.selectShadowCasters(i, soa, vr);
+
+        filament::Viewport const& viewport = shadowMap.getViewport(i);
+        FCamera const& camera = shadowMap.getCamera(i);
+
+        CameraInfo cameraInfo = {
+                .projection         = mat4f{ camera.getProjectionMatrix() },
+                .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+                .model              = camera.getModelMatrix(),
+                .view               = camera.getViewMatrix(),
+                .zn                 = camera.getNear(),
+                .zf                 = camera.getCullingFar(),
+        };
+
+        // populate the RenderPrimitive array with the proper LOD
+        view.updatePrimitivesLod(engine, cameraInfo, soa, vr);
+
+        view.prepareCamera(cameraInfo, viewport);
+        view.commitUniforms(driver);
+
+        ShadowPass shadowPass("ShadowPass", shadowMap, i);
+        driver.pushGroupMarker("Shadow map Pass");
+        shadowPass.render(engine, js, *view.getScene(), vr,
+                CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands,
+                &view.getShadowPassCommandCache(i));
+        driver.popGroupMarker();
+    }
+
+    // The shadow atlas tiles of the spot and point lights, each tile only draws its own
+    // casters. The commands are different for each tile, so they're not cached.
+    ShadowAtlas const& shadowAtlas = view.getShadowAtlas();
+    const size_t tileCount = shadowAtlas.getUpdatedTileCount();
+    for (size_t i = 0; i < tileCount; i++) {
+        commands.clear();
+
+        shadowAtlas.selectShadowCasters(i, soa, vr);
+
+        CameraInfo const& cameraInfo = shadowAtlas.getUpdatedTileCamera(i);
+        const filament::Viewport viewport = shadowAtlas.getUpdatedTileViewport(i);
+
+        // populate the RenderPrimitive array with the proper LOD
+        view.updatePrimitivesLod(engine, cameraInfo, soa, vr);
+
+        view.prepareCamera(cameraInfo, viewport);
+        view.commitUniforms(driver);
+
+        ShadowAtlasPass shadowAtlasPass("ShadowAtlasPass", shadowAtlas, i);
+        driver.pushGroupMarker("Shadow atlas Pass");
+        shadowAtlasPass.render(engine, js, *view.getScene(), vr,
+                CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
+        driver.popGroupMarker();
+    }
+    if (restoreShadowCasters || tileCount) {
+        ShadowCasterMasks::restore(soa, vr);
+    }
 }
 
 void FRenderer::ShadowPass::endRenderPass(DriverApi& driver,
@@ -647,5 +1070,22 @@ void FRenderer::ShadowPass::endRenderPass(DriverApi& driver,
     driver.endRenderPass();
 }
 
+// ------------------------------------------------------------------------------------------------
+
+FRenderer::ShadowAtlasPass::ShadowAtlasPass(const char* name,
+        ShadowAtlas const& shadowAtlas, size_t tile) noexcept
+        : RenderPass(name), shadowAtlas(shadowAtlas), tile(tile) {
+}
+
+void FRenderer::ShadowAtlasPass::beginRenderPass(driver::DriverApi& driver,
+        filament::Viewport const&, const CameraInfo&) noexcept {
+    shadowAtlas.beginRenderPass(driver, tile);
+}
+
+void FRenderer::ShadowAtlasPass::endRenderPass(DriverApi& driver,
+        filament::Viewport const&) noexcept {
+    driver.endRenderPass();
+}
+
 } // namespace details
 } // namespace filament
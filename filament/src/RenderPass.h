@@ -30,6 +30,8 @@
 #include <utils/compiler.h>
 #include <utils/Slice.h>
 
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -175,12 +177,13 @@ public:
     struct PrimitiveInfo { // 24 bytes
         FMaterialInstance const* mi = nullptr;              // 8 bytes (4)
         Handle<HwRenderPrimitive> primitiveHandle;          // 4 bytes
-        Handle<HwUniformBuffer> perRenderableBones;         // 4 bytes
+        uint32_t bonesOffset = 0;                           // 4 bytes, in the bone palette
         Driver::RasterState rasterState;                    // 4 bytes
         uint16_t index = 0;                                 // 2 bytes
         Variant materialVariant;                            // 1 byte
-        uint8_t reserved = { };                             // 1 byte
+        uint8_t instanceCount = 0;                          // 1 byte, 0 if not instanced
     };
+    static_assert(CONFIG_MAX_INSTANCE_COUNT <= 255, "PrimitiveInfo::instanceCount is 8 bits");
 
     struct alignas(8) Command {     // 32 bytes
         CommandKey key = 0;         //  8 bytes
@@ -196,6 +199,30 @@ public:
             "Command isn't trivially destructible");
 
 
+    /*
+     * Sorted commands of the previous frames, which are replayed as long as the pass, the camera
+     * and the visible renderables don't change. Only the commands of the renderables that
+     * changed are regenerated and merged in. A cache must only be used with a single view and
+     * pass, e.g. FView keeps one for its color pass and one for its shadow pass.
+     */
+    class CommandCache {
+    public:
+        void clear() noexcept {
+            mSignature = 0;
+            mRowHashes.clear();
+            mCommands.clear();
+        }
+
+    private:
+        friend class RenderPass;
+        uint64_t mSignature = 0;                // pass flags, camera and visible range
+        std::vector<uint64_t> mRowHashes;       // inputs of each visible renderable
+        std::vector<uint64_t> mNewRowHashes;
+        std::vector<uint8_t> mChangedRows;
+        std::vector<Command> mCommands;         // sorted, without cancelled commands + sentinel
+        std::vector<Command> mScratch;
+    };
+
     using RenderFlags = uint8_t;
     static constexpr RenderFlags HAS_SHADOWING           = 0x01;
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT   = 0x02;
@@ -206,13 +233,18 @@ public:
 
     virtual ~RenderPass() noexcept;
 
+    // Sorts the commands by key. Large lists are radix-sorted on all threads, which requires a
+    // scratch buffer of the same size; without it (scratch == nullptr) std::sort() is used.
+    static void sortCommands(utils::JobSystem& js,
+            Command* begin, Command* end, Command* scratch) noexcept;
+
     // appends rendering commands for the given view
     void render(
             FEngine& engine, utils::JobSystem& js,
             FScene& scene, utils::Range<uint32_t> visibleRenderables,
             uint32_t commandTypeFlags, RenderFlags renderFlags,
             const CameraInfo& camera, Viewport const& viewport,
-            utils::GrowingSlice<Command>& commands) noexcept;
+            utils::GrowingSlice<Command>& commands, CommandCache* cache = nullptr) noexcept;
 
 private:
     // Called just before rendering, make sure all needed asynchronous tasks are finished.
@@ -237,10 +269,34 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // below this count, std::sort() is faster than the parallel radix sort
+    static constexpr size_t RADIX_SORT_MIN_COMMAND_COUNT = 4096;
+    // each radix sort job processes at least this many commands
+    static constexpr size_t RADIX_SORT_BLOCK_MIN_COMMAND_COUNT = 1024;
+    static constexpr size_t RADIX_SORT_MAX_BLOCK_COUNT = 16;
+
     static inline void generateCommands(uint32_t commandTypeFlags, Command* commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
             filament::math::float3 cameraPosition, filament::math::float3 cameraForward) noexcept;
 
+    static inline void generateCommandsAt(uint32_t commandTypeFlags, Command* curr,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+            filament::math::float3 cameraPosition, filament::math::float3 cameraForward) noexcept;
+
+    static utils::Slice<Command> generateSortedCommands(utils::JobSystem& js,
+            uint32_t commandTypeFlags, FScene::RenderableSoa const& soa,
+            utils::Range<uint32_t> vr, RenderFlags renderFlags,
+            filament::math::float3 cameraPosition, filament::math::float3 cameraForward,
+            utils::GrowingSlice<Command>& commands) noexcept;
+
+    static utils::Slice<Command> generateCachedCommands(CommandCache& cache, utils::JobSystem& js,
+            uint32_t commandTypeFlags, FScene::RenderableSoa const& soa,
+            utils::Range<uint32_t> vr, RenderFlags renderFlags,
+            filament::math::float3 cameraPosition, filament::math::float3 cameraForward,
+            utils::GrowingSlice<Command>& commands) noexcept;
+
+    static uint64_t hashRenderable(FScene::RenderableSoa const& soa, uint32_t i) noexcept;
+
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
             utils::Range<uint32_t> range, RenderFlags renderFlags, filament::math::float3 cameraPosition,
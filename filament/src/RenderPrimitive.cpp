@@ -32,6 +32,7 @@ void FRenderPrimitive::init(driver::DriverApi& driver,
     mHandle = driver.createRenderPrimitive();
     mMaterialInstance = upcast(entry.materialInstance);
     mBlendOrder = entry.blendOrder;
+    mBoneOffset = entry.boneOffset;
 
     if (entry.indices && entry.vertices) {
         FVertexBuffer* vertexBuffer = upcast(entry.vertices);
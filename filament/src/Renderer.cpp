@@ -164,7 +164,14 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     filament::Viewport const& vp = view.getViewport();
     const bool hasPostProcess = view.hasPostProcessPass();
-    float2 scale = view.updateScale(mFrameInfoManager.getLastFrameTime());
+
+    // When the driver can measure it, the GPU time of the passes is what dynamic resolution
+    // acts on. Otherwise we use the time between fences at the beginning and end of the frame.
+    FrameInfo::duration frameTime = mFrameInfoManager.getLastGpuTime();
+    if (frameTime.count() <= 0) {
+        frameTime = mFrameInfoManager.getLastFrameTime();
+    }
+    float2 scale = view.updateScale(frameTime);
     bool useFXAA = view.getAntiAliasing() == View::AntiAliasing::FXAA;
     if (!hasPostProcess) {
         // dynamic scaling and FXAA are part of the post-process phase and can't happen if
@@ -199,7 +206,9 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
      */
 
     if (view.hasShadowing()) {
+        mFrameInfoManager.beginPass(driver, "Shadows");
         ShadowPass::renderShadowMap(engine, js, view, commands);
+        mFrameInfoManager.endPass(driver);
         recordHighWatermark(commands); // for debugging
         // reset the command buffer
         commands.clear();
@@ -223,14 +232,22 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
     const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
+    mFrameInfoManager.beginPass(driver, "Color");
     ColorPass::renderColorPass(engine, js, jobFroxelize,
             colorTarget ? colorTarget->target : viewRenderTarget, view, svp, commands);
+    mFrameInfoManager.endPass(driver);
 
     /*
      * Post Processing...
      */
 
 
+    // The FrameGraph path is disabled, and it only covers post-processing: the shadow and color
+    // passes above are always recorded on this thread. Until it's enabled, the passes are not
+    // recorded concurrently by FrameGraph::execute(js, pool, driver). Likewise, the transient
+    // textures are only aliased within the FrameGraph: colorTarget, which holds the HDR and MSAA
+    // buffers, comes from the RenderTargetPool either way. The view's FrameGraphCache is unused
+    // too, so nothing is cached across frames here.
 #define USE_FRAME_GRAPH false
 
     if (UTILS_LIKELY(hasPostProcess)) {
@@ -239,7 +256,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
         assert(colorTarget);
 
         if (USE_FRAME_GRAPH) {
-            FrameGraph fg;
+            FrameGraph fg(view.getFrameGraphCache());
 
             const bool translucent = mSwapChain->isTransparent();
 
@@ -270,12 +287,14 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
             fg.compile();
             //fg.export_graphviz(slog.d);
-            fg.execute(driver);
+            fg.setPassTimer(&mFrameInfoManager);
+            fg.execute(js, engine.getCommandBufferPool(), driver);
 
             rtp.put(colorTarget);
 
         } else {
 
+            mFrameInfoManager.beginPass(driver, "Post Processing");
             ppm.start();
 
             const bool translucent = mSwapChain->isTransparent();
@@ -296,6 +315,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
                 ppm.blit();
             }
             ppm.finish(view.getDiscardedTargetBuffers(), viewRenderTarget, vp, colorTarget, svp);
+            mFrameInfoManager.endPass(driver);
 
         }
 
@@ -442,6 +462,9 @@ void FRenderer::endFrame() {
     // make sure we're done with the gcs
     js.waitAndRelease(job);
 
+    // the renderables removed by gc() can only issue driver commands from this thread
+    engine.getRenderableManager().destroyCollectedPrimitives();
+
 
 #if EXTRA_TIMING_INFO
     if (UTILS_UNLIKELY(frameInfoManager.isLapRecordsEnabled())) {
@@ -453,6 +476,17 @@ void FRenderer::endFrame() {
         mPostProcess.push(postprocess.count());
         slog.d << mRendering.latest() << ", "
                << mPostProcess.latest() << io::endl;
+
+        // the GPU time of the passes is known for an older frame
+        auto pos = std::find_if(history.rbegin(), history.rend(),
+                [](FrameInfo const& info) { return info.passCount > 0; });
+        if (pos != history.rend()) {
+            slog.d << "GPU [frame " << pos->frame << "]";
+            for (size_t i = 0; i < pos->passCount; i++) {
+                slog.d << " " << pos->passes[i].name << ": " << pos->passes[i].gpuTime.count();
+            }
+            slog.d << io::endl;
+        }
     }
 #endif
 }
@@ -28,11 +28,15 @@
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
 
+#include <string.h>
+
 using namespace filament::math;
 using namespace utils;
 
@@ -49,25 +53,99 @@ FScene::FScene(FEngine& engine) :
 FScene::~FScene() noexcept = default;
 
 
+// using the inverse-transpose handles non-uniform scaling
+static inline float3 transformDirection(mat4f const& worldTransform, float3 const& d) noexcept {
+    return normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+}
+
+static inline void computePositionalLight(FLightManager const& lcm, FLightManager::Instance li,
+        mat4f const& worldTransform, float4& positionRadius, float3& direction) noexcept {
+    const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+    float3 d = 0;
+    if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+        d = transformDirection(worldTransform, lcm.getLocalDirection(li));
+    }
+    positionRadius = float4{ p.xyz, lcm.getRadius(li) };
+    direction = d;
+}
+
 void FScene::prepare(const filament::math::mat4f& worldOriginTransform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    /*
+     * Usually, only a few entities change from one frame to the next, so we only update the
+     * rows of those. Everything is re-gathered when the content of the scene changes, when
+     * components are created or destroyed, or when the changes are not known anymore
+     * (e.g. if this scene wasn't rendered during the last frame).
+     */
+
+    const uint32_t entityDestructionCount = engine.getEntityDestructionCount();
+    Slice<const Entity> changes[3];
+    bool fullUpdate = mNeedsFullUpdate ||
+            entityDestructionCount != mEntityDestructionCount ||
+            memcmp(&worldOriginTransform, &mWorldOriginTransform, sizeof(mat4f)) != 0;
+    fullUpdate = fullUpdate ||
+            !rcm.getChangeLog().getChangesSince(mChangeLogCursors.renderables, changes[0]) ||
+            !lcm.getChangeLog().getChangesSince(mChangeLogCursors.lights, changes[1]) ||
+            !tcm.getChangeLog().getChangesSince(mChangeLogCursors.transforms, changes[2]);
+
+    if (!fullUpdate) {
+        // when a large part of the scene changes (e.g. animated crowds), it's faster to
+        // re-gather everything on all threads
+        const size_t changeCount = changes[0].size() + changes[1].size() + changes[2].size();
+        fullUpdate = changeCount > mEntities.size() / 4;
+    }
+
+    if (fullUpdate) {
+        prepareAll(worldOriginTransform);
+        mShadowCasterChangeLog.invalidate();
+    } else {
+        prepareChanges(worldOriginTransform, changes, 3);
+    }
 
+    if (mHierarchicalCulling) {
+        // rows which moved were updated in the hierarchy by prepareChanges()
+        if (fullUpdate || mCullingHierarchy.needsRebuild()) {
+            buildCullingHierarchy();
+        } else {
+            mCullingHierarchy.refit();
+        }
+    }
+
+    mNeedsFullUpdate = false;
+    mEntityDestructionCount = entityDestructionCount;
+    mWorldOriginTransform = worldOriginTransform;
+    mChangeLogCursors.renderables = rcm.getChangeLog().getSequence();
+    mChangeLogCursors.lights = lcm.getChangeLog().getSequence();
+    mChangeLogCursors.transforms = tcm.getChangeLog().getSequence();
+
+    // the views cull and sort mLightData in place, so it needs to be restored every time
+    copyLightData();
+}
+
+void FScene::prepareAll(const filament::math::mat4f& worldOriginTransform) noexcept {
     FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
     FLightManager& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
-    auto const& entities = mEntities;
+    auto& lightData = mLightCache;
 
+    // robin_set<> can't be partitioned, so we gather the entities in an array first
+    auto& entities = mEntityList;
+    entities.assign(mEntities.begin(), mEntities.end());
+    const size_t entityCount = entities.size();
 
     // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
     // component can be added after the entity is added to the scene.
 
-    size_t renderableDataCapacity = entities.size();
+    size_t renderableDataCapacity = entityCount;
     // we need the capacity to be multiple of 16 for SIMD loops
     renderableDataCapacity = (renderableDataCapacity + 0xF) & ~0xF;
     // we need 1 extra entry at the end for the summed primitive count
@@ -80,81 +158,316 @@ void FScene::prepare(const filament::math::mat4f& worldOriginTransform) {
 
     // The light data list will always contain at least one entry for the
     // dominating directional light, even if there are no entities.
-    size_t lightDataCapacity = std::max<size_t>(1, entities.size());
-    // we need the capacity to be multiple of 16 for SIMD loops
-    lightDataCapacity = (lightDataCapacity + 0xF) & ~0xF;
+    size_t lightDataCapacity = DIRECTIONAL_LIGHTS_COUNT + entityCount;
 
     lightData.clear();
     if (lightData.capacity() < lightDataCapacity) {
         lightData.setCapacity(lightDataCapacity);
     }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
 
+    /*
+     * Each job processes a range of entities and writes its renderables and lights at the same
+     * offset in sceneData and lightData (the first entries of lightData are reserved for the
+     * directional lights), this can't overflow because an entity produces at most one of each.
+     * The ranges are compacted afterwards, which preserves the order of the serial loop.
+     */
 
-    // find the max intensity directional light index in our local array
-    float maxIntensity = 0;
+    sceneData.resize(entityCount);
+    lightData.resize(lightDataCapacity);
+    mDirectionalLights.resize(entityCount);
+
+    const size_t rangeCount = (entityCount + PREPARE_JOB_ENTITY_COUNT - 1) / PREPARE_JOB_ENTITY_COUNT;
+    mRangeCounts.resize(rangeCount);
+
+    auto work = [&](uint32_t firstRange, uint32_t count) {
+        for (size_t r = firstRange, c = firstRange + count; r < c; r++) {
+            const size_t first = r * PREPARE_JOB_ENTITY_COUNT;
+            const size_t last = std::min(first + PREPARE_JOB_ENTITY_COUNT, entityCount);
+            size_t renderableRow = first;
+            size_t lightRow = DIRECTIONAL_LIGHTS_COUNT + first;
+            size_t directionalLight = first;
+
+            for (size_t i = first; i < last; i++) {
+                const Entity e = entities[i];
+                if (!em.isAlive(e))
+                    continue;
+
+                // getInstance() always returns null if the entity is the Null entity
+                // so we don't need to check for that, but we need to check it's alive
+                auto ri = rcm.getInstance(e);
+                auto li = lcm.getInstance(e);
+                if (!ri & !li)
+                    continue;
+
+                // get the world transform
+                auto ti = tcm.getInstance(e);
+                const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
+
+                // don't even draw this object if it doesn't have a transform (which shouldn't happen
+                // because one is always created when creating a Renderable component).
+                if (ri && ti) {
+                    // compute the world AABB so we can perform culling
+                    const Box worldAABB = rigidTransform(rcm.getCullingAABB(ri), worldTransform);
+
+                    // we know there is enough space in the array
+                    sceneData.elementAt<RENDERABLE_INSTANCE>(renderableRow) = ri;
+                    sceneData.elementAt<WORLD_TRANSFORM>(renderableRow)     = worldTransform;
+                    sceneData.elementAt<VISIBILITY_STATE>(renderableRow)    = rcm.getVisibility(ri);
+                    sceneData.elementAt<BONES_OFFSET>(renderableRow)        = rcm.getBonesOffset(ri);
+                    sceneData.elementAt<INSTANCES>(renderableRow)           =
+                            { 0, uint16_t(rcm.getInstanceCount(ri)), 0 };
+                    sceneData.elementAt<WORLD_AABB_CENTER>(renderableRow)   = worldAABB.center;
+                    sceneData.elementAt<VISIBLE_MASK>(renderableRow)        = 0;
+                    sceneData.elementAt<LAYERS>(renderableRow)              = rcm.getLayerMask(ri);
+                    sceneData.elementAt<WORLD_AABB_EXTENT>(renderableRow)   = worldAABB.halfExtent;
+                    renderableRow++;
+                }
 
-    for (Entity e : entities) {
-        if (!em.isAlive(e))
-            continue;
+                if (li) {
+                    if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+                        // we don't store the directional lights, because we only have a single one
+                        mDirectionalLights[directionalLight++] = e;
+                    } else {
+                        computePositionalLight(lcm, li, worldTransform,
+                                lightData.elementAt<POSITION_RADIUS>(lightRow),
+                                lightData.elementAt<DIRECTION>(lightRow));
+                        lightData.elementAt<LIGHT_INSTANCE>(lightRow) = li;
+                        lightRow++;
+                    }
+                }
+            }
 
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li)
-            continue;
-
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
-
-        // don't even draw this object if it doesn't have a transform (which shouldn't happen
-        // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
+            mRangeCounts[r] = {
+                    uint32_t(renderableRow - first),
+                    uint32_t(lightRow - (DIRECTIONAL_LIGHTS_COUNT + first)),
+                    uint32_t(directionalLight - first) };
         }
+    };
+
+    // launch the computation on multiple threads
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(rangeCount),
+            std::ref(work), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    // compact the ranges, rows only move down so they can't overwrite data not yet moved
+    size_t renderableCount = 0;
+    size_t lightCount = DIRECTIONAL_LIGHTS_COUNT;
+    size_t directionalLightCount = 0;
+    for (size_t r = 0; r < rangeCount; r++) {
+        const size_t first = r * PREPARE_JOB_ENTITY_COUNT;
+        RangeCounts const& counts = mRangeCounts[r];
+        if (renderableCount != first) {
+            std::move(sceneData.begin() + first,
+                    sceneData.begin() + first + counts.renderables,
+                    sceneData.begin() + renderableCount);
+        }
+        if (lightCount != DIRECTIONAL_LIGHTS_COUNT + first) {
+            std::move(lightData.begin() + DIRECTIONAL_LIGHTS_COUNT + first,
+                    lightData.begin() + DIRECTIONAL_LIGHTS_COUNT + first + counts.lights,
+                    lightData.begin() + lightCount);
+        }
+        std::move(mDirectionalLights.begin() + first,
+                mDirectionalLights.begin() + first + counts.directionalLights,
+                mDirectionalLights.begin() + directionalLightCount);
+        renderableCount += counts.renderables;
+        lightCount += counts.lights;
+        directionalLightCount += counts.directionalLights;
+    }
+    sceneData.resize(renderableCount);
+    lightData.resize(lightCount);
+    mDirectionalLights.resize(directionalLightCount);
+
+    // instances are used as stable indices until the next structural change
+    mRenderableRows.assign(rcm.getComponentCount() + 1, 0);
+    auto const* const UTILS_RESTRICT renderableInstances = sceneData.data<RENDERABLE_INSTANCE>();
+    for (size_t i = 0; i < renderableCount; i++) {
+        mRenderableRows[renderableInstances[i].asValue()] = uint32_t(i);
+    }
+
+    mLightRows.assign(lcm.getComponentCount() + 1, 0);
+    auto const* const UTILS_RESTRICT lightInstances = lightData.data<LIGHT_INSTANCE>();
+    for (size_t i = DIRECTIONAL_LIGHTS_COUNT; i < lightCount; i++) {
+        mLightRows[lightInstances[i].asValue()] = uint32_t(i);
+    }
+
+    updateDirectionalLight(worldOriginTransform);
+}
+
+void FScene::buildCullingHierarchy() noexcept {
+    FRenderableManager& rcm = mEngine.getRenderableManager();
+    auto& sceneData = mRenderableData;
+    const size_t count = sceneData.size();
+
+    // the order of the rows doesn't matter, the hierarchy is indexed by instances
+    std::vector<uint32_t> ids(count);
+    auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = instances[i].asValue();
+    }
+
+    const size_t idCount = rcm.getComponentCount() + 1;
+    mCullingHierarchy.build(ids.data(),
+            sceneData.data<WORLD_AABB_CENTER>(), sceneData.data<WORLD_AABB_EXTENT>(),
+            count, idCount);
+    mInstanceVisibility.assign(idCount, 0);
+}
+
+void FScene::gatherHierarchicalCulling(JobSystem& js) noexcept {
+    SYSTRACE_CALL();
+
+    if (!hasCullingHierarchy()) {
+        return;
+    }
+
+    auto& sceneData = mRenderableData;
+    auto const* const instances = sceneData.data<RENDERABLE_INSTANCE>();
+    Culler::result_type* const visibleArray = sceneData.data<VISIBLE_MASK>();
+    Culler::result_type* const instanceVisibility = mInstanceVisibility.data();
+
+    // each instance appears in a single row, so the masks can be reset as we go
+    auto functor = [instances, visibleArray, instanceVisibility](uint32_t index, uint32_t c) {
+        for (uint32_t i = index, e = index + c; i < e; i++) {
+            const uint32_t instance = instances[i].asValue();
+            visibleArray[i] |= instanceVisibility[instance];
+            instanceVisibility[instance] = 0;
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(sceneData.size()),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.runAndWait(job);
+}
+
+void FScene::prepareChanges(const filament::math::mat4f& worldOriginTransform,
+        Slice<const Entity> const* changes, size_t count) noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& sceneData = mRenderableData;
+    auto& lightData = mLightCache;
+
+    bool renderableRowsValid = false;
+    bool directionalLightChanged = false;
+
+    // an entity can appear several times, updating its data is idempotent
+    for (size_t i = 0; i < count; i++) {
+        for (Entity e : changes[i]) {
+            if (mEntities.find(e) == mEntities.end())
+                continue;
+
+            auto ri = rcm.getInstance(e);
+            auto li = lcm.getInstance(e);
+            if (!ri & !li)
+                continue;
+
+            auto ti = tcm.getInstance(e);
+            const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
+
+            if (ri && ti) {
+                if (UTILS_UNLIKELY(!renderableRowsValid)) {
+                    // the views have reordered mRenderableData since we last updated it
+                    renderableRowsValid = true;
+                    auto const* const UTILS_RESTRICT instances =
+                            sceneData.data<RENDERABLE_INSTANCE>();
+                    for (size_t j = 0, c = sceneData.size(); j < c; j++) {
+                        mRenderableRows[instances[j].asValue()] = uint32_t(j);
+                    }
+                }
 
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
+                const size_t row = mRenderableRows[ri.asValue()];
+                assert(sceneData.elementAt<RENDERABLE_INSTANCE>(row) == ri);
+
+                const Box worldAABB = rigidTransform(rcm.getCullingAABB(ri), worldTransform);
+                const FRenderableManager::Visibility visibility = rcm.getVisibility(ri);
+                const FRenderableManager::Visibility oldVisibility =
+                        sceneData.elementAt<VISIBILITY_STATE>(row);
+                if (oldVisibility.castShadows || visibility.castShadows) {
+                    if (!oldVisibility.culling || !visibility.culling) {
+                        // casters which aren't culled are drawn in all the shadow maps
+                        mShadowCasterChangeLog.invalidate();
+                    } else {
+                        mShadowCasterChangeLog.mark({ sceneData.elementAt<WORLD_AABB_CENTER>(row),
+                                sceneData.elementAt<WORLD_AABB_EXTENT>(row) });
+                        mShadowCasterChangeLog.mark(worldAABB);
+                    }
                 }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+
+                sceneData.elementAt<WORLD_TRANSFORM>(row)   = worldTransform;
+                sceneData.elementAt<VISIBILITY_STATE>(row)  = visibility;
+                sceneData.elementAt<WORLD_AABB_CENTER>(row) = worldAABB.center;
+                sceneData.elementAt<LAYERS>(row)            = rcm.getLayerMask(ri);
+                sceneData.elementAt<WORLD_AABB_EXTENT>(row) = worldAABB.halfExtent;
+
+                if (mHierarchicalCulling) {
+                    mCullingHierarchy.update(ri.asValue(), worldAABB.center, worldAABB.halfExtent);
+                }
+            }
+
+            if (li) {
+                if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+                    directionalLightChanged = true;
+                } else {
+                    const size_t row = mLightRows[li.asValue()];
+                    computePositionalLight(lcm, li, worldTransform,
+                            lightData.elementAt<POSITION_RADIUS>(row),
+                            lightData.elementAt<DIRECTION>(row));
                 }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
             }
         }
     }
 
+    if (directionalLightChanged) {
+        updateDirectionalLight(worldOriginTransform);
+    }
+}
+
+void FScene::updateDirectionalLight(const filament::math::mat4f& worldOriginTransform) noexcept {
+    FEngine& engine = mEngine;
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightCache;
+
+    lightData.elementAt<FScene::POSITION_RADIUS>(0) = {};
+    lightData.elementAt<FScene::DIRECTION>(0)       = {};
+    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = {};
+
+    // find the max intensity directional light
+    float maxIntensity = 0;
+    for (Entity e : mDirectionalLights) {
+        auto li = lcm.getInstance(e);
+        if (lcm.getIntensity(li) >= maxIntensity) {
+            maxIntensity = lcm.getIntensity(li);
+            auto ti = tcm.getInstance(e);
+            const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
+            const float3 d = transformDirection(worldTransform, lcm.getLocalDirection(li));
+            lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+            lightData.elementAt<FScene::DIRECTION>(0)       = d;
+            lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
+        }
+    }
+}
+
+void FScene::copyLightData() noexcept {
+    LightSoa const& cache = mLightCache;
+    LightSoa& lightData = mLightData;
+    const size_t count = cache.size();
+
+    // we need the capacity to be multiple of 16 for SIMD loops
+    const size_t lightDataCapacity = (std::max<size_t>(1, count) + 0xF) & ~0xF;
+
+    lightData.clear();
+    if (lightData.capacity() < lightDataCapacity) {
+        lightData.setCapacity(lightDataCapacity);
+    }
+    lightData.resize(count);
+    std::copy_n(cache.data<POSITION_RADIUS>(), count, lightData.data<POSITION_RADIUS>());
+    std::copy_n(cache.data<DIRECTION>(),       count, lightData.data<DIRECTION>());
+    std::copy_n(cache.data<LIGHT_INSTANCE>(),  count, lightData.data<LIGHT_INSTANCE>());
+
+    // shadow atlas tiles are assigned by the views
+    std::fill_n(lightData.data<SHADOW_INDEX>(), count, NO_SHADOW);
+
     // some elements past the end of the array will be accessed by SIMD code, we need to make
     // sure the data is valid enough as not to produce errors such as divide-by-zero
     // (e.g. in computeLightRanges())
@@ -163,6 +476,10 @@ void FScene::prepare(const filament::math::mat4f& worldOriginTransform) {
     }
 }
 
+Handle<HwUniformBuffer> FScene::getBonesUBO() const noexcept {
+    return mEngine.getRenderableManager().getBonesUbh();
+}
+
 void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, Handle<HwUniformBuffer> renderableUbh) noexcept {
     FEngine::DriverApi& driver = mEngine.getDriverApi();
     const size_t size = visibleRenderables.size() * sizeof(PerRenderableUib);
@@ -195,6 +512,15 @@ void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, Handle<HwUnif
 
         UniformBuffer::setUniform(buffer,
                 offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
+
+        UniformBuffer::setUniform(buffer,
+                offset + offsetof(PerRenderableUib, instanced),
+                uint32_t(sceneData.elementAt<INSTANCES>(i).count != 0));
+
+        UniformBuffer::setUniform(buffer,
+                offset + offsetof(PerRenderableUib, boneFormat),
+                uint32_t(sceneData.elementAt<VISIBILITY_STATE>(i).compactBones ?
+                        RenderableManager::BoneFormat::COMPACT : RenderableManager::BoneFormat::FULL));
     }
 
     // TODO: handle static objects separately
@@ -202,9 +528,127 @@ void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, Handle<HwUnif
     driver.updateUniformBuffer(renderableUbh, { buffer, size });
 }
 
+size_t FScene::prepareInstances(utils::Range<uint32_t> visibleRenderables) noexcept {
+    // Each instanced renderable gets its own range of the UBO, because the per-instance
+    // data is addressed with gl_InstanceID. Ranges must be aligned like PerRenderableUib, and
+    // the last one must be backed by a whole InstancesUniforms block.
+    constexpr size_t blockSize = CONFIG_MAX_INSTANCE_COUNT * sizeof(PerRenderableUibInstance);
+    constexpr size_t alignment = alignof(PerRenderableUib);
+
+    InstancesInfo* const UTILS_RESTRICT instances = mRenderableData.data<INSTANCES>();
+    std::vector<uint32_t>& instanced = mInstancedRenderables;
+    instanced.clear();
+    size_t offset = 0;
+    size_t lastOffset = 0;
+    for (uint32_t i : visibleRenderables) {
+        InstancesInfo& info = instances[i];
+        if (UTILS_UNLIKELY(info.count)) {
+            info.offset = uint32_t(offset);
+            lastOffset = offset;
+            offset += (info.count * sizeof(PerRenderableUibInstance) + alignment - 1) & ~(alignment - 1);
+            instanced.push_back(i);
+        }
+    }
+    return instanced.empty() ? 0 : lastOffset + blockSize;
+}
+
+void FScene::updateInstancesUBO(JobSystem& js, Frustum const& frustum,
+        bool culling, Handle<HwUniformBuffer> instancesUbh, size_t size) noexcept {
+    if (UTILS_LIKELY(mInstancedRenderables.empty())) {
+        // the block must still be bound, but its content doesn't matter
+        mInstancesViewUbh = mEngine.getDummyInstancesUbo();
+        return;
+    }
+    mInstancesViewUbh = instancesUbh;
+
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    FRenderableManager const& rcm = mEngine.getRenderableManager();
+    auto& sceneData = mRenderableData;
+    uint32_t const* const instanced = mInstancedRenderables.data();
+
+    // allocate space into the command stream directly, unused ranges are left uninitialized.
+    // Each renderable writes its own range, so they can be processed in parallel.
+    void* const buffer = driver.allocate(size);
+
+    auto work = [&rcm, &sceneData, &frustum, culling, instanced, buffer]
+            (uint32_t index, uint32_t c) {
+        float3 centers[CONFIG_MAX_INSTANCE_COUNT];
+        float3 extents[CONFIG_MAX_INSTANCE_COUNT];
+        Culler::result_type visibility[CONFIG_MAX_INSTANCE_COUNT];
+        uint16_t order[CONFIG_MAX_INSTANCE_COUNT];
+
+        for (uint32_t r = index, e = index + c; r < e; r++) {
+            const uint32_t i = instanced[r];
+            InstancesInfo& info = sceneData.elementAt<INSTANCES>(i);
+            const auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(i);
+            mat4f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
+            mat4f const* const transforms = rcm.getInstanceTransforms(ri);
+            Box const& aabb = rcm.getAABB(ri);
+            const size_t count = info.count;
+
+            // cull each instance against the camera frustum
+            size_t visibleCount = count;
+            if (culling) {
+                for (size_t j = 0; j < count; j++) {
+                    const Box box = rigidTransform(aabb, model * transforms[j]);
+                    centers[j] = box.center;
+                    extents[j] = box.halfExtent;
+                }
+                // the culler processes multiples of Culler::MODULO
+                for (size_t j = count, n = Culler::round(count); j < n; j++) {
+                    centers[j] = extents[j] = float3{};
+                }
+                std::fill_n(visibility, Culler::round(count), 0);
+                Culler::intersects(visibility, frustum, centers, extents, count, 0);
+
+                // the visible instances come first, so the color pass can draw a prefix of the
+                // range, while the shadow pass draws all of them
+                visibleCount = 0;
+                for (size_t j = 0; j < count; j++) {
+                    if (visibility[j]) {
+                        order[visibleCount++] = uint16_t(j);
+                    }
+                }
+                for (size_t j = 0, k = visibleCount; j < count; j++) {
+                    if (!visibility[j]) {
+                        order[k++] = uint16_t(j);
+                    }
+                }
+            } else {
+                for (size_t j = 0; j < count; j++) {
+                    order[j] = uint16_t(j);
+                }
+            }
+            info.visibleCount = uint16_t(visibleCount);
+
+            for (size_t j = 0; j < count; j++) {
+                const mat4f m = model * transforms[order[j]];
+                const size_t offset = info.offset + j * sizeof(PerRenderableUibInstance);
+                UniformBuffer::setUniform(buffer,
+                        offset + offsetof(PerRenderableUibInstance, worldFromModelMatrix), m);
+
+                // see updateUBOs()
+                mat3f n = transpose(inverse(m.upperLeft()));
+                n *= mat3f(1.0f / std::sqrt(max(float3{length2(n[0]), length2(n[1]), length2(n[2])})));
+                UniformBuffer::setUniform(buffer,
+                        offset + offsetof(PerRenderableUibInstance, worldFromModelNormalMatrix), n);
+            }
+        }
+    };
+
+    // instanced renderables can have up to CONFIG_MAX_INSTANCE_COUNT instances, so each one is
+    // worth its own job
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(mInstancedRenderables.size()),
+            std::cref(work), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    driver.updateUniformBuffer(instancesUbh, { buffer, size });
+}
+
 void FScene::terminate(FEngine& engine) {
-    // DO NOT destroy this UBO, it's owned by the View
+    // DO NOT destroy these UBOs, they're owned by the View
     mRenderableViewUbh.clear();
+    mInstancesViewUbh.clear();
 }
 
 void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena, Handle<HwUniformBuffer> lightUbh) noexcept {
@@ -214,7 +658,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     /*
      * Here we copy our lights data into the GPU buffer, some lights might be left out if there
-     * are more than the GPU buffer allows (i.e. 256).
+     * are more than the GPU buffer allows (i.e. CONFIG_MAX_LIGHT_COUNT).
      *
      * We always sort lights by distance to the camera plane so that:
      * - we can build light trees
@@ -249,6 +693,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT shadows      = lightData.data<FScene::SHADOW_INDEX>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         const size_t gpuIndex = i - DIRECTIONAL_LIGHTS_COUNT;
         auto li = instances[i];
@@ -256,6 +701,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
         lp[gpuIndex].colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp[gpuIndex].directionIES         = { directions[i], 0 };
         lp[gpuIndex].spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp[gpuIndex].spotScaleOffset.z    = shadows[i] == NO_SHADOW ? -1.0f : float(shadows[i]);
     }
 
     driver.updateUniformBuffer(lightUbh, { lp, positionalLightCount * sizeof(LightsUib) });
@@ -315,14 +761,17 @@ void FScene::computeLightRanges(
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mNeedsFullUpdate = true;
 }
 
 void FScene::addEntities(const Entity* entities, size_t count) {
     mEntities.insert(entities, entities + count);
+    mNeedsFullUpdate = true;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    mNeedsFullUpdate = true;
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -353,6 +802,17 @@ bool FScene::hasEntity(Entity entity) const noexcept {
     return mEntities.find(entity) != mEntities.end();
 }
 
+void FScene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    if (mHierarchicalCulling != enabled) {
+        mHierarchicalCulling = enabled;
+        if (!enabled) {
+            mCullingHierarchy.clear();
+            mInstanceVisibility.clear();
+        }
+        mNeedsFullUpdate = true;
+    }
+}
+
 void FScene::setSkybox(FSkybox const* skybox) noexcept {
     std::swap(mSkybox, skybox);
     if (skybox) {
@@ -432,4 +892,12 @@ bool Scene::hasEntity(Entity entity) const noexcept {
     return upcast(this)->hasEntity(entity);
 }
 
+void Scene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setHierarchicalCullingEnabled(enabled);
+}
+
+bool Scene::isHierarchicalCullingEnabled() const noexcept {
+    return upcast(this)->isHierarchicalCullingEnabled();
+}
+
 } // namespace filament
@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowAtlas.h"
+
+#include "details/Engine.h"
+
+#include <private/filament/SibGenerator.h>
+#include <private/filament/UibGenerator.h>
+
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+using namespace driver;
+
+namespace details {
+
+// the near plane of the lights' cameras, relative to their radius
+static constexpr float NEAR_PLANE_RATIO = 0.01f;
+
+// spot lights with a wider cone only get the center of their cone in shadows
+static constexpr float MAX_SPOT_HALF_FOV = 85.0f * float(M_PI) / 180.0f;
+
+ShadowAtlas::ShadowAtlas(FEngine& engine) noexcept :
+        mEngine(engine),
+        mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN ||
+                          engine.getBackend() == Backend::METAL) {
+    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
+    debugRegistry.registerProperty("d.shadowmap.atlas_updates",
+            &engine.debug.shadowmap.atlas_updates);
+}
+
+void ShadowAtlas::terminate(DriverApi& driverApi) noexcept {
+    if (mRenderTarget) {
+        driverApi.destroyRenderTarget(mRenderTarget);
+    }
+    if (mTexture) {
+        driverApi.destroyTexture(mTexture);
+    }
+}
+
+void ShadowAtlas::update(FLightManager const& lcm, FScene const* scene,
+        FScene::LightSoa& lightData, CameraInfo const& camera, uint8_t visibleLayers,
+        size_t maxTileUpdates) noexcept {
+    SYSTRACE_CALL();
+
+    mFrame++;
+
+    invalidateTiles(scene, visibleLayers);
+
+    auto const* UTILS_RESTRICT spheres    = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances  = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto      * UTILS_RESTRICT shadows    = lightData.data<FScene::SHADOW_INDEX>();
+
+    /*
+     * Gather the shadow casting point and spot lights, the most important ones are those
+     * which look the largest on screen, i.e. with the largest radius relative to their
+     * distance to the camera.
+     */
+
+    std::vector<Candidate>& candidates = mCandidates;
+    candidates.clear();
+    const float3 cameraPosition = camera.getPosition();
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        FLightManager::Instance li = instances[i];
+        if (!lcm.isShadowCaster(li)) {
+            continue;
+        }
+        const float radius = spheres[i].w;
+        const float distance = length(spheres[i].xyz - cameraPosition);
+        Candidate candidate{};
+        candidate.light = li;
+        candidate.row = uint32_t(i);
+        candidate.faceCount = uint8_t(lcm.isPointLight(li) ? 6 : 1);
+        candidate.cached = lcm.isShadowMapCached(li);
+        candidate.importance = radius / std::max(distance, radius);
+        candidate.params = { spheres[i].xyz, directions[i], radius, lcm.getCosOuterSquared(li) };
+        candidates.push_back(candidate);
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+            [](Candidate const& lhs, Candidate const& rhs) {
+                return lhs.importance > rhs.importance;
+            });
+
+    // keep the most important lights that fit in the atlas
+    size_t freeTileCount = TILE_COUNT;
+    auto last = candidates.begin();
+    for (Candidate const& candidate : candidates) {
+        if (candidate.faceCount <= freeTileCount) {
+            freeTileCount -= candidate.faceCount;
+            *last++ = candidate;
+        }
+    }
+    candidates.erase(last, candidates.end());
+
+    /*
+     * Lights keep the tiles they had last frame, unless they need a different number of them.
+     * The tiles of the other lights are released, and given to the lights without tiles.
+     */
+
+    std::array<bool, TILE_COUNT> kept = {};
+    for (Candidate& candidate : candidates) {
+        size_t owned = 0;
+        for (size_t t = 0; t < TILE_COUNT; t++) {
+            Tile const& tile = mTiles[t];
+            if (tile.light == candidate.light && tile.face < candidate.faceCount) {
+                candidate.tiles[tile.face] = uint8_t(t);
+                owned++;
+            }
+        }
+        candidate.hasTiles = owned == candidate.faceCount;
+        if (candidate.hasTiles) {
+            candidate.changed = false;
+            candidate.lastUpdate = std::numeric_limits<uint32_t>::max();
+            for (size_t f = 0; f < candidate.faceCount; f++) {
+                Tile const& tile = mTiles[candidate.tiles[f]];
+                kept[candidate.tiles[f]] = true;
+                candidate.changed |= !tile.rendered || tile.dirty ||
+                        !(tile.params == candidate.params);
+                candidate.lastUpdate = std::min(candidate.lastUpdate, tile.lastUpdate);
+            }
+        } else {
+            candidate.changed = true;
+        }
+    }
+
+    for (size_t t = 0; t < TILE_COUNT; t++) {
+        if (!kept[t]) {
+            mTiles[t].light = {};
+            mTiles[t].rendered = false;
+            mTiles[t].dirty = false;
+        }
+    }
+
+    size_t freeTile = 0;
+    for (Candidate& candidate : candidates) {
+        if (!candidate.hasTiles) {
+            for (size_t f = 0; f < candidate.faceCount; f++) {
+                while (mTiles[freeTile].light.isValid()) {
+                    freeTile++;
+                }
+                assert(freeTile < TILE_COUNT);
+                Tile& tile = mTiles[freeTile];
+                tile.light = candidate.light;
+                tile.face = uint8_t(f);
+                tile.rendered = false;
+                tile.dirty = false;
+                candidate.tiles[f] = uint8_t(freeTile);
+            }
+        }
+    }
+
+    /*
+     * Pick the tiles to render this frame: first the ones of the lights that got tiles or
+     * that changed (most important first), then the ones that were rendered the longest time
+     * ago, except for the cached ones. The tiles of a light are always rendered together.
+     */
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+            [](Candidate const& lhs, Candidate const& rhs) {
+                if (lhs.changed != rhs.changed) {
+                    return lhs.changed;
+                }
+                return !lhs.changed && lhs.lastUpdate < rhs.lastUpdate;
+            });
+
+    mUpdatedTileCount = 0;
+    for (Candidate const& candidate : candidates) {
+        if (mUpdatedTileCount && mUpdatedTileCount + candidate.faceCount > maxTileUpdates) {
+            continue;
+        }
+        if (!candidate.changed && candidate.cached) {
+            continue;
+        }
+        const bool pointLight = candidate.faceCount > 1;
+        for (size_t f = 0; f < candidate.faceCount; f++) {
+            const size_t t = candidate.tiles[f];
+            Tile& tile = mTiles[t];
+            computeTileCamera(tile, candidate.params, pointLight, mClipSpaceFlipped, t);
+            tile.rendered = true;
+            tile.dirty = false;
+            tile.lastUpdate = mFrame;
+            tile.params = candidate.params;
+            mUpdatedTiles[mUpdatedTileCount++] = uint8_t(t);
+        }
+    }
+
+    /*
+     * Lights whose tiles are all rendered get a shadow index, which is the index of their
+     * first tile in the uniforms. The faces of a point light use consecutive indices.
+     */
+
+    mShadowCount = 0;
+    for (Candidate const& candidate : candidates) {
+        bool rendered = true;
+        for (size_t f = 0; f < candidate.faceCount; f++) {
+            rendered &= mTiles[candidate.tiles[f]].rendered;
+        }
+        if (!rendered) {
+            continue;
+        }
+        const float constantBias = lcm.getShadowConstantBias(candidate.light);
+        const float normalBias = lcm.getShadowNormalBias(candidate.light);
+        shadows[candidate.row] = uint8_t(mShadowCount);
+        for (size_t f = 0; f < candidate.faceCount; f++) {
+            Tile& tile = mTiles[candidate.tiles[f]];
+            tile.bias = { constantBias, normalBias * tile.texelSize, 0, 0 };
+            mShadowTiles[mShadowCount++] = candidate.tiles[f];
+        }
+    }
+}
+
+void ShadowAtlas::invalidateTiles(FScene const* scene, uint8_t visibleLayers) noexcept {
+    ChangeLog<Box> const& changeLog = scene->getShadowCasterChangeLog();
+
+    // all the tiles are dirty when the changes are not known anymore (e.g. the atlas wasn't
+    // used during the last frame), otherwise only those whose frustum sees a change are
+    Slice<const Box> changes;
+    const bool valid = scene == mCachedScene && visibleLayers == mCachedVisibleLayers &&
+            changeLog.getChangesSince(mCasterChangeCursor, changes);
+    for (Tile& tile : mTiles) {
+        if (!tile.rendered || tile.dirty) {
+            continue;
+        }
+        if (!valid) {
+            tile.dirty = true;
+            continue;
+        }
+        for (Box const& box : changes) {
+            if (tile.frustum.intersects(box)) {
+                tile.dirty = true;
+                break;
+            }
+        }
+    }
+
+    mCachedScene = scene;
+    mCachedVisibleLayers = visibleLayers;
+    mCasterChangeCursor = changeLog.getSequence();
+}
+
+void ShadowAtlas::computeTileCamera(Tile& tile, LightParams const& params,
+        bool pointLight, bool clipSpaceFlipped, size_t slot) noexcept {
+    // the faces of a point light, in the order expected by the shaders
+    static constexpr float3 faceDirections[6] = {
+            {  1,  0,  0 }, { -1,  0,  0 },
+            {  0,  1,  0 }, {  0, -1,  0 },
+            {  0,  0,  1 }, {  0,  0, -1 },
+    };
+
+    float3 direction = params.direction;
+    float3 up = { 0, 1, 0 };
+    float halfFov;
+    if (pointLight) {
+        direction = faceDirections[tile.face];
+        up = direction.y != 0 ? float3{ 0, 0, 1 } : float3{ 0, 1, 0 };
+        halfFov = float(M_PI) / 4.0f;
+    } else {
+        halfFov = std::acos(std::sqrt(params.cosOuterSquared));
+        halfFov = std::min(std::max(halfFov, 0.01f), MAX_SPOT_HALF_FOV);
+    }
+
+    const float zf = params.radius;
+    const float zn = zf * NEAR_PLANE_RATIO;
+    const mat4f model = mat4f::lookAt(params.position, params.position + direction, up);
+    const mat4f view = FCamera::getViewMatrix(model);
+    const mat4f projection = mat4f::perspective(2.0f * halfFov * 180.0f / float(M_PI), 1.0f, zn, zf);
+
+    tile.camera.projection = projection;
+    tile.camera.cullingProjection = projection;
+    tile.camera.model = model;
+    tile.camera.view = view;
+    tile.camera.zn = zn;
+    tile.camera.zf = zf;
+    tile.frustum = Frustum(projection * view);
+    tile.lightSpace = getTileMapping(slot, clipSpaceFlipped) * projection * view;
+
+    // size of a texel at 1m from the light
+    tile.texelSize = 2.0f * std::tan(halfFov) / (TILE_DIMENSION - 2);
+}
+
+mat4f ShadowAtlas::getTileMapping(size_t slot, bool clipSpaceFlipped) noexcept {
+    // remapping from NDC to texture coordinates (i.e. [-1,1] -> [0, 1])
+    const mat4f Mt(clipSpaceFlipped ? mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0, -0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    } : mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0,  0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    });
+
+    // apply the 1-texel border viewport transform
+    const float o = 1.0f / TILE_DIMENSION;
+    const float s = 1.0f - 2.0f * o;
+    const mat4f Mb(mat4f::row_major_init{
+             s, 0, 0, o,
+             0, s, 0, o,
+             0, 0, 1, 0,
+             0, 0, 0, 1
+    });
+
+    // remaps the texture coordinates of the tile to its position in the atlas, the rows are
+    // flipped along with the clip-space.
+    const size_t column = slot % GRID_SIZE;
+    const size_t row = clipSpaceFlipped ? (GRID_SIZE - 1 - slot / GRID_SIZE) : slot / GRID_SIZE;
+    const float g = 1.0f / GRID_SIZE;
+    const mat4f Mg(mat4f::row_major_init{
+            g, 0, 0, column * g,
+            0, g, 0, row * g,
+            0, 0, 1, 0,
+            0, 0, 0, 1
+    });
+
+    return Mg * Mb * Mt;
+}
+
+void ShadowAtlas::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
+    if (mTexture) {
+        // nothing to do here.
+        return;
+    }
+
+    const uint32_t dim = uint32_t(GRID_SIZE * TILE_DIMENSION);
+    mTexture = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
+            TextureUsage::DEPTH_ATTACHMENT);
+
+    mRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
+            {}, { mTexture }, {});
+
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    s.compareFunc = SamplerCompareFunc::LE;
+    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+    s.depthStencil = true;
+    sb.setSampler(PerViewSib::SHADOW_ATLAS, { mTexture, s });
+}
+
+void ShadowAtlas::updateUniforms(UniformBuffer& u) const noexcept {
+    for (size_t i = 0; i < mShadowCount; i++) {
+        Tile const& tile = mTiles[mShadowTiles[i]];
+        u.setUniform(offsetof(PerViewUib, shadowTileFromWorldMatrix) + i * sizeof(mat4f),
+                tile.lightSpace);
+        u.setUniform(offsetof(PerViewUib, shadowTileBias) + i * sizeof(float4), tile.bias);
+    }
+}
+
+filament::Viewport ShadowAtlas::getUpdatedTileViewport(size_t i) const noexcept {
+    // tiles have a 1-texel border which is cleared and never rendered into
+    const size_t slot = mUpdatedTiles[i];
+    return {
+            int32_t((slot % GRID_SIZE) * TILE_DIMENSION + 1),
+            int32_t((slot / GRID_SIZE) * TILE_DIMENSION + 1),
+            TILE_DIMENSION - 2, TILE_DIMENSION - 2 };
+}
+
+void ShadowAtlas::cullShadowCasters(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& renderableData, Range<uint32_t> casters) noexcept {
+    // one frustum per tile rendered this frame
+    std::array<Frustum const*, TILE_COUNT> frustums;
+    for (size_t i = 0; i < mUpdatedTileCount; i++) {
+        frustums[i] = &getUpdatedTileFrustum(i);
+    }
+    mCasterMasks.cull(js, arena, renderableData, casters, frustums.data(), mUpdatedTileCount);
+}
+
+void ShadowAtlas::beginRenderPass(DriverApi& driver, size_t i) const noexcept {
+    // only the tile is cleared, the other ones keep their shadow maps
+    const filament::Viewport viewport = getUpdatedTileViewport(i);
+    RenderPassParams params = {};
+    params.flags.clear = TargetBufferFlags::SHADOW;
+    params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.clearDepth = 1.0;
+    params.viewport.left = viewport.left - 1;
+    params.viewport.bottom = viewport.bottom - 1;
+    params.viewport.width = TILE_DIMENSION;
+    params.viewport.height = TILE_DIMENSION;
+    driver.beginRenderPass(mRenderTarget, params);
+
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowCasterMasks.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+void ShadowCasterMasks::cull(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& renderableData, Range<uint32_t> casters,
+        Frustum const* const* frustums, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    // Culler processes multiples of Culler::MODULO renderables, which is guaranteed from the
+    // beginning of the SoA only.
+    const uint32_t first = casters.first & ~uint32_t(Culler::MODULO - 1);
+    const size_t size = Culler::round(casters.last - first);
+    mFirst = first;
+    mCount = count;
+    mMasks = arena.allocate<Culler::result_type*>(count);
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>() + first;
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>() + first;
+
+    // one job per frustum, they each write their own mask
+    JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < count; i++) {
+        Culler::result_type* const mask = arena.allocate<Culler::result_type>(size);
+        std::fill_n(mask, size, 0);
+        mMasks[i] = mask;
+        Frustum const* const frustum = frustums[i];
+        if (!frustum) {
+            continue;
+        }
+        JobSystem::Job* job = js.createJob(parent,
+                [mask, frustum, worldAABBCenter, worldAABBExtent, size](JobSystem&, JobSystem::Job*) {
+                    Culler::intersects(mask, *frustum, worldAABBCenter, worldAABBExtent, size,
+                            VISIBLE_SHADOW_CASTER_BIT);
+                });
+        js.run(job);
+    }
+    js.runAndWait(parent);
+}
+
+bool ShadowCasterMasks::select(size_t i,
+        FScene::RenderableSoa& renderableData, Range<uint32_t> casters) const noexcept {
+    if (i >= mCount) {
+        return false;
+    }
+    Culler::result_type* const UTILS_RESTRICT visibleMask =
+            renderableData.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    Culler::result_type const* const UTILS_RESTRICT mask = mMasks[i] - mFirst;
+    for (uint32_t j : casters) {
+        // renderables without culling are always drawn, as in FView::computeVisibilityMasks()
+        const Culler::result_type caster = visibility[j].culling ? mask[j] : VISIBLE_SHADOW_CASTER;
+        visibleMask[j] = Culler::result_type((visibleMask[j] & ~VISIBLE_SHADOW_CASTER) | caster);
+    }
+    return true;
+}
+
+void ShadowCasterMasks::restore(
+        FScene::RenderableSoa& renderableData, Range<uint32_t> casters) noexcept {
+    Culler::result_type* const UTILS_RESTRICT visibleMask =
+            renderableData.data<FScene::VISIBLE_MASK>();
+    for (uint32_t j : casters) {
+        visibleMask[j] |= VISIBLE_SHADOW_CASTER;
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -26,8 +26,11 @@
 
 #include <filament/driver/DriverEnums.h>
 
+#include <algorithm>
 #include <limits>
 
+#include <string.h>
+
 using namespace filament::math;
 using namespace utils;
 
@@ -42,11 +45,17 @@ static constexpr bool USE_DEPTH_CLAMP = false;
 // currently disabled because it creates shadow acne problems at a distance
 static constexpr bool ENABLE_LISPSM = true;
 
+// The cascades are side by side in a single texture, which can't be wider than this, unless a
+// single cascade is. Vulkan guarantees 4096, as do most OpenGL ES 3.0 devices.
+static constexpr uint32_t MAX_SHADOW_MAP_WIDTH = 4096;
+
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
         mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN ||
                           engine.getBackend() == Backend::METAL) {
-    mCamera = mEngine.createCamera(EntityManager::get().create());
+    for (Cascade& cascade : mCascades) {
+        cascade.camera = mEngine.createCamera(EntityManager::get().create());
+    }
     mDebugCamera = mEngine.createCamera(EntityManager::get().create());
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
     debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
@@ -59,16 +68,18 @@ ShadowMap::ShadowMap(FEngine& engine) noexcept :
 }
 
 ShadowMap::~ShadowMap() {
-    mEngine.destroy(mCamera->getEntity());
+    for (Cascade& cascade : mCascades) {
+        mEngine.destroy(cascade.camera->getEntity());
+    }
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
 void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     assert(mShadowMapDimension);
 
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
+    const uint32_t dim = mShadowMapDimension;
+    const uint32_t width = uint32_t(dim * mCascadeCount);
+    if (mTextureWidth == width && mTextureHeight == dim) {
         // nothing to do here.
         assert(mShadowMapHandle);
         return;
@@ -83,17 +94,16 @@ void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     }
 
     // allocate new ones...
-    // we set a viewport with a 1-texel border for when we index outside of the texture
-    // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
-    // see: computeLightSpaceMatrix()
-    mViewport = { 1, 1, dim - 2, dim - 2 };
+    // the cascades are stored side by side, their viewports are set by update()
+    mTextureWidth = width;
+    mTextureHeight = dim;
 
     mShadowMapHandle = driver.createTexture(
-            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, width, dim, 1,
             TextureUsage::DEPTH_ATTACHMENT);
 
     mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
+            TargetBufferFlags::SHADOW, width, dim, 1, Driver::TextureFormat::DEPTH16,
             {}, { mShadowMapHandle }, {});
 
     SamplerParams s;
@@ -114,20 +124,32 @@ void ShadowMap::terminate(DriverApi& driverApi) noexcept {
     }
 }
 
-void ShadowMap::beginRenderPass(DriverApi& driver) const noexcept {
+void ShadowMap::beginRenderPass(DriverApi& driver, size_t cascade) const noexcept {
     RenderPassParams params = {};
-    params.flags.clear = TargetBufferFlags::SHADOW;
-    params.flags.discardStart = TargetBufferFlags::DEPTH;
     params.flags.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
     params.clearDepth = 1.0;
-    params.viewport.width = params.viewport.height = mShadowMapDimension;
-    // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
-    // needlessly.
-    params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR | RenderPassFlags::IGNORE_VIEWPORT;
+    if (mClearAll) {
+        if (cascade == 0) {
+            // the first cascade clears the whole shadow map, the other ones are rendered on top
+            params.flags.clear = TargetBufferFlags::SHADOW;
+            params.flags.discardStart = TargetBufferFlags::DEPTH;
+        }
+        params.viewport.width = mTextureWidth;
+        params.viewport.height = mShadowMapDimension;
+        // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is
+        // reloaded needlessly.
+        params.flags.clear |= RenderPassFlags::IGNORE_SCISSOR | RenderPassFlags::IGNORE_VIEWPORT;
+    } else {
+        // only this cascade (and its border) is cleared, the other ones keep their content
+        params.flags.clear = TargetBufferFlags::SHADOW;
+        params.viewport.left = int32_t(cascade * mShadowMapDimension);
+        params.viewport.width = mShadowMapDimension;
+        params.viewport.height = mShadowMapDimension;
+    }
     driver.beginRenderPass(mShadowMapRenderTarget, params);
 
-    driver.viewport(mViewport.left, mViewport.bottom,
-            mViewport.width, mViewport.height);
+    filament::Viewport const& viewport = mCascades[cascade].viewport;
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
 }
 
 void ShadowMap::update(
@@ -138,22 +160,29 @@ void ShadowMap::update(
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
-    mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
+    const uint32_t mapSize = std::max(1u, lcm.getShadowMapSize(li));
 
     FLightManager::ShadowParams params = lcm.getShadowParams(li);
+    mCascadeCount = lcm.isDirectionalLight(li) ? params.shadowCascades : 1u;
+
+    // with several cascades, each one gets a smaller map rather than exceeding the maximum
+    // texture size
+    const uint32_t maxWidth = std::max(MAX_SHADOW_MAP_WIDTH, mapSize);
+    mShadowMapDimension = std::min(mapSize, maxWidth / uint32_t(mCascadeCount));
+
+    // the casters are culled per cascade again after partitioning, see cullShadowCasters()
+    mCasterMasks.clear();
+
+    // we set a viewport with a 1-texel border for when we index outside of the texture
+    // DON'T CHANGE this unless getTextureCoordsMapping() is updated too.
+    const uint32_t dim = mShadowMapDimension;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        mCascades[i].viewport = { int32_t(i * dim + 1), 1, dim - 2, dim - 2 };
+    }
+
     mat4f projection(camera.cullingProjection);
     if (params.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.shadowFar;
-        if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
-            // perspective projection
-            projection[2].z =     (f + n) / (n - f);
-            projection[3].z = (2 * f * n) / (n - f);
-        } else {
-            // ortho projection
-            projection[2].z =    2.0f / (n - f);
-            projection[3].z = (f + n) / (n - f);
-        }
+        projection = setProjectionRange(projection, camera.zn, params.shadowFar);
     }
 
     CameraInfo cameraInfo = {
@@ -181,31 +210,150 @@ void ShadowMap::update(
     using Type = FLightManager::Type;
     switch (lcm.getType(li)) {
         case Type::SUN:
-        case Type::DIRECTIONAL:
-            computeShadowCameraDirectional(
-                    lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
-                    visibleLayers);
+        case Type::DIRECTIONAL: {
+            // scene bounds in world space
+            Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
+            scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
+            mHasVisibleShadows = false;
+            if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
+                break;
+            }
+
+            float3 const& direction = lightData.elementAt<FScene::DIRECTION>(index);
+            if (mCascadeCount == 1) {
+                mCascades[0].split = params.shadowFar > 0.0f ? params.shadowFar : camera.zf;
+                computeShadowCameraDirectional(direction, cameraInfo,
+                        wsShadowCastersVolume, wsShadowReceiversVolume, 0);
+                break;
+            }
+
+            // each cascade covers a slice of the view frustum, the cascades are always
+            // limited by the shadowFar distance, if any.
+            float splits[CONFIG_MAX_SHADOW_CASCADES];
+            const float zf = params.shadowFar > 0.0f ? params.shadowFar : camera.zf;
+            computeCascadeSplits(splits, mCascadeCount, camera.zn, zf,
+                    params.shadowCascadeSplitLambda);
+            for (size_t i = 0; i < mCascadeCount; i++) {
+                const float n = i ? splits[i - 1] : camera.zn;
+                const float f = splits[i];
+                CameraInfo cascadeCameraInfo(cameraInfo);
+                cascadeCameraInfo.projection = setProjectionRange(camera.cullingProjection, n, f);
+                cascadeCameraInfo.frustum = Frustum(cascadeCameraInfo.projection * camera.view);
+                cascadeCameraInfo.zn = n;
+                cascadeCameraInfo.zf = f;
+                mCascades[i].split = f;
+                computeShadowCameraDirectional(direction, cascadeCameraInfo,
+                        wsShadowCastersVolume, wsShadowReceiversVolume, i);
+            }
             break;
+        }
         case Type::FOCUSED_SPOT:
         case Type::SPOT:
             break;
         case Type::POINT:
             break;
     }
+
+    updateCache(scene, visibleLayers, params.cacheShadowMap);
 }
 
-void ShadowMap::computeShadowCameraDirectional(
-        filament::math::float3 const& dir, FScene const* scene, CameraInfo const& camera,
-        uint8_t visibleLayers) noexcept {
-
-    // scene bounds in world space
-    Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
-    scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
-    if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
-        mHasVisibleShadows = false;
+void ShadowMap::updateCache(FScene const* scene, uint8_t visibleLayers, bool cached) noexcept {
+    ChangeLog<Box> const& changeLog = scene->getShadowCasterChangeLog();
+
+    if (!cached) {
+        // the first cascade is always rendered since it clears the whole shadow map
+        for (size_t i = 0; i < mCascadeCount; i++) {
+            Cascade& cascade = mCascades[i];
+            cascade.dirty = i == 0 || cascade.hasVisibleShadows;
+            cascade.cached = false;
+        }
+        mClearAll = true;
+        return;
+    }
+
+    /*
+     * A cascade is only rendered again when it could look different: when its light's camera
+     * changed (e.g. because the camera moved), or when a caster changed within its frustum.
+     * Everything is rendered again when the changes are not known anymore (e.g. the shadow
+     * map wasn't used during the last frame), when the visible layers changed, or when the
+     * texture is re-allocated.
+     */
+
+    Slice<const Box> changes;
+    const bool valid = mHasVisibleShadows &&
+            scene == mCachedScene && visibleLayers == mCachedVisibleLayers &&
+            mTextureWidth == mShadowMapDimension * mCascadeCount &&
+            mTextureHeight == mShadowMapDimension &&
+            changeLog.getChangesSince(mCasterChangeCursor, changes);
+
+    bool clearAll = true;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        Cascade& cascade = mCascades[i];
+        if (!mHasVisibleShadows) {
+            // the shadow map isn't used this frame
+            cascade.dirty = false;
+            cascade.cached = false;
+            clearAll = false;
+            continue;
+        }
+
+        bool dirty = !valid || !cascade.cached ||
+                cascade.hasVisibleShadows != cascade.cachedHasVisibleShadows ||
+                memcmp(&cascade.lightSpace, &cascade.cachedLightSpace, sizeof(mat4f)) != 0;
+        if (!dirty && cascade.hasVisibleShadows) {
+            Frustum const& frustum = cascade.camera->getFrustum();
+            for (Box const& box : changes) {
+                if (frustum.intersects(box)) {
+                    dirty = true;
+                    break;
+                }
+            }
+        }
+
+        cascade.dirty = dirty;
+        if (dirty) {
+            cascade.cached = true;
+            cascade.cachedHasVisibleShadows = cascade.hasVisibleShadows;
+            cascade.cachedLightSpace = cascade.lightSpace;
+        }
+        clearAll &= dirty;
+    }
+
+    // when all the cascades are rendered, clearing the whole shadow map at once is cheaper
+    mClearAll = clearAll;
+    mCachedScene = scene;
+    mCachedVisibleLayers = visibleLayers;
+    mCasterChangeCursor = changeLog.getSequence();
+}
+
+void ShadowMap::cullShadowCasters(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& renderableData, Range<uint32_t> casters) noexcept {
+    if (mCascadeCount == 1) {
+        // the casters are those of the only cascade
         return;
     }
 
+    // One frustum per cascade rendered this frame. A cascade without visible shadows is only
+    // rendered to be cleared, it has no casters. The other cascades aren't rendered.
+    std::array<Frustum, CONFIG_MAX_SHADOW_CASCADES> frustums;
+    std::array<Frustum const*, CONFIG_MAX_SHADOW_CASCADES> cascadeFrustums = {};
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        Cascade const& cascade = mCascades[i];
+        if (cascade.dirty && cascade.hasVisibleShadows) {
+            frustums[i] = cascade.camera->getFrustum();
+            cascadeFrustums[i] = &frustums[i];
+        }
+    }
+    mCasterMasks.cull(js, arena, renderableData, casters, cascadeFrustums.data(), mCascadeCount);
+}
+
+void ShadowMap::computeShadowCameraDirectional(
+        filament::math::float3 const& dir, CameraInfo const& camera,
+        Aabb const& wsShadowCastersVolume, Aabb const& wsShadowReceiversVolume,
+        size_t cascade) noexcept {
+
+    Cascade& c = mCascades[cascade];
+
     float3 wsViewFrustumCorners[8];
     computeFrustumCorners(wsViewFrustumCorners,
             camera.model * FCamera::inverseProjection(camera.projection));
@@ -215,9 +363,12 @@ void ShadowMap::computeShadowCameraDirectional(
     size_t vertexCount = intersectFrustumWithBox(mWsClippedShadowReceiverVolume,
             camera.frustum, wsViewFrustumCorners, wsShadowReceiversVolume);
 
-    mHasVisibleShadows = vertexCount >= 2;
-    if (mHasVisibleShadows) {
-        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm;
+    c.hasVisibleShadows = vertexCount >= 2;
+    if (c.hasVisibleShadows) {
+        // LiSPSM is disabled with cascades, they're focused on slices of the view frustum
+        // that are too thin for the warping to help.
+        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm &&
+                mCascadeCount == 1;
 
         /*
          * Compute the light's model matrix
@@ -334,9 +485,9 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // For directional lights, we further constraint the light frustum to the
         // intersection of the shadow casters & receivers in light-space.
-        // However, since this relies on the 1-texel shadow map border, this wouldn't directly
-        // work if we were storing several shadow maps in a single texture.
-        if (mEngine.debug.shadowmap.focus_shadowcasters) {
+        // However, since this relies on the 1-texel shadow map border, this doesn't work
+        // when several cascades are stored in the shadow map.
+        if (mEngine.debug.shadowmap.focus_shadowcasters && mCascadeCount == 1) {
             intersectWithShadowCasters(lsLightFrustum, WLMpMv, wsShadowCastersVolume);
         }
 
@@ -344,7 +495,8 @@ void ShadowMap::computeShadowCameraDirectional(
                            (lsLightFrustum.min.y >= lsLightFrustum.max.y))) {
             // this could happen if the only thing visible is a perfectly horizontal or
             // vertical thin line
-            mHasVisibleShadows = false;
+            c.hasVisibleShadows = false;
+            c.lightSpace = getEmptyCascadeMapping(cascade);
             return;
         }
 
@@ -380,14 +532,46 @@ void ShadowMap::computeShadowCameraDirectional(
         // Final shadowmap texture transform
         const mat4f St = mat4f(MbMt * S);
 
-        mTexelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
-        mLightSpace = St;
-        mSceneRange = (zfar - znear);
-        mCamera->setCustomProjection(mat4(S), znear, zfar);
+        mHasVisibleShadows = true;
+        c.texelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
+        c.lightSpace = getCascadeMapping(cascade) * St;
+        c.sceneRange = (zfar - znear);
+        c.camera->setCustomProjection(mat4(S), znear, zfar);
+
+        if (cascade == 0) {
+            // for the debug camera, we need to undo the world origin
+            mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        }
+    } else {
+        // nothing receives shadows in this cascade, but the shader could still select it
+        // (e.g. because of the normal bias)
+        c.lightSpace = getEmptyCascadeMapping(cascade);
+    }
+}
 
-        // for the debug camera, we need to undo the world origin
-        mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+void ShadowMap::computeCascadeSplits(float* splits, size_t cascadeCount,
+        float zn, float zf, float lambda) noexcept {
+    // see: GPU Gems 3, Parallel-Split Shadow Maps on Programmable GPUs
+    for (size_t i = 1; i < cascadeCount; i++) {
+        const float t = float(i) / cascadeCount;
+        const float uniformSplit = zn + (zf - zn) * t;
+        const float logSplit = zn * std::pow(zf / zn, t);
+        splits[i - 1] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
     }
+    splits[cascadeCount - 1] = zf;
+}
+
+mat4f ShadowMap::setProjectionRange(mat4f projection, float n, float f) noexcept {
+    if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
+        // perspective projection
+        projection[2].z =     (f + n) / (n - f);
+        projection[3].z = (2 * f * n) / (n - f);
+    } else {
+        // ortho projection
+        projection[2].z =    2.0f / (n - f);
+        projection[3].z = (f + n) / (n - f);
+    }
+    return projection;
 }
 
 mat4f ShadowMap::applyLISPSM(CameraInfo const& camera, float dzn, float dzf, mat4f const& LMpMv,
@@ -493,6 +677,31 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
     return Mb * Mt;
 }
 
+mat4f ShadowMap::getCascadeMapping(size_t cascade) const noexcept {
+    // remaps the texture coordinates of a cascade to its tile in the shadow map
+    const float s = 1.0f / mCascadeCount;
+    const mat4f Mc(mat4f::row_major_init{
+            s, 0, 0, cascade * s,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1
+    });
+    return Mc;
+}
+
+mat4f ShadowMap::getEmptyCascadeMapping(size_t cascade) const noexcept {
+    // maps everything to the border of the cascade's tile, which is cleared and never rendered
+    // into, i.e.: nothing is in shadow.
+    const float o = 0.5f / mShadowMapDimension;
+    const mat4f Me(mat4f::row_major_init{
+            0, 0, 0, o,
+            0, 0, 0, o,
+            0, 0, 0, 0,
+            0, 0, 0, 1
+    });
+    return getCascadeMapping(cascade) * Me;
+}
+
 // This construct a frustum (similar to glFrustum or filament::math::frustum), except
 // it looks towards the +y axis, and assumes -1,1 for the left/right and bottom/top planes.
 mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
@@ -21,8 +21,21 @@
 
 #include "FilamentAPI-impl.h"
 
+#include <image/ColorTransform.h>
+#include <image/ImageSampler.h>
+#include <image/LinearImage.h>
+
+#include <math/half.h>
+
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
+#include <array>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
 namespace filament {
 
 using namespace details;
@@ -196,7 +209,8 @@ void FTexture::generateMipmaps(FEngine& engine) const noexcept {
     // The OpenGL spec for GenerateMipmap stipulates that it returns INVALID_OPERATION unless
     // the sized internal format is both color-renderable and texture-filterable.
     if (!ASSERT_POSTCONDITION_NON_FATAL(isColorRenderable(engine, mFormat),
-            "Texture format must be color renderable")) {
+            "Texture format must be color renderable, "
+            "use generateMipmaps() with the base level instead")) {
         return;
     }
     if (mLevels == 1 || (mWidth == 1 && mHeight == 1)) {
@@ -245,6 +259,223 @@ void FTexture::generateMipmaps(FEngine& engine) const noexcept {
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+// CPU mipmap generation
+
+namespace {
+
+size_t getComponentCount(Texture::Format format) noexcept {
+    switch (format) {
+        case Texture::Format::R:
+        case Texture::Format::ALPHA:
+            return 1;
+        case Texture::Format::RG:
+            return 2;
+        case Texture::Format::RGB:
+            return 3;
+        case Texture::Format::RGBA:
+        case Texture::Format::RGBM:
+            return 4;
+        default:
+            // integer and depth formats can't be filtered
+            return 0;
+    }
+}
+
+size_t getComponentSize(Texture::Type type) noexcept {
+    switch (type) {
+        case Texture::Type::UBYTE:
+            return 1;
+        case Texture::Type::HALF:
+            return 2;
+        case Texture::Type::FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+inline float readComponent(uint8_t const* p, Texture::Type type) noexcept {
+    if (type == Texture::Type::UBYTE) {
+        return *p * (1.0f / 255.0f);
+    }
+    if (type == Texture::Type::HALF) {
+        math::half h;
+        memcpy(&h, p, sizeof(h));
+        return float(h);
+    }
+    float f;
+    memcpy(&f, p, sizeof(f));
+    return f;
+}
+
+inline void writeComponent(uint8_t* p, Texture::Type type, float v) noexcept {
+    if (type == Texture::Type::UBYTE) {
+        *p = uint8_t(math::saturate(v) * 255.0f + 0.5f);
+    } else if (type == Texture::Type::HALF) {
+        math::half h(v);
+        memcpy(p, &h, sizeof(h));
+    } else {
+        memcpy(p, &v, sizeof(v));
+    }
+}
+
+} // anonymous namespace
+
+image::LinearImage FTexture::decodeImage(uint8_t const* data, size_t bpr,
+        uint32_t width, uint32_t height,
+        size_t componentCount, Texture::Type type, Encoding encoding) noexcept {
+    const size_t componentSize = getComponentSize(type);
+    const size_t channels = encoding == Encoding::RGBM ? 3 : componentCount;
+    image::LinearImage result(width, height, uint32_t(channels));
+    float* UTILS_RESTRICT d = result.getPixelRef();
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t const* UTILS_RESTRICT p = data + y * bpr;
+        for (uint32_t x = 0; x < width; x++) {
+            math::float4 c(0.0f);
+            for (size_t i = 0; i < componentCount; i++, p += componentSize) {
+                c[i] = readComponent(p, type);
+            }
+            if (encoding == Encoding::RGBM) {
+                c.rgb = image::RGBMtoLinear(c);
+            } else if (encoding == Encoding::SRGB && componentCount >= 3) {
+                c.rgb = image::sRGBToLinear(math::float3(c.rgb));
+            }
+            for (size_t i = 0; i < channels; i++) {
+                *d++ = c[i];
+            }
+        }
+    }
+    return result;
+}
+
+void FTexture::encodeImage(uint8_t* data, image::LinearImage const& image,
+        size_t componentCount, Texture::Type type, Encoding encoding) noexcept {
+    const size_t componentSize = getComponentSize(type);
+    const size_t channels = image.getChannels();
+    const size_t count = size_t(image.getWidth()) * image.getHeight();
+    float const* UTILS_RESTRICT s = image.getPixelRef();
+    uint8_t* UTILS_RESTRICT p = data;
+    for (size_t j = 0; j < count; j++, s += channels) {
+        math::float4 c(0.0f);
+        for (size_t i = 0; i < channels; i++) {
+            c[i] = s[i];
+        }
+        if (encoding == Encoding::RGBM) {
+            // the resampling filter can overshoot below zero
+            c = image::linearToRGBM(max(math::float3(c.rgb), math::float3(0.0f)));
+        } else if (encoding == Encoding::SRGB && componentCount >= 3) {
+            c.rgb = image::linearTosRGB(math::float3(c.rgb));
+        }
+        for (size_t i = 0; i < componentCount; i++, p += componentSize) {
+            writeComponent(p, type, c[i]);
+        }
+    }
+}
+
+void FTexture::generateMipmaps(FEngine& engine, PixelBufferDescriptor&& buffer,
+        FaceOffsets const* faceOffsets) const noexcept {
+    const bool isCubemap = faceOffsets != nullptr;
+    if (mStream || isCubemap != (mTarget == Sampler::SAMPLER_CUBEMAP) || !buffer.buffer) {
+        return;
+    }
+
+    const size_t componentSize = getComponentSize(buffer.type);
+    const size_t componentCount = componentSize ? getComponentCount(buffer.format) : 0;
+    if (!ASSERT_POSTCONDITION_NON_FATAL(componentCount,
+            "CPU mipmap generation requires R, RG, RGB, RGBA or RGBM pixels "
+            "of type UBYTE, HALF or FLOAT")) {
+        return;
+    }
+
+    Encoding encoding = Encoding::LINEAR;
+    if (mRgbm || buffer.format == Texture::Format::RGBM) {
+        if (!ASSERT_POSTCONDITION_NON_FATAL(componentCount == 4,
+                "RGBM textures must have 4 components")) {
+            return;
+        }
+        encoding = Encoding::RGBM;
+    } else if (mFormat == InternalFormat::SRGB8 || mFormat == InternalFormat::SRGB8_A8) {
+        encoding = Encoding::SRGB;
+    }
+
+    const size_t faceCount = isCubemap ? 6 : 1;
+    const size_t bpp = componentCount * componentSize;
+    const Texture::Format format = buffer.format;
+    const Texture::Type type = buffer.type;
+
+    // all generated levels are stored in a single allocation, one after the other, and the
+    // faces of a level are contiguous
+    std::vector<size_t> levelOffsets(mLevels + 1u, 0);
+    for (size_t level = 1; level < mLevels; level++) {
+        levelOffsets[level + 1] = levelOffsets[level] +
+                getWidth(level) * getHeight(level) * bpp * faceCount;
+    }
+    const size_t size = levelOffsets[mLevels];
+    uint8_t* const levels = size ? static_cast<uint8_t*>(malloc(size)) : nullptr;
+
+    if (levels) {
+        const uint8_t* const base = static_cast<uint8_t const*>(buffer.buffer);
+        const size_t bpr = PixelBufferDescriptor::computeDataSize(format, type,
+                buffer.stride ? buffer.stride : mWidth, 1, buffer.alignment);
+        const size_t skip = buffer.top * bpr + buffer.left * bpp;
+
+        utils::JobSystem& js = engine.getJobSystem();
+        std::array<image::LinearImage, 6> sources;
+
+        // first decode the base level of each face...
+        auto decode = [&](size_t face) {
+            sources[face] = decodeImage(
+                    base + (isCubemap ? (*faceOffsets)[face] : 0) + skip, bpr,
+                    mWidth, mHeight, componentCount, type, encoding);
+        };
+        auto parent = js.createJob();
+        for (size_t face = 0; face < faceCount; face++) {
+            js.run(utils::jobs::createJob(js, parent, std::cref(decode), face));
+        }
+        js.runAndWait(parent);
+
+        // ...then each level of each face is resampled from it independently
+        auto resample = [&](size_t face, size_t level) {
+            const uint32_t w = uint32_t(getWidth(level));
+            const uint32_t h = uint32_t(getHeight(level));
+            image::LinearImage image = image::resampleImage(sources[face], w, h);
+            encodeImage(levels + levelOffsets[level] + w * h * bpp * face,
+                    image, componentCount, type, encoding);
+        };
+        parent = js.createJob();
+        for (size_t level = 1; level < mLevels; level++) {
+            for (size_t face = 0; face < faceCount; face++) {
+                js.run(utils::jobs::createJob(js, parent, std::cref(resample), face, level));
+            }
+        }
+        js.runAndWait(parent);
+    }
+
+    // upload the whole chain at once, the last level frees the allocation
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    if (isCubemap) {
+        driver.updateCubeImage(mHandle, 0, std::move(buffer), *faceOffsets);
+    } else {
+        driver.update2DImage(mHandle, 0, 0, 0, mWidth, mHeight, std::move(buffer));
+    }
+    for (size_t level = 1; levels && level < mLevels; level++) {
+        const uint32_t w = uint32_t(getWidth(level));
+        const uint32_t h = uint32_t(getHeight(level));
+        PixelBufferDescriptor data(levels + levelOffsets[level],
+                levelOffsets[level + 1] - levelOffsets[level], format, type);
+        if (level + 1 == mLevels) {
+            data.setCallback([](void*, size_t, void* user) { free(user); }, levels);
+        }
+        if (isCubemap) {
+            driver.updateCubeImage(mHandle, uint8_t(level), std::move(data),
+                    FaceOffsets(w * h * bpp));
+        } else {
+            driver.update2DImage(mHandle, uint8_t(level), 0, 0, w, h, std::move(data));
+        }
+    }
+}
+
 bool FTexture::isTextureFormatSupported(FEngine& engine, InternalFormat format) noexcept {
     return engine.getDriverApi().isTextureFormatSupported(format);
 }
@@ -407,6 +638,16 @@ void Texture::generateMipmaps(Engine& engine) const noexcept {
     upcast(this)->generateMipmaps(upcast(engine));
 }
 
+void Texture::generateMipmaps(Engine& engine,
+        Texture::PixelBufferDescriptor&& buffer) const noexcept {
+    upcast(this)->generateMipmaps(upcast(engine), std::move(buffer), nullptr);
+}
+
+void Texture::generateMipmaps(Engine& engine,
+        Texture::PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept {
+    upcast(this)->generateMipmaps(upcast(engine), std::move(buffer), &faceOffsets);
+}
+
 bool Texture::isTextureFormatSupported(Engine& engine, InternalFormat format) noexcept {
     return FTexture::isTextureFormatSupported(upcast(engine), format);
 }
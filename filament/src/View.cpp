@@ -39,6 +39,7 @@
 #include <math/scalar.h>
 #include <math/fast.h>
 
+#include <limits>
 #include <memory>
 
 using namespace filament::math;
@@ -50,18 +51,12 @@ using namespace driver;
 
 namespace details {
 
-// values of the 'VISIBLE_MASK' after culling (0: not visible)
-static constexpr size_t VISIBLE_RENDERABLE_BIT = 0u;
-static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
-static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
-static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
-static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
-
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(engine.getPerViewUib()),
       mPerViewSb(engine.getPerViewSib()),
-      mDirectionalShadowMap(engine) {
+      mDirectionalShadowMap(engine),
+      mShadowAtlas(engine) {
     DriverApi& driver = engine.getDriverApi();
 
     // set-up samplers
@@ -78,7 +73,8 @@ FView::FView(FEngine& engine)
     mPerViewUbh = driver.createUniformBuffer(mPerViewUb.getSize(), driver::BufferUsage::DYNAMIC);
     mLightUbh = driver.createUniformBuffer(CONFIG_MAX_LIGHT_COUNT * sizeof(LightsUib), driver::BufferUsage::DYNAMIC);
 
-    mIsDynamicResolutionSupported = driver.isFrameTimeSupported();
+    mIsDynamicResolutionSupported =
+            driver.isFrameTimeSupported() || driver.isTimerQuerySupported();
 }
 
 FView::~FView() noexcept = default;
@@ -90,8 +86,11 @@ void FView::terminate(FEngine& engine) {
     driver.destroyUniformBuffer(mLightUbh);
     driver.destroySamplerBuffer(mPerViewSbh);
     driver.destroyUniformBuffer(mRenderableUbh);
+    driver.destroyUniformBuffer(mInstancesUbh);
     mDirectionalShadowMap.terminate(driver);
+    mShadowAtlas.terminate(driver);
     mFroxelizer.terminate(driver);
+    mFrameGraphCache.terminate(driver);
 }
 
 void FView::setViewport(filament::Viewport const& viewport) noexcept {
@@ -274,44 +273,89 @@ bool FView::isSkyboxVisible() const noexcept {
 }
 
 void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+        FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept {
     SYSTRACE_CALL();
 
-    // setup shadow mapping
-    // TODO: for now we only consider THE directional light
-
     auto& lcm = engine.getLightManager();
     UniformBuffer& u = getUb();
     FScene* const scene = mScene;
 
+    // the shaders don't sample the directional shadow map without cascades
+    uint32_t cascades = 0;
+
     // dominant directional light is always as index 0
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
-    mHasShadowing = mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
-    if (UTILS_UNLIKELY(mHasShadowing)) {
+    mHasDirectionalShadowing =
+            mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
+    if (UTILS_UNLIKELY(mHasDirectionalShadowing)) {
         // compute the frustum for this light
         ShadowMap& shadowMap = mDirectionalShadowMap;
         shadowMap.update(lightData, 0, scene, mViewingCameraInfo, mVisibleLayers);
         if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            FView::prepareVisibleShadowCasters(engine.getJobSystem(), frustum, renderableData);
+            // Cull shadow casters of all the cascades rendered this frame, the casters of
+            // each cascade are culled again after partitioning (see cullShadowCasters())
+            const size_t cascadeCount = shadowMap.getCascadeCount();
+            for (size_t i = 0; i < cascadeCount; i++) {
+                if (shadowMap.hasVisibleShadows(i) && shadowMap.isCascadeDirty(i)) {
+                    Frustum const& frustum = shadowMap.getCamera(i).getFrustum();
+                    FView::prepareVisibleShadowCasters(engine.getJobSystem(), frustum,
+                            *scene);
+                }
+            }
 
             // allocates shadowmap driver resources
             shadowMap.prepare(driver, getUs());
 
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
-
             // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
             // needed with other APIs, but at least it won't worsen the acnee there.
-            const float sceneRange = shadowMap.getSceneRange();
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
             const float constantBias = lcm.getShadowConstantBias(directionalLight);
             const float normalBias = lcm.getShadowNormalBias(directionalLight);
+
+            // unused cascades are never selected by the shader
+            float4 cascadeSplits{ std::numeric_limits<float>::infinity() };
+            float4 cascadeConstantBias{ 0 };
+            float4 cascadeNormalBias{ 0 };
+            for (size_t i = 0; i < cascadeCount; i++) {
+                mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix(i);
+                u.setUniform(offsetof(PerViewUib, lightFromWorldMatrix) + i * sizeof(mat4f),
+                        lightFromWorldMatrix);
+                if (shadowMap.hasVisibleShadows(i)) {
+                    const float sceneRange = shadowMap.getSceneRange(i);
+                    const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace(i);
+                    cascadeConstantBias[i] = 2 * constantBias / sceneRange;
+                    cascadeNormalBias[i] = normalBias * texelSizeWorldSpace;
+                }
+                cascadeSplits[i] = shadowMap.getCascadeSplit(i);
+            }
+
             u.setUniform(offsetof(PerViewUib, shadowBias),
-                    float3{ 2 * constantBias / sceneRange, normalBias * texelSizeWorldSpace, 0 });
+                    float3{ cascadeConstantBias[0], cascadeNormalBias[0], 0 });
+            u.setUniform(offsetof(PerViewUib, cascadeSplits), cascadeSplits);
+            u.setUniform(offsetof(PerViewUib, cascadeConstantBias), cascadeConstantBias);
+            u.setUniform(offsetof(PerViewUib, cascadeNormalBias), cascadeNormalBias);
+            cascades = uint32_t(cascadeCount);
         }
     }
+    u.setUniform(offsetof(PerViewUib, cascades), cascades);
+
+    // spot and point lights use the tiles of the shadow atlas
+    if (mShadowingEnabled) {
+        ShadowAtlas& shadowAtlas = mShadowAtlas;
+        shadowAtlas.update(lcm, scene, lightData, mViewingCameraInfo, mVisibleLayers,
+                size_t(std::max(1, engine.debug.shadowmap.atlas_updates)));
+        if (UTILS_UNLIKELY(shadowAtlas.hasShadows())) {
+            // Cull the shadow casters of the tiles rendered this frame, the casters of
+            // each tile are culled again after partitioning (see cullShadowCasters())
+            for (size_t i = 0, c = shadowAtlas.getUpdatedTileCount(); i < c; i++) {
+                FView::prepareVisibleShadowCasters(engine.getJobSystem(),
+                        shadowAtlas.getUpdatedTileFrustum(i), *scene);
+            }
+            shadowAtlas.prepare(driver, getUs());
+            shadowAtlas.updateUniforms(u);
+        }
+    } else {
+        mShadowAtlas.clear();
+    }
 }
 
 void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena,
@@ -384,6 +428,14 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
         // Disable the sun if there's no directional light
         float4 sun{ 0.0f, 0.0f, 0.0f, -1.0f };
         u.setUniform(offsetof(PerViewUib, sun), sun);
+
+        // Shadow receivers need the directional lighting variant (without it, the shadow
+        // receiver variant is reserved), so spot and point light shadows use a black light.
+        if (mShadowAtlas.hasShadows()) {
+            mHasDirectionalLight = true;
+            u.setUniform(offsetof(PerViewUib, lightDirection), float3{ 0, 0, 1 });
+            u.setUniform(offsetof(PerViewUib, lightColorIntensity), float4{ 0 });
+        }
     }
 
     // Dynamic lighting
@@ -484,16 +536,21 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
          * (this will set the VISIBLE_RENDERABLE bit)
          */
 
-        prepareVisibleRenderables(js, mCullingFrustum, renderableData);
-
+        prepareVisibleRenderables(js, mCullingFrustum, *scene);
 
         /*
          * Shadowing: compute the shadow camera and cull shadow casters
          * (this will set the VISIBLE_SHADOW_CASTER bit)
+         * Relies on prepareVisibleLights(), the spot and point lights shadows are only
+         * computed for the visible lights.
          */
 
+        js.waitAndRelease(prepareVisibleLightsJob);
         prepareShadowing(engine, driver, renderableData, scene->getLightData());
 
+        // with hierarchical culling, the results of all the frustums are gathered at once
+        scene->gatherHierarchicalCulling(js);
+
         /*
          * partition the array of renderable w.r.t their visibility:
          *
@@ -521,6 +578,17 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
         mVisibleShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
         merged = Range{ 0, iEnd };
 
+        // cull the casters of each shadow cascade rendered this frame
+        if (hasDirectionalShadowing()) {
+            mDirectionalShadowMap.cullShadowCasters(js, arena, renderableData,
+                    mVisibleShadowCasters);
+        }
+
+        // cull the casters of each shadow atlas tile rendered this frame
+        if (mShadowAtlas.getUpdatedTileCount()) {
+            mShadowAtlas.cullShadowCasters(js, arena, renderableData, mVisibleShadowCasters);
+        }
+
         // update those UBOs
         const size_t size = merged.size() * sizeof(PerRenderableUib);
         if (mRenderableUBOSize < size) {
@@ -534,6 +602,18 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
             // TODO: should we shrink the underlying UBO at some point?
         }
         scene->updateUBOs(merged, mRenderableUbh);
+
+        // cull the instances of the instanced renderables and update their UBO. Without them,
+        // the engine's dummy UBO is bound instead, so ours isn't created needlessly
+        const size_t instancesSize = scene->prepareInstances(merged);
+        if (mInstancesUBOSize < instancesSize) {
+            mInstancesUBOSize = uint32_t(instancesSize);
+            driver.destroyUniformBuffer(mInstancesUbh);
+            mInstancesUbh = driver.createUniformBuffer(mInstancesUBOSize,
+                    driver::BufferUsage::STREAM);
+        }
+        scene->updateInstancesUBO(js, mCullingFrustum, isFrustumCullingEnabled(),
+                mInstancesUbh, instancesSize);
     }
 
     /*
@@ -542,7 +622,6 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
      * Relies on FScene::prepare() and prepareVisibleLights()
      */
 
-    js.waitAndRelease(prepareVisibleLightsJob);
     prepareLighting(engine, driver, arena, viewport);
 
     /*
@@ -553,9 +632,8 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     getUb().setUniform(offsetof(PerViewUib, time), fraction);
     getUb().setUniform(offsetof(PerViewUib, userTime), userTime);
 
-    // upload the renderables's dirty UBOs
-    engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    // upload the bones of the skinned renderables
+    engine.getRenderableManager().prepare(driver);
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
@@ -646,11 +724,12 @@ void FView::commitFroxels(driver::DriverApi& driverApi) const noexcept {
 
 UTILS_NOINLINE
 void FView::prepareVisibleRenderables(JobSystem& js,
-        Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept {
+        Frustum const& frustum, FScene& scene) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isFrustumCullingEnabled())) {
-        FView::cullRenderables(js, renderableData, frustum, VISIBLE_RENDERABLE_BIT);
+        FView::cullRenderables(js, scene, frustum, VISIBLE_RENDERABLE_BIT);
     } else {
+        FScene::RenderableSoa& renderableData = scene.getRenderableData();
         std::uninitialized_fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
     }
@@ -658,14 +737,21 @@ void FView::prepareVisibleRenderables(JobSystem& js,
 
 UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
-        Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept {
+        Frustum const& lightFrustum, FScene& scene) noexcept {
     SYSTRACE_CALL();
-    FView::cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    FView::cullRenderables(js, scene, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
 }
 
 void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+        FScene& scene, Frustum const& frustum, size_t bit) noexcept {
+
+    if (scene.hasCullingHierarchy()) {
+        // the results are added to VISIBLE_MASK by FScene::gatherHierarchicalCulling()
+        scene.cullHierarchy(js, frustum, bit);
+        return;
+    }
 
+    FScene::RenderableSoa& renderableData = scene.getRenderableData();
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
     uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_ENTITYCHANGELOG_H
+#define TNT_FILAMENT_DETAILS_ENTITYCHANGELOG_H
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+#include <utils/Slice.h>
+
+#include <vector>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * EntityChangeLog records the entities whose component data was modified, so that the data
+ * derived from it (e.g. FScene's RenderableSoa) can be patched instead of being re-gathered.
+ * ChangeLog<T> records other kinds of changes the same way, e.g. FScene records the bounds of
+ * the shadow casters that moved.
+ *
+ * Each consumer keeps a cursor, the value of getSequence() at the time it last caught up.
+ * getChangesSince() returns the entities marked after that cursor, or false if that information
+ * has been dropped -- either because the log was trimmed (see trim()) or invalidated by a
+ * structural change (components created or destroyed), in which case the consumer must
+ * perform a full update.
+ *
+ * An entry can appear several times in the log. This class is not thread-safe.
+ */
+template<typename T>
+class ChangeLog {
+public:
+    using Sequence = uint64_t;
+
+    // records that some state associated to entry e has changed
+    void mark(T const& e) noexcept {
+        if (UTILS_LIKELY(mEntries.size() < MAX_ENTRY_COUNT)) {
+            mEntries.push_back(e);
+        } else {
+            // past this point, consumers are better off doing a full update
+            invalidate();
+        }
+    }
+
+    // forces all consumers to do a full update
+    void invalidate() noexcept {
+        mBase = getSequence() + 1;
+        mEntries.clear();
+    }
+
+    // drops all the recorded changes, consumers which haven't caught up will do a full update.
+    void trim() noexcept {
+        mBase = getSequence();
+        mEntries.clear();
+    }
+
+    Sequence getSequence() const noexcept {
+        return mBase + mEntries.size();
+    }
+
+    // returns false if the changes since 'cursor' are not known anymore
+    bool getChangesSince(Sequence cursor, utils::Slice<const T>& changes) const noexcept {
+        if (cursor < mBase) {
+            return false;
+        }
+        assert(cursor <= getSequence());
+        T const* const entries = mEntries.data();
+        changes = { entries + (cursor - mBase), entries + mEntries.size() };
+        return true;
+    }
+
+private:
+    static constexpr size_t MAX_ENTRY_COUNT = 65536;
+    std::vector<T> mEntries;
+    Sequence mBase = 0;
+};
+
+using EntityChangeLog = ChangeLog<utils::Entity>;
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_ENTITYCHANGELOG_H
@@ -173,6 +173,11 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         shadowParams.shadowFar = std::max(builder->mShadowOptions.shadowFar, 0.0f);
         shadowParams.shadowNearHint = std::max(builder->mShadowOptions.shadowNearHint, 0.0f);
         shadowParams.shadowFarHint = std::max(builder->mShadowOptions.shadowFarHint, 0.0f);
+        shadowParams.shadowCascadeSplitLambda =
+                clamp(builder->mShadowOptions.shadowCascadeSplitLambda, 0.0f, 1.0f);
+        shadowParams.shadowCascades = uint8_t(clamp(builder->mShadowOptions.shadowCascades,
+                uint8_t(1), uint8_t(CONFIG_MAX_SHADOW_CASCADES)));
+        shadowParams.cacheShadowMap = builder->mShadowOptions.cacheShadowMap;
 
         // set default values by calling the setters
         setLocalPosition(i, builder->mPosition);
@@ -188,6 +193,7 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         setSunHaloSize(i, builder->mSunHaloSize);
         setSunHaloFalloff(i, builder->mSunHaloFalloff);
     }
+    mChangeLog.invalidate();
 }
 
 void FLightManager::prepare(driver::DriverApi& driver) const noexcept {
@@ -198,6 +204,7 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        mChangeLog.invalidate();
     }
 }
 
@@ -219,12 +226,14 @@ void FLightManager::setLocalPosition(Instance i, const filament::math::float3& p
     assert(i);
     auto& manager = mManager;
     manager[i].position = position;
+    mChangeLog.mark(manager.getEntity(i));
 }
 
 void FLightManager::setLocalDirection(Instance i, float3 direction) noexcept {
     assert(i);
     auto& manager = mManager;
     manager[i].direction = direction;
+    mChangeLog.mark(manager.getEntity(i));
 }
 
 void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
@@ -268,6 +277,8 @@ void FLightManager::setIntensity(Instance i, float intensity) noexcept {
                 break;
         }
         manager[i].intensity = luminousIntensity;
+        // the dominant directional light is picked by intensity
+        mChangeLog.mark(manager.getEntity(i));
     }
 }
 
@@ -278,6 +289,7 @@ void FLightManager::setFalloff(Instance i, float falloff) noexcept {
         SpotParams& spotParams = manager[i].spotParams;
         manager[i].squaredFallOffInv = sqFalloff ? (1 / sqFalloff) : 0;
         spotParams.radius = falloff;
+        mChangeLog.mark(manager.getEntity(i));
     }
 }
 
@@ -19,6 +19,8 @@
 
 #include "upcast.h"
 
+#include "components/EntityChangeLog.h"
+
 #include "driver/DriverApiForward.h"
 
 #include <filament/LightManager.h>
@@ -53,6 +55,10 @@ public:
         return mManager.getInstance(e);
     }
 
+    size_t getComponentCount() const noexcept {
+        return mManager.getComponentCount();
+    }
+
     void create(const FLightManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
@@ -60,9 +66,17 @@ public:
     void prepare(driver::DriverApi& driver) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+        mManager.gc(em, 4, [this](utils::Entity e) {
+            mManager.removeComponent(e);
+            mChangeLog.invalidate();
+        });
     }
 
+    // entities whose state relevant to FScene (position, direction, radius, intensity) changed
+    EntityChangeLog const& getChangeLog() const noexcept { return mChangeLog; }
+
+    void trimChangeLog() noexcept { mChangeLog.trim(); }
+
     struct LightType {
         Type type : 3;
         uint8_t shadowMapBits : 4;
@@ -84,6 +98,9 @@ public:
         float shadowFar;
         float shadowNearHint;
         float shadowFarHint;
+        float shadowCascadeSplitLambda;
+        uint8_t shadowCascades;
+        bool cacheShadowMap;
     };
 
     UTILS_NOINLINE void setLocalPosition(Instance i, const filament::math::float3& position) noexcept;
@@ -154,6 +171,14 @@ public:
         return getShadowParams(i).shadowFar;
     }
 
+    constexpr uint8_t getShadowCascades(Instance i) const noexcept {
+        return getShadowParams(i).shadowCascades;
+    }
+
+    constexpr bool isShadowMapCached(Instance i) const noexcept {
+        return getShadowParams(i).cacheShadowMap;
+    }
+
     constexpr const filament::math::float3& getColor(Instance i) const noexcept {
         return mManager[i].color;
     }
@@ -268,6 +293,7 @@ private:
     };
 
     Sim mManager;
+    EntityChangeLog mChangeLog;
     FEngine& mEngine;
 };
 
@@ -48,6 +48,9 @@ struct RenderableManager::BuilderDetails {
     size_t mSkinningBoneCount = 0;
     Bone const* mUserBones = nullptr;
     filament::math::mat4f const* mUserBoneMatrices = nullptr;
+    BoneFormat mBoneFormat = BoneFormat::FULL;
+    size_t mInstanceCount = 0;
+    filament::math::mat4f const* mUserInstanceTransforms = nullptr;
 
     explicit BuilderDetails(size_t count)
             : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
@@ -152,6 +155,23 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::boneFormat(BoneFormat format) noexcept {
+    mImpl->mBoneFormat = format;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::instances(size_t instanceCount) noexcept {
+    mImpl->mInstanceCount = instanceCount;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::instances(
+        size_t instanceCount, filament::math::mat4f const* transforms) noexcept {
+    mImpl->mInstanceCount = instanceCount;
+    mImpl->mUserInstanceTransforms = transforms;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntries.size()) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -159,14 +179,25 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::boneOffset(size_t index, size_t offset) noexcept {
+    if (index < mImpl->mEntries.size()) {
+        mImpl->mEntries[index].boneOffset = uint32_t(offset);
+    }
+    return *this;
+}
+
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
     bool isEmpty = true;
 
-    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mSkinningBoneCount <= CONFIG_MAX_BONE_COUNT,
-            "bone count > %u", CONFIG_MAX_BONE_COUNT)) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mInstanceCount <= CONFIG_MAX_INSTANCE_COUNT,
+            "instance count > %u", CONFIG_MAX_INSTANCE_COUNT)) {
         return Error;
     }
 
+    // primitives bind the bones at offsets aligned to 256 bytes
+    const size_t boneAlignment = mImpl->mBoneFormat == BoneFormat::COMPACT ?
+            BonePalette::COMPACT_BONE_ALIGNMENT : BonePalette::BONE_ALIGNMENT;
+
     for (size_t i = 0, c = mImpl->mEntries.size(); i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
@@ -201,6 +232,15 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
             return Error;
         }
 
+        if (!ASSERT_PRECONDITION_NON_FATAL(entry.boneOffset % boneAlignment == 0 &&
+                (!entry.boneOffset || entry.boneOffset < mImpl->mSkinningBoneCount),
+                "[entity=%u, primitive @ %u] invalid bone offset (%u), bone count (%u)",
+                i, entity.getId(),
+                entry.boneOffset, mImpl->mSkinningBoneCount)) {
+            entry.vertices = nullptr;
+            return Error;
+        }
+
 #ifndef NDEBUG
         // this can't be an error because (1) those values are not immutable, so the caller
         // could fix later, and (2) the material's shader will work (i.e. compile), and
@@ -276,43 +316,43 @@ void FRenderableManager::create(
         setReceiveShadows(ci, builder->mReceiveShadows);
         setCulling(ci, builder->mCulling);
         setSkinning(ci, false);
+        setCompactBones(ci, builder->mBoneFormat == BoneFormat::COMPACT);
 
         const size_t count = builder->mSkinningBoneCount;
         if (UTILS_UNLIKELY(count)) {
-            std::unique_ptr<Bones>& bones = manager[ci].bones;
-            // Note that we are sizing the bones UBO according to CONFIG_MAX_BONE_COUNT rather than
-            // mSkinningBoneCount. According to the OpenGL ES 3.2 specification in 7.6.3 Uniform
-            // Buffer Object Bindings:
-            //
-            //     the uniform block must be populated with a buffer object with a size no smaller
-            //     than the minimum required size of the uniform block (the value of
-            //     UNIFORM_BLOCK_DATA_SIZE).
-            //
-            // This unfortunately means that we are using a large memory footprint for skinned
-            // renderables. In the future we could try addressing this by implementing a paging
-            // system such that multiple skinned renderables will share regions within a single
-            // large block of bones.
-            bones = std::unique_ptr<Bones>(new Bones{
-                    driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone),
-                            driver::BufferUsage::DYNAMIC),
-                    UniformBuffer{ count * sizeof(PerRenderableUibBone) },
-                    count
-            });
-            assert(bones);
-            if (bones) {
-                setSkinning(ci, true);
-                if (builder->mUserBones) {
-                    setBones(ci, builder->mUserBones, count);
-                } else if (builder->mUserBoneMatrices) {
-                    setBones(ci, builder->mUserBoneMatrices, count);
-                } else {
-                    // initialize the bones to identity
-                    PerRenderableUibBone* out = (PerRenderableUibBone*)bones->bones.invalidate();
-                    std::uninitialized_fill_n(out, count, PerRenderableUibBone{});
-                }
+            // The bones live in the engine's bone palette, a single UBO shared by all the skinned
+            // renderables. Each primitive binds a whole BonesUniforms block (as required by
+            // OpenGL ES 3.2, 7.6.3 Uniform Buffer Object Bindings) starting at its own offset
+            // in the renderable's range; the palette always has room for that past its last
+            // range. The palette initializes the bones to identity.
+            const bool compact = builder->mBoneFormat == BoneFormat::COMPACT;
+            Bones& bones = manager[ci].bones;
+            bones = { mBonePalette.allocate(getBoneStorage(count, compact)), uint32_t(count) };
+            if (compact) {
+                PerRenderableUibCompactBone* out = mBonePalette.editCompact(bones.index, 0, count);
+                std::uninitialized_fill_n(out, count, PerRenderableUibCompactBone{});
+            }
+            setSkinning(ci, true);
+            if (builder->mUserBones) {
+                setBones(ci, builder->mUserBones, count);
+            } else if (builder->mUserBoneMatrices) {
+                setBones(ci, builder->mUserBoneMatrices, count);
+            }
+        }
+
+        const size_t instanceCount = builder->mInstanceCount;
+        if (UTILS_UNLIKELY(instanceCount)) {
+            // The instance transforms are only kept on the CPU, the views cull the instances and
+            // upload the transforms of the visible ones into their own UBO.
+            std::unique_ptr<Instances>& instances = manager[ci].instances;
+            instances = std::unique_ptr<Instances>(new Instances{
+                    std::vector<mat4f>(instanceCount), builder->mAABB });
+            if (builder->mUserInstanceTransforms) {
+                setInstanceTransforms(ci, builder->mUserInstanceTransforms, instanceCount);
             }
         }
     }
+    mChangeLog.invalidate();
 }
 
 // this destroys a single component from an entity
@@ -321,11 +361,33 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mChangeLog.invalidate();
+    }
+}
+
+void FRenderableManager::gc(utils::EntityManager& em) noexcept {
+    mManager.gc(em, 4, [this](Entity e) {
+        Instance ci = mManager.getInstance(e);
+        utils::Slice<FRenderPrimitive> const& primitives = mManager[ci].primitives;
+        mCollectedPrimitives.push_back(primitives);
+        // the bone palette is only used on the CPU until it's committed
+        freeBones(ci);
+        mManager.removeComponent(e);
+        mChangeLog.invalidate();
+    });
+}
+
+void FRenderableManager::destroyCollectedPrimitives() noexcept {
+    for (auto& primitives : mCollectedPrimitives) {
+        destroyComponentPrimitives(mEngine, primitives);
     }
+    mCollectedPrimitives.clear();
 }
 
 // this destroys all components in this manager
 void FRenderableManager::terminate() noexcept {
+    destroyCollectedPrimitives();
+
     auto& manager = mManager;
     if (!manager.empty()) {
 #ifndef NDEBUG
@@ -338,6 +400,7 @@ void FRenderableManager::terminate() noexcept {
             manager.removeComponent(manager.getEntity(ci));
         }
     }
+    mBonePalette.terminate(mEngine.getDriverApi());
 }
 
 // This is basically a Renderable's destructor.
@@ -345,15 +408,20 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     auto& manager = mManager;
     FEngine& engine = mEngine;
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+    freeBones(ci);
+}
+
+// gives the bones back to the palette if any
+void FRenderableManager::freeBones(Instance ci) noexcept {
+    auto& manager = mManager;
+    Bones& bones = manager[ci].bones;
+    if (bones.count) {
+        mBonePalette.free(bones.index,
+                getBoneStorage(bones.count, getVisibility(ci).compactBones));
+        bones = {};
     }
 }
 
@@ -366,30 +434,13 @@ void FRenderableManager::destroyComponentPrimitives(
 }
 
 
-void FRenderableManager::prepare(
-        driver::DriverApi& UTILS_RESTRICT driver,
-        Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
-    auto& manager = mManager;
-
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.updateUniformBuffer(bones[i]->handle, bones[i]->bones.toBufferDescriptor(driver));
-            }
-        }
-    }
-}
-
 void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
         Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            mChangeLog.mark(mManager.getEntity(instance));
 #ifndef NDEBUG
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
@@ -445,6 +496,7 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
                     0, vertices->getVertexCount() - 1, count);
+            mChangeLog.mark(mManager.getEntity(instance));
         }
     }
 }
@@ -455,6 +507,7 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
         Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            mChangeLog.mark(mManager.getEntity(instance));
         }
     }
 }
@@ -462,18 +515,28 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            PerRenderableUibBone* UTILS_RESTRICT out = (PerRenderableUibBone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(PerRenderableUibBone),
-                    boneCount * sizeof(PerRenderableUibBone));
-            for (size_t i = 0, c = boneCount; i < c; ++i) {
-                out[i].q = transforms[i].unitQuaternion;
-                out[i].t.xyz = transforms[i].translation;
-                out[i].s = out[i].ns = { 1, 1, 1, 0 };
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.count && offset + boneCount <= bones.count);
+        if (bones.count && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            if (getVisibility(ci).compactBones) {
+                PerRenderableUibCompactBone* UTILS_RESTRICT out =
+                        mBonePalette.editCompact(bones.index, offset, boneCount);
+                for (size_t i = 0, c = boneCount; i < c; ++i) {
+                    quatf const& q = transforms[i].unitQuaternion;
+                    out[i].q = half4{ q.x, q.y, q.z, q.w };
+                    out[i].ts = half4{ transforms[i].translation, 1.0f };
+                }
+            } else {
+                PerRenderableUibBone* UTILS_RESTRICT out =
+                        mBonePalette.edit(uint32_t(bones.index + offset), boneCount);
+                for (size_t i = 0, c = boneCount; i < c; ++i) {
+                    out[i].q = transforms[i].unitQuaternion;
+                    out[i].t.xyz = transforms[i].translation;
+                    out[i].s = out[i].ns = { 1, 1, 1, 0 };
+                }
             }
+            mChangeLog.mark(mManager.getEntity(ci));
         }
     }
 }
@@ -481,20 +544,54 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setBones(Instance ci,
         filament::math::mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            PerRenderableUibBone* UTILS_RESTRICT out = (PerRenderableUibBone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(PerRenderableUibBone),
-                    boneCount * sizeof(PerRenderableUibBone));
-            for (size_t i = 0, c = boneCount; i < c; ++i) {
-                makeBone(&out[i], transforms[i]);
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.count && offset + boneCount <= bones.count);
+        if (bones.count && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            if (getVisibility(ci).compactBones) {
+                PerRenderableUibCompactBone* UTILS_RESTRICT out =
+                        mBonePalette.editCompact(bones.index, offset, boneCount);
+                for (size_t i = 0, c = boneCount; i < c; ++i) {
+                    makeCompactBone(&out[i], transforms[i]);
+                }
+            } else {
+                PerRenderableUibBone* UTILS_RESTRICT out =
+                        mBonePalette.edit(uint32_t(bones.index + offset), boneCount);
+                for (size_t i = 0, c = boneCount; i < c; ++i) {
+                    makeBone(&out[i], transforms[i]);
+                }
             }
+            mChangeLog.mark(mManager.getEntity(ci));
         }
     }
 }
 
+void FRenderableManager::setInstanceTransforms(Instance ci,
+        filament::math::mat4f const* UTILS_RESTRICT transforms, size_t instanceCount, size_t offset) noexcept {
+    if (ci) {
+        std::unique_ptr<Instances> const& instances = mManager[ci].instances;
+        assert(instances && offset + instanceCount <= instances->transforms.size());
+        if (instances) {
+            instanceCount = std::min(instanceCount, instances->transforms.size() - offset);
+            std::copy_n(transforms, instanceCount, instances->transforms.begin() + offset);
+            updateInstancesBounds(ci);
+            mChangeLog.mark(mManager.getEntity(ci));
+        }
+    }
+}
+
+void FRenderableManager::updateInstancesBounds(Instance ci) noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[ci].instances;
+    Box const& aabb = mManager[ci].aabb;
+    Aabb bounds;
+    for (mat4f const& transform : instances->transforms) {
+        const Box box = rigidTransform(aabb, transform);
+        bounds.min = min(bounds.min, box.getMin());
+        bounds.max = max(bounds.max, box.getMax());
+    }
+    instances->bounds.set(bounds.min, bounds.max);
+}
+
 void FRenderableManager::makeBone(PerRenderableUibBone* UTILS_RESTRICT out, filament::math::mat4f const& t) noexcept {
     mat4f m(t);
 
@@ -518,6 +615,18 @@ void FRenderableManager::makeBone(PerRenderableUibBone* UTILS_RESTRICT out, fila
     out->ns = is / max(abs(is));
 }
 
+void FRenderableManager::makeCompactBone(PerRenderableUibCompactBone* UTILS_RESTRICT out,
+        filament::math::mat4f const& t) noexcept {
+    PerRenderableUibBone bone;
+    makeBone(&bone, t);
+
+    // compact bones only support uniform scales, use the average
+    const float s = (std::abs(bone.s.x) + std::abs(bone.s.y) + std::abs(bone.s.z)) / 3.0f;
+
+    out->q = half4{ bone.q.x, bone.q.y, bone.q.z, bone.q.w };
+    out->ts = half4{ bone.t.xyz, s };
+}
+
 } // namespace details
 
 
@@ -616,4 +725,13 @@ void RenderableManager::setBones(Instance instance,
     upcast(this)->setBones(instance, transforms, boneCount, offset);
 }
 
+void RenderableManager::setInstanceTransforms(Instance instance,
+        mat4f const* transforms, size_t instanceCount, size_t offset) noexcept {
+    upcast(this)->setInstanceTransforms(instance, transforms, instanceCount, offset);
+}
+
+size_t RenderableManager::getInstanceCount(Instance instance) const noexcept {
+    return upcast(this)->getInstanceCount(instance);
+}
+
 } // namespace filament
@@ -21,6 +21,10 @@
 
 #include "UniformBuffer.h"
 
+#include "components/EntityChangeLog.h"
+
+#include "details/BonePalette.h"
+
 #include "driver/DriverApiForward.h"
 #include "driver/Handle.h"
 
@@ -34,8 +38,11 @@
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <vector>
+
 // for gtest
 class FilamentTest_Bones_Test;
+class FilamentTest_CompactBones_Test;
 
 namespace filament {
 namespace details {
@@ -53,6 +60,7 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool compactBones   : 1;    // bones use BoneFormat::COMPACT
     };
 
     explicit FRenderableManager(FEngine& engine) noexcept;
@@ -73,20 +81,32 @@ public:
         return mManager.getInstance(e);
     }
 
+    size_t getComponentCount() const noexcept {
+        return mManager.getComponentCount();
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
 
-    // - instances is a list of Instance (typically the list from a given scene)
-    // - list is a list of index in 'instances' (typically the visible ones)
-    void prepare(driver::DriverApi& driver,
-            RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
-
-    void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+    // uploads the bone palette if it changed
+    void prepare(driver::DriverApi& driver) noexcept {
+        mBonePalette.commit(driver);
     }
 
+    // Removes the components of dead entities. This runs concurrently with the render thread,
+    // so the primitives are only destroyed by destroyCollectedPrimitives().
+    void gc(utils::EntityManager& em) noexcept;
+
+    // destroys the primitives of the components removed by gc(), this issues driver commands
+    void destroyCollectedPrimitives() noexcept;
+
+    // entities whose state relevant to FScene (AABB, layers, visibility) or to the shadow maps
+    // (geometry, material, bones) changed
+    EntityChangeLog const& getChangeLog() const noexcept { return mChangeLog; }
+
+    void trimChangeLog() noexcept { mChangeLog.trim(); }
+
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -100,9 +120,12 @@ public:
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
     inline void setSkinning(Instance instance, bool enable) noexcept;
+    inline void setCompactBones(Instance instance, bool enable) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, filament::math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
+    void setInstanceTransforms(Instance instance, filament::math::mat4f const* transforms,
+            size_t instanceCount, size_t offset = 0) noexcept;
 
 
     inline bool isShadowCaster(Instance instance) const noexcept;
@@ -110,12 +133,19 @@ public:
     inline bool isCullingEnabled(Instance instance) const noexcept;
 
     inline Box const& getAABB(Instance instance) const noexcept;
+    // for instanced renderables, this is the union of the instances' AABB, in model space
+    inline Box const& getCullingAABB(Instance instance) const noexcept;
     inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept { return getAABB(instance); }
     inline Visibility getVisibility(Instance instance) const noexcept;
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
 
-    inline Handle<HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
+    // UBO holding the bones of all the skinned renderables
+    Handle<HwUniformBuffer> getBonesUbh() const noexcept { return mBonePalette.getHwHandle(); }
+    // offset in bytes of the renderable's bones in getBonesUbh()
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
+    inline size_t getInstanceCount(Instance instance) const noexcept;
+    inline filament::math::mat4f const* getInstanceTransforms(Instance instance) const noexcept;
 
 
     inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
@@ -135,25 +165,41 @@ public:
 
 private:
     void destroyComponent(Instance ci) noexcept;
+    void freeBones(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
     struct Bones {
-        filament::Handle<HwUniformBuffer> handle;
-        UniformBuffer bones;
-        size_t count;
+        uint32_t index = 0;     // index of the first bone in mBonePalette
+        uint32_t count = 0;
     };
 
+    struct Instances {
+        std::vector<filament::math::mat4f> transforms;
+        Box bounds; // union of the instances' AABB, in model space
+    };
+
+    void updateInstancesBounds(Instance instance) noexcept;
+
     friend class ::FilamentTest_Bones_Test;
+    friend class ::FilamentTest_CompactBones_Test;
 
     static void makeBone(PerRenderableUibBone* out, filament::math::mat4f const& transforms) noexcept;
+    static void makeCompactBone(PerRenderableUibCompactBone* out,
+            filament::math::mat4f const& transforms) noexcept;
+
+    // number of bones of the palette used by count bones
+    static size_t getBoneStorage(size_t count, bool compact) noexcept {
+        return compact ? BonePalette::getCompactBoneStorage(count) : count;
+    }
 
     enum {
         AABB,               // user data
         LAYERS,             // user data
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        BONES,              // filament data, range of the bones in the bone palette
+        INSTANCES,          // user data, transforms of the instances
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -161,7 +207,8 @@ private:
             uint8_t,
             Visibility,
             utils::Slice<FRenderPrimitive>,
-            std::unique_ptr<Bones>
+            Bones,
+            std::unique_ptr<Instances>
     >;
 
     struct Sim : public Base {
@@ -181,6 +228,7 @@ private:
                 Field<VISIBILITY>   visibility;
                 Field<PRIMITIVES>   primitives;
                 Field<BONES>        bones;
+                Field<INSTANCES>    instances;
             };
         };
 
@@ -193,6 +241,9 @@ private:
     };
 
     Sim mManager;
+    EntityChangeLog mChangeLog;
+    BonePalette mBonePalette;
+    std::vector<utils::Slice<FRenderPrimitive>> mCollectedPrimitives;  // see gc()
     FEngine& mEngine;
 };
 
@@ -201,6 +252,11 @@ FILAMENT_UPCAST(RenderableManager)
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
         mManager[instance].aabb = aabb;
+        std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+        if (UTILS_UNLIKELY(instances)) {
+            updateInstancesBounds(instance);
+        }
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -209,12 +265,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -222,6 +280,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -229,6 +288,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -236,6 +296,7 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -243,6 +304,7 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -250,6 +312,15 @@ void FRenderableManager::setSkinning(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.skinning = enable;
+        mChangeLog.mark(mManager.getEntity(instance));
+    }
+}
+
+void FRenderableManager::setCompactBones(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.compactBones = enable;
+        mChangeLog.mark(mManager.getEntity(instance));
     }
 }
 
@@ -289,9 +360,25 @@ Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : Handle<HwUniformBuffer>{};
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return uint32_t(bones.index * sizeof(PerRenderableUibBone));
+}
+
+Box const& FRenderableManager::getCullingAABB(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return instances ? instances->bounds : mManager[instance].aabb;
+}
+
+size_t FRenderableManager::getInstanceCount(Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return instances ? instances->transforms.size() : 0;
+}
+
+filament::math::mat4f const* FRenderableManager::getInstanceTransforms(
+        Instance instance) const noexcept {
+    std::unique_ptr<Instances> const& instances = mManager[instance].instances;
+    return instances ? instances->transforms.data() : nullptr;
 }
 
 utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
@@ -53,6 +53,7 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
         insertNode(i, parent);
         setTransform(i, localTransform);
     }
+    mChangeLog.invalidate();
 }
 
 void FTransformManager::setParent(Instance i, Instance parent) noexcept {
@@ -114,6 +115,9 @@ void FTransformManager::destroy(Entity e) noexcept {
         if (moved != i) {
             updateNode(i);
         }
+
+        // our children's world transforms are now relative to the root
+        mChangeLog.invalidate();
     }
 }
 
@@ -152,11 +156,12 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
 
     // compute our world transform
     manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    mChangeLog.mark(manager.getEntity(i));
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, mChangeLog, child);
     }
 }
 
@@ -183,6 +188,9 @@ void FTransformManager::commitLocalTransformTransaction() noexcept {
             assert(parent < i);
             manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
         }
+
+        // all world transforms have been recomputed
+        mChangeLog.invalidate();
     }
 }
 
@@ -305,18 +313,20 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, EntityChangeLog& changeLog,
+        Instance ci) noexcept {
     while (ci) {
         // update child's world transform
         Instance parent = manager[ci].parent;
         mat4f const& pt = manager[parent].world;
         mat4f const& local = manager[ci].local;
         manager[ci].world = pt * local;
+        changeLog.mark(manager.getEntity(ci));
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, changeLog, child);
         }
 
         // process our next child
@@ -19,6 +19,8 @@
 
 #include "upcast.h"
 
+#include "components/EntityChangeLog.h"
+
 #include <filament/TransformManager.h>
 
 #include <utils/compiler.h>
@@ -88,6 +90,11 @@ public:
         return mManager[ci].world;
     }
 
+    // entities whose world transform changed
+    EntityChangeLog const& getChangeLog() const noexcept { return mChangeLog; }
+
+    void trimChangeLog() noexcept { mChangeLog.trim(); }
+
 private:
     struct Sim;
 
@@ -97,7 +104,8 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    static void transformChildren(Sim& manager, EntityChangeLog& changeLog,
+            Instance firstChild) noexcept;
 
 
     enum {
@@ -150,6 +158,7 @@ private:
     };
 
     Sim mManager;
+    EntityChangeLog mChangeLog;
     bool mLocalTransformTransactionOpen = false;
 };
 
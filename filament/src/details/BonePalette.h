@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BONEPALETTE_H
+#define TNT_FILAMENT_DETAILS_BONEPALETTE_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include "UniformBuffer.h"
+
+#include <private/filament/UibGenerator.h>
+
+#include <filament/EngineEnums.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The bone palette holds the bones of all the skinned renderables of an engine in a single
+ * UBO. Each skinned renderable owns a range of the palette, and a primitive binds the
+ * BonesUniforms block at an offset in its renderable's range.
+ *
+ * The palette is kept on the CPU and uploaded at most once per frame, in commit(). It grows
+ * as needed, the ranges freed are reused first.
+ */
+class BonePalette {
+public:
+    // Ranges start at a multiple of BONE_ALIGNMENT bones, so they can be bound with
+    // bindUniformBufferRange(), which requires offsets aligned to 256 bytes.
+    static constexpr size_t BONE_ALIGNMENT = 256 / sizeof(PerRenderableUibBone);
+    static constexpr size_t COMPACT_BONE_ALIGNMENT = 256 / sizeof(PerRenderableUibCompactBone);
+
+    // Number of bones to allocate to store count compact bones
+    static constexpr size_t getCompactBoneStorage(size_t count) noexcept {
+        return (count * sizeof(PerRenderableUibCompactBone) + sizeof(PerRenderableUibBone) - 1)
+                / sizeof(PerRenderableUibBone);
+    }
+
+    // Size of the BonesUniforms block bound for each primitive
+    static constexpr size_t BLOCK_SIZE = CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone);
+
+    BonePalette() noexcept;
+
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    // Allocates count bones, initialized to the identity. Returns the index of the first one.
+    uint32_t allocate(size_t count) noexcept;
+
+    // Gives back the range of count bones starting at index
+    void free(uint32_t index, size_t count) noexcept;
+
+    // Returns the count bones starting at index for writing, they'll be uploaded by commit()
+    PerRenderableUibBone* edit(uint32_t index, size_t count) noexcept {
+        return static_cast<PerRenderableUibBone*>(mBones.invalidateUniforms(
+                index * sizeof(PerRenderableUibBone), count * sizeof(PerRenderableUibBone)));
+    }
+
+    // Same as edit(), for the compact bones [offset, offset + count) of the range at index
+    PerRenderableUibCompactBone* editCompact(uint32_t index, size_t offset, size_t count) noexcept {
+        return static_cast<PerRenderableUibCompactBone*>(mBones.invalidateUniforms(
+                index * sizeof(PerRenderableUibBone) + offset * sizeof(PerRenderableUibCompactBone),
+                count * sizeof(PerRenderableUibCompactBone)));
+    }
+
+    PerRenderableUibBone const* get(uint32_t index) const noexcept {
+        return static_cast<PerRenderableUibBone const*>(mBones.getBuffer()) + index;
+    }
+
+    // Creates or grows the UBO, and uploads the palette with a single updateUniformBuffer()
+    // if it changed.
+    void commit(driver::DriverApi& driver) noexcept;
+
+    Handle<HwUniformBuffer> getHwHandle() const noexcept { return mHandle; }
+
+    // number of bones in use, including the unused space between the ranges
+    size_t getUsedCount() const noexcept { return mUsedCount; }
+
+private:
+    struct Range {
+        uint32_t index;
+        uint32_t count;
+    };
+
+    static size_t align(size_t count) noexcept {
+        return (count + BONE_ALIGNMENT - 1) & ~(BONE_ALIGNMENT - 1);
+    }
+
+    UniformBuffer mBones;               // CPU copy of the palette
+    size_t mUsedCount = 0;              // bones up to the end of the last range
+    std::vector<Range> mFreeRanges;     // ranges freed below mUsedCount, sorted by index
+    Handle<HwUniformBuffer> mHandle;
+    size_t mHandleSize = 0;             // size of the UBO in bytes
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BONEPALETTE_H
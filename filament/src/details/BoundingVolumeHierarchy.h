@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+#define TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy over world-space AABBs, used to cull large scenes.
+ *
+ * Each entry is identified by a small integer (the RenderableManager instance of a renderable)
+ * and culling sets a bit in an array indexed by those. Subtrees outside of the frustum are
+ * skipped, subtrees inside are accepted without testing their entries, and the leaves
+ * intersecting the frustum are tested with the Culler.
+ *
+ * Entries can be moved with update(), the bounds of the tree are then refitted by refit(),
+ * which keeps the topology of the tree. The quality of the tree degrades as entries move,
+ * needsRebuild() tells when it's time to build() it again.
+ */
+class BoundingVolumeHierarchy {
+public:
+    // Maximum number of entries in a leaf, leaves are tested with the Culler
+    static constexpr size_t LEAF_SIZE = 64;
+
+    BoundingVolumeHierarchy() noexcept;
+    ~BoundingVolumeHierarchy() noexcept;
+
+    BoundingVolumeHierarchy(BoundingVolumeHierarchy const& rhs) = delete;
+    BoundingVolumeHierarchy& operator=(BoundingVolumeHierarchy const& rhs) = delete;
+
+    // Builds the tree from count entries, ids must be smaller than idCount
+    void build(uint32_t const* ids,
+            filament::math::float3 const* centers,
+            filament::math::float3 const* extents,
+            size_t count, size_t idCount);
+
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mNodes.empty(); }
+
+    // number of entries in the tree
+    size_t size() const noexcept { return mCount; }
+
+    // Moves the entry id, the tree is refitted by refit(). Ignored if id isn't in the tree.
+    void update(uint32_t id,
+            filament::math::float3 const& center,
+            filament::math::float3 const& extent) noexcept;
+
+    // Recomputes the bounds of the nodes affected by update()
+    void refit() noexcept;
+
+    // true when enough entries moved since the tree was built that it should be rebuilt
+    bool needsRebuild() const noexcept { return mUpdateCount > mCount; }
+
+    // Sets (1 << bit) in results[id] for each entry intersecting the frustum, results must
+    // have room for idCount entries. The subtrees are culled on multiple threads.
+    void cull(utils::JobSystem& js, Culler::result_type* results,
+            Frustum const& frustum, size_t bit) const noexcept;
+
+private:
+    static constexpr uint32_t NONE = uint32_t(-1);
+
+    struct Node {
+        filament::math::float3 min;
+        filament::math::float3 max;
+        uint32_t first;         // first entry of a leaf
+        uint32_t child;         // index of the first of the two children, 0 for leaves
+        uint32_t parent;        // NONE for the root
+        uint32_t count;         // number of entries in a leaf, 0 for inner nodes
+        bool dirty;             // leaf needing to be refitted
+    };
+
+    // builds the subtree of the count entries at indices into mNodes[index]
+    void buildNode(uint32_t index, uint32_t* indices, size_t count, uint32_t parent,
+            uint32_t const* ids,
+            filament::math::float3 const* centers, filament::math::float3 const* extents);
+
+    void refitLeaf(Node& node) noexcept;
+
+    void cullNode(uint32_t root, Culler::result_type* results,
+            Frustum const& frustum, size_t bit) const noexcept;
+
+    std::vector<Node> mNodes;
+
+    // entries, the entries of each leaf start at a multiple of Culler::MODULO
+    std::vector<filament::math::float3> mCenters;
+    std::vector<filament::math::float3> mExtents;
+    std::vector<uint32_t> mIds;                 // padding entries use id 0
+
+    std::vector<uint32_t> mEntries;             // entry of each id, or NONE
+    std::vector<uint32_t> mLeaves;              // leaf node of each entry
+    std::vector<uint32_t> mDirtyLeaves;
+    size_t mCount = 0;
+    size_t mUpdateCount = 0;                    // entries updated since the last build()
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
@@ -33,6 +33,7 @@
 #include "details/Skybox.h"
 
 #include "driver/CommandStream.h"
+#include "driver/CommandBufferPool.h"
 #include "driver/CommandBufferQueue.h"
 #include "driver/DriverApi.h"
 
@@ -51,10 +52,12 @@
 #include <utils/Allocator.h>
 #include <utils/JobSystem.h>
 #include <utils/CountDownLatch.h>
+#include <utils/Mutex.h>
 
 #include <math/mat4.h>
 #include <math/quat.h>
 
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <unordered_map>
@@ -110,12 +113,17 @@ public:
 
 public:
     static FEngine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            Platform::BlobFunc const& blobFunc = {});
 
     ~FEngine() noexcept;
 
     Driver& getDriver() const noexcept { return *mDriver; }
     DriverApi& getDriverApi() noexcept { return mCommandStream; }
+
+    // buffers for recording commands concurrently, before splicing them into getDriverApi()
+    CommandBufferPool& getCommandBufferPool() noexcept { return mCommandBufferPool; }
+
     DFG* getDFG() const noexcept { return mDFG.get(); }
 
 
@@ -135,6 +143,9 @@ public:
     // Material IDs...
     uint32_t getMaterialId() const noexcept { return mMaterialId++; }
 
+    // number of programs requested with Material::compile() that are not ready yet
+    uint32_t getPendingProgramCount() const noexcept { return mPendingProgramCount; }
+
     const FMaterial* getDefaultMaterial() const noexcept { return mDefaultMaterial; }
     const FMaterial* getSkyboxMaterial(bool rgbm) const noexcept;
     const FIndirectLight* getDefaultIndirectLight() const noexcept { return mDefaultIbl; }
@@ -160,6 +171,11 @@ public:
         return mFullScreenTriangleIb;
     }
 
+    // bound as the InstancesUniforms block when no renderable is instanced
+    Handle<HwUniformBuffer> getDummyInstancesUbo() const noexcept {
+        return mDummyInstancesUbh;
+    }
+
     PostProcessManager const& getPostProcessManager() const noexcept {
         return mPostProcessManager;
     }
@@ -196,6 +212,12 @@ public:
         return mEntityManager;
     }
 
+    // This is incremented each time entities are destroyed, it allows to invalidate the data
+    // derived from their components (see FScene::prepare()).
+    uint32_t getEntityDestructionCount() const noexcept {
+        return mEntityListener.destructionCount.load(std::memory_order_relaxed);
+    }
+
     HeapAllocatorArena& getHeapAllocator() noexcept {
         return mHeapAllocator;
     }
@@ -204,6 +226,10 @@ public:
         return mBackend;
     }
 
+    Platform* getPlatform() const noexcept {
+        return mPlatform;
+    }
+
     void* streamAlloc(size_t size, size_t alignment) noexcept;
 
     utils::JobSystem& getJobSystem() noexcept { return mJobSystem; }
@@ -238,6 +264,7 @@ public:
     FCamera* createCamera(utils::Entity entity) noexcept;
     FFence* createFence(Fence::Type type = Fence::Type::SOFT) noexcept;
     FSwapChain* createSwapChain(void* nativeWindow, uint64_t flags) noexcept;
+    FSwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept;
 
     void destroy(const FVertexBuffer* p);
     void destroy(const FFence* p);
@@ -268,6 +295,12 @@ public:
         return mFragmentShaderBuilder;
     }
 
+    // the shader builders must be used with this lock held when programs can be created
+    // concurrently, e.g. by FMaterial::getProgram() from the pass recording jobs
+    utils::Mutex& getShaderBuilderLock() const noexcept {
+        return mShaderBuilderLock;
+    }
+
     FDebugRegistry& getDebugRegistry() noexcept {
         return mDebugRegistry;
     }
@@ -275,7 +308,8 @@ public:
     bool execute();
 
 private:
-    FEngine(Backend backend, Platform* platform, void* sharedGLContext);
+    FEngine(Backend backend, Platform* platform, void* sharedGLContext,
+            Platform::BlobFunc const& blobFunc);
     void init();
 
     int loop();
@@ -294,16 +328,27 @@ private:
 
     Backend mBackend;
     Platform* mPlatform = nullptr;
+    bool mOwnPlatform = false;  // whether mPlatform was created by us
     void* mSharedGLContext = nullptr;
+    Platform::BlobFunc mBlobFunc;   // given to mPlatform before the driver is created
     bool mTerminated = false;
     Handle<HwRenderPrimitive> mFullScreenTriangleRph;
     FVertexBuffer* mFullScreenTriangleVb = nullptr;
     FIndexBuffer* mFullScreenTriangleIb = nullptr;
+    Handle<HwUniformBuffer> mDummyInstancesUbh;
 
     PostProcessManager mPostProcessManager;
     RenderTargetPool mRenderTargetPool;
 
+    // this can be called from any thread
+    struct EntityListener : public utils::EntityManager::Listener {
+        void onEntitiesDestroyed(size_t n, utils::Entity const* entities) noexcept override;
+        void onAllEntitiesDestroyed() noexcept override;
+        std::atomic<uint32_t> destructionCount = { 0 };
+    };
+
     utils::EntityManager& mEntityManager;
+    EntityListener mEntityListener;
     FRenderableManager mRenderableManager;
     FTransformManager mTransformManager;
     FLightManager mLightManager;
@@ -323,6 +368,7 @@ private:
     ResourceList<FSkybox> mSkyboxes{ "Skybox" };
 
     mutable uint32_t mMaterialId = 0;
+    uint32_t mPendingProgramCount = 0;
 
     // FMaterialInstance are handled directly by FMaterial
     std::unordered_map<const FMaterial*, ResourceList<FMaterialInstance>> mMaterialInstances;
@@ -342,6 +388,7 @@ private:
     std::thread mDriverThread;
     CommandBufferQueue mCommandBufferQueue;
     DriverApi mCommandStream;
+    CommandBufferPool mCommandBufferPool;
 
     LinearAllocatorArena mPerRenderPassAllocator;
     HeapAllocatorArena mHeapAllocator;
@@ -363,6 +410,7 @@ private:
 
     mutable filaflat::ShaderBuilder mVertexShaderBuilder;
     mutable filaflat::ShaderBuilder mFragmentShaderBuilder;
+    mutable utils::Mutex mShaderBuilderLock;
     FDebugRegistry mDebugRegistry;
 
 public:
@@ -374,6 +422,7 @@ public:
             bool lispsm = true;
             float dzn = -1.0f;
             float dzf =  1.0f;
+            int atlas_updates = 4;  // spot/point light shadow tiles rendered per frame
         } shadowmap;
     } debug;
 };
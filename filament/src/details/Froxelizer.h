@@ -56,7 +56,7 @@ public:
 
 //
 // Light UBO           Froxel Record Buffer     per-froxel light list texture
-// {4 x float4}         R_U8  {index into        RG_U16 {offset, point-count, spot-sount}
+// {4 x float4}         R_U16 {index into        RG_U32 {offset, point-count | spot-count}
 // (spot/point            light texture}
 //
 //  +----+                     +-+                     +----+
@@ -69,7 +69,7 @@ public:
 //  :    :                     | |                     |    |
 //  :    :                     | |                     |    |
 //  :    :                     +-+                     |    |
-//  :    :                  65536 max                  +----+
+//  :    :                  131072 max                 +----+
 //  |....|                                          h = num froxels
 //  |....|
 //  +----+
@@ -81,8 +81,8 @@ public:
 // - chosen texture width [64]
 // - size of CPU-side indices [16 bits]
 // Also, increasing the number of froxels adds more pressure on the "record buffer" which stores
-// the light indices per froxel. The record buffer is limited to 65536 entries, so with
-// 8192 froxels, we can store 8 lights per froxels assuming they're all used. In practice, some
+// the light indices per froxel. The record buffer is limited to 131072 entries, so with
+// 8192 froxels, we can store 16 lights per froxels assuming they're all used. In practice, some
 // froxels are not used, so we can store more.
 static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
 
@@ -144,27 +144,27 @@ public:
 
     struct FroxelEntry {
         union {
-            uint32_t u32;
+            uint64_t u64;
             struct {
-                uint16_t offset = 0;
+                uint32_t offset = 0;
                 union {
-                    uint8_t count[2] = { 0, 0 };
+                    uint16_t count[2] = { 0, 0 };
                     struct {
-                        uint8_t pointLightCount;
-                        uint8_t spotLightCount;
+                        uint16_t pointLightCount;
+                        uint16_t spotLightCount;
                     };
                 };
             };
         };
     };
-    // This depends on the maximum number of lights (currently 255),and can't be more than 16 bits.
+    // This depends on the maximum number of lights (currently 256), and can't be more than 16 bits.
     static_assert(CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint16_t>::max(), "can't have more than 65536 lights");
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
     // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
-    // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
+    // with 256 lights this implies 8 groups (256 / 32) for froxelization.
     using LightGroupType = uint32_t;
 
 private:
@@ -184,8 +184,8 @@ private:
     };
 
     struct LightTreeNode {
-        float min;          // lights z-range min
-        float max;          // lights z-range max
+        float min;          // lights z-range min (in Z slices)
+        float max;          // lights z-range max (in Z slices)
 
         uint16_t next;      // next node when range test fails
         uint16_t offset;    // offset in record buffer
@@ -205,14 +205,19 @@ private:
     void froxelizeLoop(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
+    void froxelizeLightTree(FEngine& engine,
+            const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
+
     void froxelizeAssignRecordsCompress() noexcept;
 
+    // froxelizes a light in the Z slices [zbegin, zend)
     void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
+            size_t zbegin, size_t zend,
             filament::math::mat4f const& projection, const LightParams& light) const noexcept;
 
-    static void computeLightTree(LightTreeNode* lightTree,
+    static size_t computeLightTree(LightTreeNode* lightTree,
             utils::Slice<RecordBufferType> const& lightList,
-            const FScene::LightSoa& lightData, size_t lightRecordsOffset) noexcept;
+            filament::math::float2 const* zrange, size_t lightRecordsOffset) noexcept;
 
     uint16_t getFroxelIndex(size_t ix, size_t iy, size_t iz) const noexcept {
         return uint16_t(ix + (iy * mFroxelCountX) + (iz * mFroxelCountX * mFroxelCountY));
@@ -234,13 +239,19 @@ private:
     filament::math::float4* mPlanesY = nullptr;
     filament::math::float4* mBoundingSpheres = nullptr;
 
-    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
-    utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
+    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/ 256 lights
+    utils::Slice<FroxelEntry> mFroxelBufferUser;        //  64 KiB w/ 8192 froxels
 
     // max 32 KiB  (actual: resolution dependant)
-    utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
+    utils::Slice<RecordBufferType> mRecordBufferUser;   // 256 KiB
     utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
 
+    // only used when froxelizing with a light tree
+    utils::Slice<LightParams> mLightParams;             //   9 KiB w/ 256 lights
+    utils::Slice<filament::math::float2> mLightRanges;  //   2 KiB w/ 256 lights
+    utils::Slice<RecordBufferType> mLightList;          // 256 B   w/ 256 lights
+    utils::Slice<LightTreeNode> mLightTree;             //   8 KiB w/ 256 lights
+
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
     uint16_t mFroxelCountZ = 0;
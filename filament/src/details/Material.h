@@ -28,6 +28,9 @@
 #include <filaflat/ShaderBuilder.h>
 
 #include <utils/compiler.h>
+#include <utils/Mutex.h>
+
+#include <atomic>
 
 
 namespace filament {
@@ -71,18 +74,29 @@ public:
 
     FEngine& getEngine() const noexcept  { return mEngine; }
 
-    Handle<HwProgram> getProgramSlow(uint8_t variantKey) const noexcept;
-    Handle<HwProgram> getProgram(uint8_t variantKey) const noexcept {
+    // Returns the program of a variant, if it must be created, its commands are issued with
+    // 'driver'. This can be called concurrently, e.g. from the pass recording jobs.
+    Handle<HwProgram> getProgramSlow(FEngine::DriverApi& driver,
+            uint8_t variantKey) const noexcept;
+    Handle<HwProgram> getProgram(FEngine::DriverApi& driver, uint8_t variantKey) const noexcept {
 
         // filterVariant() has already been applied in generateCommands(), shouldn't be needed here
         assert( variantKey == Variant::filterVariant(variantKey, isVariantLit()) );
 
-        Handle<HwProgram> const entry = mCachedPrograms[variantKey];
-        return UTILS_LIKELY(entry) ? entry : getProgramSlow(variantKey);
+        // a cached program is set only once, under mProgramLock, and never changes afterwards.
+        // It's published with release semantics, so it can be read without the lock.
+        Handle<HwProgram> const entry = getCachedProgram(variantKey);
+        return UTILS_LIKELY(entry) ? entry : getProgramSlow(driver, variantKey);
     }
 
     bool isVariantLit() const noexcept { return mIsVariantLit; }
 
+    // starts compiling the variants selected by the UserVariantFilterMask
+    void compile(UserVariantFilterMask variants) noexcept;
+
+    // promotes the programs started by compile() that are ready, returns how many are left
+    uint32_t updatePendingPrograms() const noexcept;
+
     const utils::CString& getName() const noexcept { return mName; }
     Driver::RasterState getRasterState() const noexcept  { return mRasterState; }
     uint32_t getId() const noexcept { return mMaterialId; }
@@ -112,9 +126,36 @@ public:
 
     uint32_t generateMaterialInstanceId() const noexcept { return mMaterialInstanceId++; }
 
+    bool isSharedVariant(uint8_t variantKey) const noexcept {
+        // the depth variants may be shared with the default material
+        return !mIsDefaultMaterial && !mHasCustomDepthShader && Variant(variantKey).isDepthPass();
+    }
+
 private:
-    // try to order by frequency of use
-    mutable std::array<Handle<HwProgram>, VARIANT_COUNT> mCachedPrograms;
+    Handle<HwProgram> createProgram(FEngine::DriverApi& driver,
+            uint8_t variantKey, bool required) const noexcept;
+    Handle<HwProgram> getFallbackProgram(uint8_t variantKey) const noexcept;
+
+    Handle<HwProgram> getCachedProgram(uint8_t variantKey) const noexcept {
+        const HandleBase::HandleId id =
+                mCachedPrograms[variantKey].load(std::memory_order_acquire);
+        return id != HandleBase::nullid ? Handle<HwProgram>(id) : Handle<HwProgram>{};
+    }
+
+    // must be called with mProgramLock held, or before the material is shared
+    void setCachedProgram(uint8_t variantKey, Handle<HwProgram> program) const noexcept {
+        mCachedPrograms[variantKey].store(program.getId(), std::memory_order_release);
+    }
+
+    // try to order by frequency of use, the handles are read without mProgramLock
+    mutable std::array<std::atomic<HandleBase::HandleId>, VARIANT_COUNT> mCachedPrograms;
+
+    // programs started by compile() or getProgramSlow() which may not be ready yet
+    mutable std::array<Handle<HwProgram>, VARIANT_COUNT> mPendingPrograms;
+    mutable uint32_t mPendingProgramCount = 0;
+
+    // protects the programs above, which are updated by getProgramSlow() from any thread
+    mutable utils::Mutex mProgramLock;
 
     Driver::RasterState mRasterState;
     BlendingMode mRenderBlendingMode;
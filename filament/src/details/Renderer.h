@@ -46,6 +46,7 @@ namespace details {
 
 class FEngine;
 class FView;
+class ShadowAtlas;
 class ShadowMap;
 
 /*
@@ -107,14 +108,26 @@ private:
     class ShadowPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
         ShadowMap const& shadowMap;
+        size_t cascade;
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ShadowPass(const char* name, ShadowMap const& shadowMap) noexcept;
+        ShadowPass(const char* name, ShadowMap const& shadowMap, size_t cascade) noexcept;
         static void renderShadowMap(FEngine& engine, utils::JobSystem& js,
                 FView& view, utils::GrowingSlice<Command>& commands) noexcept;
     };
 
+    // this class is defined in RenderPass.cpp
+    class ShadowAtlasPass final : public RenderPass {
+        using DriverApi = driver::DriverApi;
+        ShadowAtlas const& shadowAtlas;
+        size_t tile;
+        void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
+        void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+    public:
+        ShadowAtlasPass(const char* name, ShadowAtlas const& shadowAtlas, size_t tile) noexcept;
+    };
+
     Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
 
     void recordHighWatermark(utils::Slice<Command> const& commands) noexcept {
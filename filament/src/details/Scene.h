@@ -18,10 +18,12 @@
 #define TNT_FILAMENT_DETAILS_SCENE_H
 
 #include "upcast.h"
+#include "components/EntityChangeLog.h"
 #include "components/LightManager.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Culler.h"
 
 #include "Allocators.h"
@@ -36,6 +38,8 @@
 #include <utils/Range.h>
 
 #include <cstddef>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
 namespace filament {
@@ -47,6 +51,12 @@ class FIndirectLight;
 class FRenderer;
 class FSkybox;
 
+// values of the 'VISIBLE_MASK' after culling (0: not visible)
+static constexpr size_t VISIBLE_RENDERABLE_BIT = 0u;
+static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
+static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
+static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
+static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
 
 class FScene : public Scene {
 public:
@@ -69,6 +79,9 @@ public:
     size_t getLightCount() const noexcept;
     bool hasEntity(utils::Entity entity) const noexcept;
 
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+    bool isHierarchicalCullingEnabled() const noexcept { return mHierarchicalCulling; }
+
 public:
     /*
      * Filaments-scope Public API
@@ -86,20 +99,45 @@ public:
     void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, Handle<HwUniformBuffer> lightUbh) noexcept;
     void computeBounds(Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) const noexcept;
 
+    // World-space bounds of the shadow casters that changed, before and after each change,
+    // since the end of the previous frame. The cached shadow maps that intersect them must be
+    // rendered again. The log is invalidated when the whole scene is re-gathered.
+    ChangeLog<Box> const& getShadowCasterChangeLog() const noexcept {
+        return mShadowCasterChangeLog;
+    }
+
+    // called by the engine once all the views are rendered
+    void trimShadowCasterChangeLog() noexcept { mShadowCasterChangeLog.trim(); }
+
 
     filament::Handle<HwUniformBuffer> getRenderableUBO() const noexcept {
         return mRenderableViewUbh;
     }
 
+    filament::Handle<HwUniformBuffer> getInstancesUBO() const noexcept {
+        return mInstancesViewUbh;
+    }
+
+    // the engine's bone palette, BONES_OFFSET is relative to it
+    filament::Handle<HwUniformBuffer> getBonesUBO() const noexcept;
+
     /*
      * Storage for per-frame renderable data
      */
 
+    // instances of an instanced renderable, culled and uploaded by the views
+    struct InstancesInfo {
+        uint32_t offset = 0;        // offset of the instances in the view's instances UBO
+        uint16_t count = 0;         // number of instances, 0 if the renderable isn't instanced
+        uint16_t visibleCount = 0;  // instances visible from the camera, which are stored first
+    };
+
     enum {
         RENDERABLE_INSTANCE,    //  4 instance of the Renderable component
         WORLD_TRANSFORM,        // 16 instance of the Transform component
-        VISIBILITY_STATE,       //  1 visibility data of the component
-        BONES_UBH,              //  4 bones uniform buffer handle
+        VISIBILITY_STATE,       //  2 visibility data of the component
+        BONES_OFFSET,           //  4 offset of the bones in the bone palette
+        INSTANCES,              //  8 instances of an instanced renderable
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
@@ -116,7 +154,8 @@ public:
             utils::EntityInstance<RenderableManager>,
             filament::math::mat4f,
             FRenderableManager::Visibility,
-            Handle<HwUniformBuffer>,
+            uint32_t,
+            InstancesInfo,
             filament::math::float3,
             Culler::result_type,
             uint8_t,
@@ -149,7 +188,8 @@ public:
         DIRECTION,
         LIGHT_INSTANCE,
         VISIBILITY,
-        SCREEN_SPACE_Z_RANGE
+        SCREEN_SPACE_Z_RANGE,
+        SHADOW_INDEX            // index of the light's first shadow atlas tile, or NO_SHADOW
     };
 
     using LightSoa = utils::StructureOfArrays<
@@ -157,15 +197,57 @@ public:
             filament::math::float3,
             FLightManager::Instance,
             Culler::result_type,
-            filament::math::float2
+            filament::math::float2,
+            uint8_t
     >;
 
+    static constexpr uint8_t NO_SHADOW = 0xFF;
+
     LightSoa const& getLightData() const noexcept { return mLightData; }
     LightSoa& getLightData() noexcept { return mLightData; }
 
     void updateUBOs(utils::Range<uint32_t> visibleRenderables, Handle<HwUniformBuffer> renderableUbh) noexcept;
 
+    // Lays out the instances of the visible instanced renderables and returns the size needed
+    // for the instances UBO, or 0 if none of the visible renderables are instanced, in which
+    // case the engine's dummy instances UBO is bound instead.
+    size_t prepareInstances(utils::Range<uint32_t> visibleRenderables) noexcept;
+
+    // Culls the instances of the renderables laid out by prepareInstances(), one job per
+    // renderable, and uploads the transforms of all their instances, with the ones visible
+    // from the camera first.
+    void updateInstancesUBO(utils::JobSystem& js, Frustum const& frustum,
+            bool culling, Handle<HwUniformBuffer> instancesUbh, size_t size) noexcept;
+
+    /*
+     * Hierarchical culling
+     *
+     * The hierarchy is indexed by RenderableManager instances, because the views reorder
+     * mRenderableData. Culling sets bits in a per-instance mask, which is gathered into
+     * VISIBLE_MASK once all the frustums are culled.
+     */
+
+    bool hasCullingHierarchy() const noexcept { return !mCullingHierarchy.empty(); }
+
+    // Sets (1 << bit) in the mask of the renderables intersecting the frustum
+    void cullHierarchy(utils::JobSystem& js, Frustum const& frustum, size_t bit) noexcept {
+        mCullingHierarchy.cull(js, mInstanceVisibility.data(), frustum, bit);
+    }
+
+    // Adds the bits set by cullHierarchy() to VISIBLE_MASK, and resets them
+    void gatherHierarchicalCulling(utils::JobSystem& js) noexcept;
+
 private:
+    void prepareAll(const filament::math::mat4f& worldOriginTransform) noexcept;
+    void buildCullingHierarchy() noexcept;
+    void prepareChanges(const filament::math::mat4f& worldOriginTransform,
+            utils::Slice<const utils::Entity> const* changes, size_t count) noexcept;
+    void updateDirectionalLight(const filament::math::mat4f& worldOriginTransform) noexcept;
+    void copyLightData() noexcept;
+
+    // number of entities processed by each job in prepareAll()
+    static constexpr size_t PREPARE_JOB_ENTITY_COUNT = 1024;
+
     static inline void computeLightRanges(filament::math::float2* zrange,
             CameraInfo const& camera, const filament::math::float4* spheres, size_t count) noexcept;
 
@@ -193,6 +275,45 @@ private:
     RenderableSoa mRenderableData;
     LightSoa mLightData;
     Handle<HwUniformBuffer> mRenderableViewUbh; // This is actually owned by the view.
+    Handle<HwUniformBuffer> mInstancesViewUbh;  // This is actually owned by the view.
+
+    /*
+     * State used by prepare() to only update the data of entities that have changed.
+     *
+     * Rows of mRenderableData are reordered by the views (see FView::prepare), so we keep
+     * a mapping from RenderableManager instances to rows, which stays valid until a structural
+     * change (components created or destroyed) happens, at which point everything is
+     * re-gathered. mLightData is truncated and sorted by the views, so the view-independent
+     * light data is kept in mLightCache, whose rows never move.
+     */
+    struct ChangeLogCursors {
+        EntityChangeLog::Sequence renderables = 0;
+        EntityChangeLog::Sequence lights = 0;
+        EntityChangeLog::Sequence transforms = 0;
+    };
+    ChangeLogCursors mChangeLogCursors;
+    uint32_t mEntityDestructionCount = 0;
+    bool mNeedsFullUpdate = true;
+    filament::math::mat4f mWorldOriginTransform;
+    std::vector<uint32_t> mRenderableRows;      // RenderableManager::Instance -> mRenderableData
+    std::vector<uint32_t> mLightRows;           // LightManager::Instance -> mLightCache
+    std::vector<utils::Entity> mDirectionalLights;
+    LightSoa mLightCache;
+    ChangeLog<Box> mShadowCasterChangeLog;
+
+    bool mHierarchicalCulling = false;
+    BoundingVolumeHierarchy mCullingHierarchy;
+    std::vector<Culler::result_type> mInstanceVisibility;   // RenderableManager::Instance -> mask
+    std::vector<uint32_t> mInstancedRenderables;    // rows of the visible instanced renderables
+
+    // scratch data for the parallel prepareAll()
+    struct RangeCounts {
+        uint32_t renderables;
+        uint32_t lights;
+        uint32_t directionalLights;
+    };
+    std::vector<utils::Entity> mEntityList;
+    std::vector<RangeCounts> mRangeCounts;
 };
 
 FILAMENT_UPCAST(Scene)
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+#define TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+
+#include "components/LightManager.h"
+
+#include "details/Allocators.h"
+#include "details/Camera.h"
+#include "details/Scene.h"
+#include "details/ShadowCasterMasks.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/SamplerBuffer.h"
+
+#include "UniformBuffer.h"
+
+#include <filament/Frustum.h>
+#include <filament/Viewport.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Range.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <array>
+#include <vector>
+
+namespace filament {
+namespace details {
+
+/*
+ * The shadow atlas holds the shadow maps of the spot lights and point lights. It's a grid of
+ * square tiles, a spot light uses one tile and a point light uses six, one per cube face.
+ *
+ * Tiles are given to the shadow casting lights with the largest size on screen, and keep
+ * their content across frames. Each frame only a limited number of tiles is re-rendered:
+ * first the tiles of the lights that just got them, that changed or whose casters changed,
+ * then the tiles that haven't been rendered for the longest time, so changes that aren't
+ * tracked are eventually picked-up. The tiles of lights with a cached shadow map are only
+ * rendered when they change.
+ */
+class ShadowAtlas {
+public:
+    // the atlas is a GRID_SIZE x GRID_SIZE grid of TILE_DIMENSION x TILE_DIMENSION tiles
+    static constexpr size_t GRID_SIZE = 4;
+    static constexpr size_t TILE_COUNT = GRID_SIZE * GRID_SIZE;
+    static constexpr uint32_t TILE_DIMENSION = 512;
+
+    static_assert(TILE_COUNT == CONFIG_MAX_SHADOW_TILE_COUNT,
+            "the shadow atlas doesn't match the PerViewUib");
+
+    explicit ShadowAtlas(FEngine& engine) noexcept;
+
+    void terminate(driver::DriverApi& driverApi) noexcept;
+
+    // Call once per frame, after the lights have been culled. This gives tiles to the shadow
+    // casting point and spot lights of lightData, sets their SHADOW_INDEX and picks the tiles
+    // to render this frame, at most maxTileUpdates (but always at least one light).
+    void update(FLightManager const& lcm, FScene const* scene, FScene::LightSoa& lightData,
+            CameraInfo const& camera, uint8_t visibleLayers, size_t maxTileUpdates) noexcept;
+
+    // No shadows this frame, the tiles keep their content.
+    void clear() noexcept {
+        mShadowCount = 0;
+        mUpdatedTileCount = 0;
+    }
+
+    // Do we have lights with shadows. Valid after calling update().
+    bool hasShadows() const noexcept { return mShadowCount > 0; }
+
+    // Allocates the atlas texture, which is kept afterwards.
+    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
+
+    // Sets the transform and biases of each shadow index. Valid after calling update().
+    void updateUniforms(UniformBuffer& u) const noexcept;
+
+    // Number of tiles to render this frame. Valid after calling update().
+    size_t getUpdatedTileCount() const noexcept { return mUpdatedTileCount; }
+
+    // The light's frustum of a tile to render this frame. Valid after calling update().
+    Frustum const& getUpdatedTileFrustum(size_t i) const noexcept {
+        return mTiles[mUpdatedTiles[i]].frustum;
+    }
+
+    // The light's camera of a tile to render this frame. Valid after calling update().
+    CameraInfo const& getUpdatedTileCamera(size_t i) const noexcept {
+        return mTiles[mUpdatedTiles[i]].camera;
+    }
+
+    // The viewport of a tile to render this frame. Valid after calling update().
+    Viewport getUpdatedTileViewport(size_t i) const noexcept;
+
+    // Culls the casters of each tile to render this frame, in parallel. The results are
+    // allocated from the arena, which must stay alive until the tiles are rendered.
+    void cullShadowCasters(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa const& renderableData, utils::Range<uint32_t> casters) noexcept;
+
+    // Sets the VISIBLE_SHADOW_CASTER bits of the casters to the ones of a tile to render.
+    void selectShadowCasters(size_t i, FScene::RenderableSoa& renderableData,
+            utils::Range<uint32_t> casters) const noexcept {
+        mCasterMasks.select(i, renderableData, casters);
+    }
+
+    // Set-up the render target, call before rendering a tile. Only the tile is cleared.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t i) const noexcept;
+
+private:
+    struct LightParams {
+        filament::math::float3 position = {};
+        filament::math::float3 direction = {};
+        float radius = 0.0f;
+        float cosOuterSquared = 0.0f;
+        bool operator==(LightParams const& rhs) const noexcept {
+            return all(equal(position, rhs.position)) && all(equal(direction, rhs.direction)) &&
+                   radius == rhs.radius && cosOuterSquared == rhs.cosOuterSquared;
+        }
+    };
+
+    struct Tile {
+        FLightManager::Instance light;  // owner of this tile, invalid if the tile is free
+        uint8_t face = 0;               // cube face (point lights), 0 for spot lights
+        bool rendered = false;          // the tile holds the owner's shadow map
+        bool dirty = false;             // casters changed since the tile was rendered
+        uint32_t lastUpdate = 0;        // frame of the last render, used to refresh the oldest
+        LightParams params;             // light parameters of the last render
+        CameraInfo camera;              // light's camera of the last render
+        Frustum frustum;
+        filament::math::mat4f lightSpace;   // world to tile texture coordinates
+        float texelSize = 0.0f;             // size of a texel at 1 world unit from the light
+        filament::math::float4 bias;        // constant bias, normal bias, unused, unused
+    };
+
+    struct Candidate {
+        FLightManager::Instance light;
+        uint32_t row;                   // index in the LightSoa
+        uint8_t faceCount;              // 1 for a spot light, 6 for a point light
+        bool hasTiles;                  // kept its tiles from the previous frame
+        bool changed;                   // needs all its tiles rendered
+        bool cached;                    // only rendered when changed
+        float importance;               // higher values get tiles and updates first
+        uint32_t lastUpdate;            // oldest update among the light's tiles
+        LightParams params;
+        std::array<uint8_t, 6> tiles;   // tile of each face
+    };
+
+    void invalidateTiles(FScene const* scene, uint8_t visibleLayers) noexcept;
+
+    static void computeTileCamera(Tile& tile, LightParams const& params, bool pointLight,
+            bool clipSpaceFlipped, size_t slot) noexcept;
+
+    static filament::math::mat4f getTileMapping(size_t slot, bool clipSpaceFlipped) noexcept;
+
+    FEngine& mEngine;
+    const bool mClipSpaceFlipped;
+
+    std::array<Tile, TILE_COUNT> mTiles;
+
+    // set-up in update()
+    uint32_t mFrame = 0;
+    size_t mShadowCount = 0;                            // number of shadow indices
+    std::array<uint8_t, TILE_COUNT> mShadowTiles;       // shadow index -> tile
+    size_t mUpdatedTileCount = 0;
+    std::array<uint8_t, TILE_COUNT> mUpdatedTiles;      // tiles to render this frame
+    std::vector<Candidate> mCandidates;
+
+    // the casters' changes already taken into account, see invalidateTiles()
+    FScene const* mCachedScene = nullptr;
+    uint8_t mCachedVisibleLayers = 0;
+    ChangeLog<Box>::Sequence mCasterChangeCursor = 0;
+
+    // set-up in cullShadowCasters()
+    ShadowCasterMasks mCasterMasks;
+
+    // set-up in prepare()
+    Handle<HwTexture> mTexture;
+    Handle<HwRenderTarget> mRenderTarget;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWATLAS_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWCASTERMASKS_H
+#define TNT_FILAMENT_DETAILS_SHADOWCASTERMASKS_H
+
+#include "details/Allocators.h"
+#include "details/Culler.h"
+#include "details/Scene.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Range.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The shadow casters of several light frustums rendered in the same frame (e.g. the cascades
+ * of a shadow map, or the tiles of a shadow atlas), so that each frustum only draws its own
+ * casters. The view culls the casters of all frustums together, they're then culled again
+ * against each frustum, in parallel, once partitioned.
+ */
+class ShadowCasterMasks {
+public:
+    // Culls the casters against each of the 'count' frustums, one job per frustum. A null
+    // frustum gets no casters. The frustums only need to stay alive during this call. The masks
+    // are allocated from the arena, which must stay alive until the frustums are rendered.
+    void cull(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa const& renderableData, utils::Range<uint32_t> casters,
+            Frustum const* const* frustums, size_t count) noexcept;
+
+    // Forgets the masks, e.g. when a new frame starts.
+    void clear() noexcept { mCount = 0; }
+
+    // Sets the VISIBLE_SHADOW_CASTER bits of the casters to the ones of frustum 'i'. Returns
+    // false if the casters weren't culled against this frustum, and the bits are unchanged.
+    bool select(size_t i,
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> casters) const noexcept;
+
+    // Sets the VISIBLE_SHADOW_CASTER bits back, as computed by the view's culling.
+    static void restore(
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> casters) noexcept;
+
+private:
+    Culler::result_type** mMasks = nullptr;     // one mask per frustum, from the arena
+    size_t mCount = 0;
+    uint32_t mFirst = 0;                        // index of the renderable of the masks' start
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWCASTERMASKS_H
@@ -19,17 +19,24 @@
 
 #include "components/LightManager.h"
 
+#include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Scene.h"
+#include "details/ShadowCasterMasks.h"
 
 #include "driver/DriverApiForward.h"
 #include "driver/SamplerBuffer.h"
 
 #include <filament/Viewport.h>
 
+#include <utils/JobSystem.h>
+#include <utils/Range.h>
+
 #include <math/mat4.h>
 #include <math/vec4.h>
 
+#include <array>
+
 namespace filament {
 namespace details {
 
@@ -41,35 +48,76 @@ public:
     void terminate(driver::DriverApi& driverApi) noexcept;
 
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera of each cascade, and which cascades must be rendered.
     void update(
             const FScene::LightSoa& lightData, size_t index, FScene const* scene,
             details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
 
-    // Do we have visible shadows. Valid after calling update().
+    // Do we have visible shadows in any cascade. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
+    // Do we have visible shadows in this cascade. Valid after calling update().
+    bool hasVisibleShadows(size_t cascade) const noexcept {
+        return mCascades[cascade].hasVisibleShadows;
+    }
+
+    // Number of cascades of the shadow map. Valid after calling update().
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    // Must this cascade be rendered this frame. A cached shadow map keeps its content and only
+    // renders the cascades whose light's camera or casters changed. Valid after calling update().
+    bool isCascadeDirty(size_t cascade) const noexcept { return mCascades[cascade].dirty; }
+
+    // View-space distance at which the cascade ends. Valid after calling update().
+    float getCascadeSplit(size_t cascade) const noexcept { return mCascades[cascade].split; }
+
     // Allocates shadow texture based on user parameters (e.g. dimensions)
     void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
 
-    // Returns the shadow map's viewport. Valid after prepare().
-    Viewport const& getViewport() const noexcept { return mViewport; }
+    // Culls the casters of each cascade rendered this frame, in parallel, when there are
+    // several cascades. The results are allocated from the arena, which must stay alive until
+    // the cascades are rendered. Valid after calling update().
+    void cullShadowCasters(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa const& renderableData, utils::Range<uint32_t> casters) noexcept;
+
+    // Sets the VISIBLE_SHADOW_CASTER bits of the casters to the ones of a cascade to render.
+    // Returns false if the casters weren't culled per cascade, and the bits are unchanged.
+    bool selectShadowCasters(size_t cascade, FScene::RenderableSoa& renderableData,
+            utils::Range<uint32_t> casters) const noexcept {
+        return mCasterMasks.select(cascade, renderableData, casters);
+    }
+
+    // Returns the cascade's viewport within the shadow map. Valid after calling update().
+    Viewport const& getViewport(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].viewport;
+    }
 
     // Computes the transform to use in the shader to access the shadow map.
     // Valid after calling update().
-    filament::math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
+    filament::math::mat4f const& getLightSpaceMatrix(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].lightSpace;
+    }
 
     // return the size of a texel in world space (pre-warping)
-    float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
+    float getTexelSizeWorldSpace(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].texelSizeWs;
+    }
 
     // Returns the shadow map's depth range. Valid after init().
-    float getSceneRange() const noexcept { return mSceneRange; }
+    float getSceneRange(size_t cascade = 0) const noexcept { return mCascades[cascade].sceneRange; }
 
     // Returns the light's projection. Valid after calling update().
-    FCamera const& getCamera() const noexcept { return *mCamera; }
+    FCamera const& getCamera(size_t cascade = 0) const noexcept { return *mCascades[cascade].camera; }
+
+    // Set-up the render target, call before rendering a cascade of the shadow map.
+    // The first cascade clears the whole shadow map, so it must be rendered first, unless
+    // the shadow map is cached, in which case each cascade only clears its own area.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t cascade = 0) const noexcept;
 
-    // Set-up the render target, call before rendering the shadow map.
-    void beginRenderPass(driver::DriverApi& driverApi) const noexcept;
+    // Computes the view-space distance at which each cascade ends, blending a uniform (lambda = 0)
+    // and a logarithmic (lambda = 1) split of the [zn, zf] range.
+    static void computeCascadeSplits(float* splits, size_t cascadeCount,
+            float zn, float zf, float lambda) noexcept;
 
     // use only for debugging
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
@@ -104,9 +152,29 @@ private:
     // 8 corners, 12 segments w/ 2 intersection max -- all of this twice (8 + 12 * 2) * 2 (768 bytes)
     using FrustumBoxIntersection = std::array<filament::math::float3, 64>;
 
+    struct Cascade {
+        FCamera* camera = nullptr;
+        filament::math::mat4f lightSpace;
+        float sceneRange = 0.0f;
+        float texelSizeWs = 0.0f;
+        float split = 0.0f;
+        Viewport viewport;
+        bool hasVisibleShadows = false;
+        bool dirty = true;                      // must be rendered this frame
+        bool cached = false;                    // content is valid for cachedLightSpace
+        bool cachedHasVisibleShadows = false;
+        filament::math::mat4f cachedLightSpace; // lightSpace when the cascade was rendered
+    };
+
+    void updateCache(FScene const* scene, uint8_t visibleLayers, bool cached) noexcept;
+
     void computeShadowCameraDirectional(
-            filament::math::float3 const& direction, FScene const* scene, CameraInfo const& camera,
-            uint8_t visibleLayers) noexcept;
+            filament::math::float3 const& direction, CameraInfo const& camera,
+            Aabb const& wsShadowCastersVolume, Aabb const& wsShadowReceiversVolume,
+            size_t cascade) noexcept;
+
+    static filament::math::mat4f setProjectionRange(filament::math::mat4f projection,
+            float n, float f) noexcept;
 
     static filament::math::mat4f applyLISPSM(
             CameraInfo const& camera, float dzn, float dzf, const filament::math::mat4f& LMpMv,
@@ -150,6 +218,10 @@ private:
 
     filament::math::mat4f getTextureCoordsMapping() const noexcept;
 
+    filament::math::mat4f getCascadeMapping(size_t cascade) const noexcept;
+
+    filament::math::mat4f getEmptyCascadeMapping(size_t cascade) const noexcept;
+
     float texelSizeWorldSpace(const filament::math::mat4f& lightSpaceMatrix) const noexcept;
     float texelSizeWorldSpace(const filament::math::mat4f& lightSpaceMatrix, filament::math::float3 const& str) const noexcept;
 
@@ -167,20 +239,31 @@ private:
             { 2, 6, 7, 3 },  // top
     };
 
-    FCamera* mCamera = nullptr;
     FCamera* mDebugCamera = nullptr;
-    filament::math::mat4f mLightSpace;
-    float mSceneRange = 0.0f;
-    float mTexelSizeWs = 0.0f;
+
+    // the cascades are laid out side by side in the shadow map, each is a
+    // mShadowMapDimension x mShadowMapDimension tile with its own 1-texel border.
+    std::array<Cascade, CONFIG_MAX_SHADOW_CASCADES> mCascades;
 
     // set-up in prepare()
-    Viewport mViewport;
+    uint32_t mTextureWidth = 0;
+    uint32_t mTextureHeight = 0;
     Handle<HwTexture> mShadowMapHandle;
     Handle<HwRenderTarget> mShadowMapRenderTarget;
 
+    // set-up in cullShadowCasters(), reset by update()
+    ShadowCasterMasks mCasterMasks;
+
     // set-up in update()
     uint32_t mShadowMapDimension = 0;
+    size_t mCascadeCount = 1;
     bool mHasVisibleShadows = false;
+    bool mClearAll = true;
+
+    // state of the cached shadow map, whose cascades are only rendered when they change
+    FScene const* mCachedScene = nullptr;
+    uint8_t mCachedVisibleLayers = 0;
+    ChangeLog<Box>::Sequence mCasterChangeCursor = 0;
 
     // use a member here (instead of stack) because we don't want to pay the
     // initialization of the float3 each time
@@ -23,6 +23,8 @@
 
 #include <filament/Texture.h>
 
+#include <image/LinearImage.h>
+
 #include <utils/compiler.h>
 
 namespace filament {
@@ -33,6 +35,12 @@ class FStream;
 
 class FTexture : public Texture {
 public:
+    // how the components of a pixel buffer are encoded for CPU mipmap generation, filtering is
+    // always done in linear space
+    enum class Encoding : uint8_t {
+        LINEAR, SRGB, RGBM
+    };
+
     static bool isTextureFormatSupported(FEngine& engine, InternalFormat format) noexcept;
     static size_t computeTextureDataSize(Texture::Format format, Texture::Type type,
             size_t stride, size_t height, size_t alignment) noexcept;
@@ -64,6 +72,19 @@ public:
 
     void generateMipmaps(FEngine& engine) const noexcept;
 
+    // CPU mipmap generation from the base level, faceOffsets is null for 2D textures
+    void generateMipmaps(FEngine& engine, PixelBufferDescriptor&& buffer,
+            FaceOffsets const* faceOffsets) const noexcept;
+
+    // decodes a pixel buffer to a linear image, RGBM images are decoded to 3 components
+    static image::LinearImage decodeImage(uint8_t const* data, size_t bpr,
+            uint32_t width, uint32_t height,
+            size_t componentCount, Texture::Type type, Encoding encoding) noexcept;
+
+    // encodes a linear image back to a pixel buffer, the destination is tightly packed
+    static void encodeImage(uint8_t* data, image::LinearImage const& image,
+            size_t componentCount, Texture::Type type, Encoding encoding) noexcept;
+
     void setSampleCount(size_t sampleCount) noexcept { mSampleCount = uint8_t(sampleCount); }
     size_t getSampleCount() const noexcept { return mSampleCount; }
     bool isMultisample() const noexcept { return mSampleCount > 1; }
@@ -21,17 +21,21 @@
 
 #include "upcast.h"
 
+#include "RenderPass.h"
 #include "UniformBuffer.h"
 
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
 
 #include "driver/DriverApi.h"
 #include "driver/Handle.h"
 
+#include "fg/FrameGraph.h"
+
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
 #include <utils/StructureOfArrays.h>
@@ -119,7 +123,7 @@ public:
 
     void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
     void prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
     void froxelize(FEngine& engine) const noexcept;
@@ -128,7 +132,10 @@ public:
 
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
-    bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasShadowing() const noexcept { return hasDirectionalShadowing() | mShadowAtlas.hasShadows(); }
+    bool hasDirectionalShadowing() const noexcept {
+        return mHasDirectionalShadowing & mDirectionalShadowMap.hasVisibleShadows();
+    }
 
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
@@ -137,6 +144,14 @@ public:
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
     ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
+    ShadowAtlas const& getShadowAtlas() const { return mShadowAtlas; }
+
+    RenderPass::CommandCache& getColorPassCommandCache() noexcept { return mColorPassCommandCache; }
+    RenderPass::CommandCache& getShadowPassCommandCache(size_t cascade) noexcept {
+        return mShadowPassCommandCaches[cascade];
+    }
+
+    FrameGraphCache& getFrameGraphCache() noexcept { return mFrameGraphCache; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
         return &mDirectionalShadowMap.getDebugCamera();
@@ -221,17 +236,17 @@ private:
     static constexpr size_t MAX_FRAMETIME_HISTORY = 32u;
 
     void prepareVisibleRenderables(utils::JobSystem& js,
-            Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept;
+            Frustum const& frustum, FScene& scene) const noexcept;
 
     static void prepareVisibleShadowCasters(utils::JobSystem& js,
-            Frustum const& lightFrustum, FScene::RenderableSoa& renderableData) noexcept;
+            Frustum const& lightFrustum, FScene& scene) noexcept;
 
     static void prepareVisibleLights(
             FLightManager const& lcm, utils::JobSystem& js, Frustum const& frustum,
             FScene::LightSoa& lightData) noexcept;
 
     static void cullRenderables(utils::JobSystem& js,
-            FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept;
+            FScene& scene, Frustum const& frustum, size_t bit) noexcept;
 
     void computeVisibilityMasks(
             uint8_t visibleLayers, uint8_t const* layers,
@@ -254,6 +269,7 @@ private:
     Handle<HwUniformBuffer> mPerViewUbh;
     Handle<HwUniformBuffer> mLightUbh;
     Handle<HwUniformBuffer> mRenderableUbh;
+    Handle<HwUniformBuffer> mInstancesUbh;
 
     Handle<HwSamplerBuffer> getUsh() const noexcept { return mPerViewSbh; }
     Handle<HwUniformBuffer> getUbh() const noexcept { return mPerViewUbh; }
@@ -268,6 +284,14 @@ private:
 
     mutable Froxelizer mFroxelizer;
 
+    // sorted commands of the previous frames, reused when the view is static
+    RenderPass::CommandCache mColorPassCommandCache;
+    RenderPass::CommandCache mShadowPassCommandCaches[CONFIG_MAX_SHADOW_CASCADES];
+
+    // compiled post-processing FrameGraph and its textures, reused while it doesn't change
+    // (unused while USE_FRAME_GRAPH is disabled in FRenderer)
+    FrameGraphCache mFrameGraphCache;
+
     Viewport mViewport;
     LinearColorA mClearColor;
     bool mCulling = true;
@@ -306,10 +330,12 @@ private:
     Range mVisibleRenderables;
     Range mVisibleShadowCasters;
     uint32_t mRenderableUBOSize = 0;
+    uint32_t mInstancesUBOSize = 0;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
-    mutable bool mHasShadowing = false;
+    mutable bool mHasDirectionalShadowing = false;
     mutable ShadowMap mDirectionalShadowMap;
+    mutable ShadowAtlas mShadowAtlas;
 };
 
 FILAMENT_UPCAST(View)
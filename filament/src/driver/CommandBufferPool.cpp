@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandBufferPool.h"
+
+#include <mutex>
+
+#include <assert.h>
+
+namespace filament {
+
+CommandBufferPool::CommandBufferPool(size_t bufferSize) noexcept
+        : mBufferSize(bufferSize) {
+}
+
+CommandBufferPool::~CommandBufferPool() noexcept {
+    // all buffers must have been returned to the pool
+    assert(mFreeBuffers.size() == mBuffers.size());
+}
+
+CircularBuffer* CommandBufferPool::acquire() noexcept {
+    std::lock_guard<utils::Mutex> lock(mLock);
+    if (mFreeBuffers.empty()) {
+        mBuffers.emplace_back(new CircularBuffer(mBufferSize));
+        return mBuffers.back().get();
+    }
+    CircularBuffer* const buffer = mFreeBuffers.back();
+    mFreeBuffers.pop_back();
+    assert(buffer->empty());
+    return buffer;
+}
+
+void CommandBufferPool::release(CircularBuffer* buffer) noexcept {
+    std::lock_guard<utils::Mutex> lock(mLock);
+    mFreeBuffers.push_back(buffer);
+}
+
+size_t CommandBufferPool::getBufferCount() const noexcept {
+    std::lock_guard<utils::Mutex> lock(mLock);
+    return mBuffers.size();
+}
+
+size_t CommandBufferPool::getFreeBufferCount() const noexcept {
+    std::lock_guard<utils::Mutex> lock(mLock);
+    return mFreeBuffers.size();
+}
+
+} // namespace filament
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDBUFFERPOOL_H
+#define TNT_FILAMENT_DRIVER_COMMANDBUFFERPOOL_H
+
+#include "driver/CircularBuffer.h"
+
+#include <utils/compiler.h>
+#include <utils/Mutex.h>
+
+#include <memory>
+#include <vector>
+
+namespace filament {
+
+/*
+ * A pool of CircularBuffers used to record commands away from the main CommandStream, e.g.
+ * concurrently on JobSystem threads. The recorded commands are spliced into the main
+ * CommandStream (see CommandStream::beginSplice()), so a buffer can only be released once the
+ * driver thread has executed them.
+ *
+ * acquire() and release() are thread-safe.
+ */
+class CommandBufferPool {
+public:
+    // bufferSize: size of each buffer
+    explicit CommandBufferPool(size_t bufferSize) noexcept;
+    ~CommandBufferPool() noexcept;
+
+    CommandBufferPool(CommandBufferPool const& rhs) = delete;
+    CommandBufferPool& operator=(CommandBufferPool const& rhs) = delete;
+
+    // returns an empty buffer, allocating a new one if none is available
+    CircularBuffer* acquire() noexcept;
+
+    // returns a buffer to the pool, its commands must have been executed
+    void release(CircularBuffer* buffer) noexcept;
+
+    // size of each buffer, a CommandStream recording into more commands chains several buffers
+    size_t getBufferSize() const noexcept { return mBufferSize; }
+
+    // number of buffers allocated by the pool, and how many of them are not in use
+    size_t getBufferCount() const noexcept;
+    size_t getFreeBufferCount() const noexcept;
+
+private:
+    const size_t mBufferSize;
+    mutable utils::Mutex mLock;
+    std::vector<std::unique_ptr<CircularBuffer>> mBuffers;
+    std::vector<CircularBuffer*> mFreeBuffers;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDBUFFERPOOL_H
@@ -16,8 +16,11 @@
 
 #include "driver/CommandStream.h"
 
+#include "driver/CommandBufferPool.h"
+
 #include <utils/CallStack.h>
 #include <utils/Log.h>
+#include <utils/Panic.h>
 #include <utils/Profiler.h>
 #include <utils/Systrace.h>
 
@@ -93,6 +96,44 @@ void CommandStream::execute(void* buffer) {
     }
 }
 
+CommandStream::CommandStream(CommandStream const& primary, CommandBufferPool& pool,
+        std::vector<CircularBuffer*>& buffers) noexcept
+        : CommandStream(*primary.mDriver, *buffers.back()) {
+    mPool = &pool;
+    mBuffers = &buffers;
+}
+
+void CommandStream::reserve(size_t size) noexcept {
+    // the buffer is empty when recording starts, and must keep room for the jump out of it
+    CircularBuffer& buffer = *mCurrentBuffer;
+    const size_t jump = CommandBase::align(sizeof(NoopCommand));
+    const size_t used = size_t((char*)buffer.getHead() - (char*)buffer.getTail());
+    if (UTILS_UNLIKELY(used + size + jump > buffer.size())) {
+        ASSERT_POSTCONDITION(size + jump <= buffer.size(),
+                "command of %u bytes doesn't fit in a %u bytes command buffer",
+                unsigned(size), unsigned(buffer.size()));
+        CircularBuffer* const next = mPool->acquire();
+        new(buffer.allocate(jump)) NoopCommand(next->getHead());
+        buffer.circularize();
+        mBuffers->push_back(next);
+        mCurrentBuffer = next;
+    }
+}
+
+void* CommandStream::beginSplice(CircularBuffer& buffer) noexcept {
+    assert(buffer.empty());
+    // jump to the commands to be recorded in 'buffer'...
+    new(allocateCommand(CommandBase::align(sizeof(NoopCommand)))) NoopCommand(buffer.getHead());
+    // ...which jump back here once they're done
+    return mCurrentBuffer->getHead();
+}
+
+void CommandStream::endSplice(CircularBuffer& buffer, void* resume) noexcept {
+    new(buffer.allocate(CommandBase::align(sizeof(NoopCommand)))) NoopCommand(resume);
+    // the next recording will start after these commands
+    buffer.circularize();
+}
+
 void CommandStream::queueCommand(std::function<void()> command) {
     new(allocateCommand(CustomCommand::align(sizeof(CustomCommand)))) CustomCommand(std::move(command));
 }
@@ -28,6 +28,7 @@
 #include <tuple>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include <assert.h>
 #include <cstddef>
@@ -39,6 +40,7 @@
 namespace filament {
 
 class CommandBase;
+class CommandBufferPool;
 
 /*
  * Dispatcher is a data structure containing only function pointers.
@@ -228,6 +230,17 @@ public:
     CommandStream() noexcept = default;
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // Creates a CommandStream for the same driver as 'primary', recording into its own 'buffer'.
+    // This is used to record commands concurrently with 'primary' (see beginSplice()), and must
+    // be called from the thread using the new CommandStream.
+    CommandStream(CommandStream const& primary, CircularBuffer& buffer) noexcept
+            : CommandStream(*primary.mDriver, buffer) { }
+
+    // Same as above, but recording starts in buffers[0] and when a buffer is full, another one
+    // is acquired from 'pool' and chained after it. The buffers used are appended to 'buffers'.
+    CommandStream(CommandStream const& primary, CommandBufferPool& pool,
+            std::vector<CircularBuffer*>& buffers) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -239,6 +252,16 @@ public:
 
     void execute(void* buffer);
 
+    /*
+     * beginSplice() inserts, at this point of the stream, the commands that will be recorded
+     * into the empty 'buffer' by another CommandStream. The commands are not copied, so the
+     * buffer must stay valid until they're executed.
+     * Once the recording is done, endSplice() must be called with the last buffer recorded to
+     * and the value returned by beginSplice(), and before this CommandStream is flushed.
+     */
+    void* beginSplice(CircularBuffer& buffer) noexcept;
+    static void endSplice(CircularBuffer& buffer, void* resume) noexcept;
+
     /*
      * queueCommand() allows to queue a lambda function as a command.
      * This is much less efficient than using the Driver* API.
@@ -267,13 +290,23 @@ private:
     Driver* mDriver = nullptr;
     CircularBuffer* UTILS_RESTRICT mCurrentBuffer = nullptr;
 
+    // set for the streams recording into buffers from a CommandBufferPool
+    CommandBufferPool* mPool = nullptr;
+    std::vector<CircularBuffer*>* mBuffers = nullptr;
+
 #ifndef NDEBUG
     // just for debugging...
     std::thread::id mThreadId;
 #endif
 
+    // chains a new buffer from mPool if 'size' bytes don't fit in the current one
+    void reserve(size_t size) noexcept;
+
     inline void* allocateCommand(size_t size) {
         assert(mThreadId == std::this_thread::get_id());
+        if (UTILS_UNLIKELY(mPool)) {
+            reserve(size);
+        }
         return mCurrentBuffer->allocate(size);
     }
 };
@@ -97,6 +97,7 @@ public:
     using FenceHandle           = Handle<HwFence>;
     using SwapChainHandle       = Handle<HwSwapChain>;
     using StreamHandle          = Handle<HwStream>;
+    using TimerQueryHandle      = Handle<HwTimerQuery>;
 
     struct Attribute {
         static constexpr uint8_t FLAG_NORMALIZED     = 0x1;
@@ -216,6 +217,12 @@ public:
         PolygonOffset polygonOffset;
     };
 
+    // a draw of the batch given to drawBatch()
+    struct BatchedDraw {
+        RenderPrimitiveHandle primitive;
+        uint32_t offset = 0;    // offset of the uniform buffer range used by this draw
+    };
+
     static SamplerFormat getSamplerFormat(TextureFormat format) noexcept;
     static SamplerPrecision getSamplerPrecision(TextureFormat format) noexcept;
     static size_t getElementTypeSize(ElementType type) noexcept;
@@ -85,6 +85,10 @@ void MetalDriver::flush(int dummy) {
 
 }
 
+void MetalDriver::finish(int dummy) {
+
+}
+
 void MetalDriver::createVertexBufferR(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
         uint8_t attributeCount, uint32_t vertexCount, Driver::AttributeArray attributes,
         Driver::BufferUsage usage) {
@@ -173,11 +177,20 @@ void MetalDriver::createSwapChainR(Driver::SwapChainHandle sch, void* nativeWind
     construct_handle<MetalSwapChain>(mHandleMap, sch, mContext->device, metalLayer);
 }
 
+void MetalDriver::createSwapChainHeadlessR(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+
+}
+
 void MetalDriver::createStreamFromTextureIdR(Driver::StreamHandle, intptr_t externalTextureId,
         uint32_t width, uint32_t height) {
 
 }
 
+void MetalDriver::createTimerQueryR(Driver::TimerQueryHandle tqh, int) {
+
+}
+
 Driver::VertexBufferHandle MetalDriver::createVertexBufferS() noexcept {
     return alloc_handle<MetalVertexBuffer, HwVertexBuffer>();
 }
@@ -222,10 +235,18 @@ Driver::SwapChainHandle MetalDriver::createSwapChainS() noexcept {
     return alloc_handle<MetalSwapChain, HwSwapChain>();
 }
 
+Driver::SwapChainHandle MetalDriver::createSwapChainHeadlessS() noexcept {
+    return {};
+}
+
 Driver::StreamHandle MetalDriver::createStreamFromTextureIdS() noexcept {
     return {};
 }
 
+Driver::TimerQueryHandle MetalDriver::createTimerQueryS() noexcept {
+    return {};
+}
+
 void MetalDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
         destruct_handle<MetalVertexBuffer>(mHandleMap, vbh);
@@ -284,6 +305,10 @@ void MetalDriver::destroyStream(Driver::StreamHandle sh) {
     // no-op
 }
 
+void MetalDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    // no-op
+}
+
 void MetalDriver::terminate() {
     [mContext->commandQueue release];
     [mContext->driverPool drain];
@@ -337,6 +362,14 @@ bool MetalDriver::isFrameTimeSupported() {
     return false;
 }
 
+bool MetalDriver::isTimerQuerySupported() {
+    return false;
+}
+
+bool MetalDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    return false;
+}
+
 // TODO: the implementations here for updateVertexBuffer and updateIndexBuffer assume static usage.
 // Dynamically updated vertex / index buffers will require synchronization.
 
@@ -384,6 +417,10 @@ bool MetalDriver::canGenerateMipmaps() {
     return false;
 }
 
+bool MetalDriver::isProgramReady(Driver::ProgramHandle ph) {
+    return true;
+}
+
 void MetalDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
         Driver::BufferDescriptor&& data) {
     auto buffer = handle_cast<MetalUniformBuffer>(mHandleMap, ubh);
@@ -566,6 +603,14 @@ void MetalDriver::popGroupMarker(int dummy) {
 
 }
 
+void MetalDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+
+}
+
+void MetalDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+
+}
+
 void MetalDriver::readPixels(Driver::RenderTargetHandle src, uint32_t x, uint32_t y, uint32_t width,
         uint32_t height, Driver::PixelBufferDescriptor&& data) {
 
@@ -583,6 +628,11 @@ void MetalDriver::blit(Driver::TargetBufferFlags buffers,
 }
 
 void MetalDriver::draw(Driver::PipelineState ps, Driver::RenderPrimitiveHandle rph) {
+    drawInstanced(ps, rph, 1);
+}
+
+void MetalDriver::drawInstanced(Driver::PipelineState ps, Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
     ASSERT_PRECONDITION(mContext->currentCommandEncoder != nullptr,
             "Attempted to draw without a valid command encoder.");
     auto primitive = handle_cast<MetalRenderPrimitive>(mHandleMap, rph);
@@ -738,7 +788,19 @@ void MetalDriver::draw(Driver::PipelineState ps, Driver::RenderPrimitiveHandle r
                                               indexCount:primitive->count
                                                indexType:getIndexType(indexBuffer->elementSize)
                                              indexBuffer:indexBuffer->buffer
-                                       indexBufferOffset:primitive->offset];
+                                       indexBufferOffset:primitive->offset
+                                           instanceCount:instanceCount];
+}
+
+void MetalDriver::drawBatch(Driver::PipelineState ps, size_t index,
+        Driver::UniformBufferHandle ubh, size_t size,
+        const Driver::BatchedDraw* draws, size_t count) {
+    // draw() only updates the encoder's state when it changes, so there is not much to gain
+    // from handling batches specially.
+    for (size_t i = 0; i < count; i++) {
+        bindUniformBufferRange(index, ubh, draws[i].offset, size);
+        draw(ps, draws[i].primitive);
+    }
 }
 
 void MetalDriver::enumerateSamplerBuffers(const MetalProgram *program,
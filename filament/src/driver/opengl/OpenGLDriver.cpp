@@ -16,6 +16,7 @@
 
 #include "driver/opengl/OpenGLDriver.h"
 
+#include <algorithm>
 #include <set>
 
 #include <utils/compiler.h>
@@ -131,14 +132,23 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &gets.max_renderbuffer_size);
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &gets.max_uniform_block_size);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &gets.uniform_buffer_offset_alignment);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &gets.num_program_binary_formats);
 
 #ifndef NDEBUG
     slog.i
         << "GL_MAX_RENDERBUFFER_SIZE = " << gets.max_renderbuffer_size << io::endl
         << "GL_MAX_UNIFORM_BLOCK_SIZE = " << gets.max_uniform_block_size << io::endl
-        << "GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT = " << gets.uniform_buffer_offset_alignment << io::endl;
+        << "GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT = " << gets.uniform_buffer_offset_alignment << io::endl
+        << "GL_NUM_PROGRAM_BINARY_FORMATS = " << gets.num_program_binary_formats << io::endl;
 #endif
 
+    // program binaries are only valid for the driver that produced them
+    uint64_t driverHash = OpenGLProgram::HASH_SEED;
+    for (char const* s : { vendor, renderer, version }) {
+        driverHash = OpenGLProgram::hash(s, strlen(s), driverHash);
+    }
+    mDriverHash = driverHash;
+
     if (strstr(renderer, "Adreno")) {
         bugs.clears_hurt_performance = true;
     } else if (strstr(renderer, "Mali")) {
@@ -214,6 +224,21 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     glHint(GL_FRAGMENT_SHADER_DERIVATIVE_HINT, GL_NICEST);
 #endif
 
+    // let the GL driver pick how many threads it uses to compile programs in the background
+    if (ext.KHR_parallel_shader_compile) {
+#if defined(GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#elif defined(GL_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+#else
+        ext.KHR_parallel_shader_compile = false;
+#endif
+    }
+
+#if !defined(GL_TIME_ELAPSED)
+    ext.EXT_disjoint_timer_query = false;
+#endif
+
     // For the shadow pass
     glPolygonOffset(1.0f, 1.0f);
 
@@ -251,6 +276,8 @@ void OpenGLDriver::initExtensionsGLES(GLint major, GLint minor, ExtentionSet con
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
     ext.texture_compression_s3tc = hasExtension(exts, "WEBGL_compressed_texture_s3tc");
     ext.EXT_multisampled_render_to_texture = hasExtension(exts, "GL_EXT_multisampled_render_to_texture");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = hasExtension(exts, "GL_EXT_disjoint_timer_query");
 }
 
 void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, ExtentionSet const& exts) {
@@ -260,6 +287,8 @@ void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, ExtentionSet const
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = true;  // Assumes core profile.
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_ARB_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = true;  // Assumes core profile (GL_ARB_timer_query).
 }
 
 void OpenGLDriver::terminate() {
@@ -268,6 +297,7 @@ void OpenGLDriver::terminate() {
         glDeleteSamplers(1, &item.second);
     }
     mSamplerMap.clear();
+    updateReadPixels(true);
     if (mOpenGLBlitter) {
         mOpenGLBlitter->terminate();
     }
@@ -496,6 +526,11 @@ void OpenGLDriver::useProgram(GLuint program) noexcept {
 }
 
 void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
+    if (UTILS_UNLIKELY(p->isPending())) {
+        // the program is needed now, this blocks until it's linked. It's removed from
+        // mCompilingPrograms in updateCompilingPrograms().
+        p->initialize(this);
+    }
     useProgram(p->gl.program);
     // set-up textures and samplers in the proper TMUs (as specified in setSamplers)
     p->use(this);
@@ -750,6 +785,7 @@ OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
     slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
     slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
     slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
+    slog.d << "GLTimerQuery: " << sizeof(GLTimerQuery) << io::endl;
 #endif
 }
 
@@ -821,7 +857,11 @@ Handle<HwRenderPrimitive> OpenGLDriver::createRenderPrimitiveS() noexcept {
 }
 
 Handle<HwProgram> OpenGLDriver::createProgramS() noexcept {
-    return Handle<HwProgram>( allocateHandle(sizeof(OpenGLProgram)) );
+    Handle<HwProgram> ph( allocateHandle(sizeof(OpenGLProgram)) );
+    // the program is not ready until createProgramR() has run (and its compilation finished)
+    std::lock_guard<std::mutex> lock(mPendingProgramsLock);
+    mPendingPrograms.insert(ph.getId());
+    return ph;
 }
 
 Handle<HwSamplerBuffer> OpenGLDriver::createSamplerBufferS() noexcept {
@@ -852,10 +892,18 @@ Handle<HwSwapChain> OpenGLDriver::createSwapChainS() noexcept {
     return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
 }
 
+Handle<HwSwapChain> OpenGLDriver::createSwapChainHeadlessS() noexcept {
+    return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
+}
+
 Handle<HwStream> OpenGLDriver::createStreamFromTextureIdS() noexcept {
     return Handle<HwStream>( allocateHandle(sizeof(GLStream)) );
 }
 
+Handle<HwTimerQuery> OpenGLDriver::createTimerQueryS() noexcept {
+    return Handle<HwTimerQuery>( allocateHandle(sizeof(GLTimerQuery)) );
+}
+
 void OpenGLDriver::createVertexBufferR(
     Driver::VertexBufferHandle vbh,
     uint8_t bufferCount,
@@ -915,10 +963,36 @@ void OpenGLDriver::createRenderPrimitiveR(Driver::RenderPrimitiveHandle rph, int
 void OpenGLDriver::createProgramR(Driver::ProgramHandle ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    OpenGLProgram* p = construct<OpenGLProgram>(ph, this, std::move(program));
+    if (p->isPending()) {
+        mCompilingPrograms.push_back(ph);
+    } else {
+        setProgramReady(ph);
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setProgramReady(Driver::ProgramHandle ph) noexcept {
+    std::lock_guard<std::mutex> lock(mPendingProgramsLock);
+    mPendingPrograms.erase(ph.getId());
+}
+
+void OpenGLDriver::updateCompilingPrograms() noexcept {
+    auto& programs = mCompilingPrograms;
+    programs.erase(std::remove_if(programs.begin(), programs.end(),
+            [this](Driver::ProgramHandle ph) {
+                OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+                if (p->isPending()) {
+                    if (!p->isLinkComplete()) {
+                        return false;
+                    }
+                    p->initialize(this);
+                }
+                setProgramReady(ph);
+                return true;
+            }), programs.end());
+}
+
 void OpenGLDriver::createSamplerBufferR(Driver::SamplerBufferHandle sbh, size_t size) {
     DEBUG_MARKER()
 
@@ -1328,6 +1402,14 @@ void OpenGLDriver::createSwapChainR(Driver::SwapChainHandle sch, void* nativeWin
     sc->swapChain = mPlatform.createSwapChain(nativeWindow, flags);
 }
 
+void OpenGLDriver::createSwapChainHeadlessR(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    DEBUG_MARKER()
+
+    HwSwapChain* sc = construct<HwSwapChain>(sch);
+    sc->swapChain = mPlatform.createSwapChain(width, height, flags);
+}
+
 void OpenGLDriver::createStreamFromTextureIdR(Driver::StreamHandle sh,
         intptr_t externalTextureId, uint32_t width, uint32_t height) {
     DEBUG_MARKER()
@@ -1345,6 +1427,16 @@ void OpenGLDriver::createStreamFromTextureIdR(Driver::StreamHandle sh,
     }
 }
 
+void OpenGLDriver::createTimerQueryR(Driver::TimerQueryHandle tqh, int) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = construct<GLTimerQuery>(tqh);
+    if (ext.EXT_disjoint_timer_query) {
+        glGenQueries(1, &tq->gl.query);
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 // ------------------------------------------------------------------------------------------------
 // Destroying driver objects
 // ------------------------------------------------------------------------------------------------
@@ -1404,6 +1496,11 @@ void OpenGLDriver::destroyProgram(Driver::ProgramHandle ph) {
 
     if (ph) {
         OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+        if (UTILS_UNLIKELY(!mCompilingPrograms.empty())) {
+            auto& programs = mCompilingPrograms;
+            programs.erase(std::remove(programs.begin(), programs.end(), ph), programs.end());
+        }
+        setProgramReady(ph);
         destruct(ph, p);
     }
 }
@@ -1531,6 +1628,23 @@ void OpenGLDriver::destroyStream(Driver::StreamHandle sh) {
     }
 }
 
+void OpenGLDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        auto& queries = mActiveTimerQueries;
+        queries.erase(std::remove(queries.begin(), queries.end(), tqh), queries.end());
+        std::unique_lock<std::mutex> lock(mTimerQueryResultsLock);
+        mTimerQueryResults.erase(tqh.getId());
+        lock.unlock();
+        if (tq->gl.query) {
+            glDeleteQueries(1, &tq->gl.query);
+        }
+        destruct(tqh, tq);
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 // Synchronous APIs
 // These are called on the application's thread
@@ -1673,6 +1787,23 @@ bool OpenGLDriver::isFrameTimeSupported() {
     return mPlatform.canCreateFence();
 }
 
+bool OpenGLDriver::isTimerQuerySupported() {
+    return ext.EXT_disjoint_timer_query;
+}
+
+bool OpenGLDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    std::lock_guard<std::mutex> lock(mTimerQueryResultsLock);
+    auto pos = mTimerQueryResults.find(tqh.getId());
+    if (pos == mTimerQueryResults.end()) {
+        return false;
+    }
+    *elapsedTime = pos->second;
+    // the result is only returned once, so it can't be mistaken for the next one when the
+    // query is reused
+    mTimerQueryResults.erase(pos);
+    return true;
+}
+
 // ------------------------------------------------------------------------------------------------
 // Swap chains
 // ------------------------------------------------------------------------------------------------
@@ -1870,6 +2001,11 @@ bool OpenGLDriver::canGenerateMipmaps() {
     return true;
 }
 
+bool OpenGLDriver::isProgramReady(Driver::ProgramHandle ph) {
+    std::lock_guard<std::mutex> lock(mPendingProgramsLock);
+    return mPendingPrograms.find(ph.getId()) == mPendingPrograms.end();
+}
+
 void OpenGLDriver::setTextureData(GLTexture* t,
                                   uint32_t level,
                                   uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -2677,6 +2813,71 @@ void OpenGLDriver::popGroupMarker(int) {
 #endif
 }
 
+void OpenGLDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+#if defined(GL_TIME_ELAPSED)
+    if (ext.EXT_disjoint_timer_query) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        // a query that's reused before its result is known loses that result
+        auto& queries = mActiveTimerQueries;
+        queries.erase(std::remove(queries.begin(), queries.end(), tqh), queries.end());
+        glBeginQuery(GL_TIME_ELAPSED, tq->gl.query);
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+#endif
+}
+
+void OpenGLDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+#if defined(GL_TIME_ELAPSED)
+    if (ext.EXT_disjoint_timer_query) {
+        glEndQuery(GL_TIME_ELAPSED);
+        mActiveTimerQueries.push_back(tqh);
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+#endif
+}
+
+void OpenGLDriver::updateTimerQueries() noexcept {
+#if defined(GL_TIME_ELAPSED)
+    auto& queries = mActiveTimerQueries;
+
+#if defined(GL_GPU_DISJOINT_EXT)
+    // if something happened that makes the GPU timings meaningless (e.g. a frequency change),
+    // the results of the active queries are dropped
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        queries.clear();
+        return;
+    }
+#endif
+
+    // the queries complete in order, so we stop at the first one that isn't available
+    auto pos = queries.begin();
+    for (; pos != queries.end(); ++pos) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(*pos);
+        GLuint available = 0;
+        glGetQueryObjectuiv(tq->gl.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+#if defined(GL_EXT_disjoint_timer_query) && !defined(GL_VERSION_3_3)
+        glGetQueryObjectui64vEXT(tq->gl.query, GL_QUERY_RESULT, &elapsed);
+#else
+        glGetQueryObjectui64v(tq->gl.query, GL_QUERY_RESULT, &elapsed);
+#endif
+        std::lock_guard<std::mutex> lock(mTimerQueryResultsLock);
+        mTimerQueryResults[pos->getId()] = elapsed;
+    }
+    queries.erase(queries.begin(), pos);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
 // ------------------------------------------------------------------------------------------------
 // Read-back ops
 // ------------------------------------------------------------------------------------------------
@@ -2722,7 +2923,21 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
     GLRenderTarget const* s = handle_cast<GLRenderTarget const*>(src);
     bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
 
-    // TODO: we could use a PBO to make this asynchronous
+    if (HAS_MAPBUFFERS) {
+        // The pixels are read into a pixel-pack buffer that has the same layout as the client's
+        // buffer, which doesn't stall. They're copied when the GPU is done, see updateReadPixels().
+        GLuint pbo;
+        glGenBuffers(1, &pbo);
+        bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, p.size, nullptr, GL_STREAM_READ);
+        glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, nullptr);
+        bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mPendingReadPixels.push_back({ pbo, sync, width, height, 0, std::move(p) });
+        CHECK_GL_ERROR(utils::slog.e)
+        return;
+    }
+
     glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
 
     // now we need to flip the buffer vertically to match our API
@@ -2743,12 +2958,68 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::updateReadPixels(bool wait) noexcept {
+#if HAS_MAPBUFFERS
+    auto& pending = mPendingReadPixels;
+
+    // the readbacks complete in order, so we stop at the first one that isn't done
+    auto pos = pending.begin();
+    for (; pos != pending.end(); ++pos) {
+        PixelBufferDescriptor& p = pos->p;
+        if (wait || ++pos->age >= MAX_READ_PIXELS_LATENCY) {
+            glClientWaitSync(pos->sync, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_FOR_EVER);
+        } else {
+            GLenum status = glClientWaitSync(pos->sync, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+        }
+        glDeleteSync(pos->sync);
+
+        // copy the pixels, flipping them vertically to match our API
+        bindBuffer(GL_PIXEL_PACK_BUFFER, pos->pbo);
+        void const* vaddr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, p.size, GL_MAP_READ_BIT);
+        if (vaddr) {
+            size_t stride = p.stride ? p.stride : pos->width;
+            size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
+            size_t bpr = PixelBufferDescriptor::computeDataSize(
+                    p.format, p.type, stride, 1, p.alignment);
+            size_t offset = p.left * bpp + bpr * p.top;
+            char const* head = (char const*)vaddr + offset;
+            char* tail = (char*)p.buffer + offset + bpr * (pos->height - 1);
+            for (uint32_t i = 0; i < pos->height; i++, head += bpr, tail -= bpr) {
+                memcpy(tail, head, bpp * pos->width);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            // the client's buffer is released without the pixels
+            utils::slog.e << "readPixels: couldn't map the pixel-pack buffer" << utils::io::endl;
+        }
+        bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(1, &pos->pbo);
+
+        scheduleDestroy(std::move(p));
+    }
+    pending.erase(pending.begin(), pos);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
 // ------------------------------------------------------------------------------------------------
 // Rendering ops
 // ------------------------------------------------------------------------------------------------
 
 void OpenGLDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId) {
     insertEventMarker("beginFrame");
+    if (UTILS_UNLIKELY(!mCompilingPrograms.empty())) {
+        updateCompilingPrograms();
+    }
+    if (!mActiveTimerQueries.empty()) {
+        updateTimerQueries();
+    }
+    if (!mPendingReadPixels.empty()) {
+        updateReadPixels(false);
+    }
     if (UTILS_UNLIKELY(!mExternalStreams.empty())) {
         driver::OpenGLPlatform& platform = mPlatform;
         const size_t index = getIndexForTextureTarget(GL_TEXTURE_EXTERNAL_OES);
@@ -2778,6 +3049,17 @@ void OpenGLDriver::endFrame(uint32_t frameId) {
 void OpenGLDriver::flush(int) {
     DEBUG_MARKER()
     glFlush();
+    if (!mPendingReadPixels.empty()) {
+        updateReadPixels(false);
+    }
+}
+
+void OpenGLDriver::finish(int) {
+    DEBUG_MARKER()
+    // only the pending read-backs are waited for, readPixels() is synchronous otherwise
+    if (!mPendingReadPixels.empty()) {
+        updateReadPixels(true);
+    }
 }
 
 UTILS_NOINLINE
@@ -2936,6 +3218,63 @@ void OpenGLDriver::draw(
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::drawInstanced(
+        Driver::PipelineState state,
+        Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
+    DEBUG_MARKER()
+
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(state.program);
+    useProgram(p);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    bindVertexArray(rp);
+
+    setRasterState(state.rasterState);
+
+    polygonOffset(state.polygonOffset.slope, state.polygonOffset.constant);
+
+    // there is no instanced version of glDrawRangeElements
+    glDrawElementsInstanced(GLenum(rp->type), rp->count, rp->gl.indicesType,
+            reinterpret_cast<const void*>(rp->offset), GLsizei(instanceCount));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawBatch(
+        Driver::PipelineState state,
+        size_t index, Driver::UniformBufferHandle ubh, size_t size,
+        const Driver::BatchedDraw* draws, size_t count) {
+    DEBUG_MARKER()
+
+    // the pipeline state is set once for the whole batch
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(state.program);
+    useProgram(p);
+
+    setRasterState(state.rasterState);
+
+    polygonOffset(state.polygonOffset.slope, state.polygonOffset.constant);
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer*>(ubh);
+    assert(size <= ub->gl.ubo.size);
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t offset = draws[i].offset;
+        assert(ub->gl.ubo.base + offset + size <= ub->gl.ubo.capacity);
+        bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo.id,
+                ub->gl.ubo.base + offset, size);
+
+        Driver::RenderPrimitiveHandle rph = draws[i].primitive;
+        const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+        bindVertexArray(rp);
+
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    }
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 // explicit instantiation of the Dispatcher
 template class ConcreteDispatcher<OpenGLDriver>;
 
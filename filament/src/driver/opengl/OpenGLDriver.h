@@ -27,8 +27,11 @@
 #include <math/vec4.h>
 
 #include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
 
+#include <mutex>
 #include <set>
+#include <vector>
 
 #include <assert.h>
 
@@ -184,6 +187,12 @@ public:
         } gl;
     };
 
+    struct GLTimerQuery : public HwTimerQuery {
+        struct {
+            GLuint query = 0;
+        } gl;
+    };
+
     void useProgram(GLuint program) noexcept;
 
     OpenGLDriver(OpenGLDriver const&) = delete;
@@ -512,15 +521,54 @@ private:
     std::array<HwSamplerBuffer*, Program::NUM_SAMPLER_BINDINGS> mSamplerBindings;   // 8 pointers
 
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
+
+    // Programs whose compilation hasn't finished. mPendingPrograms is read from the main thread
+    // (isProgramReady), mCompilingPrograms is only used on the driver thread.
+    std::mutex mPendingProgramsLock;
+    tsl::robin_set<HandleBase::HandleId> mPendingPrograms;
+    std::vector<Driver::ProgramHandle> mCompilingPrograms;
+    void updateCompilingPrograms() noexcept;
+    void setProgramReady(Driver::ProgramHandle ph) noexcept;
     mutable std::vector<GLTexture*> mExternalStreams;
 
+    // Timer queries whose result isn't known yet, in the order they ended, are only used on the
+    // driver thread. The results are read from the main thread (getTimerQueryValue).
+    std::vector<Driver::TimerQueryHandle> mActiveTimerQueries;
+    std::mutex mTimerQueryResultsLock;
+    tsl::robin_map<HandleBase::HandleId, uint64_t> mTimerQueryResults;
+    void updateTimerQueries() noexcept;
+
+    // Asynchronous readPixels() are read into a pixel-pack buffer and copied to the client's
+    // buffer once their fence is signaled, in the order they were issued. The ones that are
+    // still pending after MAX_READ_PIXELS_LATENCY frames are waited on.
+    static constexpr uint32_t MAX_READ_PIXELS_LATENCY = 3;
+    struct PendingReadPixels {
+        GLuint pbo;
+        GLsync sync;
+        uint32_t width;
+        uint32_t height;
+        uint32_t age;
+        PixelBufferDescriptor p;
+    };
+    std::vector<PendingReadPixels> mPendingReadPixels;
+    void updateReadPixels(bool wait) noexcept;
+
     // glGet*() values
     struct {
         GLint max_renderbuffer_size = 0;
         GLint max_uniform_block_size = 0;
         GLint uniform_buffer_offset_alignment = 256;
+        GLint num_program_binary_formats = 0;
     } gets;
 
+    // identifies this GL driver in the keys of OpenGLProgram's binary cache
+    uint64_t mDriverHash = 0;
+
+    // whether OpenGLProgram can store and retrieve program binaries through the Platform
+    bool isProgramBinaryCacheEnabled() const noexcept {
+        return gets.num_program_binary_formats > 0 && mPlatform.hasBlobFunc();
+    }
+
     // features supported by this version of GL or GLES
     struct {
         bool multisample_texture = false;
@@ -536,6 +584,8 @@ private:
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
         bool EXT_multisampled_render_to_texture = false;
+        bool KHR_parallel_shader_compile = false;   // or ARB_parallel_shader_compile
+        bool EXT_disjoint_timer_query = false;      // or ARB_timer_query
     } ext;
 
     struct {
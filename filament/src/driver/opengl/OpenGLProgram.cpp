@@ -17,6 +17,7 @@
 #include "driver/opengl/OpenGLProgram.h"
 
 #include <cctype>
+#include <memory>
 #include <sstream>
 
 #include <utils/Log.h>
@@ -41,14 +42,22 @@ static char* copy_n(char const* s, size_t n, char* d) noexcept {
     return d;
 }
 
-OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) noexcept
+OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, Program&& programBuilder) noexcept
         :  HwProgram(programBuilder.getName()), mIsValid(false) {
 
     using Shader = Program::Shader;
 
+    const bool useBinaryCache = gl->isProgramBinaryCacheEnabled();
+    if (useBinaryCache && loadBinary(gl, programBuilder)) {
+        // the program was linked from a cached binary, there is no shader to compile
+        initialize(gl, programBuilder);
+        return;
+    }
+
     const auto& shadersSource = programBuilder.getShadersSource();
 
-    // build all shaders
+    // build all shaders, compilation errors are checked in initialize(), so that the GL driver
+    // can compile them in parallel if it supports it.
     #pragma nounroll
     for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
         GLenum glShaderType;
@@ -63,19 +72,10 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
         }
 
         if (shadersSource[i].length()) {
-            GLint status;
             char const* const source = shadersSource[i].c_str();
-
             GLuint shaderId = glCreateShader(glShaderType);
             glShaderSource(shaderId, 1, &source, nullptr);
             glCompileShader(shaderId);
-
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
             this->gl.shaders[i] = shaderId;
             mValidShaderSet |= 1U << i;
         }
@@ -84,29 +84,79 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
     // we need at least a vertex and fragment program
     const uint8_t validShaderSet = mValidShaderSet;
     const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
+    if (UTILS_LIKELY((validShaderSet & mask) == mask)) {
         GLuint program = glCreateProgram();
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
             if (validShaderSet & (1U << i)) {
                 glAttachShader(program, this->gl.shaders[i]);
             }
         }
+        if (useBinaryCache) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            mStoreBinary = true;
+        }
         glLinkProgram(program);
+        this->gl.program = program;
+    }
+
+    if (gl->ext.KHR_parallel_shader_compile) {
+        // keep what we need to finish initializing the program once it's linked
+        mPendingBuilder.reset(new Program(std::move(programBuilder)));
+    } else {
+        initialize(gl, programBuilder);
+    }
+}
+
+bool OpenGLProgram::isLinkComplete() const noexcept {
+    assert(mPendingBuilder);
+#ifdef GL_COMPLETION_STATUS_KHR
+    if (this->gl.program) {
+        GLint status = GL_FALSE;
+        glGetProgramiv(this->gl.program, GL_COMPLETION_STATUS_KHR, &status);
+        return status == GL_TRUE;
+    }
+#endif
+    return true;
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl) noexcept {
+    assert(mPendingBuilder);
+    std::unique_ptr<Program> builder(std::move(mPendingBuilder));
+    initialize(gl, *builder);
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl, Program const& builder) noexcept {
+    const auto& shadersSource = builder.getShadersSource();
+    const uint8_t validShaderSet = mValidShaderSet;
+
+    // this waits for the compilation to finish
+    #pragma nounroll
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        if (validShaderSet & (1U << i)) {
+            GLint status;
+            GLuint shaderId = this->gl.shaders[i];
+            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                logCompilationError(slog.e, shaderId, shadersSource[i].c_str());
+                goto error;
+            }
+        }
+    }
 
+    if (UTILS_LIKELY(this->gl.program)) {
+        GLint status;
+        GLuint program = this->gl.program;
         glGetProgramiv(program, GL_LINK_STATUS, &status);
         if (UTILS_UNLIKELY(status != GL_TRUE)) {
             char error[512];
             glGetProgramInfoLog(program, sizeof(error), nullptr, error);
 
             slog.e << "LINKING: " << error << io::endl;
-            glDeleteProgram(program);
-            return;
+            goto error;
         }
-        this->gl.program = program;
 
         // Associate each UniformBlock in the program to a known binding.
-        auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
+        auto const& uniformInterfaceBlocks = builder.getUniformInterfaceBlocks();
         size_t n = uniformInterfaceBlocks.size();
         #pragma nounroll
         for (GLuint binding = 0; binding < n; binding++) {
@@ -120,12 +170,12 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
             }
         }
 
-        if (programBuilder.hasSamplers()) {
+        if (builder.hasSamplers()) {
             // if we have samplers, we need to do a bit of extra work
             // activate this program so we can set all its samplers once and for all (glUniform1i)
             gl->useProgram(program);
 
-            auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
+            auto const& samplerInterfaceBlocks = builder.getSamplerInterfaceBlocks();
             auto& indicesRun = mIndicesRuns;
             uint8_t numUsedBindings = 0;
             uint8_t tmu = 0;
@@ -185,33 +235,136 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
             mUsedBindingsCount = numUsedBindings;
         }
         mIsValid = true;
+
+        if (mStoreBinary) {
+            storeBinary(gl, builder);
+        }
     }
 
+error:
     // failing to compile a program can't be fatal, because this will happen a lot in
     // the material tools. We need to have a better way to handle these errors and
     // return to the editor.
     if (UTILS_UNLIKELY(!isValid())) {
+        // don't keep a program which failed to link, so that draws using it don't run with
+        // whatever program was current before
+        if (this->gl.program) {
+            glDeleteProgram(this->gl.program);
+            this->gl.program = 0;
+        }
         PANIC_LOG("failed to compile glsl program");
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+// Program binary cache
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// the key under which a program binary is stored with Platform::insertBlob()
+struct BinaryKey {
+    static constexpr uint32_t VERSION = 1;  // bump when the key or the value layout changes
+    uint32_t version = VERSION;
+    uint32_t variant = 0;                   // material variant, see Variant
+    uint64_t driver = 0;                    // GL vendor, renderer and version
+    uint64_t shaders[Program::NUM_SHADER_TYPES] = {}; // source of each shader
+};
+
+// the value starts with this header, followed by the program binary
+struct BinaryHeader {
+    GLenum format;
+};
+
+BinaryKey getBinaryKey(uint64_t driverHash, Program const& builder) noexcept {
+    BinaryKey key;
+    key.variant = builder.getVariant();
+    key.driver = driverHash;
+    const auto& shadersSource = builder.getShadersSource();
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        key.shaders[i] = OpenGLProgram::hash(shadersSource[i].c_str(), shadersSource[i].length());
+    }
+    return key;
+}
+
+} // anonymous namespace
+
+uint64_t OpenGLProgram::hash(void const* data, size_t size, uint64_t seed) noexcept {
+    uint8_t const* p = static_cast<uint8_t const*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+bool OpenGLProgram::loadBinary(OpenGLDriver* gl, Program const& builder) noexcept {
+    driver::OpenGLPlatform& platform = gl->mPlatform;
+    const BinaryKey key = getBinaryKey(gl->mDriverHash, builder);
+
+    const size_t size = platform.retrieveBlob(&key, sizeof(key), nullptr, 0);
+    if (size <= sizeof(BinaryHeader)) {
+        return false;
+    }
+
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[size]);
+    if (platform.retrieveBlob(&key, sizeof(key), blob.get(), size) != size) {
+        return false;
+    }
+
+    BinaryHeader header;
+    memcpy(&header, blob.get(), sizeof(header));
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format,
+            blob.get() + sizeof(header), GLsizei(size - sizeof(header)));
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        // this can happen when the GL driver is updated, the program is compiled again and
+        // its new binary will replace this one.
+        glDeleteProgram(program);
+        return false;
+    }
+    this->gl.program = program;
+    return true;
+}
+
+void OpenGLProgram::storeBinary(OpenGLDriver* gl, Program const& builder) const noexcept {
+    GLuint program = this->gl.program;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    const size_t size = sizeof(BinaryHeader) + size_t(length);
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[size]);
+    BinaryHeader header;
+    glGetProgramBinary(program, length, nullptr, &header.format, blob.get() + sizeof(header));
+    memcpy(blob.get(), &header, sizeof(header));
+
+    const BinaryKey key = getBinaryKey(gl->mDriverHash, builder);
+    gl->mPlatform.insertBlob(&key, sizeof(key), blob.get(), size);
+}
+
 OpenGLProgram::~OpenGLProgram() noexcept {
     const size_t validShaderSet = mValidShaderSet;
-    const bool isValid = mIsValid;
     GLuint program = gl.program;
     if (validShaderSet) {
         #pragma nounroll
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
             if (validShaderSet & (1U << i)) {
                 const GLuint shader = gl.shaders[i];
-                if (isValid) {
+                if (program) {
                     glDetachShader(program, shader);
                 }
                 glDeleteShader(shader);
             }
         }
     }
-    if (isValid) {
+    if (program) {
         glDeleteProgram(program);
     }
 }
@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include <utils/compiler.h>
@@ -36,11 +37,20 @@ namespace filament {
 class OpenGLProgram : public HwProgram {
 public:
 
-    OpenGLProgram(OpenGLDriver* gl, const Program& builder) noexcept;
+    OpenGLProgram(OpenGLDriver* gl, Program&& builder) noexcept;
     ~OpenGLProgram() noexcept;
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // When the GL driver compiles programs in parallel, the program stays pending until
+    // initialize() is called, which blocks until the program is linked.
+    bool isPending() const noexcept { return bool(mPendingBuilder); }
+
+    // returns whether initialize() can be called without blocking
+    bool isLinkComplete() const noexcept;
+
+    void initialize(OpenGLDriver* gl) noexcept;
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
             // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
@@ -60,12 +70,16 @@ public:
     }
 
     struct {
-        GLuint shaders[Program::NUM_SHADER_TYPES];
-        GLuint program;
+        GLuint shaders[Program::NUM_SHADER_TYPES] = {};
+        GLuint program = 0;
     } gl; // 12 bytes
 
     static void logCompilationError(utils::io::ostream& out, GLuint shaderId, char const* source) noexcept;
 
+    // 64-bit FNV-1a, used to build the keys of the program binary cache
+    static constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+    static uint64_t hash(void const* data, size_t size, uint64_t seed = HASH_SEED) noexcept;
+
 private:
     static constexpr uint8_t NUM_TEXTURE_UNITS = OpenGLDriver::MAX_TEXTURE_UNITS;
     static constexpr uint8_t VERTEX_SHADER_BIT   = uint8_t(1) << size_t(Program::Shader::VERTEX);
@@ -86,6 +100,7 @@ private:
     uint8_t mUsedBindingsCount = 0;
     uint8_t mValidShaderSet = 0;
     bool mIsValid = false;
+    bool mStoreBinary = false;  // whether the program binary must be stored once linked
 
     // information about each USED sampler buffer (no gaps)
     std::array<BlockInfo, Program::NUM_SAMPLER_BINDINGS> mBlockInfos;   // 8 bytes
@@ -94,6 +109,14 @@ private:
     std::array<uint8_t, NUM_TEXTURE_UNITS> mIndicesRuns;    // 16 bytes
 
     void updateSamplers(OpenGLDriver* gl) noexcept;
+    void initialize(OpenGLDriver* gl, Program const& builder) noexcept;
+
+    // program binary cache, see Platform::setBlobFunc()
+    bool loadBinary(OpenGLDriver* gl, Program const& builder) noexcept;
+    void storeBinary(OpenGLDriver* gl, Program const& builder) const noexcept;
+
+    // only set while the program is pending
+    std::unique_ptr<Program> mPendingBuilder;
 };
 
 
@@ -84,6 +84,11 @@ Platform::SwapChain* PlatformCocoaGL::createSwapChain(void* nativewindow, uint64
     return (SwapChain*) nativewindow;
 }
 
+Platform::SwapChain* PlatformCocoaGL::createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    ASSERT_POSTCONDITION_NON_FATAL(false, "Headless SwapChain not supported by PlatformCocoaGL.");
+    return nullptr;
+}
+
 void PlatformCocoaGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
 }
 
@@ -91,6 +91,11 @@ Platform::SwapChain* PlatformCocoaTouchGL::createSwapChain(void* nativewindow, u
     return (SwapChain*) nativewindow;
 }
 
+Platform::SwapChain* PlatformCocoaTouchGL::createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    ASSERT_POSTCONDITION_NON_FATAL(false, "Headless SwapChain not supported by PlatformCocoaTouchGL.");
+    return nullptr;
+}
+
 void PlatformCocoaTouchGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
 }
 
@@ -342,6 +342,23 @@ Platform::SwapChain* PlatformEGL::createSwapChain(
     return (SwapChain*)sur;
 }
 
+Platform::SwapChain* PlatformEGL::createSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    EGLint attribs[] = {
+            EGL_WIDTH,  EGLint(width),
+            EGL_HEIGHT, EGLint(height),
+            EGL_NONE
+    };
+    EGLSurface sur = eglCreatePbufferSurface(mEGLDisplay,
+            (flags & driver::SWAP_CHAIN_CONFIG_TRANSPARENT) ? mEGLTransparentConfig : mEGLConfig,
+            attribs);
+    if (UTILS_UNLIKELY(sur == EGL_NO_SURFACE)) {
+        logEglError("eglCreatePbufferSurface");
+        return nullptr;
+    }
+    return (SwapChain*)sur;
+}
+
 void PlatformEGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
     EGLSurface sur = (EGLSurface) swapChain;
     if (sur != EGL_NO_SURFACE) {
@@ -23,6 +23,8 @@
 #include <GL/glx.h>
 #include <GL/glxext.h>
 
+#include <algorithm>
+
 #include "driver/opengl/OpenGLDriver.h"
 
 #include <dlfcn.h>
@@ -167,7 +169,34 @@ Platform::SwapChain* PlatformGLX::createSwapChain(
     return (SwapChain*) nativeWindow;
 }
 
-void PlatformGLX::destroySwapChain(Platform::SwapChain* /*swapChain*/) noexcept {
+Platform::SwapChain* PlatformGLX::createSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+
+    // Transparent swap chain is not supported
+    flags &= ~driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
+
+    int pbufferAttribs[] = {
+            GLX_PBUFFER_WIDTH,  int(width),
+            GLX_PBUFFER_HEIGHT, int(height),
+            GL_NONE
+    };
+    GLXPbuffer sur = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
+    if (UTILS_UNLIKELY(!sur)) {
+        utils::slog.e << "glXCreatePbuffer() failed" << utils::io::endl;
+        return nullptr;
+    }
+    mPBuffers.push_back(sur);
+    return (SwapChain*) sur;
+}
+
+void PlatformGLX::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
+    // only the headless swap chains are owned by us
+    auto it = std::find(mPBuffers.begin(), mPBuffers.end(), (GLXPbuffer) swapChain);
+    if (it != mPBuffers.end()) {
+        g_glx.setCurrentContext(mGLXDisplay, mDummySurface, mDummySurface, mGLXContext);
+        g_glx.destroyPbuffer(mGLXDisplay, *it);
+        mPBuffers.erase(it);
+    }
 }
 
 void PlatformGLX::makeCurrent(
@@ -169,6 +169,12 @@ Platform::SwapChain* PlatformWGL::createSwapChain(void* nativeWindow, uint64_t&
     return swapChain;
 }
 
+Platform::SwapChain* PlatformWGL::createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    // TODO: implement headless SwapChain with WGL_ARB_pbuffer
+    ASSERT_POSTCONDITION_NON_FATAL(false, "Headless SwapChain not supported by PlatformWGL.");
+    return nullptr;
+}
+
 void PlatformWGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
     // make this swapChain not current (by making a dummy one current)
     wglMakeCurrent(mWhdc, mContext);
@@ -33,6 +33,12 @@ Platform::SwapChain* PlatformWebGL::createSwapChain(
     return (SwapChain*) nativeWindow;
 }
 
+Platform::SwapChain* PlatformWebGL::createSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    // WebGL always renders into its canvas
+    return nullptr;
+}
+
 void PlatformWebGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
 }
 
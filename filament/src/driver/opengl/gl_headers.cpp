@@ -37,6 +37,12 @@ PFNGLPOPGROUPMARKEREXTPROC glPopGroupMarkerEXT;
 PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT;
 PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT;
 #endif
+#ifdef GL_KHR_parallel_shader_compile
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+#endif
+#ifdef GL_EXT_disjoint_timer_query
+PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+#endif
 }
 
 using namespace glext;
@@ -81,6 +87,16 @@ public:
         glRenderbufferStorageMultisampleEXT =
                 (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress(
                         "glRenderbufferStorageMultisampleEXT");
+#endif
+#ifdef GL_KHR_parallel_shader_compile
+        glMaxShaderCompilerThreadsKHR =
+                (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)eglGetProcAddress(
+                        "glMaxShaderCompilerThreadsKHR");
+#endif
+#ifdef GL_EXT_disjoint_timer_query
+        glGetQueryObjectui64vEXT =
+                (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
+                        "glGetQueryObjectui64vEXT");
 #endif
     }
 } instance;
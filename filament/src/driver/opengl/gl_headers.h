@@ -39,6 +39,12 @@
 #if GL_EXT_multisampled_render_to_texture
         extern PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT;
         extern PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT;
+#endif
+#ifdef GL_KHR_parallel_shader_compile
+        extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+#endif
+#ifdef GL_EXT_disjoint_timer_query
+        extern PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
 #endif
     }
 
@@ -76,6 +82,16 @@
 #define GL_TEXTURE_EXTERNAL_OES           0x8D65
 #endif
 
+// GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile share the same enums
+#if !defined(GL_COMPLETION_STATUS_KHR) && defined(GL_COMPLETION_STATUS_ARB)
+#define GL_COMPLETION_STATUS_KHR          GL_COMPLETION_STATUS_ARB
+#endif
+
+// GL_EXT_disjoint_timer_query and GL_ARB_timer_query share the same enums
+#if !defined(GL_TIME_ELAPSED) && defined(GL_TIME_ELAPSED_EXT)
+#define GL_TIME_ELAPSED                   GL_TIME_ELAPSED_EXT
+#endif
+
 #include "driver/opengl/NullGLES.h"
 
 #if (!defined(GL_ES_VERSION_3_1) && !defined(GL_VERSION_4_1))
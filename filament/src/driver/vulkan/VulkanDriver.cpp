@@ -41,8 +41,9 @@ namespace driver {
 VulkanDriver::VulkanDriver(VulkanPlatform* platform,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>()),
-        mContextManager(*platform), mStagePool(mContext), mFramebufferCache(mContext),
-        mSamplerCache(mContext) {
+        mContextManager(*platform),
+        mHandleArena("Handles", 4U * 1024U * 1024U), // TODO: set the amount in configuration
+        mStagePool(mContext), mFramebufferCache(mContext), mSamplerCache(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
 
     // Load Vulkan entry points.
@@ -248,56 +249,65 @@ void VulkanDriver::flush(int) {
     // Todo: equivalent of glFlush()
 }
 
+void VulkanDriver::finish(int) {
+    // The read-backs are delivered by the tasks of the swap contexts, which run once their
+    // command buffer is done. Within a frame, they're delivered once it's committed. Without
+    // pending read-backs, there is nothing to wait for.
+    if (mPendingReadPixels && !mContext.cmdbuffer) {
+        waitForIdle(mContext);
+    }
+}
+
 void VulkanDriver::createVertexBufferR(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
         uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes,
         Driver::BufferUsage usage) {
-    construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool, bufferCount,
+    construct_handle<VulkanVertexBuffer>(vbh, mContext, mStagePool, bufferCount,
             attributeCount, elementCount, attributes);
 }
 
 void VulkanDriver::createIndexBufferR(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
         uint32_t indexCount, Driver::BufferUsage usage) {
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
-    construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool, elementSize,
+    construct_handle<VulkanIndexBuffer>(ibh, mContext, mStagePool, elementSize,
             indexCount);
 }
 
 void VulkanDriver::createTextureR(Driver::TextureHandle th, SamplerType target, uint8_t levels,
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
-    construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format, samples,
+    construct_handle<VulkanTexture>(th, mContext, target, levels, format, samples,
             w, h, depth, usage, mStagePool);
 }
 
 void VulkanDriver::createSamplerBufferR(Driver::SamplerBufferHandle sbh, size_t count) {
-    construct_handle<VulkanSamplerBuffer>(mHandleMap, sbh, mContext, count);
+    construct_handle<VulkanSamplerBuffer>(sbh, mContext, count);
 }
 
 void VulkanDriver::createUniformBufferR(Driver::UniformBufferHandle ubh, size_t size,
         Driver::BufferUsage usage) {
-    construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext, mStagePool, size, usage);
+    construct_handle<VulkanUniformBuffer>(ubh, mContext, mStagePool, size, usage);
 }
 
 void VulkanDriver::createRenderPrimitiveR(Driver::RenderPrimitiveHandle rph, int) {
-    construct_handle<VulkanRenderPrimitive>(mHandleMap, rph, mContext);
+    construct_handle<VulkanRenderPrimitive>(rph, mContext);
 }
 
 void VulkanDriver::createProgramR(Driver::ProgramHandle ph, Program&& program) {
-    construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
+    construct_handle<VulkanProgram>(ph, mContext, program);
 }
 
 void VulkanDriver::createDefaultRenderTargetR(Driver::RenderTargetHandle rth, int) {
-    construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
+    construct_handle<VulkanRenderTarget>(rth, mContext);
 }
 
 void VulkanDriver::createRenderTargetR(Driver::RenderTargetHandle rth,
         Driver::TargetBufferFlags targets, uint32_t width, uint32_t height, uint8_t samples,
         TextureFormat format, Driver::TargetBufferInfo color, Driver::TargetBufferInfo depth,
         Driver::TargetBufferInfo stencil) {
-    auto& renderTarget = *construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext,
+    auto& renderTarget = *construct_handle<VulkanRenderTarget>(rth, mContext,
             width, height, color.level);
     if (color.handle) {
-        auto colorTexture = handle_cast<VulkanTexture>(mHandleMap, color.handle);
+        auto colorTexture = handle_cast<VulkanTexture>(color.handle);
         renderTarget.setColorImage({
             .image = colorTexture->textureImage,
             .view = colorTexture->imageView,
@@ -307,7 +317,7 @@ void VulkanDriver::createRenderTargetR(Driver::RenderTargetHandle rth,
         renderTarget.createColorImage(getVkFormat(format));
     }
     if (depth.handle) {
-        auto depthTexture = handle_cast<VulkanTexture>(mHandleMap, depth.handle);
+        auto depthTexture = handle_cast<VulkanTexture>(depth.handle);
         renderTarget.setDepthImage({
             .image = depthTexture->textureImage,
             .view = depthTexture->imageView,
@@ -321,9 +331,23 @@ void VulkanDriver::createRenderTargetR(Driver::RenderTargetHandle rth,
 void VulkanDriver::createFenceR(Driver::FenceHandle fh, int) {
 }
 
+void VulkanDriver::createTimerQueryR(Driver::TimerQueryHandle tqh, int) {
+    auto* query = construct_handle<VulkanTimerQuery>(tqh);
+    mTimerQueries.insert(tqh.getId());
+    if (isTimerQuerySupported()) {
+        VkQueryPoolCreateInfo info = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+        };
+        VkResult result = vkCreateQueryPool(mContext.device, &info, VKALLOC, &query->pool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateQueryPool error.");
+    }
+}
+
 void VulkanDriver::createSwapChainR(Driver::SwapChainHandle sch, void* nativeWindow,
         uint64_t flags) {
-    auto* swapChain = construct_handle<VulkanSwapChain>(mHandleMap, sch);
+    auto* swapChain = construct_handle<VulkanSwapChain>(sch);
     VulkanSurfaceContext& sc = swapChain->surfaceContext;
     sc.surface = (VkSurfaceKHR) mContextManager.createVkSurfaceKHR(nativeWindow,
             mContext.instance, &sc.clientSize.width, &sc.clientSize.height);
@@ -340,10 +364,47 @@ void VulkanDriver::createSwapChainR(Driver::SwapChainHandle sch, void* nativeWin
     }
 }
 
+void VulkanDriver::createSwapChainHeadlessR(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    // TODO: implement headless swap chains with offscreen images
+}
+
 void VulkanDriver::createStreamFromTextureIdR(Driver::StreamHandle sh, intptr_t externalTextureId,
         uint32_t width, uint32_t height) {
 }
 
+VulkanDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
+        : mPool0(area.begin(),
+                 utils::pointermath::add(area.begin(), (1 * area.getSize()) / 8)),
+          mPool1(utils::pointermath::add(area.begin(), (1 * area.getSize()) / 8),
+                 utils::pointermath::add(area.begin(), (4 * area.getSize()) / 8)),
+          mPool2(utils::pointermath::add(area.begin(), (4 * area.getSize()) / 8),
+                 area.end()) {
+}
+
+void* VulkanDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
+    assert(size <= mPool2.getSize());
+    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
+    if (size <= mPool1.getSize()) return mPool1.alloc(size, 16, extra);
+    if (size <= mPool2.getSize()) return mPool2.alloc(size, 16, extra);
+    return nullptr;
+}
+
+void VulkanDriver::HandleAllocator::free(void* p, size_t size) noexcept {
+    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
+    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
+    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
+}
+
+// Called from the main thread (createXXXS), while handles are freed on the driver thread.
+HandleBase::HandleId VulkanDriver::allocateHandle(size_t size) noexcept {
+    void* addr = mHandleArena.alloc(size);
+    ASSERT_POSTCONDITION(addr, "Out of memory for Vulkan handles (%s).", mHandleArena.getName());
+    char* const base = (char*)mHandleArena.getArea().begin();
+    size_t offset = (char*)addr - base;
+    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
+}
+
 Handle<HwVertexBuffer> VulkanDriver::createVertexBufferS() noexcept {
     return alloc_handle<VulkanVertexBuffer, HwVertexBuffer>();
 }
@@ -388,35 +449,43 @@ Handle<HwSwapChain> VulkanDriver::createSwapChainS() noexcept {
     return alloc_handle<VulkanSwapChain, HwSwapChain>();
 }
 
+Handle<HwSwapChain> VulkanDriver::createSwapChainHeadlessS() noexcept {
+    return {};
+}
+
 Handle<HwStream> VulkanDriver::createStreamFromTextureIdS() noexcept {
     return {};
 }
 
+Handle<HwTimerQuery> VulkanDriver::createTimerQueryS() noexcept {
+    return alloc_handle<VulkanTimerQuery, HwTimerQuery>();
+}
+
 void VulkanDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
+        destruct_handle<VulkanVertexBuffer>(vbh);
     }
 }
 
 void VulkanDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
+        destruct_handle<VulkanIndexBuffer>(ibh);
     }
 }
 
 void VulkanDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
     if (rph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderPrimitive>(mHandleMap, rph);
+        destruct_handle<VulkanRenderPrimitive>(rph);
     }
 }
 
 void VulkanDriver::destroyProgram(Driver::ProgramHandle ph) {
     if (ph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
+        destruct_handle<VulkanProgram>(ph);
     }
 }
 
@@ -426,53 +495,65 @@ void VulkanDriver::destroySamplerBuffer(Driver::SamplerBufferHandle sbh) {
         // not map to any Vulkan objects. To handle destruction, the only thing we need to do is
         // ensure that the next draw call doesn't try to access a zombie sampler buffer. Therefore,
         // simply replace all weak references with null.
-        auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+        auto* hwsb = handle_cast<VulkanSamplerBuffer>(sbh);
         for (auto& binding : mSamplerBindings) {
             if (binding == hwsb) {
                 binding = nullptr;
             }
         }
-        destruct_handle<VulkanSamplerBuffer>(mHandleMap, sbh);
+        destruct_handle<VulkanSamplerBuffer>(sbh);
     }
 }
 
 void VulkanDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
-        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
         mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
         waitForIdle(mContext);
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
+        destruct_handle<VulkanUniformBuffer>(ubh);
     }
 }
 
 void VulkanDriver::destroyTexture(Driver::TextureHandle th) {
     if (th) {
-        auto* tex = handle_cast<VulkanTexture>(mHandleMap, th);
+        auto* tex = handle_cast<VulkanTexture>(th);
         mBinder.unbindImageView(tex->imageView);
         waitForIdle(mContext);
-        destruct_handle<VulkanTexture>(mHandleMap, th);
+        destruct_handle<VulkanTexture>(th);
     }
 }
 
 void VulkanDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
     if (rth) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
+        destruct_handle<VulkanRenderTarget>(rth);
     }
 }
 
 void VulkanDriver::destroySwapChain(Driver::SwapChainHandle sch) {
     if (sch) {
         waitForIdle(mContext);
-        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(sch)->surfaceContext;
         destroySurfaceContext(mContext, sc);
-        destruct_handle<VulkanSwapChain>(mHandleMap, sch);
+        destruct_handle<VulkanSwapChain>(sch);
     }
 }
 
 void VulkanDriver::destroyStream(Driver::StreamHandle sh) {
 }
 
+void VulkanDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    if (tqh) {
+        waitForIdle(mContext);
+        vkDestroyQueryPool(mContext.device, handle_cast<VulkanTimerQuery>(tqh)->pool, VKALLOC);
+        mTimerQueries.erase(tqh.getId());
+        std::unique_lock<std::mutex> lock(mTimerQueryResultsLock);
+        mTimerQueryResults.erase(tqh.getId());
+        lock.unlock();
+        destruct_handle<VulkanTimerQuery>(tqh);
+    }
+}
+
 Handle<HwStream> VulkanDriver::createStream(void* nativeStream) {
     return {};
 }
@@ -522,16 +603,33 @@ bool VulkanDriver::isFrameTimeSupported() {
     return false;
 }
 
+bool VulkanDriver::isTimerQuerySupported() {
+    return mContext.physicalDeviceProperties.limits.timestampComputeAndGraphics;
+}
+
+bool VulkanDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    std::lock_guard<std::mutex> lock(mTimerQueryResultsLock);
+    auto pos = mTimerQueryResults.find(tqh.getId());
+    if (pos == mTimerQueryResults.end()) {
+        return false;
+    }
+    *elapsedTime = pos->second;
+    // the result is only returned once, so it can't be mistaken for the next one when the
+    // query is reused
+    mTimerQueryResults.erase(pos);
+    return true;
+}
+
 void VulkanDriver::updateVertexBuffer(Driver::VertexBufferHandle vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
-    auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+    auto& vb = *handle_cast<VulkanVertexBuffer>(vbh);
     vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
 
 void VulkanDriver::updateIndexBuffer(Driver::IndexBufferHandle ibh, BufferDescriptor&& p,
         uint32_t byteOffset, uint32_t byteSize) {
-    auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
+    auto& ib = *handle_cast<VulkanIndexBuffer>(ibh);
     ib.buffer->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
@@ -540,13 +638,13 @@ void VulkanDriver::update2DImage(Driver::TextureHandle th,
         uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& data) {
     assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->update2DImage(data, width, height, level);
+    handle_cast<VulkanTexture>(th)->update2DImage(data, width, height, level);
     scheduleDestroy(std::move(data));
 }
 
 void VulkanDriver::updateCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
-    handle_cast<VulkanTexture>(mHandleMap, th)->updateCubeImage(data, faceOffsets, level);
+    handle_cast<VulkanTexture>(th)->updateCubeImage(data, faceOffsets, level);
     scheduleDestroy(std::move(data));
 }
 
@@ -562,9 +660,13 @@ bool VulkanDriver::canGenerateMipmaps() {
     return false;
 }
 
+bool VulkanDriver::isProgramReady(Driver::ProgramHandle ph) {
+    return true;
+}
+
 void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh, BufferDescriptor&& data) {
     if (data.size > 0) {
-        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
         buffer->loadFromCpu(data.buffer, (uint32_t) data.size);
         scheduleDestroy(std::move(data));
     }
@@ -572,7 +674,7 @@ void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh, BufferDe
 
 void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
         SamplerBuffer&& samplerBuffer) {
-    auto* sb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* sb = handle_cast<VulkanSamplerBuffer>(sbh);
     *sb->sb = samplerBuffer;
 }
 
@@ -583,7 +685,7 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     assert(mContext.currentSurface);
     VulkanSurfaceContext& surface = *mContext.currentSurface;
     const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
-    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
+    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(rth);
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const VkExtent2D extent = rt->getExtent();
     assert(extent.width > 0 && extent.height > 0);
@@ -679,15 +781,15 @@ void VulkanDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 void VulkanDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
         Driver::VertexBufferHandle vbh, Driver::IndexBufferHandle ibh,
         uint32_t enabledAttributes) {
-    auto primitive = handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
-    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(mHandleMap, vbh),
-            handle_cast<VulkanIndexBuffer>(mHandleMap, ibh), enabledAttributes);
+    auto primitive = handle_cast<VulkanRenderPrimitive>(rph);
+    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(vbh),
+            handle_cast<VulkanIndexBuffer>(ibh), enabledAttributes);
 }
 
 void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
         Driver::PrimitiveType pt, uint32_t offset,
         uint32_t minIndex, uint32_t maxIndex, uint32_t count) {
-    auto& primitive = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    auto& primitive = *handle_cast<VulkanRenderPrimitive>(rph);
     primitive.setPrimitiveType(pt);
     primitive.offset = offset * primitive.indexBuffer->elementSize;
     primitive.count = count;
@@ -717,7 +819,7 @@ void VulkanDriver::setViewportScissor(
 void VulkanDriver::makeCurrent(Driver::SwapChainHandle drawSch, Driver::SwapChainHandle readSch) {
     ASSERT_PRECONDITION_NON_FATAL(drawSch == readSch,
                                   "Vulkan driver does not support distinct draw/read swap chains.");
-    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleMap, drawSch)->surfaceContext;
+    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(drawSch)->surfaceContext;
     mContext.currentSurface = &sContext;
 }
 
@@ -728,7 +830,7 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
     releaseCommandBuffer(mContext);
 
     // Present the backbuffer.
-    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(sch)->surfaceContext;
     VkPresentInfoKHR presentInfo {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
@@ -766,7 +868,7 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
 }
 
 void VulkanDriver::bindUniformBuffer(size_t index, Driver::UniformBufferHandle ubh) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
     // The driver API does not currently expose offset / range, but it will do so in the future.
     const VkDeviceSize offset = 0;
     const VkDeviceSize size = VK_WHOLE_SIZE;
@@ -775,12 +877,12 @@ void VulkanDriver::bindUniformBuffer(size_t index, Driver::UniformBufferHandle u
 
 void VulkanDriver::bindUniformBufferRange(size_t index, Driver::UniformBufferHandle ubh,
         size_t offset, size_t size) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
     mBinder.bindUniformBuffer((uint32_t)index, buffer->getGpuBuffer(), offset, size);
 }
 
 void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
-    auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* hwsb = handle_cast<VulkanSamplerBuffer>(sbh);
     mSamplerBindings[index] = hwsb;
 }
 
@@ -809,10 +911,176 @@ void VulkanDriver::popGroupMarker(int) {
     }
 }
 
+void VulkanDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VkQueryPool pool = handle_cast<VulkanTimerQuery>(tqh)->pool;
+    if (pool) {
+        // resetting a query pool isn't allowed inside a render pass
+        assert(mContext.currentRenderPass.renderPass == VK_NULL_HANDLE);
+        vkCmdResetQueryPool(mContext.cmdbuffer, pool, 0, 2);
+        vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, 0);
+    }
+}
+
+void VulkanDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VkQueryPool pool = handle_cast<VulkanTimerQuery>(tqh)->pool;
+    if (!pool) {
+        return;
+    }
+    vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, 1);
+
+    // The timestamps are read back when this swap context is acquired again, i.e. once the
+    // command buffer has been executed. By then the query may have been destroyed, and its id
+    // reused by a query that isn't available yet, which vkGetQueryPoolResults() reports.
+    getSwapContext(mContext).pendingWork.push_back([this, tqh](VkCommandBuffer) {
+        if (mTimerQueries.find(tqh.getId()) == mTimerQueries.end()) {
+            return;
+        }
+        uint64_t timestamps[2];
+        VkResult result = vkGetQueryPoolResults(mContext.device,
+                handle_const_cast<VulkanTimerQuery>(tqh)->pool, 0, 2,
+                sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            const double period = mContext.physicalDeviceProperties.limits.timestampPeriod;
+            std::lock_guard<std::mutex> lock(mTimerQueryResultsLock);
+            mTimerQueryResults[tqh.getId()] = uint64_t((timestamps[1] - timestamps[0]) * period);
+        }
+    });
+}
+
 void VulkanDriver::readPixels(Driver::RenderTargetHandle src,
         uint32_t x, uint32_t y, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& p) {
-    scheduleDestroy(std::move(p));
+    // The pixels are copied into a host-visible buffer, which is read when the fence of the
+    // command buffer is signaled, i.e. when its swap context comes around again. VulkanTask
+    // must be copyable, hence the shared descriptor.
+    auto data = std::make_shared<PixelBufferDescriptor>(std::move(p));
+    auto srcTarget = handle_cast<VulkanRenderTarget>(src);
+    mPendingReadPixels++;
+
+    auto vkreadback = [=](VkCommandBuffer cmdbuffer) {
+        const VulkanAttachment color = srcTarget->getColor();
+        const uint32_t level = srcTarget->getColorLevel();
+        const uint32_t bpp = getBytesPerPixel(color.format);
+        if (!ASSERT_POSTCONDITION_NON_FATAL(bpp == PixelBufferDescriptor::computeDataSize(
+                data->format, data->type, 1, 1, 1),
+                "readPixels: the pixel format doesn't match the render target")) {
+            scheduleDestroy(std::move(*data));
+            mPendingReadPixels--;
+            return;
+        }
+
+        // the swap chain images can only be copied from if the surface allows it
+        const bool offscreen = srcTarget->isOffscreen();
+        if (!ASSERT_POSTCONDITION_NON_FATAL(offscreen || (mContext.currentSurface &&
+                (mContext.currentSurface->surfaceCapabilities.supportedUsageFlags &
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT)),
+                "readPixels: the swap chain can't be read from on this surface")) {
+            scheduleDestroy(std::move(*data));
+            mPendingReadPixels--;
+            return;
+        }
+
+        VkBufferCreateInfo bufferInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = width * height * bpp,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        };
+        VmaAllocationCreateInfo allocInfo {
+            .usage = VMA_MEMORY_USAGE_GPU_TO_CPU
+        };
+        VkBuffer buffer;
+        VmaAllocation memory;
+        vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &buffer, &memory, nullptr);
+
+        // Filament's y axis points up, Vulkan's points down.
+        VkRect2D rect { { int32_t(x), int32_t(y) }, { width, height } };
+        srcTarget->transformClientRectToPlatform(&rect);
+
+        // The render pass left the image in its final layout, which we restore after the copy.
+        VkImageMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .oldLayout = offscreen ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL :
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = color.image,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 },
+        };
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        const VkBufferImageCopy region {
+            .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+            .imageOffset = { rect.offset.x, rect.offset.y, 0 },
+            .imageExtent = { width, height, 1 },
+        };
+        vkCmdCopyImageToBuffer(cmdbuffer, color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                buffer, 1, &region);
+
+        std::swap(barrier.oldLayout, barrier.newLayout);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = offscreen ? VK_ACCESS_SHADER_READ_BIT : 0;
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                offscreen ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT :
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        const VkBufferMemoryBarrier hostBarrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+        // the swap chain images may be BGRA, while the client always gets RGBA
+        const bool swizzle = data->type == PixelDataType::UBYTE &&
+                (color.format == VK_FORMAT_B8G8R8A8_UNORM ||
+                 color.format == VK_FORMAT_B8G8R8A8_SRGB);
+
+        getSwapContext(mContext).pendingWork.push_back(
+                [this, data, buffer, memory, width, height, bpp, swizzle](VkCommandBuffer) {
+            PixelBufferDescriptor& p = *data;
+            void* vaddr = nullptr;
+            vmaMapMemory(mContext.allocator, memory, &vaddr);
+            vmaInvalidateAllocation(mContext.allocator, memory, 0, VK_WHOLE_SIZE);
+            const size_t stride = p.stride ? p.stride : width;
+            const size_t bpr = PixelBufferDescriptor::computeDataSize(
+                    p.format, p.type, stride, 1, p.alignment);
+            uint8_t const* head = static_cast<uint8_t const*>(vaddr);
+            uint8_t* out = static_cast<uint8_t*>(p.buffer) + p.left * bpp + bpr * p.top;
+            for (uint32_t i = 0; i < height; i++, head += width * bpp, out += bpr) {
+                memcpy(out, head, width * bpp);
+                if (swizzle) {
+                    for (uint32_t j = 0; j < width; j++) {
+                        std::swap(out[j * 4], out[j * 4 + 2]);
+                    }
+                }
+            }
+            vmaUnmapMemory(mContext.allocator, memory);
+            vmaDestroyBuffer(mContext.allocator, buffer, memory);
+            scheduleDestroy(std::move(p));
+            mPendingReadPixels--;
+        });
+    };
+
+    if (!mContext.cmdbuffer) {
+        mContext.pendingWork.emplace_back(vkreadback);
+    } else {
+        vkreadback(mContext.cmdbuffer);
+    }
 }
 
 void VulkanDriver::readStreamPixels(Driver::StreamHandle sh, uint32_t x, uint32_t y, uint32_t width,
@@ -823,8 +1091,8 @@ void VulkanDriver::readStreamPixels(Driver::StreamHandle sh, uint32_t x, uint32_
 void VulkanDriver::blit(TargetBufferFlags buffers,
         Driver::RenderTargetHandle dst, driver::Viewport dstRect,
         Driver::RenderTargetHandle src, driver::Viewport srcRect) {
-    auto dstTarget = handle_cast<VulkanRenderTarget>(mHandleMap, dst);
-    auto srcTarget = handle_cast<VulkanRenderTarget>(mHandleMap, src);
+    auto dstTarget = handle_cast<VulkanRenderTarget>(dst);
+    auto srcTarget = handle_cast<VulkanRenderTarget>(src);
 
     // In debug builds, verify that the two render targets have blittable formats.
 #ifndef NDEBUG
@@ -885,14 +1153,41 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
 void VulkanDriver::draw(Driver::PipelineState pipelineState, Driver::RenderPrimitiveHandle rph) {
     VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
     ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
-    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    bindPipelineState(pipelineState);
+    drawPrimitive(cmdbuffer, rph);
+}
+
+void VulkanDriver::drawInstanced(Driver::PipelineState pipelineState,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
+    bindPipelineState(pipelineState);
+    drawPrimitive(cmdbuffer, rph, instanceCount);
+}
+
+void VulkanDriver::drawBatch(Driver::PipelineState pipelineState,
+        size_t index, Driver::UniformBufferHandle ubh, size_t size,
+        const Driver::BatchedDraw* draws, size_t count) {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
+
+    // The raster state, program and samplers are resolved once for the whole batch.
+    bindPipelineState(pipelineState);
 
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
+    for (size_t i = 0; i < count; i++) {
+        mBinder.bindUniformBuffer((uint32_t)index, buffer->getGpuBuffer(), draws[i].offset, size);
+        drawPrimitive(cmdbuffer, draws[i].primitive);
+    }
+}
+
+void VulkanDriver::bindPipelineState(Driver::PipelineState const& pipelineState) {
     Driver::ProgramHandle programHandle = pipelineState.program;
     Driver::RasterState rasterState = pipelineState.rasterState;
     Driver::PolygonOffset depthOffset = pipelineState.polygonOffset;
 
     // If this is a debug build, validate the current shader.
-    auto* program = handle_cast<VulkanProgram>(mHandleMap, programHandle);
+    auto* program = handle_cast<VulkanProgram>(programHandle);
 #if !defined(NDEBUG)
     if (program->bundle.vertex == VK_NULL_HANDLE || program->bundle.fragment == VK_NULL_HANDLE) {
         utils::slog.e << "Binding missing shader: " << program->name.c_str() << utils::io::endl;
@@ -942,8 +1237,6 @@ void VulkanDriver::draw(Driver::PipelineState pipelineState, Driver::RenderPrimi
     // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
     mBinder.bindProgramBundle(shaderHandles);
     mBinder.bindRasterState(mContext.rasterState);
-    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
-    mBinder.bindVertexArray(prim.varray);
 
     // Query the program for the mapping from (SamplerBufferBinding,Offset) to (SamplerBinding),
     // where "SamplerBinding" is the integer in the GLSL, and SamplerBufferBinding is the abstract
@@ -968,7 +1261,7 @@ void VulkanDriver::draw(Driver::PipelineState pipelineState, Driver::RenderPrimi
                     &group)) {
                 const SamplerParams& samplerParams = sampler->s;
                 VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
-                const auto* tex = handle_const_cast<VulkanTexture>(mHandleMap, sampler->t);
+                const auto* tex = handle_const_cast<VulkanTexture>(sampler->t);
                 mBinder.bindSampler(binding, {
                     .sampler = vksampler,
                     .imageView = tex->imageView,
@@ -979,6 +1272,14 @@ void VulkanDriver::draw(Driver::PipelineState pipelineState, Driver::RenderPrimi
             }
         }
     }
+}
+
+void VulkanDriver::drawPrimitive(VkCommandBuffer cmdbuffer, Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(rph);
+
+    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
+    mBinder.bindVertexArray(prim.varray);
 
     // Bind a new descriptor set if it needs to change.
     VkDescriptorSet descriptor;
@@ -1005,10 +1306,10 @@ void VulkanDriver::draw(Driver::PipelineState pipelineState, Driver::RenderPrimi
 
     // Finally, make the actual draw call. TODO: support subranges
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
+    // the shaders index the instances data with gl_InstanceIndex, which includes firstInstance
+    const uint32_t firstInstId = 0;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
@@ -29,8 +29,10 @@
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
 
-#include <unordered_map>
-#include <vector>
+#include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
+
+#include <mutex>
 
 namespace filament {
 namespace driver {
@@ -77,67 +79,71 @@ private:
 private:
     driver::VulkanPlatform& mContextManager;
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = std::vector<uint8_t>;
-    using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
-    HandleMap mHandleMap;
-    std::mutex mHandleMapMutex;
-    HandleBase::HandleId mNextId = 1;
+    /*
+     * Handles are allocated from a handle arena, a set of fixed-size pools carved out of a single
+     * heap area; a handle id is the object's offset in that area, so handle_cast is a couple of
+     * arithmetic instructions. The pools use lock-free free lists because handles are allocated
+     * on the main thread and destroyed on the driver thread.
+     */
+    class HandleAllocator {
+        utils::PoolAllocator< 32, 16, 0, utils::AtomicFreeList>   mPool0;
+        utils::PoolAllocator<128, 16, 0, utils::AtomicFreeList>   mPool1;
+        utils::PoolAllocator<320, 16, 0, utils::AtomicFreeList>   mPool2;
+    public:
+        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
+        static constexpr size_t MAX_HANDLE_SIZE = 320;
+        explicit HandleAllocator(const utils::HeapArea& area);
+        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
+        void free(void* p, size_t size) noexcept;
+    };
+
+    // The pools are lock-free, so the arena doesn't need a lock. Note that this rules out the
+    // HighWatermark tracking policy, which isn't thread-safe.
+    using HandleArena = utils::Arena<HandleAllocator, utils::LockingPolicy::NoLock>;
+
+    HandleArena mHandleArena;
+
+    HandleBase::HandleId allocateHandle(size_t size) noexcept;
 
     template<typename Dp, typename B>
-    Handle<B> alloc_handle() {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
+    Handle<B> alloc_handle() noexcept {
+        static_assert(sizeof(Dp) <= HandleAllocator::MAX_HANDLE_SIZE, "Handle<> too large");
+        return Handle<B>(allocateHandle(sizeof(Dp)));
     }
 
     template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
+    Dp* handle_cast(Handle<B>& handle) noexcept {
         assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<Dp*>(blob.data());
+        char* const base = (char*)mHandleArena.getArea().begin();
+        size_t offset = size_t(handle.getId()) << HandleAllocator::MIN_ALIGNMENT_SHIFT;
+        return reinterpret_cast<Dp*>(base + offset);
     }
 
     template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<const Dp*>(blob.data());
+    const Dp* handle_const_cast(const Handle<B>& handle) noexcept {
+        return handle_cast<Dp>(const_cast<Handle<B>&>(handle));
     }
 
     template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob.data());
+    Dp* construct_handle(Handle<B>& handle, ARGS&& ... args) noexcept {
+        Dp* addr = handle_cast<Dp>(handle);
         new(addr) Dp(std::forward<ARGS>(args)...);
         return addr;
     }
 
     template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        reinterpret_cast<Dp*>(blob.data())->~Dp();
-        handleMap.erase(handle.getId());
+    void destruct_handle(Handle<B>& handle) noexcept {
+        // Call the destructor and return the memory to its pool, the id can be reused.
+        Dp* addr = handle_cast<Dp>(handle);
+        addr->~Dp();
+        mHandleArena.free(addr, sizeof(Dp));
     }
 
+    // helpers for draw() and drawBatch()
+    void bindPipelineState(Driver::PipelineState const& pipelineState);
+    void drawPrimitive(VkCommandBuffer cmdbuffer, Driver::RenderPrimitiveHandle rph,
+            uint32_t instanceCount = 1);
+
     VulkanContext mContext = {};
     VulkanBinder mBinder;
     VulkanStagePool mStagePool;
@@ -146,6 +152,15 @@ private:
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerBuffer* mSamplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
+
+    // number of readPixels() whose callbacks haven't been scheduled yet
+    uint32_t mPendingReadPixels = 0;
+
+    // Timer queries that haven't been destroyed, only used on the driver thread. The results
+    // are read from the main thread (getTimerQueryValue).
+    tsl::robin_set<HandleBase::HandleId> mTimerQueries;
+    std::mutex mTimerQueryResultsLock;
+    tsl::robin_map<HandleBase::HandleId, uint64_t> mTimerQueryResults;
 };
 
 } // namespace driver
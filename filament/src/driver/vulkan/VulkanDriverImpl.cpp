@@ -294,6 +294,12 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
     const auto compositeAlpha = (compositionCaps & VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR) ?
             VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR : VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
+    // The swap chain images can be read back with readPixels() if the surface allows it.
+    const auto usageCaps = surfaceContext.surfaceCapabilities.supportedUsageFlags;
+    const VkImageUsageFlags imageUsage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+            (usageCaps & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
     // Create the low-level swap chain.
     const auto size = surfaceContext.surfaceCapabilities.currentExtent;
     VkSwapchainCreateInfoKHR createInfo {
@@ -304,7 +310,7 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         .imageColorSpace = surfaceContext.surfaceFormat.colorSpace,
         .imageExtent = size,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .imageUsage = imageUsage,
         .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
         .compositeAlpha = compositeAlpha,
         .presentMode = VK_PRESENT_MODE_FIFO_KHR,
@@ -723,6 +729,33 @@ uint32_t getBytesPerPixel(TextureFormat format) {
     return (uint32_t)details::FTexture::getFormatSize(format);
 }
 
+uint32_t getBytesPerPixel(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            // other formats can't be read back
+            return 0;
+    }
+}
+
 SwapContext& getSwapContext(VulkanContext& context) {
     VulkanSurfaceContext& surface = *context.currentSurface;
     return surface.swapContexts[surface.currentSwapIndex];
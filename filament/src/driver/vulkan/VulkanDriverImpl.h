@@ -113,6 +113,7 @@ uint32_t selectMemoryType(VulkanContext& context, uint32_t flags, VkFlags reqs);
 VkFormat getVkFormat(ElementType type, bool normalized);
 VkFormat getVkFormat(TextureFormat format);
 uint32_t getBytesPerPixel(TextureFormat format);
+uint32_t getBytesPerPixel(VkFormat format);
 SwapContext& getSwapContext(VulkanContext& context);
 bool hasPendingWork(VulkanContext& context);
 VkCompareOp getCompareOp(SamplerCompareFunc func);
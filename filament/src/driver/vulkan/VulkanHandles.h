@@ -163,6 +163,11 @@ struct VulkanRenderPrimitive : public HwRenderPrimitive {
     std::vector<VkDeviceSize> offsets;
 };
 
+struct VulkanTimerQuery : public HwTimerQuery {
+    // holds two timestamps, written before and after the measured commands
+    VkQueryPool pool = VK_NULL_HANDLE;
+};
+
 } // namespace filament
 } // namespace driver
 
@@ -20,14 +20,21 @@
 
 #include "driver/Driver.h"
 #include "driver/Handle.h"
+#include "driver/CommandBufferPool.h"
 #include "driver/CommandStream.h"
 #include "FrameGraphResource.h"
 
+#include "details/Texture.h"
+
 #include <filament/driver/DriverEnums.h>
 
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
 using namespace utils;
 
 namespace filament {
@@ -208,6 +215,9 @@ struct RenderTarget { // 32
     TargetFlags targetFlags{};
     RenderTargetResource* cache = nullptr;
 
+    // set during execute(), before the pass using this rendertarget executes
+    FrameGraphPassResources::RenderTargetInfo targetInfo;
+
     void resolve(FrameGraph& fg) noexcept {
         const auto& resourceNodes = fg.mResourceNodes;
         auto& renderTargetCache = fg.mRenderTargetCache;
@@ -316,7 +326,8 @@ struct PassNode { // 200
               writes(fg.getArena()),
               renderTargets(fg.getArena()),
               devirtualize(fg.getArena()),
-              destroy(fg.getArena()) {
+              destroy(fg.getArena()),
+              textures(fg.getArena()) {
     }
     PassNode(PassNode const&) = delete;
     PassNode(PassNode&& rhs) noexcept = default;
@@ -349,6 +360,26 @@ struct PassNode { // 200
         return r;
     }
 
+    // Takes a copy of the concrete resources used by this pass, so it can be executed
+    // concurrently with the creation and destruction of the resources of other passes.
+    void resolve(FrameGraph& fg) noexcept {
+        auto const& resourceNodes = fg.mResourceNodes;
+        textures.clear();
+        for (FrameGraphResource const& r : reads) {
+            textures.push_back(resourceNodes[r.index].resource->texture);
+        }
+        for (RenderTarget* renderTarget : renderTargets) {
+            if (renderTarget->cache) {
+                auto& info = renderTarget->targetInfo;
+                info = renderTarget->cache->targetInfo;
+                // overwrite discard flags with the per-rendertarget (per-pass) computed value
+                info.params.flags.discardStart = renderTarget->targetFlags.discardStart;
+                info.params.flags.discardEnd   = renderTarget->targetFlags.discardEnd;
+                info.params.flags.dependencies = renderTarget->targetFlags.dependencies;
+            }
+        }
+    }
+
     bool isReadingFrom(FrameGraphResource resource) const noexcept {
         auto pos = std::find_if(reads.begin(), reads.end(),
                 [resource](FrameGraphResource cur) { return resource.index == cur.index; });
@@ -419,6 +450,9 @@ struct PassNode { // 200
     Vector<VirtualResource*> destroy;              // resources we need to destroy after executing
     uint32_t refCount = 0;                  // count resources that have a reference to us
 
+    // set during execute()
+    Vector<Handle<HwTexture>> textures;             // concrete textures of 'reads'
+
     // set by the builder
     bool hasSideEffect = false;             // whether this pass has side effects
 };
@@ -438,24 +472,25 @@ Resource::~Resource() noexcept {
     }
 }
 
-void Resource::create(FrameGraph&, DriverApi& driver) noexcept {
+void Resource::create(FrameGraph& fg, DriverApi& driver) noexcept {
     // some sanity check
     if (!imported) {
         if (needsTexture) {
             assert(usage);
             // (it means it's only used as an attachment for a rendertarget)
-            texture = driver.createTexture(desc.type, desc.levels, desc.format, 1,
-                    desc.width, desc.height, desc.depth, usage);
+            texture = fg.acquireTexture(driver, desc, usage);
         }
     }
 }
 
-void Resource::destroy(FrameGraph&, DriverApi& driver) noexcept {
+void Resource::destroy(FrameGraph& fg, DriverApi&) noexcept {
     // we don't own the handles of imported resources
     if (!imported) {
         if (texture) {
-            driver.destroyTexture(texture);
-            texture.clear(); // needed because of noop driver
+            // the concrete texture is only destroyed at the end of execute(), until then it can
+            // be reused by a resource created by a later pass
+            fg.releaseTexture(texture);
+            texture.clear();
         }
     }
 }
@@ -558,11 +593,16 @@ Handle <HwTexture> FrameGraphPassResources::getTexture(FrameGraphResource r) con
     assert(pResource);
 
     // check that this FrameGraphResource is indeed used by this pass
-    ASSERT_POSTCONDITION_NON_FATAL(mPass.isReadingFrom(r),
+    auto const& reads = mPass.reads;
+    auto pos = std::find_if(reads.begin(), reads.end(),
+            [r](FrameGraphResource cur) { return r.index == cur.index; });
+
+    // check that this FrameGraphResource is indeed used by this pass
+    ASSERT_POSTCONDITION_NON_FATAL(pos != reads.end(),
             "Pass \"%s\" doesn't declare reads to resource \"%s\" -- expect graphic corruptions",
             mPass.name, pResource->name);
 
-    return pResource->texture;
+    return pos != reads.end() ? mPass.textures[pos - reads.begin()] : pResource->texture;
 }
 
 FrameGraphPassResources::RenderTargetInfo
@@ -587,11 +627,7 @@ FrameGraphPassResources::getRenderTarget(FrameGraphResource r) const noexcept {
                 });
         if (pos != std::end(desc.attachments.textures)) {
             assert(renderTarget->cache);
-            info = renderTarget->cache->targetInfo;
-            // overwrite discard flags with the per-rendertarget (per-pass) computed value
-            info.params.flags.discardStart = renderTarget->targetFlags.discardStart;
-            info.params.flags.discardEnd   = renderTarget->targetFlags.discardEnd;
-            info.params.flags.dependencies = renderTarget->targetFlags.dependencies;
+            info = renderTarget->targetInfo;
             assert(info.target);
             break;
         }
@@ -628,7 +664,8 @@ FrameGraph::FrameGraph()
           mRenderTargets(mArena),
           mAliases(mArena),
           mResourceRegistry(mArena),
-          mRenderTargetCache(mArena) {
+          mRenderTargetCache(mArena),
+          mTransientTextures(mArena) {
 //    slog.d << "PassNode: " << sizeof(PassNode) << io::endl;
 //    slog.d << "ResourceNode: " << sizeof(ResourceNode) << io::endl;
 //    slog.d << "Resource: " << sizeof(Resource) << io::endl;
@@ -638,6 +675,10 @@ FrameGraph::FrameGraph()
 //    slog.d << "Vector: " << sizeof(Vector<fg::PassNode>) << io::endl;
 }
 
+FrameGraph::FrameGraph(FrameGraphCache& cache) : FrameGraph() {
+    mCache = &cache;
+}
+
 FrameGraph::~FrameGraph() = default;
 
 bool FrameGraph::isValid(FrameGraphResource handle) const noexcept {
@@ -827,6 +868,7 @@ FrameGraph& FrameGraph::compile() noexcept {
     Vector<fg::ResourceNode>& resourceNodes = mResourceNodes;
     Vector<UniquePtr<fg::Resource>>& resourceRegistry = mResourceRegistry;
     Vector<UniquePtr<RenderTargetResource>>& renderTargetCache = mRenderTargetCache;
+    const size_t importedRenderTargetCount = renderTargetCache.size();
 
     /*
      * remap aliased resources
@@ -871,6 +913,25 @@ FrameGraph& FrameGraph::compile() noexcept {
         }
     }
 
+    /*
+     * use the result of the previous compile() if the graph hasn't changed
+     */
+
+    if (mCache) {
+        Vector<uint32_t> key(mArena);
+        getKey(key);
+        const uint32_t hash = utils::hash::murmur3(key.data(), key.size(), 0);
+        FrameGraphCache& cache = *mCache;
+        if (hash == cache.mHash && key.size() == cache.mKey.size() &&
+                std::equal(key.begin(), key.end(), cache.mKey.begin())) {
+            restore(cache);
+            return *this;
+        }
+        cache.mKey.assign(key.begin(), key.end());
+        cache.mHash = hash;
+        cache.mCompileCount++;
+    }
+
     /*
      * compute passes and resource reference counts
      */
@@ -1007,11 +1068,191 @@ FrameGraph& FrameGraph::compile() noexcept {
         }
     }
 
+    if (mCache) {
+        store(*mCache, importedRenderTargetCount);
+    }
+
     return *this;
 }
 
+void FrameGraph::getKey(Vector<uint32_t>& key) const noexcept {
+    // this must capture everything compile() depends on
+    auto push = [&key](auto const& object) {
+        static_assert(sizeof(object) % sizeof(uint32_t) == 0, "must be a multiple of 4 bytes");
+        uint32_t const* p = reinterpret_cast<uint32_t const*>(&object);
+        key.insert(key.end(), p, p + sizeof(object) / sizeof(uint32_t));
+    };
+    auto pushTargetDescriptor = [&key, &push](FrameGraphRenderTarget::Descriptor const& desc) {
+        for (FrameGraphResource const& attachment : desc.attachments.textures) {
+            key.push_back(attachment.index);
+        }
+        push(desc.viewport);
+        key.push_back(desc.samples);
+    };
+
+    key.push_back(uint32_t(mPassNodes.size()));
+    for (PassNode const& pass : mPassNodes) {
+        key.push_back(pass.hasSideEffect);
+        key.push_back(uint32_t(pass.reads.size()));
+        for (FrameGraphResource const& r : pass.reads) {
+            key.push_back(r.index);
+        }
+        key.push_back(uint32_t(pass.writes.size()));
+        for (FrameGraphResource const& r : pass.writes) {
+            key.push_back(r.index);
+        }
+        key.push_back(uint32_t(pass.renderTargets.size()));
+        for (RenderTarget const* renderTarget : pass.renderTargets) {
+            key.push_back(renderTarget->index);
+            key.push_back(renderTarget->imported);
+            key.push_back(renderTarget->userTargetFlags.clear);
+            pushTargetDescriptor(renderTarget->desc);
+        }
+    }
+
+    key.push_back(uint32_t(mResourceNodes.size()));
+    for (ResourceNode const& node : mResourceNodes) {
+        key.push_back(node.resource->id);
+    }
+
+    key.push_back(uint32_t(mResourceRegistry.size()));
+    for (UniquePtr<Resource> const& resource : mResourceRegistry) {
+        FrameGraphResource::Descriptor const& desc = resource->desc;
+        key.push_back(desc.width);
+        key.push_back(desc.height);
+        key.push_back(desc.depth);
+        key.push_back(desc.levels | uint32_t(desc.type) << 8u | uint32_t(desc.relaxed) << 16u);
+        key.push_back(uint32_t(desc.format));
+        key.push_back(resource->imported | resource->needsTexture << 1u | resource->usage << 8u);
+    }
+
+    // only imported rendertargets are in the cache at this point
+    key.push_back(uint32_t(mRenderTargetCache.size()));
+    for (UniquePtr<RenderTargetResource> const& entry : mRenderTargetCache) {
+        key.push_back(entry->width);
+        key.push_back(entry->height);
+        key.push_back(entry->attachments);
+        pushTargetDescriptor(entry->desc);
+    }
+}
+
+void FrameGraph::store(FrameGraphCache& cache, size_t importedRenderTargetCount) const noexcept {
+    auto const& registry = mResourceRegistry;
+    auto const& renderTargetCache = mRenderTargetCache;
+
+    auto indexOf = [&](VirtualResource const* resource) -> uint32_t {
+        for (size_t i = 0, c = registry.size(); i < c; i++) {
+            if (registry[i].get() == resource) {
+                return uint32_t(i);
+            }
+        }
+        for (size_t i = 0, c = renderTargetCache.size(); i < c; i++) {
+            if (renderTargetCache[i].get() == resource) {
+                return uint32_t(i) | FrameGraphCache::RENDER_TARGET_BIT;
+            }
+        }
+        return FrameGraphCache::NONE;
+    };
+
+    cache.mPasses.clear();
+    cache.mDevirtualize.clear();
+    cache.mDestroy.clear();
+    for (PassNode const& pass : mPassNodes) {
+        for (VirtualResource const* resource : pass.devirtualize) {
+            cache.mDevirtualize.push_back(indexOf(resource));
+        }
+        for (VirtualResource const* resource : pass.destroy) {
+            cache.mDestroy.push_back(indexOf(resource));
+        }
+        cache.mPasses.push_back({ pass.refCount,
+                uint32_t(cache.mDevirtualize.size()), uint32_t(cache.mDestroy.size()) });
+    }
+
+    cache.mResources.clear();
+    for (UniquePtr<Resource> const& resource : registry) {
+        cache.mResources.push_back({ resource->refs, resource->desc.width, resource->desc.height });
+    }
+
+    cache.mRenderTargets.clear();
+    for (RenderTarget const& renderTarget : mRenderTargets) {
+        cache.mRenderTargets.push_back({ renderTarget.cache ?
+                (indexOf(renderTarget.cache) & ~FrameGraphCache::RENDER_TARGET_BIT) :
+                FrameGraphCache::NONE,
+                renderTarget.targetFlags.discardStart, renderTarget.targetFlags.discardEnd });
+    }
+
+    cache.mRenderTargetResources.clear();
+    cache.mClearFlags.clear();
+    for (size_t i = 0, c = renderTargetCache.size(); i < c; i++) {
+        RenderTargetResource const& entry = *renderTargetCache[i];
+        if (i >= importedRenderTargetCount) {
+            cache.mRenderTargetResources.push_back({ entry.desc,
+                    entry.width, entry.height, entry.format, uint8_t(entry.attachments) });
+        }
+        cache.mClearFlags.push_back(entry.targetInfo.params.flags.clear);
+    }
+}
+
+void FrameGraph::restore(FrameGraphCache const& cache) noexcept {
+    auto& registry = mResourceRegistry;
+    auto& renderTargetCache = mRenderTargetCache;
+
+    for (FrameGraphCache::RenderTargetResourceInfo const& info : cache.mRenderTargetResources) {
+        RenderTargetResource* pRenderTargetResource = mArena.make<RenderTargetResource>(
+                info.desc, false, TargetBufferFlags(info.attachments),
+                info.width, info.height, info.format);
+        renderTargetCache.emplace_back(pRenderTargetResource, *this);
+    }
+    for (size_t i = 0, c = renderTargetCache.size(); i < c; i++) {
+        renderTargetCache[i]->targetInfo.params.flags.clear = cache.mClearFlags[i];
+    }
+
+    for (size_t i = 0, c = registry.size(); i < c; i++) {
+        FrameGraphCache::ResourceInfo const& info = cache.mResources[i];
+        registry[i]->refs = info.refs;
+        registry[i]->desc.width = info.width;
+        registry[i]->desc.height = info.height;
+    }
+
+    for (size_t i = 0, c = mRenderTargets.size(); i < c; i++) {
+        FrameGraphCache::RenderTargetInfo const& info = cache.mRenderTargets[i];
+        RenderTarget& renderTarget = mRenderTargets[i];
+        renderTarget.cache = info.cache != FrameGraphCache::NONE ?
+                renderTargetCache[info.cache].get() : nullptr;
+        renderTarget.targetFlags = {
+                .clear = 0,  // this is eventually set by the user
+                .discardStart = info.discardStart,
+                .discardEnd = info.discardEnd,
+                .dependencies = 0
+        };
+    }
+
+    auto resourceAt = [&](uint32_t index) -> VirtualResource* {
+        if (index & FrameGraphCache::RENDER_TARGET_BIT) {
+            return renderTargetCache[index & ~FrameGraphCache::RENDER_TARGET_BIT].get();
+        }
+        return registry[index].get();
+    };
+
+    uint32_t devirtualize = 0;
+    uint32_t destroy = 0;
+    for (size_t i = 0, c = mPassNodes.size(); i < c; i++) {
+        FrameGraphCache::PassInfo const& info = cache.mPasses[i];
+        PassNode& pass = mPassNodes[i];
+        pass.refCount = info.refCount;
+        for (; devirtualize < info.devirtualizeEnd; devirtualize++) {
+            pass.devirtualize.push_back(resourceAt(cache.mDevirtualize[devirtualize]));
+        }
+        for (; destroy < info.destroyEnd; destroy++) {
+            pass.destroy.push_back(resourceAt(cache.mDestroy[destroy]));
+        }
+    }
+}
+
 void FrameGraph::execute(DriverApi& driver) noexcept {
-    for (PassNode const& node : mPassNodes) {
+    mTransientMemoryStats = {};
+
+    for (PassNode& node : mPassNodes) {
         if (!node.refCount) continue;
         assert(node.base);
 
@@ -1021,8 +1262,15 @@ void FrameGraph::execute(DriverApi& driver) noexcept {
         }
 
         // execute the pass
+        node.resolve(*this);
+        if (mPassTimer) {
+            mPassTimer->beginPass(driver, node.name);
+        }
         FrameGraphPassResources resources(*this, node);
         node.base->execute(resources, driver);
+        if (mPassTimer) {
+            mPassTimer->endPass(driver);
+        }
 
         // destroy concrete resources
         for (VirtualResource* resource : node.destroy) {
@@ -1030,7 +1278,83 @@ void FrameGraph::execute(DriverApi& driver) noexcept {
         }
     }
 
+    reset(driver);
+}
+
+void FrameGraph::execute(JobSystem& js, CommandBufferPool& pool, DriverApi& driver) noexcept {
+    mTransientMemoryStats = {};
+
+    struct Recording {
+        std::vector<CircularBuffer*> buffers;   // the buffers the pass was recorded in
+        void* resume;
+    };
+    // recordings are written by the jobs, so they must not move
+    Vector<Recording> recordings(mArena);
+    recordings.reserve(mPassNodes.size());
+
+    JobSystem::Job* root = js.createJob();
+    for (PassNode& node : mPassNodes) {
+        if (!node.refCount) continue;
+        assert(node.base);
+
+        // create concrete resources and rendertargets
+        for (VirtualResource* resource : node.devirtualize) {
+            resource->create(*this, driver);
+        }
+
+        // Record the pass in its own buffer, which is spliced here in the stream. This happens
+        // concurrently with the next passes, so the pass only sees copies of its resources.
+        node.resolve(*this);
+        if (mPassTimer) {
+            mPassTimer->beginPass(driver, node.name);
+        }
+        CircularBuffer* const buffer = pool.acquire();
+        recordings.push_back({ { buffer }, driver.beginSplice(*buffer) });
+        js.run(js.createJob(root, [this, &node, &driver, &pool, &recording = recordings.back()]
+                (JobSystem&, JobSystem::Job*) {
+            CommandStream stream(driver, pool, recording.buffers);
+            FrameGraphPassResources resources(*this, node);
+            node.base->execute(resources, stream);
+        }));
+        if (mPassTimer) {
+            // the pass' commands are spliced before this point of the stream
+            mPassTimer->endPass(driver);
+        }
+
+        // destroy concrete resources, the commands are issued after the pass' commands
+        for (VirtualResource* resource : node.destroy) {
+            resource->destroy(*this, driver);
+        }
+    }
+    js.runAndWait(root);
+
+    for (Recording const& recording : recordings) {
+        CommandStream::endSplice(*recording.buffers.back(), recording.resume);
+        // the buffers can be reused once their commands have been executed
+        for (CircularBuffer* buffer : recording.buffers) {
+            driver.queueCommand([&pool, buffer]() { pool.release(buffer); });
+        }
+    }
+
+    reset(driver);
+}
+
+void FrameGraph::reset(DriverApi& driver) noexcept {
+    // All resources are destroyed at this point, so are the concrete textures backing them,
+    // unless they're kept for the next frame. The ones kept by the previous frame and that
+    // we didn't use are destroyed.
+    if (mCache) {
+        mCache->terminate(driver);
+        mCache->mTextures.assign(mTransientTextures.begin(), mTransientTextures.end());
+    } else {
+        for (TransientTexture const& t : mTransientTextures) {
+            assert(!t.inUse);
+            driver.destroyTexture(t.handle);
+        }
+    }
+
     // reset the frame graph state
+    mTransientTextures.clear();
     mPassNodes.clear();
     mResourceNodes.clear();
     mResourceRegistry.clear();
@@ -1039,6 +1363,84 @@ void FrameGraph::execute(DriverApi& driver) noexcept {
     mId = 0;
 }
 
+Handle<HwTexture> FrameGraph::acquireTexture(DriverApi& driver,
+        FrameGraphResource::Descriptor const& desc, TextureUsage usage) noexcept {
+    const size_t size = getTextureSize(desc);
+    mTransientMemoryStats.unaliased += size;
+    mTransientMemoryStats.resourceCount++;
+
+    // Passes are executed in order, so a texture that's not in use at this point won't be
+    // used anymore by the resource it was backing: we can alias it.
+    // Relaxed resources have their dimensions rounded up in RenderTarget::resolve(), which
+    // increases the chances of a match.
+    auto matches = [&desc, usage](TransientTexture const& t) {
+        return !t.inUse && t.usage == usage &&
+               t.desc.type == desc.type && t.desc.format == desc.format &&
+               t.desc.levels == desc.levels && t.desc.width == desc.width &&
+               t.desc.height == desc.height && t.desc.depth == desc.depth;
+    };
+
+    auto pos = std::find_if(mTransientTextures.begin(), mTransientTextures.end(), matches);
+    if (pos != mTransientTextures.end()) {
+        pos->inUse = true;
+        return pos->handle;
+    }
+
+    mTransientMemoryStats.peak += size;
+    mTransientMemoryStats.textureCount++;
+
+    // then try the textures left by the previous frame
+    if (mCache) {
+        auto& textures = mCache->mTextures;
+        auto cached = std::find_if(textures.begin(), textures.end(), matches);
+        if (cached != textures.end()) {
+            Handle<HwTexture> handle = cached->handle;
+            mTransientTextures.push_back({ handle, desc, usage, true });
+            textures.erase(cached);
+            return handle;
+        }
+    }
+
+    Handle<HwTexture> handle = driver.createTexture(desc.type, desc.levels, desc.format, 1,
+            desc.width, desc.height, desc.depth, usage);
+    mTransientTextures.push_back({ handle, desc, usage, true });
+    mTransientMemoryStats.createdCount++;
+    return handle;
+}
+
+void FrameGraph::releaseTexture(Handle<HwTexture> handle) noexcept {
+    auto pos = std::find_if(mTransientTextures.begin(), mTransientTextures.end(),
+            [handle](TransientTexture const& t) { return t.inUse && t.handle.getId() == handle.getId(); });
+    assert(pos != mTransientTextures.end());
+    pos->inUse = false;
+}
+
+size_t FrameGraph::getTextureSize(FrameGraphResource::Descriptor const& desc) noexcept {
+    const size_t bpp = details::FTexture::getFormatSize(desc.format);
+    size_t size = 0;
+    for (size_t level = 0; level < desc.levels; level++) {
+        size += std::max(1u, desc.width >> level) * std::max(1u, desc.height >> level) * bpp;
+    }
+    return size * desc.depth;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraphCache::FrameGraphCache() noexcept = default;
+
+FrameGraphCache::~FrameGraphCache() noexcept {
+    assert(mTextures.empty());
+}
+
+void FrameGraphCache::terminate(DriverApi& driver) noexcept {
+    for (FrameGraph::TransientTexture const& t : mTextures) {
+        driver.destroyTexture(t.handle);
+    }
+    mTextures.clear();
+}
+
+// ------------------------------------------------------------------------------------------------
+
 void FrameGraph::export_graphviz(utils::io::ostream& out) {
     out << "digraph framegraph {\n";
     out << "rankdir = LR\n";
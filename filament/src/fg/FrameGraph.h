@@ -41,8 +41,15 @@
  *
  */
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
+class CommandBufferPool;
+class FrameGraphCache;
+
 namespace fg {
 struct Resource;
 struct ResourceNode;
@@ -107,6 +114,11 @@ public:
     };
 
     FrameGraph();
+
+    // Creates a FrameGraph that reuses what the previous FrameGraph created with the same cache
+    // compiled, and its concrete textures, as long as the declared graph doesn't change.
+    explicit FrameGraph(FrameGraphCache& cache);
+
     FrameGraph(FrameGraph const&) = delete;
     FrameGraph& operator = (FrameGraph const&) = delete;
     ~FrameGraph();
@@ -117,6 +129,9 @@ public:
      *   used by this pass. Captures should be done by reference.
      * The Execute lambda is called asynchronously from FrameGraph::execute(), and this is where
      *   immediate drawing commands can be issued. Captures must be done by copy.
+     *   With execute(js, pool, driver) it runs on a JobSystem thread, concurrently with the
+     *   other passes, so it must issue commands only through the DriverApi it's given, and not
+     *   write any state shared with other passes.
      */
     template <typename Data, typename Setup, typename Execute>
     FrameGraphPass<Data, Execute>& addPass(const char* name, Setup setup, Execute&& execute) {
@@ -173,14 +188,57 @@ public:
     // execute all referenced passes
     void execute(driver::DriverApi& driver) noexcept;
 
+    // Execute all referenced passes, recording them concurrently on the JobSystem, each into
+    // its own buffers from 'pool'. The buffers are spliced into 'driver' in the passes' order.
+    // Note: FRenderer only uses the FrameGraph for post-processing, and only when
+    // USE_FRAME_GRAPH is enabled (it isn't), so no pass is recorded concurrently yet.
+    void execute(utils::JobSystem& js, CommandBufferPool& pool, driver::DriverApi& driver) noexcept;
+
+    /*
+     * Memory used by the transient (i.e. not imported) textures during the last execute().
+     * Resources whose lifetimes don't overlap share the same concrete texture when they have
+     * the same descriptor and usage, so 'peak' is typically much lower than 'unaliased'.
+     * Note: the scene's HDR and MSAA targets come from FRenderer's RenderTargetPool and are
+     * imported, so they're not aliased, and the FrameGraph is only used when USE_FRAME_GRAPH
+     * is enabled (it isn't).
+     */
+    struct TransientMemoryStats {
+        size_t peak = 0;                // bytes of all concrete textures used by execute()
+        size_t unaliased = 0;           // bytes needed if each resource had its own texture
+        uint32_t textureCount = 0;      // # of concrete textures used
+        uint32_t resourceCount = 0;     // # of resources that needed a texture
+        uint32_t createdCount = 0;      // # of concrete textures not reused from a FrameGraphCache
+    };
+
+    TransientMemoryStats const& getTransientMemoryStats() const noexcept {
+        return mTransientMemoryStats;
+    }
+
+    /*
+     * Notified around the execution of each pass, in the driver's command stream, e.g. to
+     * measure the GPU time of the passes. The calls aren't nested.
+     */
+    class PassTimer {
+    public:
+        virtual void beginPass(driver::DriverApi& driver, const char* name) noexcept = 0;
+        virtual void endPass(driver::DriverApi& driver) noexcept = 0;
+    protected:
+        ~PassTimer() = default;
+    };
+
+    // the timer must stay alive until execute() returns
+    void setPassTimer(PassTimer* timer) noexcept { mPassTimer = timer; }
+
     // for debugging
     void export_graphviz(utils::io::ostream& out);
 
 private:
+    friend class FrameGraphCache;
     friend class FrameGraphPassResources;
     friend struct fg::PassNode;
     friend struct fg::RenderTarget;
     friend struct fg::RenderTargetResource;
+    friend struct fg::Resource;
 
     template <typename T>
     struct Deleter {
@@ -202,6 +260,11 @@ private:
     fg::RenderTarget& createRenderTarget(const char* name,
             FrameGraphRenderTarget::Descriptor const& desc, bool imported) noexcept;
 
+    // the declared graph, which determines the result of compile()
+    void getKey(Vector<uint32_t>& key) const noexcept;
+    void restore(FrameGraphCache const& cache) noexcept;
+    void store(FrameGraphCache& cache, size_t importedRenderTargetCount) const noexcept;
+
     enum class DiscardPhase { START, END };
     uint8_t computeDiscardFlags(DiscardPhase phase,
             fg::PassNode const* curr, fg::PassNode const* first,
@@ -210,6 +273,22 @@ private:
     bool equals(FrameGraphRenderTarget::Descriptor const& lhs,
             FrameGraphRenderTarget::Descriptor const& rhs) const noexcept;
 
+    // a concrete texture, which can back several resources during execute()
+    struct TransientTexture {
+        Handle<HwTexture> handle;
+        FrameGraphResource::Descriptor desc;
+        driver::TextureUsage usage;
+        bool inUse;
+    };
+
+    Handle<HwTexture> acquireTexture(driver::DriverApi& driver,
+            FrameGraphResource::Descriptor const& desc, driver::TextureUsage usage) noexcept;
+    void releaseTexture(Handle<HwTexture> handle) noexcept;
+    static size_t getTextureSize(FrameGraphResource::Descriptor const& desc) noexcept;
+
+    // destroys the concrete textures and resets the frame graph state after execute()
+    void reset(driver::DriverApi& driver) noexcept;
+
     details::LinearAllocatorArena mArena;
     Vector<fg::PassNode> mPassNodes;                    // list of frame graph passes
     Vector<fg::ResourceNode> mResourceNodes;            // list of resource nodes
@@ -217,10 +296,84 @@ private:
     Vector<fg::Alias> mAliases;                         // list of aliases
     Vector<UniquePtr<fg::Resource>> mResourceRegistry;  // list of actual textures
     Vector<UniquePtr<fg::RenderTargetResource>> mRenderTargetCache; // list of actual rendertargets
+    Vector<TransientTexture> mTransientTextures;        // concrete textures, alive until the end of execute()
+    TransientMemoryStats mTransientMemoryStats;
+    FrameGraphCache* mCache = nullptr;
+    PassTimer* mPassTimer = nullptr;
 
     uint16_t mId = 0;
 };
 
+/*
+ * Keeps the result of FrameGraph::compile() and the concrete textures of a FrameGraph, for the
+ * FrameGraph of the next frame. compile() only runs again when the declared graph (passes,
+ * resources, descriptors and render targets) is different from the previous one.
+ * This is meant to be owned by what builds a FrameGraph every frame, e.g. a View.
+ * Note: FView's cache is only used by FRenderer when USE_FRAME_GRAPH is enabled (it isn't).
+ */
+class FrameGraphCache {
+public:
+    FrameGraphCache() noexcept;
+    ~FrameGraphCache() noexcept;
+
+    FrameGraphCache(FrameGraphCache const&) = delete;
+    FrameGraphCache& operator=(FrameGraphCache const&) = delete;
+
+    // destroys the concrete textures kept by the cache
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    // number of times the graph had to be compiled, for debugging
+    uint32_t getCompileCount() const noexcept { return mCompileCount; }
+
+private:
+    friend class FrameGraph;
+
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+    static constexpr uint32_t RENDER_TARGET_BIT = 0x80000000u; // tags RenderTargetResource indices
+
+    struct PassInfo {
+        uint32_t refCount;
+        uint32_t devirtualizeEnd;           // end of this pass' entries in mDevirtualize
+        uint32_t destroyEnd;                // end of this pass' entries in mDestroy
+    };
+
+    struct ResourceInfo {
+        uint32_t refs;
+        uint32_t width;                     // relaxed resources are resized by compile()
+        uint32_t height;
+    };
+
+    struct RenderTargetInfo {
+        uint32_t cache;                     // index of its RenderTargetResource, or NONE
+        uint8_t discardStart;
+        uint8_t discardEnd;
+    };
+
+    struct RenderTargetResourceInfo {       // RenderTargetResources created by compile()
+        FrameGraphRenderTarget::Descriptor desc;
+        uint32_t width;
+        uint32_t height;
+        driver::TextureFormat format;
+        uint8_t attachments;
+    };
+
+    // the declared graph the data below was computed from
+    std::vector<uint32_t> mKey;
+    uint32_t mHash = 0;
+
+    std::vector<PassInfo> mPasses;
+    std::vector<ResourceInfo> mResources;
+    std::vector<RenderTargetInfo> mRenderTargets;
+    std::vector<RenderTargetResourceInfo> mRenderTargetResources;
+    std::vector<uint8_t> mClearFlags;       // per RenderTargetResource, including imported ones
+    std::vector<uint32_t> mDevirtualize;    // resources to create, for all passes
+    std::vector<uint32_t> mDestroy;         // resources to destroy, for all passes
+    uint32_t mCompileCount = 0;
+
+    // concrete textures left by the last execute()
+    std::vector<FrameGraph::TransientTexture> mTextures;
+};
+
 } // namespace filament
 
 #endif //TNT_FILAMENT_FRAMEGRAPH_H
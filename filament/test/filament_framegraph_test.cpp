@@ -19,9 +19,15 @@
 #include "fg/FrameGraph.h"
 #include "fg/FrameGraphPassResources.h"
 
+#include "driver/CommandBufferPool.h"
 #include "driver/CommandStream.h"
 #include "driver/noop/NoopDriver.h"
 
+#include <utils/JobSystem.h>
+
+#include <string>
+#include <vector>
+
 using namespace filament;
 using namespace driver;
 
@@ -338,3 +344,257 @@ TEST(FrameGraphTest, RenderTargetLifetime) {
     EXPECT_TRUE(renderPassExecuted1);
     EXPECT_TRUE(renderPassExecuted2);
 }
+
+TEST(FrameGraphTest, TransientTextureAliasing) {
+
+    FrameGraph fg;
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    FrameGraphResource::Descriptor desc{
+            .width = 64,
+            .height = 64,
+            .format = TextureFormat::RGBA16F
+    };
+
+    // each pass samples the output of the previous one, so that all outputs need a texture
+    auto addPass = [&](const char* name, FrameGraphResource input) {
+        auto& pass = fg.addPass<PassData>(name,
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    if (input.isValid()) {
+                        data.input = builder.read(input);
+                    }
+                    data.output = builder.createTexture(name, desc);
+                    data.output = builder.useRenderTarget(data.output).textures[0];
+                },
+                [=](FrameGraphPassResources const& resources,
+                        PassData const& data,
+                        DriverApi& driver) {
+                    if (data.input.isValid()) {
+                        EXPECT_TRUE(resources.getTexture(data.input));
+                    }
+                });
+        return pass.getData().output;
+    };
+
+    FrameGraphResource a = addPass("a", {});
+    FrameGraphResource b = addPass("b", a);
+    FrameGraphResource c = addPass("c", b); // 'a' is dead by then, 'c' can use its texture
+    FrameGraphResource d = addPass("d", c);
+    fg.present(d);
+
+    fg.compile();
+    fg.execute(driverApi);
+
+    const size_t size = 64 * 64 * 8;
+    FrameGraph::TransientMemoryStats const& stats = fg.getTransientMemoryStats();
+    EXPECT_EQ(3, stats.resourceCount);
+    EXPECT_EQ(2, stats.textureCount);
+    EXPECT_EQ(3 * size, stats.unaliased);
+    EXPECT_EQ(2 * size, stats.peak);
+}
+
+TEST(FrameGraphTest, ParallelRecording) {
+
+    utils::JobSystem js;
+    js.adopt();
+
+    CircularBuffer buffer(65536);
+    CommandStream driver(driverApi, buffer);
+    CommandBufferPool pool(65536);
+
+    FrameGraph fg;
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    std::vector<int> order;
+
+    // each pass records commands that log its index when they're executed
+    auto addPass = [&](const char* name, int index, size_t count, FrameGraphResource input) {
+        auto& pass = fg.addPass<PassData>(name,
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    if (input.isValid()) {
+                        data.input = builder.read(input);
+                    }
+                    data.output = builder.createTexture(name);
+                    data.output = builder.useRenderTarget(data.output).textures[0];
+                },
+                [=, &order](FrameGraphPassResources const& resources,
+                        PassData const& data,
+                        DriverApi& driver) {
+                    EXPECT_TRUE(resources.getRenderTarget(data.output).target);
+                    for (size_t i = 0; i < count; i++) {
+                        driver.queueCommand([&order, index]() { order.push_back(index); });
+                    }
+                });
+        return pass.getData().output;
+    };
+
+    // "b" records more commands than a buffer of the pool can hold
+    const size_t overflowCount = 4 * pool.getBufferSize() / sizeof(CustomCommand);
+    FrameGraphResource a = addPass("a", 0, 1, {});
+    FrameGraphResource b = addPass("b", 1, overflowCount, a);
+    FrameGraphResource c = addPass("c", 2, 1, b);
+    fg.present(c);
+
+    fg.compile();
+    fg.execute(js, pool, driver);
+
+    // terminate and execute the stream, the way the driver thread would
+    new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    driver.execute(buffer.getTail());
+
+    // the passes are in order...
+    std::vector<int> expected;
+    expected.push_back(0);
+    expected.insert(expected.end(), overflowCount, 1);
+    expected.push_back(2);
+    EXPECT_EQ(expected, order);
+
+    // ...and all the buffers are back in the pool, "b" needed several of them
+    EXPECT_LT(3, pool.getBufferCount());
+    EXPECT_EQ(pool.getBufferCount(), pool.getFreeBufferCount());
+
+    js.emancipate();
+}
+
+TEST(FrameGraphTest, PassTimer) {
+
+    utils::JobSystem js;
+    js.adopt();
+
+    CircularBuffer buffer(65536);
+    CommandStream driver(driverApi, buffer);
+    CommandBufferPool pool(65536);
+
+    FrameGraph fg;
+
+    // everything is logged when the commands are executed
+    std::vector<std::string> log;
+
+    struct Timer : public FrameGraph::PassTimer {
+        std::vector<std::string>& log;
+        explicit Timer(std::vector<std::string>& log) : log(log) { }
+        void beginPass(DriverApi& driver, const char* name) noexcept override {
+            std::string entry = std::string("begin ") + name;
+            driver.queueCommand([this, entry]() { log.push_back(entry); });
+        }
+        void endPass(DriverApi& driver) noexcept override {
+            driver.queueCommand([this]() { log.push_back("end"); });
+        }
+    } timer(log);
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    auto addPass = [&](const char* name, FrameGraphResource input) {
+        auto& pass = fg.addPass<PassData>(name,
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    if (input.isValid()) {
+                        data.input = builder.read(input);
+                    }
+                    data.output = builder.createTexture(name);
+                    data.output = builder.useRenderTarget(data.output).textures[0];
+                },
+                [=, &log](FrameGraphPassResources const& resources,
+                        PassData const& data,
+                        DriverApi& driver) {
+                    driver.queueCommand([&log, name]() { log.push_back(name); });
+                });
+        return pass.getData().output;
+    };
+
+    FrameGraphResource a = addPass("a", {});
+    FrameGraphResource b = addPass("b", a);
+    addPass("culled", a);
+    fg.present(b);
+
+    fg.compile();
+    fg.setPassTimer(&timer);
+    fg.execute(js, pool, driver);
+
+    new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    driver.execute(buffer.getTail());
+
+    // each pass that's executed is timed, and its commands are between begin and end
+    EXPECT_EQ(std::vector<std::string>({
+            "begin a", "a", "end",
+            "begin b", "b", "end",
+            "begin Present", "end" }), log);
+
+    js.emancipate();
+}
+
+TEST(FrameGraphTest, CompileCache) {
+
+    FrameGraphCache cache;
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    auto frame = [&cache](uint32_t width) {
+        FrameGraph fg(cache);
+
+        FrameGraphResource::Descriptor desc{
+                .width = width,
+                .height = 64,
+                .format = TextureFormat::RGBA16F
+        };
+
+        auto addPass = [&](const char* name, FrameGraphResource input) {
+            auto& pass = fg.addPass<PassData>(name,
+                    [&](FrameGraph::Builder& builder, PassData& data) {
+                        if (input.isValid()) {
+                            data.input = builder.read(input);
+                        }
+                        data.output = builder.createTexture(name, desc);
+                        data.output = builder.useRenderTarget(data.output).textures[0];
+                    },
+                    [=](FrameGraphPassResources const& resources,
+                            PassData const& data,
+                            DriverApi& driver) {
+                        auto const& rt = resources.getRenderTarget(data.output);
+                        EXPECT_TRUE(rt.target);
+                        EXPECT_EQ(TargetBufferFlags::ALL, rt.params.flags.discardStart);
+                        EXPECT_EQ(TargetBufferFlags::DEPTH_AND_STENCIL, rt.params.flags.discardEnd);
+                    });
+            return pass.getData().output;
+        };
+
+        FrameGraphResource a = addPass("a", {});
+        FrameGraphResource b = addPass("b", a);
+        FrameGraphResource c = addPass("c", b);
+        fg.present(addPass("d", c));
+
+        fg.compile();
+        fg.execute(driverApi);
+        return fg.getTransientMemoryStats();
+    };
+
+    FrameGraph::TransientMemoryStats stats = frame(64);
+    EXPECT_EQ(1, cache.getCompileCount());
+    EXPECT_EQ(2, stats.createdCount);
+
+    // same graph: nothing is compiled or created
+    stats = frame(64);
+    EXPECT_EQ(1, cache.getCompileCount());
+    EXPECT_EQ(2, stats.textureCount);
+    EXPECT_EQ(0, stats.createdCount);
+
+    // a descriptor changed
+    stats = frame(128);
+    EXPECT_EQ(2, cache.getCompileCount());
+    EXPECT_EQ(2, stats.createdCount);
+
+    cache.terminate(driverApi);
+}
@@ -33,14 +33,32 @@
 #include <private/filament/UibGenerator.h>
 
 #include "details/Allocators.h"
+#include "details/BonePalette.h"
+#include "details/BoundingVolumeHierarchy.h"
+#include "details/Culler.h"
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/ShadowMap.h"
+#include "details/Texture.h"
 #include "details/Engine.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
+#include "Intersections.h"
+#include "RenderPass.h"
 #include "UniformBuffer.h"
 
+#include "generated/resources/materials.h"
+
+#include <image/ColorTransform.h>
+#include <image/ImageSampler.h>
+#include <image/LinearImage.h>
+
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <vector>
+
 using namespace filament;
 using namespace filament::math;
 using namespace utils;
@@ -146,6 +164,52 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
 }
 
+TEST(FilamentTest, TransformManagerChangeLog) {
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    tcm.create(entities[0]);
+    TransformManager::Instance parent = tcm.getInstance(entities[0]);
+    tcm.create(entities[1], parent, mat4f{});
+    tcm.create(entities[2]);
+
+    auto const& log = tcm.getChangeLog();
+    Slice<const Entity> changes;
+
+    // creating components invalidates the log
+    EXPECT_FALSE(log.getChangesSince(0, changes));
+
+    auto cursor = log.getSequence();
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    EXPECT_EQ(changes.size(), 0);
+
+    // changing the parent's transform marks its children as well
+    tcm.setTransform(parent, mat4f{ float4{ 2 }});
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    ASSERT_EQ(changes.size(), 2);
+    EXPECT_EQ(changes[0], entities[0]);
+    EXPECT_EQ(changes[1], entities[1]);
+
+    cursor = log.getSequence();
+    tcm.setTransform(tcm.getInstance(entities[2]), mat4f{ float4{ 2 }});
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    ASSERT_EQ(changes.size(), 1);
+    EXPECT_EQ(changes[0], entities[2]);
+
+    // changes are forgotten once the log is trimmed
+    tcm.trimChangeLog();
+    EXPECT_FALSE(log.getChangesSince(cursor, changes));
+    EXPECT_TRUE(log.getChangesSince(log.getSequence(), changes));
+    EXPECT_EQ(changes.size(), 0);
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -330,6 +394,86 @@ TEST(FilamentTest, UniformBuffer) {
     //buffer.log(std::cout, ib);
 }
 
+TEST(FilamentTest, PerRenderableUib) {
+    // the C++ structures must match the std140 layout of the uniform blocks
+    UniformInterfaceBlock const& uib = UibGenerator::getPerRenderableUib();
+    EXPECT_EQ(offsetof(PerRenderableUib, worldFromModelMatrix),
+            size_t(uib.getUniformOffset("worldFromModelMatrix", 0)));
+    EXPECT_EQ(offsetof(PerRenderableUib, worldFromModelNormalMatrix),
+            size_t(uib.getUniformOffset("worldFromModelNormalMatrix", 0)));
+    EXPECT_EQ(offsetof(PerRenderableUib, instanced),
+            size_t(uib.getUniformOffset("instanced", 0)));
+    EXPECT_EQ(offsetof(PerRenderableUib, boneFormat),
+            size_t(uib.getUniformOffset("boneFormat", 0)));
+
+    UniformInterfaceBlock const& instancesUib = UibGenerator::getPerRenderableInstancesUib();
+    EXPECT_EQ(CONFIG_MAX_INSTANCE_COUNT * sizeof(PerRenderableUibInstance), instancesUib.getSize());
+    EXPECT_EQ(sizeof(PerRenderableUibInstance), size_t(instancesUib.getUniformOffset("instances", 7)));
+}
+
+TEST(FilamentTest, PerViewUibCascades) {
+    // one light-space matrix per cascade, followed by the per-cascade parameters
+    UniformInterfaceBlock const& uib = UibGenerator::getPerViewUib();
+    for (size_t i = 0; i < CONFIG_MAX_SHADOW_CASCADES; i++) {
+        EXPECT_EQ(offsetof(PerViewUib, lightFromWorldMatrix) + i * sizeof(mat4f),
+                size_t(uib.getUniformOffset("lightFromWorldMatrix", i)));
+    }
+    EXPECT_EQ(offsetof(PerViewUib, userTime), size_t(uib.getUniformOffset("userTime", 0)));
+    EXPECT_EQ(offsetof(PerViewUib, cascadeSplits),
+            size_t(uib.getUniformOffset("cascadeSplits", 0)));
+    EXPECT_EQ(offsetof(PerViewUib, cascadeConstantBias),
+            size_t(uib.getUniformOffset("cascadeConstantBias", 0)));
+    EXPECT_EQ(offsetof(PerViewUib, cascadeNormalBias),
+            size_t(uib.getUniformOffset("cascadeNormalBias", 0)));
+    EXPECT_EQ(offsetof(PerViewUib, cascades), size_t(uib.getUniformOffset("cascades", 0)));
+}
+
+TEST(FilamentTest, PerViewUibShadowTiles) {
+    // the shadow atlas tiles come last, they must account for the whole block
+    UniformInterfaceBlock const& uib = UibGenerator::getPerViewUib();
+    for (size_t i = 0; i < CONFIG_MAX_SHADOW_TILE_COUNT; i++) {
+        EXPECT_EQ(offsetof(PerViewUib, shadowTileFromWorldMatrix) + i * sizeof(mat4f),
+                size_t(uib.getUniformOffset("shadowTileFromWorldMatrix", i)));
+        EXPECT_EQ(offsetof(PerViewUib, shadowTileBias) + i * sizeof(float4),
+                size_t(uib.getUniformOffset("shadowTileBias", i)));
+    }
+    EXPECT_EQ(sizeof(PerViewUib), uib.getSize());
+}
+
+TEST(FilamentTest, ShadowCascadeSplits) {
+    float splits[CONFIG_MAX_SHADOW_CASCADES];
+
+    // a single cascade covers the whole range
+    filament::details::ShadowMap::computeCascadeSplits(splits, 1, 0.1f, 100.0f, 0.5f);
+    EXPECT_FLOAT_EQ(100.0f, splits[0]);
+
+    // uniform splits
+    filament::details::ShadowMap::computeCascadeSplits(splits, 4, 1.0f, 101.0f, 0.0f);
+    EXPECT_FLOAT_EQ(26.0f, splits[0]);
+    EXPECT_FLOAT_EQ(51.0f, splits[1]);
+    EXPECT_FLOAT_EQ(76.0f, splits[2]);
+    EXPECT_FLOAT_EQ(101.0f, splits[3]);
+
+    // logarithmic splits
+    filament::details::ShadowMap::computeCascadeSplits(splits, 3, 1.0f, 1000.0f, 1.0f);
+    EXPECT_FLOAT_EQ(10.0f, splits[0]);
+    EXPECT_FLOAT_EQ(100.0f, splits[1]);
+    EXPECT_FLOAT_EQ(1000.0f, splits[2]);
+
+    // blended splits are in between, and always increasing
+    float uniformSplits[CONFIG_MAX_SHADOW_CASCADES];
+    float logSplits[CONFIG_MAX_SHADOW_CASCADES];
+    filament::details::ShadowMap::computeCascadeSplits(uniformSplits, 4, 0.1f, 200.0f, 0.0f);
+    filament::details::ShadowMap::computeCascadeSplits(logSplits, 4, 0.1f, 200.0f, 1.0f);
+    filament::details::ShadowMap::computeCascadeSplits(splits, 4, 0.1f, 200.0f, 0.5f);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_LT(logSplits[i], splits[i]);
+        EXPECT_LT(splits[i], uniformSplits[i]);
+        EXPECT_LT(splits[i], splits[i + 1]);
+    }
+    EXPECT_FLOAT_EQ(200.0f, splits[3]);
+}
+
 TEST(FilamentTest, BoxCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -519,8 +663,8 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
     FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {});
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, FScene::NO_SHADOW);
 
     {
         froxelData.froxelizeLights(*engine, {}, lights);
@@ -555,11 +699,266 @@ TEST(FilamentTest, FroxelData) {
         EXPECT_GT(pointCount, 0);
     }
 
+    {
+        // with many lights, the lights are assigned using the light tree, which must cover
+        // the same froxels as a single light
+        auto const& froxelBuffer = froxelData.getFroxelBufferUser();
+        std::vector<bool> lit(froxelData.getFroxelCount());
+        for (size_t i = 0; i < lit.size(); i++) {
+            lit[i] = froxelBuffer[i].pointLightCount != 0;
+        }
+
+        const float4 position = lights.elementAt<FScene::POSITION_RADIUS>(1);
+        while (lights.size() < CONFIG_MAX_LIGHT_COUNT + FScene::DIRECTIONAL_LIGHTS_COUNT) {
+            lights.push_back(position, {}, instance, 1, {}, FScene::NO_SHADOW);
+        }
+
+        froxelData.froxelizeLights(*engine, {}, lights);
+        for (size_t i = 0; i < lit.size(); i++) {
+            EXPECT_EQ(lit[i] ? CONFIG_MAX_LIGHT_COUNT : 0, froxelBuffer[i].pointLightCount);
+            EXPECT_EQ(0, froxelBuffer[i].spotLightCount);
+        }
+    }
+
     froxelData.terminate(engine->getDriverApi());
     engine->shutdown();
     delete engine;
 }
 
+TEST(FilamentTest, ShadowCasterChangeLog) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FScene* scene = engine->createScene();
+    FTransformManager& tcm = engine->getTransformManager();
+
+    // the scene is only patched when few of its entities changed
+    std::array<Entity, 8> entities;
+    engine->getEntityManager().create(entities.size(), entities.data());
+    for (size_t i = 0; i < entities.size(); i++) {
+        RenderableManager::Builder(1)
+                .boundingBox({{ 0, 0, 0 }, { 1, 1, 1 }})
+                .castShadows(i != 1)
+                .build(*engine, entities[i]);
+        tcm.setTransform(tcm.getInstance(entities[i]),
+                mat4f::translate(float3{ float(i) * 4.0f, 0, 0 }));
+        scene->addEntity(entities[i]);
+    }
+
+    ChangeLog<Box> const& log = scene->getShadowCasterChangeLog();
+    Slice<const Box> changes;
+
+    // gathering the whole scene invalidates the log
+    scene->prepare(mat4f{});
+    EXPECT_FALSE(log.getChangesSince(0, changes));
+    auto cursor = log.getSequence();
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    EXPECT_EQ(changes.size(), 0);
+
+    // a caster moving records its bounds before and after the change
+    tcm.setTransform(tcm.getInstance(entities[2]), mat4f::translate(float3{ 0, 10, 0 }));
+    scene->prepare(mat4f{});
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    ASSERT_EQ(changes.size(), 2);
+    EXPECT_EQ(changes[0].center, (float3{ 8, 0, 0 }));
+    EXPECT_EQ(changes[1].center, (float3{ 0, 10, 0 }));
+
+    // renderables which don't cast shadows are ignored
+    cursor = log.getSequence();
+    tcm.setTransform(tcm.getInstance(entities[1]), mat4f::translate(float3{ 0, 20, 0 }));
+    scene->prepare(mat4f{});
+    EXPECT_TRUE(log.getChangesSince(cursor, changes));
+    EXPECT_EQ(changes.size(), 0);
+
+    // changes are forgotten at the end of the frame
+    scene->trimShadowCasterChangeLog();
+    EXPECT_TRUE(log.getChangesSince(log.getSequence(), changes));
+    EXPECT_EQ(changes.size(), 0);
+
+    for (Entity e : entities) {
+        engine->destroy(e);
+    }
+    engine->getEntityManager().destroy(entities.size(), entities.data());
+    engine->destroy(scene);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, MaterialSharedVariants) {
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FEngine::DriverApi& driver = engine->getDriverApi();
+    FMaterial const* defaultMaterial = engine->getDefaultMaterial();
+
+    // the default material doesn't have a custom depth shader, so a copy of it shares its
+    // depth variants with the default material
+    FMaterial* material = upcast(Material::Builder()
+            .package(MATERIALS_DEFAULTMATERIAL_DATA, MATERIALS_DEFAULTMATERIAL_SIZE)
+            .build(*engine));
+
+    std::array<HandleBase::HandleId, VARIANT_COUNT> depthPrograms;
+    for (uint8_t i = 0; i < VARIANT_COUNT; i++) {
+        const bool isDepthPass = Variant(i).isDepthPass();
+        EXPECT_FALSE(defaultMaterial->isSharedVariant(i));
+        EXPECT_EQ(material->isSharedVariant(i), isDepthPass);
+        if (isDepthPass) {
+            depthPrograms[i] = defaultMaterial->getProgram(driver, i).getId();
+            EXPECT_EQ(material->getProgram(driver, i).getId(), depthPrograms[i]);
+        }
+    }
+
+    // destroying the material leaves the shared variants to the default material
+    engine->destroy(material);
+    for (uint8_t i = 0; i < VARIANT_COUNT; i++) {
+        if (Variant(i).isDepthPass()) {
+            EXPECT_EQ(defaultMaterial->getProgram(driver, i).getId(), depthPrograms[i]);
+        }
+    }
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, TextureMipmapsSRGB) {
+    using namespace filament::details;
+    using Encoding = FTexture::Encoding;
+
+    // a black and white checkerboard is decoded to linear space...
+    const uint8_t pixels[2 * 2 * 3] = {
+              0,   0,   0,     255, 255, 255,
+            255, 255, 255,       0,   0,   0 };
+    image::LinearImage base = FTexture::decodeImage(pixels, 2 * 3, 2, 2, 3,
+            Texture::Type::UBYTE, Encoding::SRGB);
+    ASSERT_EQ(base.getChannels(), 3);
+    EXPECT_FLOAT_EQ(base.getPixelRef(0, 0)[0], 0.0f);
+    EXPECT_FLOAT_EQ(base.getPixelRef(1, 0)[0], 1.0f);
+    EXPECT_FLOAT_EQ(base.getPixelRef(0, 1)[2], 1.0f);
+
+    // ...filtered to linear mid-gray...
+    image::LinearImage level = image::resampleImage(base, 1, 1);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_NEAR(level.getPixelRef()[i], 0.5f, 1e-5f);
+    }
+
+    // ...and encoded back to sRGB, which isn't the average of the sRGB values
+    uint8_t encoded[3];
+    FTexture::encodeImage(encoded, level, 3, Texture::Type::UBYTE, Encoding::SRGB);
+    const uint8_t expected = uint8_t(image::linearTosRGB(0.5f) * 255.0f + 0.5f);
+    EXPECT_EQ(expected, 188);
+    for (uint8_t c : encoded) {
+        EXPECT_EQ(c, expected);
+    }
+
+    // linear buffers are left alone
+    FTexture::encodeImage(encoded, level, 3, Texture::Type::UBYTE, Encoding::LINEAR);
+    for (uint8_t c : encoded) {
+        EXPECT_EQ(c, 128);
+    }
+}
+
+TEST(FilamentTest, TextureMipmapsRGBM) {
+    using namespace filament::details;
+    using Encoding = FTexture::Encoding;
+
+    // RGBM pixels are decoded to 3 components linear pixels: (rgb * m * 16)^2
+    const float pixels[2 * 4] = {
+            0.5f, 0.25f, 0.0f, 0.5f,
+            0.0f, 0.0f,  0.0f, 1.0f / 16.0f };
+    image::LinearImage base = FTexture::decodeImage(
+            reinterpret_cast<uint8_t const*>(pixels), sizeof(pixels), 2, 1, 4,
+            Texture::Type::FLOAT, Encoding::RGBM);
+    ASSERT_EQ(base.getChannels(), 3);
+    EXPECT_FLOAT_EQ(base.getPixelRef(0, 0)[0], 16.0f);
+    EXPECT_FLOAT_EQ(base.getPixelRef(0, 0)[1], 4.0f);
+    EXPECT_FLOAT_EQ(base.getPixelRef(0, 0)[2], 0.0f);
+    EXPECT_FLOAT_EQ(base.getPixelRef(1, 0)[0], 0.0f);
+
+    // filtering happens on the linear values, not on the encoded ones
+    image::LinearImage level = image::resampleImage(base, 1, 1);
+    EXPECT_NEAR(level.getPixelRef()[0], 8.0f, 1e-4f);
+    EXPECT_NEAR(level.getPixelRef()[1], 2.0f, 1e-4f);
+    EXPECT_NEAR(level.getPixelRef()[2], 0.0f, 1e-4f);
+
+    // the result is re-encoded as RGBM and decodes back to the filtered value
+    float encoded[4];
+    FTexture::encodeImage(reinterpret_cast<uint8_t*>(encoded), level, 4,
+            Texture::Type::FLOAT, Encoding::RGBM);
+    const float3 decoded = image::RGBMtoLinear(
+            float4{ encoded[0], encoded[1], encoded[2], encoded[3] });
+    EXPECT_NEAR(decoded.r, 8.0f, 1e-3f);
+    EXPECT_NEAR(decoded.g, 2.0f, 1e-3f);
+    EXPECT_NEAR(decoded.b, 0.0f, 1e-3f);
+
+    // UBYTE pixels round-trip within the precision of the format
+    uint8_t bytes[4];
+    FTexture::encodeImage(bytes, level, 4, Texture::Type::UBYTE, Encoding::RGBM);
+    image::LinearImage roundTrip = FTexture::decodeImage(bytes, sizeof(bytes), 1, 1, 4,
+            Texture::Type::UBYTE, Encoding::RGBM);
+    EXPECT_NEAR(roundTrip.getPixelRef()[0], 8.0f, 0.2f);
+    EXPECT_NEAR(roundTrip.getPixelRef()[1], 2.0f, 0.2f);
+}
+
+TEST(FilamentTest, FroxelIntersections) {
+    // the batched intersection tests must give the same results as the scalar ones
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    // planes of the form {x,0,z,0} and spheres (with squared radius) as used by the Froxelizer
+    std::vector<float4> planes(37);
+    for (float4& plane : planes) {
+        const float2 n = normalize(float2{ distribution(generator), distribution(generator) });
+        plane = { n.x, 0, n.y, 0 };
+    }
+    std::vector<float4> spheres(37);
+    for (float4& sphere : spheres) {
+        sphere = { distribution(generator) * 4.0f, distribution(generator) * 4.0f,
+                   distribution(generator) * 4.0f, std::abs(distribution(generator)) };
+    }
+
+    for (size_t i = 0; i < spheres.size(); i++) {
+        float4 const& s = spheres[i];
+        for (size_t begin = 0; begin < 9; begin++) {
+            for (size_t end = begin; end <= planes.size(); end++) {
+                size_t first = begin;
+                while (first < end &&
+                       !(spherePlaneDistanceSquared(s, planes[first].x, planes[first].z) > 0)) {
+                    first++;
+                }
+                size_t last = end;
+                while (last > begin &&
+                       !(spherePlaneDistanceSquared(s, planes[last - 1].x, planes[last - 1].z) > 0)) {
+                    last--;
+                }
+                EXPECT_EQ(first, findFirstSpherePlaneIntersection(s, planes.data(), begin, end));
+                EXPECT_EQ(last, findLastSpherePlaneIntersection(s, planes.data(), begin, end));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < 64; i++) {
+        const float3 position = { distribution(generator), distribution(generator), distribution(generator) };
+        const float3 axis = normalize(float3{
+                distribution(generator), distribution(generator), distribution(generator) });
+        const float outer = 0.1f + std::abs(distribution(generator));
+        const float cosSqr = std::cos(outer) * std::cos(outer);
+        const float invSin = 1.0f / std::sin(outer);
+        const uint32_t mask = 1u << (i % 32);
+
+        // all counts up to the size of the array, to exercise the remainders
+        for (size_t count = 0; count <= spheres.size(); count++) {
+            std::vector<uint32_t> results(count, 0x80000001u);
+            sphereConeIntersectionFast(spheres.data(), count, position, axis, invSin, cosSqr,
+                    results.data(), mask);
+            for (size_t k = 0; k < count; k++) {
+                const bool intersect = sphereConeIntersectionFast(spheres[k],
+                        position, axis, invSin, cosSqr);
+                EXPECT_EQ(0x80000001u | (intersect ? mask : 0u), results[k]);
+            }
+        }
+    }
+}
+
 TEST(FilamentTest, Bones) {
     using namespace ::filament::details;
 
@@ -694,6 +1093,196 @@ TEST(FilamentTest, Bones) {
     }
 }
 
+TEST(FilamentTest, CompactBones) {
+    using namespace ::filament::details;
+
+    // same as mulBoneVertice() in getters.vs, for compact bones
+    auto vertice = [](float3 v, PerRenderableUibCompactBone const& bone) {
+        float4 q = { bone.q.x, bone.q.y, bone.q.z, bone.q.w };
+        float4 ts = { bone.ts.x, bone.ts.y, bone.ts.z, bone.ts.w };
+        v *= ts.w;
+        v += 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        return v + ts.xyz;
+    };
+
+    mat4f m = mat4f::translate(float3{ 1, -2, 3 }) *
+              mat4f::rotate(M_PI / 3, normalize(float3{ 1, 1, 0 })) *
+              mat4f::scale(float3{ 2 });
+
+    PerRenderableUibCompactBone bone;
+    FRenderableManager::makeCompactBone(&bone, m);
+    EXPECT_NEAR(2.0f, float(bone.ts.w), 1e-3);
+
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> distribution(-10.0f, 10.0f);
+    auto rand_gen = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        float3 p(rand_gen(), rand_gen(), rand_gen());
+        float3 expected = (m * float4(p, 1.0f)).xyz;
+        float3 actual = vertice(p, bone);
+        // half floats have 11 bits of precision, the scaled vertex is at most 2|p| long
+        float epsilon = (2.0f * length(p) + length(float3{ 1, -2, 3 })) / 256.0f;
+        EXPECT_NEAR(expected.x, actual.x, epsilon);
+        EXPECT_NEAR(expected.y, actual.y, epsilon);
+        EXPECT_NEAR(expected.z, actual.z, epsilon);
+    }
+
+    // the compact bones of a range are packed, 4 per bone of the palette
+    EXPECT_EQ(1, BonePalette::getCompactBoneStorage(1));
+    EXPECT_EQ(1, BonePalette::getCompactBoneStorage(4));
+    EXPECT_EQ(2, BonePalette::getCompactBoneStorage(5));
+}
+
+TEST(FilamentTest, BonePalette) {
+    using namespace ::filament::details;
+    constexpr size_t A = BonePalette::BONE_ALIGNMENT;
+
+    BonePalette palette;
+
+    // ranges are aligned and allocated back to back
+    uint32_t a = palette.allocate(1);
+    uint32_t b = palette.allocate(A + 1);
+    uint32_t c = palette.allocate(3);
+    EXPECT_EQ(0, a);
+    EXPECT_EQ(A, b);
+    EXPECT_EQ(3 * A, c);
+    EXPECT_EQ(4 * A, palette.getUsedCount());
+
+    // bones are initialized to identity
+    PerRenderableUibBone const& bone = *palette.get(b + A);
+    EXPECT_EQ(1.0f, bone.q.w);
+    EXPECT_EQ(0.0f, bone.t.x);
+
+    // the space freed is reused first
+    palette.free(a, 1);
+    EXPECT_EQ(a, palette.allocate(2));
+    EXPECT_EQ(4 * A, palette.getUsedCount());
+
+    // freed neighbors are merged and fit a larger range
+    palette.free(a, 2);
+    palette.free(b, A + 1);
+    EXPECT_EQ(a, palette.allocate(3 * A));
+    EXPECT_EQ(4 * A, palette.getUsedCount());
+
+    // freeing the last ranges shrinks the palette
+    palette.free(c, 3);
+    EXPECT_EQ(3 * A, palette.getUsedCount());
+    palette.free(a, 3 * A);
+    EXPECT_EQ(0, palette.getUsedCount());
+
+    // the palette grows past its initial capacity, and keeps the bones already set
+    uint32_t d = palette.allocate(1);
+    palette.edit(d, 1)->t = float4{ 1, 2, 3, 0 };
+    uint32_t e = palette.allocate(CONFIG_MAX_BONE_COUNT * 4);
+    EXPECT_EQ(A, e);
+    EXPECT_EQ(3.0f, palette.get(d)->t.z);
+    EXPECT_EQ(1.0f, palette.get(e + CONFIG_MAX_BONE_COUNT * 4 - 1)->q.w);
+}
+
+TEST(FilamentTest, SortCommands) {
+    using namespace ::filament::details;
+    using Command = RenderPass::Command;
+
+    JobSystem js;
+    js.adopt();
+
+    std::default_random_engine generator(82828);
+    std::uniform_int_distribution<uint32_t> distribution;
+    auto rand_gen = std::bind(distribution, generator);
+
+    // enough commands to use the radix sort, with a mix of sentinels and regular keys
+    const size_t count = 50000;
+    std::vector<Command> commands(count);
+    std::vector<Command> scratch(count);
+    for (size_t i = 0; i < count; i++) {
+        Command& command = commands[i];
+        if (rand_gen() % 4 == 0) {
+            command.key = uint64_t(RenderPass::Pass::SENTINEL);
+        } else {
+            command.key = uint64_t(rand_gen() % 2 ? RenderPass::Pass::COLOR : RenderPass::Pass::DEPTH);
+            command.key |= RenderPass::makeField(rand_gen() % 8,
+                    RenderPass::PRIORITY_MASK, RenderPass::PRIORITY_SHIFT);
+            command.key |= RenderPass::makeField(rand_gen(),
+                    RenderPass::DISTANCE_BITS_MASK, RenderPass::DISTANCE_BITS_SHIFT);
+        }
+        command.primitive.index = uint16_t(i);
+    }
+
+    std::vector<Command> expected(commands);
+    std::sort(expected.begin(), expected.end());
+
+    RenderPass::sortCommands(js, commands.data(), commands.data() + count, scratch.data());
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(expected[i].key, commands[i].key);
+    }
+
+    // the radix sort is stable
+    for (size_t i = 1; i < count; i++) {
+        if (commands[i - 1].key == commands[i].key &&
+                commands[i].key != uint64_t(RenderPass::Pass::SENTINEL)) {
+            EXPECT_LT(commands[i - 1].primitive.index, commands[i].primitive.index);
+        }
+    }
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, BoundingVolumeHierarchy) {
+    using namespace ::filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+    // enough entries to cull the subtrees in parallel, with ids in no particular order
+    const size_t count = 20000;
+    std::vector<uint32_t> ids(count);
+    std::vector<float3> centers(Culler::round(count));
+    std::vector<float3> extents(Culler::round(count));
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = uint32_t(i + 1);
+        centers[i] = { position(generator), position(generator), position(generator) };
+        extents[i] = size(generator);
+    }
+    std::shuffle(ids.begin(), ids.end(), generator);
+
+    BoundingVolumeHierarchy bvh;
+    bvh.build(ids.data(), centers.data(), extents.data(), count, count + 1);
+    EXPECT_EQ(count, bvh.size());
+
+    auto check = [&](Frustum const& frustum) {
+        std::vector<Culler::result_type> expected(Culler::round(count));
+        Culler::intersects(expected.data(), frustum, centers.data(), extents.data(), count, 1);
+
+        std::vector<Culler::result_type> results(count + 1);
+        bvh.cull(js, results.data(), frustum, 1);
+        EXPECT_EQ(0, results[0]);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expected[i], results[ids[i]]);
+        }
+    };
+
+    const mat4f projection = mat4f::perspective(60.0f, 1.0f, 0.1f, 150.0f);
+    check(Frustum(projection));
+    check(Frustum(projection * mat4f::translate(float3{ 50, -20, 30 })));
+
+    // move some entries, the tree is refitted
+    for (size_t i = 0; i < count; i += 7) {
+        centers[i] = { position(generator), position(generator), position(generator) };
+        bvh.update(ids[i], centers[i], extents[i]);
+    }
+    EXPECT_FALSE(bvh.needsRebuild());
+    bvh.refit();
+    check(Frustum(projection));
+    check(Frustum(projection * mat4f::translate(float3{ -40, 10, 60 })));
+
+    js.emancipate();
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -35,15 +35,16 @@ enum VertexAttribute : uint8_t {
 
 // Binding points for uniform buffers and sampler buffers.
 // Effectively, these are just names.
-// These are limited by Program::NUM_UNIFORM_BINDINGS (currently 6)
+// These are limited by Program::NUM_UNIFORM_BINDINGS (currently 7)
 namespace BindingPoints {
     constexpr uint8_t PER_VIEW                = 0;    // uniforms/samplers updated per view
     constexpr uint8_t PER_RENDERABLE          = 1;    // uniforms/samplers updated per renderable
     constexpr uint8_t PER_RENDERABLE_BONES    = 2;    // bones data, per renderable
     constexpr uint8_t LIGHTS                  = 3;    // lights data array
     constexpr uint8_t POST_PROCESS            = 4;    // samplers for the post process pass
-    constexpr uint8_t PER_MATERIAL_INSTANCE   = 5;    // uniforms/samplers updates per material
-    constexpr uint8_t COUNT                   = 6;
+    constexpr uint8_t PER_RENDERABLE_INSTANCES= 5;    // instances data, per instanced renderable
+    constexpr uint8_t PER_MATERIAL_INSTANCE   = 6;    // uniforms/samplers updates per material
+    constexpr uint8_t COUNT                   = 7;
 }
 
 static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
@@ -62,6 +63,17 @@ constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 // We store 64 bytes per bone.
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
+// We store 112 bytes per instance.
+constexpr size_t CONFIG_MAX_INSTANCE_COUNT = 128;
+
+// Number of shadow cascades of the directional light, the cascade splits are stored in a float4.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// Number of tiles of the shadow atlas used by the spot and point lights. A spot light uses one
+// tile, a point light uses six. We store 80 bytes per tile in the per-view UBO.
+constexpr size_t CONFIG_MAX_SHADOW_TILE_COUNT = 16;
+
 // can't really use std::underlying_type<AttributeIndex>::type because the driver takes a uint32_t
 using AttributeBitset = utils::bitset32;
 
@@ -21,7 +21,7 @@
 #include <stdint.h>
 
 namespace filament {
-static constexpr size_t MATERIAL_VERSION = 2;
+static constexpr size_t MATERIAL_VERSION = 8;
 
 enum class Shading : uint8_t {
     UNLIT,                  // no lighting applied, emissive possible
@@ -104,6 +104,18 @@ enum class PostProcessStage : uint8_t {
     ANTI_ALIASING_TRANSLUCENT,     // Anti-aliasing stage
 };
 
+/**
+ * Variants of a material that can be compiled ahead of time with Material::compile().
+ */
+using UserVariantFilterMask = uint8_t;
+enum class UserVariantFilterBit : UserVariantFilterMask {
+    DIRECTIONAL_LIGHTING = 0x01,   // a directional light is present
+    DYNAMIC_LIGHTING = 0x02,       // point, spot or area lights are present
+    SHADOW_RECEIVER = 0x04,        // the renderable receives shadows
+    SKINNING = 0x08,               // GPU skinning
+    ALL = 0x0F
+};
+
 } // namespace filament
 
 #endif
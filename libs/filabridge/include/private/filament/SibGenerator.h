@@ -41,7 +41,7 @@ struct PerViewSib {
     static constexpr size_t FROXELS        = 2;
     static constexpr size_t IBL_DFG_LUT    = 3;
     static constexpr size_t IBL_SPECULAR   = 4;
-    static constexpr size_t IBL_IRRADIANCE = 5;
+    static constexpr size_t SHADOW_ATLAS   = 5;
 };
 
 struct PostProcessSib {
@@ -17,6 +17,7 @@
 #ifndef TNT_FILABRIDGE_UIBGENERATOR_H
 #define TNT_FILABRIDGE_UIBGENERATOR_H
 
+#include <filament/EngineEnums.h>
 
 #include <math/mat4.h>
 #include <math/vec4.h>
@@ -32,6 +33,7 @@ public:
     static UniformInterfaceBlock const& getLightsUib() noexcept;
     static UniformInterfaceBlock const& getPostProcessingUib() noexcept;
     static UniformInterfaceBlock const& getPerRenderableBonesUib() noexcept;
+    static UniformInterfaceBlock const& getPerRenderableInstancesUib() noexcept;
 };
 
 /*
@@ -50,7 +52,7 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     filament::math::mat4f viewFromClipMatrix;
     filament::math::mat4f clipFromWorldMatrix;
     filament::math::mat4f worldFromClipMatrix;
-    filament::math::mat4f lightFromWorldMatrix;
+    filament::math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES];
 
     filament::math::float4 resolution; // viewport width, height, 1/width, 1/height
 
@@ -80,6 +82,15 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     alignas(16) filament::math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
 
     filament::math::float4 userTime;  // time(s), (double)time - (float)time, 0, 0
+
+    filament::math::float4 cascadeSplits;       // view-space far distance of each cascade
+    filament::math::float4 cascadeConstantBias; // shadowBias.x of each cascade
+    filament::math::float4 cascadeNormalBias;   // shadowBias.y of each cascade
+    uint32_t cascades;                          // number of cascades, 0 without directional shadows
+
+    // transform to the shadow atlas tile and biases of each spot light and point light face
+    alignas(16) filament::math::mat4f shadowTileFromWorldMatrix[CONFIG_MAX_SHADOW_TILE_COUNT];
+    filament::math::float4 shadowTileBias[CONFIG_MAX_SHADOW_TILE_COUNT]; // constant, normal, unused, unused
 };
 
 
@@ -87,6 +98,9 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
 struct alignas(256) PerRenderableUib {
     filament::math::mat4f worldFromModelMatrix;
     filament::math::mat3f worldFromModelNormalMatrix;
+    float reserved[3];  // std140 pads each column of a mat3 to a float4
+    uint32_t instanced; // non-zero if the transforms come from the InstancesUniforms block
+    uint32_t boneFormat; // RenderableManager::BoneFormat of the skinned renderables
 };
 
 struct LightsUib {
@@ -96,7 +110,7 @@ struct LightsUib {
     filament::math::float4 positionFalloff;   // { float3(pos), 1/falloff^2 }
     filament::math::float4 colorIntensity;    // { float3(col), intensity }
     filament::math::float4 directionIES;      // { float3(dir), IES index }
-    filament::math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
+    filament::math::float4 spotScaleOffset;   // { scale, offset, shadow index, unused }
 };
 
 struct PostProcessingUib {
@@ -116,6 +130,19 @@ struct PerRenderableUibBone {
     filament::math::float4 ns = { 1, 1, 1, 0 };
 };
 
+// Same as PerRenderableUibBone, in the compact format: the scale is uniform and there is no
+// inverse scale, which would be 1 after normalization.
+struct PerRenderableUibCompactBone {
+    filament::math::half4 q = { 0, 0, 0, 1 };   // x, y, z, w
+    filament::math::half4 ts = { 0, 0, 0, 1 };  // translation, uniform scale
+};
+
+// This is not the UBO proper, but just an element of the instances array.
+struct PerRenderableUibInstance {
+    filament::math::mat4f worldFromModelMatrix;
+    filament::math::float4 worldFromModelNormalMatrix[3]; // a mat3 with the std140 layout
+};
+
 } // namespace filament
 
 #endif // TNT_FILABRIDGE_UIBGENERATOR_H
@@ -31,6 +31,12 @@ static_assert(sizeof(PerRenderableUib) % 256 == 0,
 static_assert(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone) <= 16384,
         "Bones exceed max UBO size");
 
+static_assert(sizeof(PerRenderableUibCompactBone) * 4 == sizeof(PerRenderableUibBone),
+        "4 compact bones must fit in a bone");
+
+static_assert(CONFIG_MAX_INSTANCE_COUNT * sizeof(PerRenderableUibInstance) <= 16384,
+        "Instances exceed max UBO size");
+
 
 UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
     // IMPORTANT NOTE: Respect std140 layout, don't update without updating Engine::PerViewUib
@@ -43,7 +49,7 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromClipMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -73,6 +79,14 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
             // user time
             .add("userTime",                1, UniformInterfaceBlock::Type::FLOAT4)
+            // shadow cascades
+            .add("cascadeSplits",           1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("cascadeConstantBias",     1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("cascadeNormalBias",       1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("cascades",                1, UniformInterfaceBlock::Type::UINT)
+            // shadow atlas
+            .add("shadowTileFromWorldMatrix", CONFIG_MAX_SHADOW_TILE_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("shadowTileBias",          CONFIG_MAX_SHADOW_TILE_COUNT, UniformInterfaceBlock::Type::FLOAT4)
             .build();
     return uib;
 }
@@ -82,6 +96,8 @@ UniformInterfaceBlock const& UibGenerator::getPerRenderableUib() noexcept {
             .name("ObjectUniforms")
             .add("worldFromModelMatrix",       1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromModelNormalMatrix", 1, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            .add("instanced",                  1, UniformInterfaceBlock::Type::UINT)
+            .add("boneFormat",                 1, UniformInterfaceBlock::Type::UINT)
             .build();
     return uib;
 }
@@ -107,7 +123,16 @@ UniformInterfaceBlock const& UibGenerator::getPostProcessingUib() noexcept {
 UniformInterfaceBlock const& UibGenerator::getPerRenderableBonesUib() noexcept {
     static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
             .name("BonesUniforms")
-            .add("bones", CONFIG_MAX_BONE_COUNT * 4, UniformInterfaceBlock::Type::FLOAT4, Precision::MEDIUM)
+            // uint so the half floats of the compact bones can be unpacked exactly
+            .add("bones", CONFIG_MAX_BONE_COUNT * 4, UniformInterfaceBlock::Type::UINT4, Precision::HIGH)
+            .build();
+    return uib;
+}
+
+UniformInterfaceBlock const& UibGenerator::getPerRenderableInstancesUib() noexcept {
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("InstancesUniforms")
+            .add("instances", CONFIG_MAX_INSTANCE_COUNT * 7, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -189,6 +189,9 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
                 BindingPoints::PER_RENDERABLE_BONES,
                 UibGenerator::getPerRenderableBonesUib());
     }
+    cg.generateUniforms(vs, ShaderType::VERTEX,
+            BindingPoints::PER_RENDERABLE_INSTANCES,
+            UibGenerator::getPerRenderableInstancesUib());
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
     cg.generateSeparator(vs);
@@ -72,7 +72,61 @@ static void BM_JobSystemParallelFor(benchmark::State& state) {
     state.SetItemsProcessed((int64_t)state.iterations() * 4096);
 }
 
+static void setStatsCounters(benchmark::State& state, JobSystem const& js) {
+    JobSystem::Stats stats = js.getStats();
+    state.counters["steals"] = double(stats.steals) / double(state.iterations());
+    state.counters["idle_ms"] = double(stats.idleTime) * 1e-6;
+    state.counters["jobs_max"] = stats.jobCountHighWatermark;
+    state.counters["jobs_capacity"] = stats.jobCapacity;
+}
+
+// more children than the initial size of the job pool
+static void BM_JobSystemAsChildren16k(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto root = js.create(nullptr, &emptyJob);
+            for (size_t i = 0; i < 16383; i++) {
+                JobSystem::Job* job = js.create(root, &emptyJob);
+                if (job) {
+                    js.run(job);
+                }
+            }
+            js.runAndWait(root);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 16384);
+    setStatsCounters(state, js);
+}
+
+// several parallel_for() running concurrently, e.g. culling, froxelization and commands
+// generation in the same frame.
+static void BM_JobSystemConcurrentParallelFor(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const size_t parallelForCount = size_t(state.range(0));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto root = js.create(nullptr, &emptyJob);
+            for (size_t i = 0; i < parallelForCount; i++) {
+                js.run(jobs::parallel_for(js, root, 0, 4096, [](uint32_t start, uint32_t count) {
+                }, jobs::CountSplitter<1>()));
+            }
+            js.runAndWait(root);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 4096 * parallelForCount);
+    setStatsCounters(state, js);
+}
+
 
 BENCHMARK(BM_JobSystem);
 BENCHMARK(BM_JobSystemAsChildren4k);
+BENCHMARK(BM_JobSystemAsChildren16k);
 BENCHMARK(BM_JobSystemParallelFor);
+BENCHMARK(BM_JobSystemConcurrentParallelFor)->Arg(1)->Arg(3)->Arg(8);
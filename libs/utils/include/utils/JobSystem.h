@@ -20,6 +20,7 @@
 #include <assert.h>
 
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <vector>
@@ -37,10 +38,20 @@
 namespace utils {
 
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
-    static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
+    // Jobs are allocated by blocks, the pool starts with INITIAL_JOB_BLOCK_COUNT blocks and
+    // grows as needed, up to MAX_JOB_COUNT jobs.
+    static constexpr size_t JOB_BLOCK_SIZE = 1024;
+    static constexpr size_t INITIAL_JOB_BLOCK_COUNT = 4;
+    static constexpr size_t MAX_JOB_BLOCK_COUNT = 16;
+    static constexpr size_t MAX_JOB_COUNT = JOB_BLOCK_SIZE * MAX_JOB_BLOCK_COUNT;
+    static_assert(MAX_JOB_COUNT <= 0xFFFE, "MAX_JOB_COUNT must be <= 0xFFFE");
     using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
 
+    // Each thread keeps a cache of free jobs, which is refilled from (or spilled to) the
+    // shared pool JOB_CACHE_BATCH_SIZE jobs at a time.
+    static constexpr size_t JOB_CACHE_SIZE = 64;
+    static constexpr size_t JOB_CACHE_BATCH_SIZE = JOB_CACHE_SIZE / 4;
+
 public:
     class Job;
 
@@ -68,12 +79,21 @@ public:
         void* storage[JOB_STORAGE_SIZE_WORDS];                  // 48 | 48
         JobFunc function;                                       //  4 |  8
         uint16_t parent;                                        //  2 |  2
+        uint16_t id;                                            //  2 |  2
         std::atomic<uint16_t> runningJobCount = { 1 };          //  2 |  2
         mutable std::atomic<uint16_t> refCount = { 1 };         //  2 |  2
-                                                                //  6 |  2 (padding)
+                                                                //  4 |  0 (padding)
                                                                 // 64 | 64
     };
 
+    struct Stats {
+        uint64_t steals = 0;                // number of jobs stolen from another thread's queue
+        uint64_t idleTime = 0;              // time in nanoseconds threads spent sleeping
+        uint32_t jobCount = 0;              // jobs allocated, including the per-thread caches
+        uint32_t jobCountHighWatermark = 0; // maximum value jobCount has reached
+        uint32_t jobCapacity = 0;           // jobs that can be allocated without growing the pool
+    };
+
     explicit JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1) noexcept;
 
     ~JobSystem();
@@ -310,6 +330,10 @@ public:
         return mParallelSplitCount;
     }
 
+    // Statistics accumulated since this JobSystem was created. This can be called from any
+    // thread, but the values from the various threads are not read atomically.
+    Stats getStats() const noexcept;
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -334,8 +358,25 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t id;
+
+        // free jobs, only accessed by the thread owning this state
+        uint32_t jobCacheCount = 0;
+        uint16_t jobCache[JOB_CACHE_SIZE];
+
+        // statistics, only written by the thread owning this state
+        std::atomic<uint64_t> steals = { 0 };
+        std::atomic<uint64_t> idleTime = { 0 };
     };
 
+    // A block of jobs and its free-list, the free-list can be accessed from any thread.
+    struct JobBlock {
+        Job jobs[JOB_BLOCK_SIZE];
+        utils::PoolAllocator<sizeof(Job), alignof(Job), 0, AtomicFreeList> pool;
+        JobBlock() noexcept : pool(jobs, jobs + JOB_BLOCK_SIZE) { }
+    };
+
+    static constexpr uint16_t NO_PARENT = 0xFFFF;
+
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
             "ThreadState doesn't align to a cache line");
 
@@ -345,6 +386,11 @@ private:
     void decRef(Job const* job) noexcept;
 
     Job* allocateJob() noexcept;
+    void freeJob(Job* job) noexcept;
+    size_t allocateFromPool(uint16_t* ids, size_t count) noexcept;
+    void freeToPool(uint16_t const* ids, size_t count) noexcept;
+    uint32_t growJobPool(uint32_t blockCount) noexcept;
+    void addIdleTime(ThreadState& state, std::chrono::steady_clock::duration d) noexcept;
     JobSystem::ThreadState* getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
 
@@ -355,22 +401,30 @@ private:
     bool execute(JobSystem::ThreadState& state) noexcept;
     void finish(Job* job) noexcept;
 
+    Job* getJob(size_t index) noexcept {
+        assert(index < MAX_JOB_COUNT);
+        // memory_order_relaxed is safe because whoever gave us this index has synchronized with
+        // the thread that published the block (see growJobPool()).
+        JobBlock* const block = mJobBlocks[index / JOB_BLOCK_SIZE].load(std::memory_order_relaxed);
+        return &block->jobs[index % JOB_BLOCK_SIZE];
+    }
+
     void put(WorkQueue& workQueue, Job* job) noexcept {
-        size_t index = job - mJobStorageBase;
-        assert(index >= 0 && index < MAX_JOB_COUNT);
+        size_t index = job->id;
+        assert(index < MAX_JOB_COUNT);
         workQueue.push(uint16_t(index + 1));
     }
 
     Job* pop(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.pop();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : &mJobStorageBase[index - 1];
+        return !index ? nullptr : getJob(index - 1);
     }
 
     Job* steal(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.steal();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : &mJobStorageBase[index - 1];
+        return !index ? nullptr : getJob(index - 1);
     }
 
     // these have thread contention, keep them together
@@ -381,7 +435,15 @@ private:
     utils::Condition mWaiterCondition;
 
     std::atomic<uint32_t> mActiveJobs = { 0 };
-    utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock> mJobPool;
+
+    // only updated when jobs move in and out of the per-thread caches
+    std::atomic<uint32_t> mJobCount = { 0 };
+    std::atomic<uint32_t> mJobCountHighWatermark = { 0 };
+
+    // blocks are never freed until the JobSystem is destroyed
+    std::atomic<JobBlock*> mJobBlocks[MAX_JOB_BLOCK_COUNT] = {};
+    std::atomic<uint32_t> mJobBlockCount = { 0 };
+    utils::Mutex mJobBlockLock;                         // only held while growing the pool
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -396,7 +458,6 @@ private:
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { false };       // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
-    Job* const mJobStorageBase;                         // Base for conversion to indices
     uint16_t mThreadCount = 0;                          // total # of threads in the pool
     uint8_t mParallelSplitCount = 0;                    // # of split allowable in parallel_for
     Job* mMasterJob = nullptr;
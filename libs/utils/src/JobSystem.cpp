@@ -113,11 +113,13 @@ void JobSystem::setThreadAffinityById(size_t id) noexcept {
 }
 
 JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
-    : mJobPool("JobSystem Job pool", MAX_JOB_COUNT * sizeof(Job)),
-      mJobStorageBase(static_cast<Job *>(mJobPool.getAllocator().getCurrent()))
 {
     SYSTRACE_ENABLE();
 
+    for (uint32_t i = 0; i < INITIAL_JOB_BLOCK_COUNT; i++) {
+        growJobPool(i);
+    }
+
     if (threadCount == 0) {
         // default value, system dependant
         size_t hwThreads = std::thread::hardware_concurrency();
@@ -166,6 +168,12 @@ JobSystem::~JobSystem() {
             state.thread.join();
         }
     }
+
+    for (size_t i = 0, n = mJobBlockCount.load(); i < n; i++) {
+        JobBlock* const block = mJobBlocks[i].load(std::memory_order_relaxed);
+        block->~JobBlock();
+        utils::aligned_free(block);
+    }
 }
 
 inline void JobSystem::incRef(Job const* job) noexcept {
@@ -195,7 +203,7 @@ void JobSystem::decRef(Job const* job) noexcept {
         // TSAN doesn't handle standalone fences, we use memory_order_acq_rel instead
         std::atomic_thread_fence(std::memory_order_acquire);
 #endif
-        mJobPool.destroy(job);
+        freeJob(const_cast<Job*>(job));
     }
 }
 
@@ -229,8 +237,104 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
     return *sThreadState;
 }
 
+UTILS_NOINLINE
+uint32_t JobSystem::growJobPool(uint32_t blockCount) noexcept {
+    std::lock_guard<Mutex> lock(mJobBlockLock);
+    uint32_t count = mJobBlockCount.load(std::memory_order_relaxed);
+    if (count != blockCount || count == MAX_JOB_BLOCK_COUNT) {
+        // another thread grew the pool already, or we can't grow it anymore
+        return count;
+    }
+    void* p = utils::aligned_alloc(sizeof(JobBlock), alignof(JobBlock));
+    if (UTILS_UNLIKELY(!p)) {
+        return count;
+    }
+    mJobBlocks[count].store(new(p) JobBlock, std::memory_order_relaxed);
+    // memory_order_release makes the new block visible to threads that acquire the count
+    mJobBlockCount.store(count + 1, std::memory_order_release);
+    return count + 1;
+}
+
+size_t JobSystem::allocateFromPool(uint16_t* ids, size_t count) noexcept {
+    size_t n = 0;
+    uint32_t blockCount = mJobBlockCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; n < count;) {
+        if (i == blockCount) {
+            // all blocks are exhausted, try to add one
+            blockCount = growJobPool(blockCount);
+            if (i == blockCount) {
+                break;
+            }
+        }
+        JobBlock* const block = mJobBlocks[i].load(std::memory_order_relaxed);
+        Job* const job = static_cast<Job*>(block->pool.alloc());
+        if (job) {
+            ids[n++] = uint16_t(i * JOB_BLOCK_SIZE + (job - block->jobs));
+        } else {
+            i++;
+        }
+    }
+
+    if (n) {
+        uint32_t jobCount = mJobCount.fetch_add(uint32_t(n), std::memory_order_relaxed) + n;
+        uint32_t highWatermark = mJobCountHighWatermark.load(std::memory_order_relaxed);
+        while (jobCount > highWatermark &&
+               !mJobCountHighWatermark.compare_exchange_weak(highWatermark, jobCount,
+                       std::memory_order_relaxed)) {
+        }
+    }
+    return n;
+}
+
+void JobSystem::freeToPool(uint16_t const* ids, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        JobBlock* const block = mJobBlocks[ids[i] / JOB_BLOCK_SIZE].load(std::memory_order_relaxed);
+        block->pool.free(&block->jobs[ids[i] % JOB_BLOCK_SIZE]);
+    }
+    mJobCount.fetch_sub(uint32_t(count), std::memory_order_relaxed);
+}
+
 JobSystem::Job* JobSystem::allocateJob() noexcept {
-    return mJobPool.make<Job>();
+    uint16_t id;
+    ThreadState* const state = sThreadState;
+    if (state && state->js == this) {
+        // this is one of our threads, use its job cache
+        if (UTILS_UNLIKELY(!state->jobCacheCount)) {
+            state->jobCacheCount = uint32_t(allocateFromPool(state->jobCache, JOB_CACHE_BATCH_SIZE));
+            if (UTILS_UNLIKELY(!state->jobCacheCount)) {
+                return nullptr;
+            }
+        }
+        id = state->jobCache[--state->jobCacheCount];
+    } else if (UTILS_UNLIKELY(!allocateFromPool(&id, 1))) {
+        return nullptr;
+    }
+    Job* const job = new(getJob(id)) Job;
+    job->id = id;
+    return job;
+}
+
+void JobSystem::freeJob(Job* job) noexcept {
+    const uint16_t id = job->id;
+    job->~Job();
+    ThreadState* const state = sThreadState;
+    if (state && state->js == this) {
+        if (UTILS_UNLIKELY(state->jobCacheCount == JOB_CACHE_SIZE)) {
+            // the cache is full, give some jobs back to the other threads
+            state->jobCacheCount -= JOB_CACHE_BATCH_SIZE;
+            freeToPool(state->jobCache + state->jobCacheCount, JOB_CACHE_BATCH_SIZE);
+        }
+        state->jobCache[state->jobCacheCount++] = id;
+    } else {
+        freeToPool(&id, 1);
+    }
+}
+
+void JobSystem::addIdleTime(ThreadState& state, std::chrono::steady_clock::duration d) noexcept {
+    // only this thread writes this value, so we don't need an atomic add.
+    uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    state.idleTime.store(state.idleTime.load(std::memory_order_relaxed) + ns,
+            std::memory_order_relaxed);
 }
 
 inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -258,6 +362,12 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
             // nullptr -> nothing to steal in that queue either, if there are active jobs,
             // continue to try stealing one.
         } while (!job && mActiveJobs.load(std::memory_order_relaxed) && !exitRequested());
+
+        if (job) {
+            // only this thread writes this value, so we don't need an atomic add.
+            state.steals.store(state.steals.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+        }
     }
 
     if (job) {
@@ -292,7 +402,9 @@ void JobSystem::loop(ThreadState* state) noexcept {
         if (!execute(*state)) {
             std::unique_lock<Mutex> lock(mLooperLock);
             while (!exitRequested() && !(mActiveJobs.load(std::memory_order_relaxed))) {
+                const auto start = std::chrono::steady_clock::now();
                 mLooperCondition.wait(lock);
+                addIdleTime(*state, std::chrono::steady_clock::now() - start);
                 setThreadAffinityById(state->id);
             }
         }
@@ -306,8 +418,6 @@ void JobSystem::finish(Job* job) noexcept {
     bool notify = false;
 
     // terminate this job and notify its parent
-    auto& jobPool = mJobPool;
-    Job* const storage = mJobStorageBase;
     do {
         // std::memory_order_release here is needed to synchronize with JobSystem::wait()
         // which needs to "see" all changes that happened before the job terminated.
@@ -322,7 +432,7 @@ void JobSystem::finish(Job* job) noexcept {
 #endif
             // no more work, destroy this job and notify its the parent
             notify = true;
-            Job* const parent = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+            Job* const parent = job->parent == NO_PARENT ? nullptr : getJob(job->parent);
             decRef(job);
             job = parent;
         } else {
@@ -346,7 +456,7 @@ JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept
     parent = (parent == nullptr) ? mMasterJob : parent;
     Job* const job = allocateJob();
     if (UTILS_LIKELY(job)) {
-        size_t index = 0x7FFF;
+        uint16_t index = NO_PARENT;
         if (parent) {
             // add a reference to the parent to make sure it can't be terminated.
             // memory_order_relaxed is safe because no action is taken at this point
@@ -356,11 +466,11 @@ JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept
             // can't create a child job of a terminated parent
             assert(parentJobCount > 0);
 
-            index = parent - mJobStorageBase;
+            index = parent->id;
             assert(index < MAX_JOB_COUNT);
         }
         job->function = func;
-        job->parent = uint16_t(index);
+        job->parent = index;
     }
     return job;
 }
@@ -428,7 +538,9 @@ void JobSystem::waitAndRelease(Job*& job) noexcept {
             if (!hasJobCompleted(job)) {
                 std::unique_lock<Mutex> lock(mWaiterLock);
                 while (!hasJobCompleted(job) && !exitRequested()) {
+                    const auto start = std::chrono::steady_clock::now();
                     mWaiterCondition.wait(lock);
+                    addIdleTime(state, std::chrono::steady_clock::now() - start);
                 }
             }
         }
@@ -477,13 +589,31 @@ void JobSystem::emancipate() {
     ThreadState* const state = sThreadState;
     ASSERT_PRECONDITION(state, "this thread is not an adopted thread");
     ASSERT_PRECONDITION(state->js == this, "this thread is not adopted by us");
+    // the jobs cached by this thread would be lost otherwise
+    freeToPool(state->jobCache, state->jobCacheCount);
+    state->jobCacheCount = 0;
     sThreadState = nullptr;
 }
 
+JobSystem::Stats JobSystem::getStats() const noexcept {
+    Stats stats;
+    for (auto const& state : mThreadStates) {
+        stats.steals += state.steals.load(std::memory_order_relaxed);
+        stats.idleTime += state.idleTime.load(std::memory_order_relaxed);
+    }
+    stats.jobCount = mJobCount.load(std::memory_order_relaxed);
+    stats.jobCountHighWatermark = mJobCountHighWatermark.load(std::memory_order_relaxed);
+    stats.jobCapacity = uint32_t(mJobBlockCount.load(std::memory_order_relaxed) * JOB_BLOCK_SIZE);
+    return stats;
+}
+
 io::ostream& operator<<(io::ostream& out, JobSystem const& js) {
     for (auto const& item : js.mThreadStates) {
         out << size_t(item.id) << ": " << item.workQueue.getCount() << io::endl;
     }
+    JobSystem::Stats stats = js.getStats();
+    out << "jobs: " << stats.jobCount << " (max " << stats.jobCountHighWatermark
+        << ", capacity " << stats.jobCapacity << ")" << io::endl;
     return out;
 }
 
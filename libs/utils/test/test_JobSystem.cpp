@@ -219,6 +219,36 @@ TEST(JobSystem, JobSystemParallelChildren) {
 }
 
 
+TEST(JobSystem, JobSystemManyChildren) {
+    JobSystem js;
+    js.adopt();
+
+    struct User {
+        std::atomic_int calls = {0};
+        void func(JobSystem&, JobSystem::Job*) {
+            calls++;
+        };
+    } j;
+
+    // more jobs than the initial capacity of the job pool
+    JobSystem::Job* root = js.createJob<User, &User::func>(nullptr, &j);
+    for (int i=0 ; i<8192 ; i++) {
+        JobSystem::Job* job = js.createJob<User, &User::func>(root, &j);
+        ASSERT_NE(nullptr, job);
+        js.run(job);
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(8193, j.calls);
+
+    JobSystem::Stats stats = js.getStats();
+    EXPECT_LE(stats.jobCountHighWatermark, stats.jobCapacity);
+    EXPECT_LE(stats.jobCount, stats.jobCountHighWatermark);
+
+    js.emancipate();
+}
+
+
 TEST(JobSystem, JobSystemSequentialChildren) {
     JobSystem js;
     js.adopt();
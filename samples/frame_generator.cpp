@@ -15,11 +15,15 @@
  */
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -28,12 +32,15 @@
 #include <utils/Path.h>
 
 #include <filament/driver/PixelBufferDescriptor.h>
+#include <filament/Camera.h>
 #include <filament/Color.h>
 #include <filament/Engine.h>
+#include <filament/Fence.h>
 #include <filament/LightManager.h>
 #include <filament/Material.h>
 #include <filament/MaterialInstance.h>
 #include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
 #include <filament/Scene.h>
 #include <filament/Skybox.h>
 #include <filament/TransformManager.h>
@@ -65,6 +72,7 @@ struct Param {
 };
 
 const int FRAME_TO_SKIP = 10;
+const uint32_t FRAME_SIZE = 512;
 
 static std::vector<Path> g_filenames;
 static std::vector<char> g_materialBuffer;
@@ -74,7 +82,9 @@ static bool g_lightOn = false;
 static bool g_skyboxOn = true;
 static int g_materialVariantCount = 1;
 static int g_currentFrame = 0;
+static int g_readFrames = 0;
 static std::atomic_int g_savedFrames(0);
+static bool g_headless = false;
 static std::vector<Param> g_parameters;
 static std::string g_prefix;
 static uint32_t g_clearColor = 0x000000;
@@ -84,6 +94,7 @@ static std::map<std::string, MaterialInstance*> g_meshMaterialInstances;
 static const Material* g_material = nullptr;
 static MaterialInstance* g_materialInstance = nullptr;
 static Entity g_light;
+static std::unique_ptr<IBL> g_headlessIBL;
 
 static Config g_config;
 
@@ -127,6 +138,8 @@ static void printUsage(char* name) {
             "       Hide the skybox, showing the clear color\n\n"
             "   --clear-color=0xRRGGBB, -b 0xRRGGBB\n"
             "       Set the clear color\n\n"
+            "   --headless, -e\n"
+            "       Render offscreen without a window (OpenGL only), as fast as the GPU allows\n\n"
     );
     const std::string from("SAMPLE_FRAME_GENERATOR");
     for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
@@ -136,7 +149,7 @@ static void printUsage(char* name) {
 }
 
 static int handleCommandLineArgments(int argc, char* argv[], Config* config) {
-    static constexpr const char* OPTSTR = "ha:s:li:m:c:p:x:yb:";
+    static constexpr const char* OPTSTR = "ha:s:li:m:c:p:x:yb:e";
     static const struct option OPTIONS[] = {
             { "help",        no_argument,       nullptr, 'h' },
             { "api",         required_argument, nullptr, 'a' },
@@ -149,6 +162,7 @@ static int handleCommandLineArgments(int argc, char* argv[], Config* config) {
             { "skybox-off",  no_argument,       nullptr, 'y' },
             { "prefix",      required_argument, nullptr, 'x' },
             { "clear-color", required_argument, nullptr, 'b' },
+            { "headless",    no_argument,       nullptr, 'e' },
             { nullptr, 0, nullptr, 0 }  // termination of the option list
     };
     int opt;
@@ -202,6 +216,9 @@ static int handleCommandLineArgments(int argc, char* argv[], Config* config) {
             case 'l':
                 g_lightOn = true;
                 break;
+            case 'e':
+                g_headless = true;
+                break;
             case 'y':
                 g_skyboxOn = false;
             case 'c':
@@ -323,7 +340,7 @@ static void setup(Engine* engine, View* view, Scene* scene) {
     }
 
     if (!g_skyboxOn) {
-        auto ibl = FilamentApp::get().getIBL();
+        auto ibl = g_headless ? g_headlessIBL.get() : FilamentApp::get().getIBL();
         if (ibl) ibl->getSkybox()->setLayerMask(0xff, 0x00);
     }
 
@@ -350,64 +367,123 @@ static LinearImage toLinear(size_t w, size_t h, size_t bpr, const uint8_t* src)
     return result;
 }
 
-static void render(Engine*, View*, Scene*, Renderer*) {
-    int frame = g_currentFrame - FRAME_TO_SKIP - 1;
-    if (frame >= 0 && frame < g_materialVariantCount) {
-        for (const auto& p : g_parameters) {
-            g_materialInstance->setParameter(p.name.c_str(),
-                    p.start + frame * ((p.end - p.start) / float(g_materialVariantCount - 1)));
+/*
+ * Encodes and saves the frames on a separate thread. Read-back callbacks are invoked on the
+ * main thread, so they only hand the pixels over and the render loop never waits on the PNG
+ * encoder.
+ */
+class FrameSink {
+public:
+    struct Frame {
+        int index;
+        uint32_t width;
+        uint32_t height;
+        std::unique_ptr<uint8_t[]> pixels;
+    };
+
+    FrameSink() : mThread(&FrameSink::loop, this) { }
+
+    // saves the frames still queued
+    ~FrameSink() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mExitRequested = true;
+        lock.unlock();
+        mCondition.notify_one();
+        mThread.join();
+    }
+
+    void push(Frame&& frame) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mFrames.push_back(std::move(frame));
+        lock.unlock();
+        mCondition.notify_one();
+    }
+
+private:
+    void loop() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (true) {
+            mCondition.wait(lock, [this]() { return mExitRequested || !mFrames.empty(); });
+            if (mFrames.empty()) {
+                break;
+            }
+            Frame frame(std::move(mFrames.front()));
+            mFrames.pop_front();
+            lock.unlock();
+            save(frame);
+            lock.lock();
         }
     }
-}
 
-static void postRender(Engine*, View* view, Scene*, Renderer* renderer) {
-    int frame = g_currentFrame - FRAME_TO_SKIP - 1;
-    // Account for the back buffer
-    if (frame >= 1 && frame < g_materialVariantCount + 1) {
-        frame -= 1;
+    static void save(Frame const& frame) {
+        LinearImage image(toLinear<uint8_t>(frame.width, frame.height, frame.width * 3,
+                frame.pixels.get()));
+
+        int digits = (int) log10 ((double) g_materialVariantCount) + 1;
 
-        const Viewport& vp = view->getViewport();
-        uint8_t* pixels = new uint8_t[vp.width * vp.height * 3];
+        std::ostringstream stringStream;
+        stringStream << "./" << g_prefix;
+        stringStream << std::setfill('0') << std::setw(digits);
+        stringStream << std::to_string(frame.index);
+        stringStream << ".png";
 
-        struct CaptureState {
-            View* view = nullptr;
-            int currentFrame = 0;
-        };
+        std::string name = stringStream.str();
+        Path out(name);
 
-        driver::PixelBufferDescriptor buffer(pixels, vp.width * vp.height * 3,
-                driver::PixelBufferDescriptor::PixelDataFormat::RGB,
-                driver::PixelBufferDescriptor::PixelDataType::UBYTE,
-                [](void* buffer, size_t size, void* user) {
-                    CaptureState* state = static_cast<CaptureState*>(user);
-                    const Viewport& v = state->view->getViewport();
+        std::ofstream outputStream(out, std::ios::binary | std::ios::trunc);
+        ImageEncoder::encode(outputStream, ImageEncoder::Format::PNG, image, "", name);
 
-                    LinearImage image(toLinear<uint8_t>(v.width, v.height, v.width * 3,
-                            static_cast<uint8_t*>(buffer)));
+        g_savedFrames++;
+    }
 
-                    int digits = (int) log10 ((double) g_materialVariantCount) + 1;
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<Frame> mFrames;
+    bool mExitRequested = false;
+    std::thread mThread;
+};
 
-                    std::ostringstream stringStream;
-                    stringStream << "./" << g_prefix;
-                    stringStream << std::setfill('0') << std::setw(digits);
-                    stringStream << std::to_string(state->currentFrame);
-                    stringStream << ".png";
+static std::unique_ptr<FrameSink> g_frameSink;
 
-                    std::string name = stringStream.str();
-                    Path out(name);
+static void setParameters(int frame) {
+    for (const auto& p : g_parameters) {
+        g_materialInstance->setParameter(p.name.c_str(),
+                p.start + frame * ((p.end - p.start) / float(g_materialVariantCount - 1)));
+    }
+}
 
-                    std::ofstream outputStream(out, std::ios::binary | std::ios::trunc);
-                    ImageEncoder::encode(outputStream, ImageEncoder::Format::PNG, image, "", name);
+// Issues the read-back of the viewport, the frame is handed to the sink once the GPU is done.
+static void readFrame(Renderer* renderer, const Viewport& vp, int frame) {
+    uint8_t* pixels = new uint8_t[vp.width * vp.height * 3];
+
+    driver::PixelBufferDescriptor buffer(pixels, vp.width * vp.height * 3,
+            driver::PixelBufferDescriptor::PixelDataFormat::RGB,
+            driver::PixelBufferDescriptor::PixelDataType::UBYTE,
+            [](void* buffer, size_t size, void* user) {
+                std::unique_ptr<FrameSink::Frame> frame(static_cast<FrameSink::Frame*>(user));
+                frame->pixels.reset(static_cast<uint8_t*>(buffer));
+                g_frameSink->push(std::move(*frame));
+                g_readFrames++;
+            },
+            new FrameSink::Frame { frame, vp.width, vp.height, nullptr }
+    );
 
-                    delete[] static_cast<uint8_t*>(buffer);
-                    delete state;
+    renderer->readPixels(
+            (uint32_t) vp.left, (uint32_t) vp.bottom, vp.width, vp.height, std::move(buffer));
+}
 
-                    g_savedFrames++;
-                },
-                new CaptureState { view, frame }
-        );
+static void render(Engine*, View*, Scene*, Renderer*) {
+    int frame = g_currentFrame - FRAME_TO_SKIP - 1;
+    if (frame >= 0 && frame < g_materialVariantCount) {
+        setParameters(frame);
+    }
+}
 
-        renderer->readPixels(
-                (uint32_t) vp.left, (uint32_t) vp.bottom, vp.width, vp.height, std::move(buffer));
+static void postRender(Engine*, View* view, Scene*, Renderer* renderer) {
+    int frame = g_currentFrame - FRAME_TO_SKIP - 1;
+    // Account for the back buffer
+    if (frame >= 1 && frame < g_materialVariantCount + 1) {
+        readFrame(renderer, view->getViewport(), frame - 1);
     }
 
     if (g_savedFrames.load() == g_materialVariantCount) {
@@ -417,6 +493,75 @@ static void postRender(Engine*, View* view, Scene*, Renderer* renderer) {
     g_currentFrame++;
 }
 
+/*
+ * Renders all the variants into an offscreen swap chain. Unlike the windowed mode, nothing
+ * waits on the display or on the read-backs: each frame issues its read-back and the next
+ * frame is rendered while the GPU is still working, several read-backs are in flight and
+ * the frames are saved as they complete.
+ */
+static int runHeadless() {
+    Engine* engine = Engine::create(g_config.backend);
+    SwapChain* swapChain = engine->createSwapChain(FRAME_SIZE, FRAME_SIZE);
+    if (!swapChain) {
+        std::cerr << "Headless rendering is not supported on this platform." << std::endl;
+        Engine::destroy(&engine);
+        return 1;
+    }
+
+    Renderer* renderer = engine->createRenderer();
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    Camera* camera = engine->createCamera();
+    camera->setExposure(16.0f, 1 / 125.0f, 100.0f);
+    camera->setProjection(45.0, 1.0, 0.1, 50, Camera::Fov::VERTICAL);
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, FRAME_SIZE, FRAME_SIZE });
+
+    if (!g_config.iblDirectory.empty()) {
+        g_headlessIBL = std::make_unique<IBL>(*engine);
+        if (g_headlessIBL->loadFromDirectory(Path(g_config.iblDirectory))) {
+            scene->setSkybox(g_headlessIBL->getSkybox());
+            scene->setIndirectLight(g_headlessIBL->getIndirectLight());
+        } else {
+            std::cerr << "Could not load the specified IBL: " << g_config.iblDirectory << std::endl;
+            g_headlessIBL.reset();
+        }
+    }
+
+    setup(engine, view, scene);
+
+    if (g_materialInstance) {
+        // the material parameters are latched by beginFrame(), a skipped frame is rendered again
+        for (int frame = 0; frame < g_materialVariantCount; ) {
+            setParameters(frame);
+            if (renderer->beginFrame(swapChain)) {
+                renderer->render(view);
+                readFrame(renderer, view->getViewport(), frame);
+                renderer->endFrame();
+                frame++;
+            }
+        }
+
+        // A Fence waits for the last read-backs, their callbacks are then invoked when the
+        // engine is flushed, i.e. by waiting on the next Fence. This blocks instead of spinning.
+        while (g_readFrames < g_materialVariantCount) {
+            Fence::waitAndDestroy(engine->createFence());
+        }
+    }
+
+    cleanup(engine, view, scene);
+    g_headlessIBL.reset();
+
+    engine->destroy(camera);
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     int option_index = handleCommandLineArgments(argc, argv, &g_config);
     int num_args = argc - option_index;
@@ -434,10 +579,20 @@ int main(int argc, char* argv[]) {
         g_filenames.push_back(filename);
     }
 
+    g_frameSink = std::make_unique<FrameSink>();
+
+    if (g_headless) {
+        int result = runHeadless();
+        g_frameSink.reset();
+        return result;
+    }
+
     g_config.title = "Frame Generator";
     FilamentApp& filamentApp = FilamentApp::get();
     filamentApp.run(g_config,
-            setup, cleanup, FilamentApp::ImGuiCallback(), render, postRender, 512, 512);
+            setup, cleanup, FilamentApp::ImGuiCallback(), render, postRender,
+            FRAME_SIZE, FRAME_SIZE);
 
+    g_frameSink.reset();
     return 0;
 }
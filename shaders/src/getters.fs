@@ -24,7 +24,37 @@ vec2 getUV1() {
 #endif
 
 #if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Returns the index of the shadow cascade covering the current fragment. The cascade
+ * is selected by comparing the fragment's view space depth to the cascade splits.
+ */
+uint getShadowCascade() {
+    HIGHP float z = -(frameUniforms.viewFromWorldMatrix * vec4(vertex_worldPosition, 1.0)).z;
+    uint cascade = uint(dot(vec4(greaterThan(vec4(z), frameUniforms.cascadeSplits)), vec4(1.0)));
+    return min(cascade, frameUniforms.cascades - 1u);
+}
+
 HIGHP vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    if (frameUniforms.cascades <= 1u) {
+        return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    }
+
+    // with several cascades the light space position depends on the fragment's cascade,
+    // this is the same computation as getLightSpacePosition() in the vertex shader
+    uint cascade = getShadowCascade();
+    HIGHP vec3 p = vertex_worldPosition;
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+    vec3 n = normalize(vertex_worldNormal);
+    float NoL = saturate(dot(n, frameUniforms.lightDirection));
+#ifdef TARGET_MOBILE
+    float normalBias = 1.0 - NoL * NoL;
+#else
+    float normalBias = sqrt(1.0 - NoL * NoL);
+#endif
+    p += n * (normalBias * frameUniforms.cascadeNormalBias[cascade]);
+#endif
+    HIGHP vec4 lightSpacePosition = frameUniforms.lightFromWorldMatrix[cascade] * vec4(p, 1.0);
+    lightSpacePosition.z -= frameUniforms.cascadeConstantBias[cascade];
+    return lightSpacePosition.xyz * (1.0 / lightSpacePosition.w);
 }
 #endif
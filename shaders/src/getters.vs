@@ -3,16 +3,34 @@
 //------------------------------------------------------------------------------
 
 mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+    // the vertex shader only computes the light space position in the first cascade
+    return frameUniforms.lightFromWorldMatrix[0];
 }
 
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+#define INSTANCE_INDEX gl_InstanceIndex
+#else
+#define INSTANCE_INDEX gl_InstanceID
+#endif
+
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
+    if (objectUniforms.instanced != 0u) {
+        // each instance is stored as a mat4 followed by a mat3 (see PerRenderableUibInstance)
+        uint i = uint(INSTANCE_INDEX) * 7u;
+        return mat4(instancesUniforms.instances[i + 0u], instancesUniforms.instances[i + 1u],
+                instancesUniforms.instances[i + 2u], instancesUniforms.instances[i + 3u]);
+    }
     return objectUniforms.worldFromModelMatrix;
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
+    if (objectUniforms.instanced != 0u) {
+        uint i = uint(INSTANCE_INDEX) * 7u;
+        return mat3(instancesUniforms.instances[i + 4u].xyz, instancesUniforms.instances[i + 5u].xyz,
+                instancesUniforms.instances[i + 6u].xyz);
+    }
     return objectUniforms.worldFromModelNormalMatrix;
 }
 
@@ -21,25 +39,69 @@ mat3 getWorldFromModelNormalMatrix() {
 //------------------------------------------------------------------------------
 
 #if defined(HAS_SKINNING)
-vec3 mulBoneNormal(vec3 n, uint i) {
-    vec4 q  = bonesUniforms.bones[i + 0u];
-    vec3 is = bonesUniforms.bones[i + 3u].xyz;
+// See RenderableManager::BoneFormat
+#define BONE_FORMAT_FULL    0u
+#define BONE_FORMAT_COMPACT 1u
+
+#if defined(GL_ES) || __VERSION__ >= 420
+#define unpackBoneHalf2x16 unpackHalf2x16
+#else
+vec2 unpackBoneHalf2x16(uint v) {
+    // same as half::htof(), denormals included
+    uvec2 h = uvec2(v, v >> 16u) & 0xFFFFu;
+    vec2 f = uintBitsToFloat((h & 0x7FFFu) << 13u) * 5.192297e33; // 2^112
+    return mix(f, -f, notEqual(h & 0x8000u, uvec2(0u)));
+}
+#endif
+
+// unit quaternion and, for compact bones, the uniform scale in w
+void getCompactBone(uint id, out vec4 q, out vec4 ts) {
+    uvec4 bone = bonesUniforms.bones[id];
+    q  = vec4(unpackBoneHalf2x16(bone.x), unpackBoneHalf2x16(bone.y));
+    ts = vec4(unpackBoneHalf2x16(bone.z), unpackBoneHalf2x16(bone.w));
+}
+
+vec3 mulBoneNormal(vec3 n, uint id) {
+    vec4 q;
+    if (objectUniforms.boneFormat == BONE_FORMAT_COMPACT) {
+        // the scale is uniform, the normalized inverse scale is 1
+        vec4 ts;
+        getCompactBone(id, q, ts);
+    } else {
+        uint i = id * 4u;
+        q       = uintBitsToFloat(bonesUniforms.bones[i + 0u]);
+        vec3 is = uintBitsToFloat(bonesUniforms.bones[i + 3u].xyz);
+
+        // apply the inverse of the non-uniform scales
+        n *= is;
+    }
 
-    // apply the inverse of the non-uniform scales
-    n *= is;
     // apply the rigid transform (valid only for unit quaternions)
     n += 2.0 * cross(q.xyz, cross(q.xyz, n) + q.w * n);
 
     return n;
 }
 
-vec3 mulBoneVertice(vec3 v, uint i) {
-    vec4 q = bonesUniforms.bones[i + 0u];
-    vec3 t = bonesUniforms.bones[i + 1u].xyz;
-    vec3 s = bonesUniforms.bones[i + 2u].xyz;
+vec3 mulBoneVertice(vec3 v, uint id) {
+    vec4 q;
+    vec3 t;
+    if (objectUniforms.boneFormat == BONE_FORMAT_COMPACT) {
+        vec4 ts;
+        getCompactBone(id, q, ts);
+        t = ts.xyz;
+
+        // apply the uniform scale
+        v *= ts.w;
+    } else {
+        uint i = id * 4u;
+        q      = uintBitsToFloat(bonesUniforms.bones[i + 0u]);
+        t      = uintBitsToFloat(bonesUniforms.bones[i + 1u].xyz);
+        vec3 s = uintBitsToFloat(bonesUniforms.bones[i + 2u].xyz);
+
+        // apply the non-uniform scales
+        v *= s;
+    }
 
-    // apply the non-uniform scales
-    v *= s;
     // apply the rigid transform (valid only for unit quaternions)
     v += 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
     // apply the translation
@@ -49,17 +111,17 @@ vec3 mulBoneVertice(vec3 v, uint i) {
 }
 
 void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
-    n =   mulBoneNormal(n, ids.x * 4u) * weights.x
-        + mulBoneNormal(n, ids.y * 4u) * weights.y
-        + mulBoneNormal(n, ids.z * 4u) * weights.z
-        + mulBoneNormal(n, ids.w * 4u) * weights.w;
+    n =   mulBoneNormal(n, ids.x) * weights.x
+        + mulBoneNormal(n, ids.y) * weights.y
+        + mulBoneNormal(n, ids.z) * weights.z
+        + mulBoneNormal(n, ids.w) * weights.w;
 }
 
 void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
-    p =   mulBoneVertice(p, ids.x * 4u) * weights.x
-        + mulBoneVertice(p, ids.y * 4u) * weights.y
-        + mulBoneVertice(p, ids.z * 4u) * weights.z
-        + mulBoneVertice(p, ids.w * 4u) * weights.w;
+    p =   mulBoneVertice(p, ids.x) * weights.x
+        + mulBoneVertice(p, ids.y) * weights.y
+        + mulBoneVertice(p, ids.z) * weights.z
+        + mulBoneVertice(p, ids.w) * weights.w;
 }
 #endif
 
@@ -32,7 +32,10 @@ void evaluateDirectionalLight(const PixelParams pixel, inout vec3 color) {
     float visibility = 1.0;
 #if defined(HAS_SHADOWING)
     if (light.NoL > 0.0) {
-        visibility = shadow(light_shadowMap, getLightSpacePosition());
+        // the directional light may not cast shadows when spot or point lights do
+        if (frameUniforms.cascades > 0u) {
+            visibility = shadow(light_shadowMap, getLightSpacePosition());
+        }
     } else {
 #if defined(MATERIAL_CAN_SKIP_LIGHTING)
         return;
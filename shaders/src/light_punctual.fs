@@ -7,12 +7,12 @@
 #define FROXEL_BUFFER_WIDTH         (1u << FROXEL_BUFFER_WIDTH_SHIFT)
 #define FROXEL_BUFFER_WIDTH_MASK    (FROXEL_BUFFER_WIDTH - 1u)
 
-#define RECORD_BUFFER_WIDTH_SHIFT   5u
+#define RECORD_BUFFER_WIDTH_SHIFT   6u
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
 struct FroxelParams {
-    uint recordOffset; // offset at which the list of lights for this froxel starts
+    HIGHP uint recordOffset; // offset at which the list of lights for this froxel starts
     uint pointCount;   // number of point lights in this froxel
     uint spotCount;    // number of spot lights in this froxel
 };
@@ -60,12 +60,12 @@ ivec2 getFroxelTexCoord(uint froxelIndex) {
  */
 FroxelParams getFroxelParams(uint froxelIndex) {
     ivec2 texCoord = getFroxelTexCoord(froxelIndex);
-    uvec2 entry = texelFetch(light_froxels, texCoord, 0).rg;
+    HIGHP uvec2 entry = texelFetch(light_froxels, texCoord, 0).rg;
 
     FroxelParams froxel;
     froxel.recordOffset = entry.r;
-    froxel.pointCount = entry.g & 0xFFu;
-    froxel.spotCount = entry.g >> 8u;
+    froxel.pointCount = entry.g & 0xFFFFu;
+    froxel.spotCount = entry.g >> 16u;
     return froxel;
 }
 
@@ -74,7 +74,7 @@ FroxelParams getFroxelParams(uint froxelIndex) {
  * given the specified index. A light record is a single uint index into the
  * lights data buffer (lightsUniforms UBO).
  */
-ivec2 getRecordTexCoord(uint index) {
+ivec2 getRecordTexCoord(HIGHP uint index) {
     return ivec2(index & RECORD_BUFFER_WIDTH_MASK, index >> RECORD_BUFFER_WIDTH_SHIFT);
 }
 
@@ -99,6 +99,58 @@ float getAngleAttenuation(const vec3 lightDir, const vec3 l, const vec2 scaleOff
     return attenuation * attenuation;
 }
 
+#if defined(HAS_SHADOWING)
+/**
+ * Returns the position of the current fragment in the shadow atlas tile at the specified
+ * shadow index. The position is offset towards the light and along the normal to avoid
+ * shadow acne, the normal offset grows with the size of a texel, i.e. with the distance.
+ */
+HIGHP vec3 getShadowAtlasPosition(const uint index, const HIGHP vec3 posToLight) {
+    vec4 bias = frameUniforms.shadowTileBias[index];
+    HIGHP vec3 l = normalize(posToLight);
+    HIGHP vec3 p = vertex_worldPosition + l * bias.x;
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+    vec3 n = normalize(vertex_worldNormal);
+    float NoL = saturate(dot(n, l));
+#ifdef TARGET_MOBILE
+    float normalBias = 1.0 - NoL * NoL;
+#else
+    float normalBias = sqrt(1.0 - NoL * NoL);
+#endif
+    p += n * (normalBias * bias.y * length(posToLight));
+#endif
+    HIGHP vec4 position = frameUniforms.shadowTileFromWorldMatrix[index] * vec4(p, 1.0);
+    return position.xyz * (1.0 / position.w);
+}
+
+/**
+ * Returns the visibility of a spot or point light from the current fragment. The shadow
+ * index of a light is negative when it doesn't cast shadows, otherwise it's the index
+ * of its (first) tile in the shadow atlas. Point lights use 6 tiles, one per cube face,
+ * in the +x, -x, +y, -y, +z, -z order.
+ */
+float getPunctualShadowVisibility(const float shadowIndex, const HIGHP vec3 posToLight,
+        const bool isPointLight) {
+    if (shadowIndex < 0.0) {
+        return 1.0;
+    }
+    uint index = uint(shadowIndex);
+    if (isPointLight) {
+        // the face is picked by the major axis of the light to fragment direction
+        HIGHP vec3 d = -posToLight;
+        vec3 a = abs(d);
+        if (a.x >= a.y && a.x >= a.z) {
+            index += d.x > 0.0 ? 0u : 1u;
+        } else if (a.y >= a.z) {
+            index += d.y > 0.0 ? 2u : 3u;
+        } else {
+            index += d.z > 0.0 ? 4u : 5u;
+        }
+    }
+    return shadow(light_shadowAtlas, getShadowAtlasPosition(index, posToLight));
+}
+#endif
+
 /**
  * Light setup common to point and spot light. This function sets the light vector
  * "l" and the attenuation factor in the Light structure. The attenuation factor
@@ -121,7 +173,7 @@ void setupPunctualLight(inout Light light, const HIGHP vec4 positionFalloff) {
  * The light parameters used to compute the Light structure are fetched from the
  * lightsUniforms uniform buffer.
  */
-Light getSpotLight(uint index) {
+Light getSpotLight(HIGHP uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
@@ -138,6 +190,14 @@ Light getSpotLight(uint index) {
 
     light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
 
+#if defined(HAS_SHADOWING)
+    if (light.NoL > 0.0) {
+        float shadowIndex = lightsUniforms.lights[lightIndex][3].z;
+        light.attenuation *= getPunctualShadowVisibility(shadowIndex,
+                positionFalloff.xyz - vertex_worldPosition, false);
+    }
+#endif
+
     return light;
 }
 
@@ -149,7 +209,7 @@ Light getSpotLight(uint index) {
  * The light parameters used to compute the Light structure are fetched from the
  * lightsUniforms uniform buffer.
  */
-Light getPointLight(uint index) {
+Light getPointLight(HIGHP uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
@@ -162,6 +222,14 @@ Light getPointLight(uint index) {
 
     setupPunctualLight(light, positionFalloff);
 
+#if defined(HAS_SHADOWING)
+    if (light.NoL > 0.0) {
+        float shadowIndex = lightsUniforms.lights[lightIndex][3].z;
+        light.attenuation *= getPunctualShadowVisibility(shadowIndex,
+                positionFalloff.xyz - vertex_worldPosition, true);
+    }
+#endif
+
     return light;
 }
 
@@ -181,8 +249,9 @@ void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
     // texture. The records texture contains the indices of the actual
     // light data in the lightsUniforms uniform buffer
 
-    uint index = froxel.recordOffset;
-    uint end = index + froxel.pointCount;
+    // record offsets can be larger than 16 bits
+    HIGHP uint index = froxel.recordOffset;
+    HIGHP uint end = index + froxel.pointCount;
 
     // Iterate point lights
     for ( ; index < end; index++) {